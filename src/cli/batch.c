@@ -0,0 +1,223 @@
+/**
+ * @file batch.c
+ * @brief Batch Interface
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup cli
+ * @{
+ * @defgroup cli_batch Batch Functions
+ *
+ * Runs a job piped to STDIN, and exits once it has run: openglow_cnc --batch < job.gcode
+ *
+ * STDIN is read BATCH_READ_BUFFER bytes at a time, and each line goes to cli_process_line(). A G-Code line
+ * waits for room in the parser queue, so reading is held back at the pace the parser takes lines, and the pipe
+ * holds back the writer. At end of input, any motion still planned is started, and the daemon exits once the
+ * parser, planner and step generator are idle. A summary is printed to STDERR. The exit status is non-zero if
+ * any line failed, or the machine alarmed.
+ *
+ * Oks are counted rather than written. Errors, and everything else, go to STDOUT.
+ *
+ * @{
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "../openglow-cnc.h"
+
+/**
+ * @brief Batch run counters
+ */
+typedef struct {
+    uint32_t lines;     /*!< Lines read */
+    uint64_t bytes;     /*!< Bytes read */
+    uint32_t oks;       /*!< Ok replies */
+    uint32_t errors;    /*!< Error replies */
+    int64_t start;      /*!< Start time (ns) */
+    int64_t queued;     /*!< End of input time (ns) */
+    int64_t waited;     /*!< Time spent handing lines to the CLI, mostly waiting for room in the parser queue (ns) */
+} batch_stats_t;
+
+/**
+ * @brief Batch read thread
+ */
+static pthread_t batch_thread;
+
+/**
+ * @brief Batch run counters
+ */
+static batch_stats_t batch_stats;
+
+/**
+ * @brief STDIN read buffer
+ */
+static char batch_buffer[BATCH_READ_BUFFER];
+
+// Static function declarations
+static ssize_t _batch_drain();
+static void _batch_line(char *line, bool overflow);
+static void *_batch_read(void *arg);
+
+/**
+ * @brief Initializes batch interface
+ *
+ * Launches the batch read thread.
+ *
+ * @return Zero is returned upon success, negative otherwise.
+ */
+ssize_t batch_init() {
+    ssize_t ret = 0;
+    memset(&batch_stats, 0, sizeof(batch_stats_t));
+    if ((ret = pthread_create(&batch_thread, NULL, _batch_read, NULL)) != 0) {
+        fprintf(stderr, "batch_init: pthread_create returned %zd\n", ret);
+        return -ret;
+    }
+    return ret;
+}
+
+/**
+ * @brief Tears down the batch interface
+ */
+void batch_reset() {
+    fflush(stdout);
+}
+
+/**
+ * @brief Count a reply
+ * @param status Status code of the reply
+ * @return True if the reply should be written. Oks are only counted.
+ */
+bool batch_status(ssize_t status) {
+    if (status == STATUS_OK) {
+        __atomic_add_fetch(&batch_stats.oks, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    __atomic_add_fetch(&batch_stats.errors, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+/**
+ * @brief Write to STDOUT
+ * @param line The string to write. Uses printf formatting.
+ * @param args Variable Arguments to submit to vsprintf
+ * @return The number of characters printed. Negative otherwise.
+ */
+ssize_t batch_write(char *line, va_list args) {
+    char buf[CLI_LINE_LENGTH];
+    vsnprintf(buf, CLI_LINE_LENGTH, line, args);
+    return printf("%s\n", buf);
+}
+
+/**
+ * @brief Wait for the job to finish running
+ *
+ * Waits for the parser to take every line, starts any motion left planned that didn't fill the planner to
+ * auto cycle start, and waits for the planner and step generator to empty.
+ * @return 0 on success, -ECANCELED if the machine alarmed or faulted.
+ */
+static ssize_t _batch_drain() {
+    ssize_t ret = 0;
+    if ((ret = gc_queue_sync()) < 0) {
+        fprintf(stderr, "batch_drain: gc_queue_sync returned %zd\n", ret);
+        return ret;
+    }
+    if ((plan_get_current_block() != NULL) && (sys_state == SYS_STATE_IDLE)) {
+        fsm_request(SYS_STATE_RUN);
+        stepgen_wake_up();
+    }
+    while ((plan_get_current_block() != NULL) || (segment_queued() > 0) ||
+           (sys_state == SYS_STATE_RUN) || (sys_req_state == SYS_STATE_RUN)) {
+        if ((sys_state == SYS_STATE_ALARM) || (sys_state == SYS_STATE_FAULT)) { return -ECANCELED; }
+        usleep(BATCH_DRAIN_POLL * 1000);
+    }
+    return ret;
+}
+
+/**
+ * @brief Process one line of input
+ * @param line Line, with its line break and terminator
+ * @param overflow Line exceeded CLI_LINE_LENGTH, and was cut short
+ */
+static void _batch_line(char *line, bool overflow) {
+    batch_stats.lines++;
+    if (overflow) {
+        message_status(STATUS_LINE_LENGTH_EXCEEDED);
+        return;
+    }
+    int64_t start = latency_now();
+    cli_process_line(line);
+    batch_stats.waited += latency_now() - start;
+}
+
+/**
+ * @brief Batch read thread
+ *
+ * Reads STDIN to the end, waits for the job to finish, prints the summary and exits.
+ * @param arg Unused
+ * @return NULL
+ */
+static void *_batch_read(void *arg) {
+    char line[CLI_LINE_LENGTH];
+    size_t len = 0;
+    bool overflow = false;
+    ssize_t ret = 0;
+
+    batch_stats.start = latency_now();
+    while (loop_run) {
+        ssize_t n = read(STDIN_FILENO, batch_buffer, sizeof(batch_buffer));
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            perror("batch_read: read error");
+            ret = -errno;
+            break;
+        }
+        if (n == 0) { break; } // End of input
+        batch_stats.bytes += n;
+        for (ssize_t i = 0; i < n; i++) {
+            if (batch_buffer[i] == '\r') { continue; }
+            if (batch_buffer[i] != '\n') {
+                // Leave room for the line break and terminator
+                if (len < CLI_LINE_LENGTH - 2) { line[len++] = batch_buffer[i]; }
+                else { overflow = true; }
+                continue;
+            }
+            line[len++] = '\n';
+            line[len] = '\0';
+            _batch_line(line, overflow);
+            len = 0;
+            overflow = false;
+        }
+    }
+    if (len > 0) {
+        // Last line, without a line break
+        line[len++] = '\n';
+        line[len] = '\0';
+        _batch_line(line, overflow);
+    }
+    batch_stats.queued = latency_now();
+
+    ssize_t drained = _batch_drain();
+    if (ret == 0) { ret = drained; }
+    if ((ret == 0) && (batch_stats.errors > 0)) { ret = -EIO; }
+
+    double elapsed = (latency_now() - batch_stats.start) / 1e9;
+    double reading = (batch_stats.queued - batch_stats.start) / 1e9;
+    fflush(stdout);
+    fprintf(stderr, "batch: %u lines, %1.1f KB, %u ok, %u errors in %1.3fs\n", batch_stats.lines,
+            batch_stats.bytes / 1024.0, batch_stats.oks, batch_stats.errors, elapsed);
+    fprintf(stderr, "batch: input read in %1.3fs, %1.0f lines/s, %1.1f KB/s, %1.0f%% waiting on the parser queue\n",
+            reading, (reading > 0) ? batch_stats.lines / reading : 0.0,
+            (reading > 0) ? batch_stats.bytes / 1024.0 / reading : 0.0,
+            (reading > 0) ? 100.0 * batch_stats.waited / 1e9 / reading : 0.0);
+    fsm_exit(ret);
+    return NULL;
+}
+
+/** @} */
+/** @} */
@@ -0,0 +1,34 @@
+/**
+ * @file batch.h
+ * @brief Batch Interface
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup cli_batch
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_BATCH_H
+#define OPENGLOW_CNC_BATCH_H
+
+#include "../common.h"
+
+#define BATCH_READ_BUFFER   65536   // Bytes read from STDIN at a time
+#define BATCH_DRAIN_POLL    10      // Motion drain poll period, after end of input (ms)
+
+ssize_t batch_init();
+
+void batch_reset();
+
+bool batch_status(ssize_t status);
+
+ssize_t batch_write(char *line, va_list args);
+
+#endif //OPENGLOW_CNC_BATCH_H
+
+/** @} */
@@ -86,12 +86,22 @@ static const command_t commands[NUMBER_OF_USER_COMMANDS] = {
         [USR_CYCLE_START]           = {"~", false},
         [USR_CHECK_GCODE_MODE]      = {"$C", false},
         [USR_FEED_HOLD]             = {"!", false},
+        [USR_FILL]                  = {"$FILL=", true},
+        [USR_FLIGHT_RECORDER]       = {"$FR", false},
         [USR_HELP]                  = {"$", false},
+        [USR_JOB]                   = {"$JOB=", true},
+        [USR_LATENCY]               = {"$L", false},
+        [USR_METRICS]               = {"$M", false},
+        [USR_PLANNER_BACKEND]       = {"$PB=", true},
+        [USR_PREVIEW]               = {"$P=", true},
         [USR_RESET]                 = {"X", false},
+        [USR_RT_DIAGNOSTICS]        = {"$D", false},
         [USR_RUN_HOMING_CYCLE]      = {"$H", false},
         [USR_SLEEP]                 = {"$SLP", false},
         [USR_STATUS_REPORT]         = {"?", false},
+        [USR_STEP_REPEAT]           = {"$SR=", true},
         [USR_TEST_CYCLE]            = {"$T", false},
+        [USR_TRANSFORM]             = {"$TF=", true},
 };
 
 /**
@@ -129,6 +139,10 @@ ssize_t cli_init() {
             ret = socket_init();
             break;
         }
+        case CLI_BATCH: {
+            ret = batch_init();
+            break;
+        }
         default:;
     }
     if (ret >= 0) {
@@ -151,7 +165,7 @@ ssize_t cli_init() {
  */
 void cli_process_line(char *line) {
     if ((line[0] == '\n') | (line[0] == '\r')) {
-        message_write(MSG_OK);
+        message_status(STATUS_OK);
         return;
     }
     strtok(line, "\r");
@@ -176,14 +190,84 @@ void cli_process_line(char *line) {
                     message_status(STATUS_UNSUPPORTED_COMMAND);
                     return;
                 }
+                case USR_FILL: {
+                    ssize_t ret;
+                    if ((ret = gc_queue_command(GC_COMMAND_FILL, &line[strlen(commands[i].string)])) < 0) {
+                        fprintf(stderr, "cli_process_line: gc_queue_command returned %zd\n", ret);
+                    }
+                    return;
+                }
+                case USR_FLIGHT_RECORDER: {
+                    message_status(flight_freeze(FLIGHT_REQUEST) ? STATUS_OK : STATUS_UNSUPPORTED_COMMAND);
+                    return;
+                }
                 case USR_HELP: {
                     message_write(MSG_HELP);
                     return;
                 }
+                case USR_JOB: {
+                    // Runs in the parser task. Its ok or error is sent when it has been executed.
+                    ssize_t ret;
+                    if ((ret = gc_queue_command(GC_COMMAND_JOB, &line[strlen(commands[i].string)])) < 0) {
+                        fprintf(stderr, "cli_process_line: gc_queue_command returned %zd\n", ret);
+                    }
+                    return;
+                }
+                case USR_LATENCY: {
+                    latency_report();
+                    return;
+                }
+                case USR_METRICS: {
+                    metrics_report();
+                    return;
+                }
+                case USR_PLANNER_BACKEND: {
+                    char *end;
+                    long backend = strtol(&line[strlen(commands[i].string)], &end, 10);
+                    if ((end == &line[strlen(commands[i].string)]) || (*end != '\0')) {
+                        message_status(STATUS_BAD_NUMBER_FORMAT);
+                    } else if (backend < 0) {
+                        message_status(STATUS_NEGATIVE_VALUE);
+                    } else if (backend >= N_PLANNER_BACKENDS) {
+                        message_status(STATUS_MAX_VALUE_EXCEEDED);
+                    } else {
+                        settings.planner_backend = (uint8_t) backend; // Applies to blocks planned from now on
+                        message_write(MSG_OK);
+                    }
+                    return;
+                }
+                case USR_PREVIEW: {
+                    char *end;
+                    float horizon = strtof(&line[strlen(commands[i].string)], &end);
+                    if ((end == &line[strlen(commands[i].string)]) || (*end != '\0')) {
+                        message_status(STATUS_BAD_NUMBER_FORMAT);
+                    } else if (horizon <= 0.0) {
+                        message_status(STATUS_NEGATIVE_VALUE);
+                    } else {
+                        plan_preview_sample_t samples[CLI_PREVIEW_SAMPLES];
+                        float interval = horizon / (CLI_PREVIEW_SAMPLES - 1);
+                        ssize_t count = plan_preview(samples, CLI_PREVIEW_SAMPLES, horizon, interval < 1.0 ? 1.0 : interval);
+                        if (count < 0) {
+                            fprintf(stderr, "cli_process_line: plan_preview returned %zd\n", count);
+                            message_status(STATUS_SYSTEM_GC_LOCK);
+                            return;
+                        }
+                        for (ssize_t s = 0; s < count; s++) {
+                            message_write(MSG_PREVIEW, samples[s].time, samples[s].position[X_AXIS],
+                                          samples[s].position[Y_AXIS], samples[s].position[Z_AXIS], samples[s].speed);
+                        }
+                        message_write(MSG_OK);
+                    }
+                    return;
+                }
                 case USR_RESET: {
                     message_status(STATUS_UNSUPPORTED_COMMAND);
                     return;
                 }
+                case USR_RT_DIAGNOSTICS: {
+                    rtdiag_report();
+                    return;
+                }
                 case USR_RUN_HOMING_CYCLE: {
                     message_status(STATUS_UNSUPPORTED_COMMAND);
                     return;
@@ -199,6 +283,13 @@ void cli_process_line(char *line) {
                                   steps_to_float(sys_position[Z_AXIS], Z_AXIS));
                     return;
                 }
+                case USR_STEP_REPEAT: {
+                    ssize_t ret;
+                    if ((ret = gc_queue_command(GC_COMMAND_STEP_REPEAT, &line[strlen(commands[i].string)])) < 0) {
+                        fprintf(stderr, "cli_process_line: gc_queue_command returned %zd\n", ret);
+                    }
+                    return;
+                }
                 case USR_TEST_CYCLE: {
                     if (sys_state == SYS_STATE_IDLE && sys_req_state == FSM_STATE_NO_REQ) {
                         message_feedback("Queuing Test Code");
@@ -221,6 +312,13 @@ void cli_process_line(char *line) {
                     }
                     return;
                 }
+                case USR_TRANSFORM: {
+                    ssize_t ret;
+                    if ((ret = gc_queue_command(GC_COMMAND_TRANSFORM, &line[strlen(commands[i].string)])) < 0) {
+                        fprintf(stderr, "cli_process_line: gc_queue_command returned %zd\n", ret);
+                    }
+                    return;
+                }
                 default: {
                 }
             }
@@ -253,6 +351,10 @@ void cli_reset() {
             socket_reset();
             break;
         }
+        case CLI_BATCH: {
+            batch_reset();
+            break;
+        }
         default:;
     }
     cli_fsm_state = CLI_STATE_UNINITIALIZED;
@@ -25,6 +25,8 @@
  */
 #define CLI_LINE_LENGTH    512 // Maximum length of a line sent/received by cli.
 
+#define CLI_PREVIEW_SAMPLES 50  // Samples returned by the trajectory preview command
+
 /**
  * @brief CLI Transport Mode
  *
@@ -32,7 +34,8 @@
  */
 enum CLI_TRANSPORT {
     CLI_SOCKET,     /*!< Use TCP Socket for CLI */
-    CLI_CONSOLE     /*!< Use STDIN/OUT Console for CLI */
+    CLI_CONSOLE,    /*!< Use STDIN/OUT Console for CLI */
+    CLI_BATCH       /*!< Run the job piped to STDIN, then exit */
 };
 
 /**
@@ -47,12 +50,22 @@ enum USER_COMMANDS {
     USR_CHECK_GCODE_MODE,   /*!< Validate G-Code only. Do not execute motion. */
     USR_CYCLE_START,        /*!< Execute currently queued G-Code, or resume from hold. */
     USR_FEED_HOLD,          /*!< Halt current motion, in a resumable manner. */
+    USR_FILL,               /*!< Hatch fill closed contours. */
+    USR_FLIGHT_RECORDER,    /*!< Dump the pipeline flight recorder. */
     USR_HELP,               /*!< Show help information. */
+    USR_JOB,                /*!< Run a job file stored on the machine. */
+    USR_LATENCY,            /*!< Print per-line latency report. */
+    USR_METRICS,            /*!< Print runtime metrics. */
+    USR_PLANNER_BACKEND,    /*!< Select the planner backend for new blocks. */
+    USR_PREVIEW,            /*!< Print planned trajectory preview for the next N ms. */
     USR_RESET,              /*!< Reset all system states. Will require re-homing. */
+    USR_RT_DIAGNOSTICS,     /*!< Print real time context diagnostics. */
     USR_RUN_HOMING_CYCLE,   /*!< Execute Homing Cycle */
     USR_SLEEP,              /*!< Enter low power mode. Will require re-homing. */
     USR_STATUS_REPORT,      /*!< Print status report. */
+    USR_STEP_REPEAT,        /*!< Run a job file at an array of positions. */
     USR_TEST_CYCLE,         /*!< Runs test cycle. */
+    USR_TRANSFORM,          /*!< Set the job placement transform. */
     NUMBER_OF_USER_COMMANDS,/*!< Number of User Commands - For internal use. */
 };
 
@@ -78,7 +78,8 @@ ssize_t console_write(char *line, va_list args) {
 static void _console_read() {
     char *line = NULL;
     size_t len = 0;
-    while (getline(&line, &len, stdin)) {
+    rtdiag_task("console_read_task");
+    while (getline(&line, &len, stdin) > 0) {
         cli_process_line(line);
     }
 }
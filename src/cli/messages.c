@@ -27,9 +27,16 @@ static const messages_t messages[N_MESSAGES] = {
         [MSG_ALARM]                 = {"ALARM:%zd", false},
         [MSG_ERROR]                 = {"error:%zd", false},
         [MSG_FEEDBACK]              = {"[MSG:%s]", false},
-        [MSG_HELP]                  = {"[HLP:$$ $# $G $I $N $SLP $C $X $H ~ ! ? X]", true},
+        [MSG_HELP]                  = {"[HLP:$$ $# $D $G $FILL $FR $I $JOB $L $M $N $P $PB $SLP $SR $TF $C $X $H ~ ! ? X]", true},
+        [MSG_LATENCY_HIST]          = {"[LAT:%s:<%uus:%u]", false},
+        [MSG_LATENCY_MAX]           = {"[LAT:%s:max:%uus]", false},
+        [MSG_LATENCY_SLOW]          = {"[SLOW:%u:N%u:%uus:%u,%u,%u,%u]", false},
+        [MSG_METRIC]                = {"[MET:%s:%u]", false},
         [MSG_OK]                    = {"ok", false},
         [MSG_PLAIN_TEXT]            = {"%s", false},
+        [MSG_PREVIEW]               = {"[PRV:%1.1f,%1.3f,%1.3f,%1.3f,%1.0f]", false},
+        [MSG_READY]                 = {"[RDY:%ums]", false},
+        [MSG_RTDIAG]                = {"[RTD:%s:%s:%s:%u]", false},
         [MSG_STATUS_REPORT]         = {"<%s,MPos:%1.3f,%1.3f,%1.3f>", true},
         [MSG_WELCOME_BANNER]        = {"OpenGlow CNC v%s ['$' for help]", false},
 };
@@ -71,6 +78,7 @@ void message_feedback(char *feeback) {
  * @param status STATUS_CODE for the message
  */
 void message_status(ssize_t status) {
+    if ((settings.cli.comm_mode == CLI_BATCH) && !batch_status(status)) { return; }
     if (status == 0) {
         message_write(MSG_OK);
     } else {
@@ -94,6 +102,10 @@ void _message_write(char *msg, va_list args) {
             socket_write(msg, args);
             return;
         }
+        case CLI_BATCH: {
+            batch_write(msg, args);
+            return;
+        }
         default:;
     }
 }
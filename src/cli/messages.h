@@ -38,8 +38,15 @@ enum MESSAGE_TYPES {
     MSG_ERROR,
     MSG_FEEDBACK,
     MSG_HELP,
+    MSG_LATENCY_HIST,
+    MSG_LATENCY_MAX,
+    MSG_LATENCY_SLOW,
+    MSG_METRIC,
     MSG_OK,
     MSG_PLAIN_TEXT,
+    MSG_PREVIEW,
+    MSG_READY,
+    MSG_RTDIAG,
     MSG_STATUS_REPORT,
     MSG_WELCOME_BANNER,
     N_MESSAGES,
@@ -80,6 +87,13 @@ enum STATUS_CODES {
         STATUS_NO_OFFSETS_IN_PLANE = 35,
         STATUS_UNUSED_WORDS = 36,
         STATUS_MAX_VALUE_EXCEEDED = 38,
+
+        STATUS_NGC_EXPRESSION = 60,
+        STATUS_NGC_PARAMETER = 61,
+        STATUS_NGC_OWORD = 62,
+        STATUS_NGC_UNDEFINED_SUB = 63,
+        STATUS_NGC_OVERFLOW = 64,
+        STATUS_NGC_LOOP = 65,
 };
 
 
@@ -14,31 +14,58 @@
  *
  * Functions for providing the socket transport to the CLI.
  *
+ * Serves up to SOCKET_MAX_CLIENTS clients, over TCP or a UNIX socket. Replies to a command go to the client
+ * that sent it. Everything else, including the ok for each G-Code line, which is sent when the line has been
+ * executed, goes to all clients. Only one client should stream G-Code. Others may observe, and poll status.
+ *
  * @{
  */
 
 #include "../openglow-cnc.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <semaphore.h>
 
+/**
+ * @brief Socket client connection
+ */
+typedef struct {
+    int sock;                   /*!< Client socket descriptor, 0 if the slot is free */
+    char line[CLI_LINE_LENGTH]; /*!< Line being received */
+    size_t len;                 /*!< Length of the line being received */
+    bool overflow;              /*!< Line exceeded CLI_LINE_LENGTH. Discarded up to the line break. */
+} socket_client_t;
+
 /**
  * @brief Server socket descriptor
  */
 static int s_sock = 0;
 
 /**
- * @brief Client socket descriptor
+ * @brief Client connections
+ */
+static socket_client_t clients[SOCKET_MAX_CLIENTS];
+
+/**
+ * @brief Client whose line the read thread is processing, 0 if none
+ */
+static int c_reply = 0;
+
+/**
+ * @brief Socket read thread
  */
-static int c_sock = 0;
+static pthread_t read_thread;
 
 /**
- * @brief Socket write mutex
+ * @brief Socket write mutex. Also guards the client list.
  */
 static sem_t write_mutex;
 
@@ -58,31 +85,80 @@ volatile int comm_tx_buffer_head = 0;
 volatile int comm_tx_buffer_tail = 0;
 
 // Static function declarations
-static ssize_t _socket_flush_buffer();
+static void _socket_accept();
+static void _socket_close(socket_client_t *client);
+static ssize_t _socket_flush_buffer(int sock);
 static void *_socket_read();
+static void _socket_receive(socket_client_t *client);
+static ssize_t _socket_send(int sock, const char *buf, size_t len);
+
+/**
+ * @brief Accept a new client connection
+ */
+static void _socket_accept() {
+    int sock = accept(s_sock, NULL, NULL);
+    if (sock < 0) {
+        perror("socket_accept: accept error");
+        return;
+    }
+    sem_wait(&write_mutex);
+    socket_client_t *client = NULL;
+    for (int i = 0; i < SOCKET_MAX_CLIENTS; i++) {
+        if (clients[i].sock == 0) {
+            client = &clients[i];
+            break;
+        }
+    }
+    if (client != NULL) {
+        memset(client, 0, sizeof(socket_client_t));
+        client->sock = sock;
+        struct timeval timeout = {.tv_sec = SOCKET_SEND_TIMEOUT / 1000,
+                                  .tv_usec = (SOCKET_SEND_TIMEOUT % 1000) * 1000};
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+    sem_post(&write_mutex);
+    if (client == NULL) {
+        fprintf(stderr, "socket_accept: more than %d clients, connection refused\n", SOCKET_MAX_CLIENTS);
+        close(sock);
+        return;
+    }
+    if (verbose) printf("socket_accept: client %d connected\n", sock);
+    // Dump the buffer, in case there are any outgoing messages waiting.
+    _socket_flush_buffer(sock);
+}
+
+/**
+ * @brief Close a client connection
+ * @param client Client to close
+ */
+static void _socket_close(socket_client_t *client) {
+    if (verbose) printf("socket_close: client %d disconnected\n", client->sock);
+    sem_wait(&write_mutex);
+    close(client->sock);
+    client->sock = 0;
+    client->len = 0;
+    sem_post(&write_mutex);
+}
 
 /**
- * @brief Flush the transmit ring buffer to the socket
+ * @brief Flush the transmit ring buffer to a client
+ * @param sock Client socket descriptor
  * @return Bytes written on success, negative on failure
  */
-static ssize_t _socket_flush_buffer() {
+static ssize_t _socket_flush_buffer(int sock) {
     ssize_t ret = 0;
     if (verbose) printf("socket_flush_buffer: init\n");
     sem_wait(&write_mutex);
-    if (verbose) printf("socket_flush_buffer: write_mutex acquired\n");
-    int i = 0;
-    char buf[TX_RING_BUFFER + 1];
-    memset(buf, 0, sizeof(buf));
+    size_t len = 0;
+    char buf[TX_RING_BUFFER];
 
     while (comm_tx_buffer_head != comm_tx_buffer_tail) {
-        buf[i] = (char) comm_tx_buffer[comm_tx_buffer_tail];
-        i++;
+        buf[len++] = (char) comm_tx_buffer[comm_tx_buffer_tail];
         comm_tx_buffer_tail++;
         if (comm_tx_buffer_tail == TX_RING_BUFFER) comm_tx_buffer_tail = 0;
     }
-    ret = write(c_sock, buf, strlen(buf));
+    if (len > 0) { ret = _socket_send(sock, buf, len); }
     sem_post(&write_mutex);
-    if (verbose) printf("socket_flush_buffer: write_mutex released\n");
     return ret;
 }
 
@@ -93,59 +169,150 @@ static ssize_t _socket_flush_buffer() {
 ssize_t socket_init() {
     if (verbose) printf("socket_init: init\n");
     sem_init(&write_mutex, 0, 1);
+    memset(clients, 0, sizeof(clients));
 
-    /* Create the socket. */
-    s_sock = socket(PF_INET, SOCK_STREAM, 0);
-    if (s_sock < 0) {
-        perror("telnet init: socket creation error");
-        return -1;
-    }
+    if (settings.cli.socket_path != NULL) {
+        /* Create the UNIX socket. */
+        s_sock = socket(PF_UNIX, SOCK_STREAM, 0);
+        if (s_sock < 0) {
+            perror("socket_init: socket creation error");
+            return -1;
+        }
+        struct sockaddr_un sock_un;
+        memset(&sock_un, 0, sizeof(sock_un));
+        sock_un.sun_family = AF_UNIX;
+        if (strlen(settings.cli.socket_path) >= sizeof(sock_un.sun_path)) {
+            fprintf(stderr, "socket_init: socket path %s too long\n", settings.cli.socket_path);
+            return -1;
+        }
+        strcpy(sock_un.sun_path, settings.cli.socket_path);
+        unlink(settings.cli.socket_path); // Left behind by a previous run
+        if (bind(s_sock, (struct sockaddr *) &sock_un, sizeof(sock_un)) < 0) {
+            perror("socket_init: socket bind error");
+            return -1;
+        }
+    } else {
+        /* Create the TCP socket. */
+        s_sock = socket(PF_INET, SOCK_STREAM, 0);
+        if (s_sock < 0) {
+            perror("socket_init: socket creation error");
+            return -1;
+        }
+        int reuse = 1;
+        setsockopt(s_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
-    struct sockaddr_in sock_in;
-    sock_in.sin_family = AF_INET;
-    sock_in.sin_port = htons(settings.cli.listen_port);
-    sock_in.sin_addr.s_addr = settings.cli.listen_ip.s_addr;
-    if (bind(s_sock, (struct sockaddr *) &sock_in, sizeof(sock_in)) < 0) {
-        perror("socket_init: socket bind error");
-        return -1;
+        struct sockaddr_in sock_in;
+        sock_in.sin_family = AF_INET;
+        sock_in.sin_port = htons(settings.cli.listen_port);
+        sock_in.sin_addr.s_addr = settings.cli.listen_ip.s_addr;
+        if (bind(s_sock, (struct sockaddr *) &sock_in, sizeof(sock_in)) < 0) {
+            perror("socket_init: socket bind error");
+            return -1;
+        }
     }
-    listen(s_sock, 1);
-    pthread_t t;
-    return pthread_create(&t, NULL, _socket_read, NULL);
+    listen(s_sock, SOCKET_MAX_CLIENTS);
+    return pthread_create(&read_thread, NULL, _socket_read, NULL);
 }
 
 /**
- * @brief Read user input from socket
- * Calls cli_process_line with received line
+ * @brief Read user input from the clients
+ *
+ * Waits for connections and input on all clients, and calls cli_process_line() with each complete line.
  * @return NULL
  */
 static void *_socket_read() {
     if (verbose) printf("socket_read: init\n");
-    char line[CLI_LINE_LENGTH];
-    struct sockaddr_in client_addr;
-    int c = sizeof(struct sockaddr_in);
-
-    // Connection Loop
-    // waits if no connection
-    while ((c_sock = accept(s_sock, (struct sockaddr *) &client_addr, (socklen_t *) &c))) {
-        // New connection. We'll dump the buffer, just in case there are any outgoing messages waiting.
-        _socket_flush_buffer();
-        // RX Loop
-        while (recv(c_sock, line, CLI_LINE_LENGTH, 0) > 0) {
-            // Process each character received from client
-            cli_process_line(line);
-            memset(line, 0, sizeof(line));
+    struct pollfd fds[SOCKET_MAX_CLIENTS + 1];
+
+    while (loop_run) {
+        fds[0].fd = s_sock;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < SOCKET_MAX_CLIENTS; i++) {
+            fds[i + 1].fd = (clients[i].sock > 0) ? clients[i].sock : -1;
+            fds[i + 1].events = POLLIN;
+        }
+        if (poll(fds, SOCKET_MAX_CLIENTS + 1, SOCKET_POLL_TIMEOUT) < 0) {
+            if (errno == EINTR) { continue; }
+            perror("socket_read: poll error");
+            break;
+        }
+        for (int i = 0; i < SOCKET_MAX_CLIENTS; i++) {
+            if ((fds[i + 1].fd >= 0) && (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+                _socket_receive(&clients[i]);
+            }
         }
-        c_sock = 0;
+        if (fds[0].revents & POLLIN) { _socket_accept(); }
     }
     return NULL;
 }
 
+/**
+ * @brief Receive from a client, and process each complete line
+ *
+ * Lines may arrive split across, or packed into, reads. Replies to commands go back to this client.
+ * @param client Client with input pending
+ */
+static void _socket_receive(socket_client_t *client) {
+    char buf[SOCKET_RX_BUFFER];
+    ssize_t len = recv(client->sock, buf, sizeof(buf), 0);
+    if (len <= 0) {
+        _socket_close(client);
+        return;
+    }
+    for (ssize_t i = 0; i < len; i++) {
+        if (buf[i] == '\r') { continue; }
+        if (buf[i] != '\n') {
+            // Leave room for the line break and terminator
+            if (client->len < CLI_LINE_LENGTH - 2) { client->line[client->len++] = buf[i]; }
+            else { client->overflow = true; }
+            continue;
+        }
+        client->line[client->len++] = '\n';
+        client->line[client->len] = '\0';
+        c_reply = client->sock;
+        if (client->overflow) { message_status(STATUS_LINE_LENGTH_EXCEEDED); }
+        else { cli_process_line(client->line); }
+        c_reply = 0;
+        client->len = 0;
+        client->overflow = false;
+    }
+}
+
 /**
  * @brief Closes socket
  */
 void socket_reset() {
+    sem_wait(&write_mutex);
+    for (int i = 0; i < SOCKET_MAX_CLIENTS; i++) {
+        if (clients[i].sock > 0) {
+            close(clients[i].sock);
+            clients[i].sock = 0;
+        }
+    }
+    sem_post(&write_mutex);
     close(s_sock);
+    if (settings.cli.socket_path != NULL) { unlink(settings.cli.socket_path); }
+}
+
+/**
+ * @brief Send to a client
+ *
+ * A client that has gone away, or stopped taking output for SOCKET_SEND_TIMEOUT, is shut down, and closed by
+ * the read thread. So a stalled client can't hold up the writer for long.
+ * Must be called with write_mutex held.
+ * @param sock Client socket descriptor
+ * @param buf Data to send
+ * @param len Length of data
+ * @return Bytes sent on success, negative on error.
+ */
+static ssize_t _socket_send(int sock, const char *buf, size_t len) {
+    ssize_t ret = send(sock, buf, len, MSG_NOSIGNAL);
+    if (ret != (ssize_t) len) {
+        fprintf(stderr, "socket_send: client %d send returned %zd, dropping client\n", sock, ret);
+        shutdown(sock, SHUT_RDWR);
+        return -1;
+    }
+    return ret;
 }
 
 /**
@@ -156,25 +323,37 @@ void socket_reset() {
  */
 ssize_t socket_write(char *line, va_list args) {
     if (verbose) printf("socket_write: init\n");
+    ssize_t ret = 0;
+    char buf[CLI_LINE_LENGTH + 2];
+    int len = vsnprintf(buf, CLI_LINE_LENGTH, line, args);
+    if (len < 0) { return len; }
+    if (len >= CLI_LINE_LENGTH) { len = CLI_LINE_LENGTH - 1; }
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+
     sem_wait(&write_mutex);
-    if (verbose) printf("socket_write: write_mutex acquired\n");
-    char buf[CLI_LINE_LENGTH];
-    vsprintf(buf, line, args);
-    sprintf(buf, "%s\n\r", line);
-    buf[strlen(line) + 2] = 0; // Make sure the buffer is zero padded
-    if (c_sock > 0) {
-        return write(c_sock, buf, strlen(buf));
+    if ((c_reply > 0) && pthread_equal(pthread_self(), read_thread)) {
+        // Reply to the client whose command is being processed
+        ret = _socket_send(c_reply, buf, (size_t) len);
     } else {
-        // We don't have an active connection, buffer the output until we do.
-        for (int i = 0; i < strlen(buf); i++) {
-            comm_tx_buffer[comm_tx_buffer_head] = line[i];
-            comm_tx_buffer_head++;
-            if (comm_tx_buffer_head == TX_RING_BUFFER) { comm_tx_buffer_head = 0; }
+        bool connected = false;
+        for (int i = 0; i < SOCKET_MAX_CLIENTS; i++) {
+            if (clients[i].sock > 0) {
+                connected = true;
+                ret = _socket_send(clients[i].sock, buf, (size_t) len);
+            }
+        }
+        if (!connected) {
+            // We don't have an active connection, buffer the output until we do.
+            for (int i = 0; i < len; i++) {
+                comm_tx_buffer[comm_tx_buffer_head] = buf[i];
+                comm_tx_buffer_head++;
+                if (comm_tx_buffer_head == TX_RING_BUFFER) { comm_tx_buffer_head = 0; }
+            }
         }
     }
     sem_post(&write_mutex);
-    if (verbose) printf("socket_write: write_mutex released\n");
-    return 0;
+    return ret;
 }
 
 /** @} */
@@ -26,6 +26,11 @@
  */
 #define TX_RING_BUFFER 1024
 
+#define SOCKET_MAX_CLIENTS  8       // Concurrent client connections. One streams, the rest observe.
+#define SOCKET_RX_BUFFER    1024    // Receive buffer. Streaming clients keep at most this many bytes unacknowledged.
+#define SOCKET_POLL_TIMEOUT 1000    // Client poll timeout (ms)
+#define SOCKET_SEND_TIMEOUT 1000    // Drop a client that hasn't taken output for this long (ms)
+
 ssize_t socket_init();
 
 void socket_reset();
@@ -23,6 +23,7 @@ bool verbose;
 
 #define DEBUG_STEP_TO_FILE 1
 #define TARGET_BUILD 1
+#define STEPGEN_AXIS_KERNELS 1 // Per axis-mask Bresenham kernels. Undefine to benchmark against the XYZ kernel.
 
 #define COMM_LISTEN_PORT    "51401"
 #define COMM_LISTEN_ADDR    "127.0.0.1"
@@ -48,9 +49,19 @@ bool verbose;
 #define Z_MAX_RATE 50.0 // mm/min
 #define MINIMUM_FEED_RATE 1.0 // (mm/min)
 
+// Long laser-off rapids, with --rapid-microsteps. Stepped at 1/(1 << shift) the resolution, so faster for the step rate.
+#define RAPID_MICROSTEP_SHIFT 2 // 2 = MSTEPS_4 from 16 microsteps
+#define RAPID_MICROSTEP_MIN_TRAVEL 50.0 // mm. Shorter rapids aren't worth stopping for the driver switch.
+#define X_RAPID_MAX_RATE 12000.0 // mm/min
+#define Y_RAPID_MAX_RATE 12000.0 // mm/min
+
 #define X_ACCELERATION (200.0*60*60) // 10*60*60 mm/min^2 = 10 mm/sec^2
 #define Y_ACCELERATION (200.0*60*60) // 10*60*60 mm/min^2 = 10 mm/sec^2
 #define Z_ACCELERATION (200.0*60*60) // 10*60*60 mm/min^2 = 10 mm/sec^2
+// Laser-off moves don't affect cut quality, so they can accelerate harder
+#define X_TRAVEL_ACCELERATION (500.0*60*60) // 500*60*60 mm/min^2 = 500 mm/sec^2
+#define Y_TRAVEL_ACCELERATION (500.0*60*60) // 500*60*60 mm/min^2 = 500 mm/sec^2
+#define Z_TRAVEL_ACCELERATION (200.0*60*60) // 200*60*60 mm/min^2 = 200 mm/sec^2
 #define ACCELERATION_TICKS_PER_SECOND 1000
 
 #define X_MAX_TRAVEL 495.3 // mm
@@ -58,7 +69,10 @@ bool verbose;
 #define Z_MAX_TRAVEL 12.0 // mm
 
 #define JUNCTION_DEVIATION 0.01 // mm
-#define ARC_TOLERANCE 0.002 // mm
+#define TRAVEL_JUNCTION_DEVIATION 0.05 // mm
+#define ARC_TOLERANCE 0.002 // Chord error of arcs expected to run at ARC_TOLERANCE_SPEED or faster (mm)
+#define ARC_TOLERANCE_MAX 0.01 // Chord error bound, for the slowest arcs (mm)
+#define ARC_TOLERANCE_SPEED 3000.0 // Slower arcs use coarser chords, with the same turn rate per chord (mm/min)
 
 #define X_AXIS_STEP_BIT     bit(0)
 #define Y_AXIS_STEP_BIT     bit(2)
@@ -88,6 +102,21 @@ bool verbose;
  */
 #define STEP_GEN_PRIORITY   50
 
+/**
+ * @brief CPU affinity for Segment Prep Worker RT Task
+ */
+#define SEGMENT_PREP_CPU_AFFINITY   2
+
+/**
+ * @brief Priority for Segment Prep Worker RT Task
+ */
+#define SEGMENT_PREP_PRIORITY   45
+
+/**
+ * @brief Segment Prep Worker poll period when not woken by the planner or step generator (ns)
+ */
+#define SEGMENT_PREP_PERIOD     1000000
+
 #endif //OPENGLOW_CNC_CONFIG_H
 
 /** @} */
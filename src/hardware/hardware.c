@@ -17,45 +17,14 @@
  * @{
  * @defgroup hardware_init Initialization
  *
- * Initialization of the hardware.
+ * Initialization of the hardware. The individual hardware subsystems are started as
+ * phases of system_control_init().
  *
  * @{
  */
 
 #include "../openglow-cnc.h"
 
-/**
- * @brief Initialize hardware
- * @return 0 on success, negative on error.
- */
-ssize_t hardware_init() {
-    ssize_t ret = 0;
-    // Startup OpenGlow control board
-    if ((ret = openglow_init()) < 0) {
-        fprintf(stderr, "hardware_init: openglow_init returned %zd\n", ret);
-        return ret;
-    }
-
-    // Startup switch thread
-    if ((ret = switches_init()) < 0) {
-        fprintf(stderr, "system_control_loop: switches_init returned %zd\n", ret);
-        return ret;
-    }
-
-    // Startup limits thread
-    if ((ret = limits_init()) < 0) {
-        fprintf(stderr, "system_control_loop: limits_init returned %zd\n", ret);
-        return ret;
-    }
-
-    // Startup STEPPER_LOOP thread
-    if ((ret = stepgen_init()) < 0) {
-        fprintf(stderr, "system_control_loop: stepgen_init returned %zd\n", ret);
-        return ret;
-    }
-    return ret;
-}
-
 /**
  * @brief Reset hardware
  */
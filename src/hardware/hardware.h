@@ -18,8 +18,6 @@
 
 #include "../common.h"
 
-ssize_t hardware_init();
-
 void hardware_reset();
 
 #endif //OPENGLOW_CNC_HARDWARE_H
@@ -147,6 +147,7 @@ static void _limits_event_loop() {
     struct input_event ev[64];
     ssize_t i, rd;
     fd_set rdfs;
+    rtdiag_task("rt_limits_event_loop_task");
 
     FD_ZERO(&rdfs);
     FD_SET(limits_fd, &rdfs);
@@ -17,6 +17,7 @@
  */
 
 #include <alchemy/task.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <string.h>
@@ -37,6 +38,21 @@ static FILE *openglow_pulse_fd;
  */
 static int openglow_state_fd = 0;
 
+/**
+ * @brief Pulse stream run to idle transitions seen by the state poll
+ */
+static volatile uint32_t openglow_pulse_stops = 0;
+
+/**
+ * @brief openglow_pulse_stops when the pulse stream was last started
+ */
+static uint32_t openglow_pulse_run_stops = 0;
+
+/**
+ * @brief Pulse stream is being drained mid-cycle. Its stop doesn't end the cycle.
+ */
+static volatile bool openglow_pulse_draining = false;
+
 const led_color_t btn_led_red = { .red = 100, .green = 0, .blue = 0 };      /*!< Predefined LED Color - RED */
 const led_color_t btn_led_green = { .red = 0, .green = 100, .blue = 0 };    /*!< Predefined LED Color - GREEN */
 const led_color_t btn_led_white = { .red = 60, .green = 80, .blue = 100 };  /*!< Predefined LED Color - WHITE */
@@ -234,6 +250,7 @@ static void _openglow_state_poll() {
     ssize_t ret = 0;
     uint8_t read_state;
     char buf[32];
+    rtdiag_task("rt_openglow_poll_task");
     if ((openglow_state_fd = open(ATTR_STATE, O_RDONLY)) < 0) {
         fprintf(stderr, "_openglow_state_poll: failed to open %s. %d\n", ATTR_STATE, openglow_state_fd);
         og_fsm_state = OG_STATE_FAULT;
@@ -260,7 +277,10 @@ static void _openglow_state_poll() {
         else if (strcmp(buf, "running") == 0) read_state = OG_STATE_RUN;
         else read_state = OG_STATE_FAULT;
         if (read_state != og_fsm_state) {
-            if ((og_fsm_state == OG_STATE_RUN) && (read_state == OG_STATE_IDLE)) fsm_request(SYS_STATE_IDLE);
+            if ((og_fsm_state == OG_STATE_RUN) && (read_state == OG_STATE_IDLE)) {
+                if (!openglow_pulse_draining) fsm_request(SYS_STATE_IDLE);
+                openglow_pulse_stops++;
+            }
             og_fsm_state = read_state;
             fsm_update(FSM_OPENGLOW, og_fsm_state);
             openglow_button_led((og_fsm_state == OG_STATE_RUN) ? btn_led_white : btn_led_off);
@@ -311,6 +331,28 @@ void openglow_pulse_close() {
     openglow_pulse_fd = 0;
 }
 
+/**
+ * @brief Wait for the data written to the OpenGlow pulse device to play out
+ *
+ * Starts the SDMA engine if it wasn't, and waits for it to go idle. The system stays in RUN.
+ * @param started SDMA engine was started with openglow_pulse_run() since the data was last drained
+ * @return 0 on success, negative on error or timeout.
+ */
+ssize_t openglow_pulse_drain(bool started) {
+    ssize_t ret = 0;
+    openglow_pulse_draining = true;
+    openglow_pulse_flush();
+    if (!started && ((ret = openglow_pulse_run()) < 0)) {
+        fprintf(stderr, "openglow_pulse_drain: openglow_pulse_run returned %zd\n", ret);
+    }
+    for (uint32_t polls = 0; (ret >= 0) && (openglow_pulse_stops == openglow_pulse_run_stops); polls++) {
+        if (polls == OPENGLOW_DRAIN_TIMEOUT) { ret = -ETIMEDOUT; }
+        else { rt_task_sleep(OPENGLOW_DRAIN_POLL); }
+    }
+    openglow_pulse_draining = false;
+    return ret;
+}
+
 /**
  * @brief Flush data written to OpenGlow pulse device
  */
@@ -333,6 +375,15 @@ ssize_t openglow_pulse_open() {
     return 0;
 }
 
+/**
+ * @brief Start the SDMA engine on the data written to OpenGlow pulse device
+ * @return Length of data written on success, negative on failure
+ */
+ssize_t openglow_pulse_run() {
+    openglow_pulse_run_stops = openglow_pulse_stops;
+    return openglow_write_attr_str(ATTR_RUN, "1\n");
+}
+
 /**
  * @brief Write single byte of data to OpenGlow pulse device
  * @param data Byte of data to write
@@ -48,6 +48,10 @@
 #define ATTR_WATER_PUMP         "/sys/openglow/thermal/water_pump_on"
 
 #define ATTR_PULSE              "/dev/openglow"
+
+#define OPENGLOW_DRAIN_POLL     1000000     // Pulse stream drain poll period (ns)
+#define OPENGLOW_DRAIN_TIMEOUT  60000       // Longest wait for the pulse stream to drain (polls)
+
 /**
  * @brief OpenGlow clear commands
  */
@@ -84,10 +88,14 @@ void openglow_lid_led(uint8_t brightness);
 
 void openglow_pulse_close();
 
+ssize_t openglow_pulse_drain(bool started);
+
 void openglow_pulse_flush();
 
 ssize_t openglow_pulse_open();
 
+ssize_t openglow_pulse_run();
+
 ssize_t openglow_pulse_write(uint8_t data);
 
 ssize_t openglow_read_attr_str(const char *attr, char *buf, size_t length);
@@ -243,5 +243,33 @@ ssize_t step_drv_init(void) {
     return 0;
 };
 
+/**
+ * @brief Switch the XY drivers' microstep resolution
+ *
+ * The configured resolution is coarsened by shift, to at most full steps. The driver keeps its place in the
+ * microstep table, so a coarse step moves exactly 1 << shift configured steps.
+ * @note The switch takes effect as the drivers are written. The pulse stream must be at rest.
+ * @param shift Resolution is 1 / (1 << shift) of the configured resolution. 0 restores it.
+ * @return 0 on success, negative otherwise
+ */
+ssize_t step_drv_set_microsteps(uint8_t shift) {
+#ifdef TARGET_BUILD
+    char buf_attr[64];
+    ssize_t ret;
+    for (int axis = 0; axis < NUM_DRV_AXIS; axis++) {
+        uint64_t chopconf = axis_settings[axis][DRV_CHOPCONF];
+        uint8_t mres = (uint8_t) (((chopconf & CHOPCONF_MRES_MASK) >> 24) + shift);
+        if (mres > MSTEPS_FULL) { mres = MSTEPS_FULL; }
+        chopconf = (chopconf & ~CHOPCONF_MRES_MASK) | CHOPCONF_MRES(mres);
+        sprintf(buf_attr, "%s%s/%s", DRV_ATTR_PATH, axis_attr[axis], drv_attr_map[DRV_CHOPCONF].attr);
+        if ((ret = openglow_write_attr_uint64(buf_attr, chopconf)) < 0) {
+            fprintf(stderr, "step_drv_set_microsteps: write %s returned %zd\n", buf_attr, ret);
+            return ret;
+        }
+    }
+#endif
+    return 0;
+}
+
 /** @} */
 /** @} */
@@ -118,6 +118,7 @@ struct attr_s {
 #define CHOPCONF_VHIGHCHM           bit(19)
 #define CHOPCONF_SYNC(x)            bits(20, x, 4)
 #define CHOPCONF_MRES(x)            bits(24, x, 4)
+#define CHOPCONF_MRES_MASK          bits(24, 0xF, 4)
 #define CHOPCONF_INTPOL             bit(28)
 #define CHOPCONF_DEDGE              bit(29)
 #define CHOPCONF_DISS2G             bit(30)
@@ -231,6 +232,8 @@ struct attr_s {
 
 ssize_t step_drv_init(void);
 
+ssize_t step_drv_set_microsteps(uint8_t shift);
+
 #endif //OPENGLOW_CNC_STEP_DRV_H
 
 /** @} */
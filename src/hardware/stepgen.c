@@ -21,9 +21,11 @@
  */
 
 #include <alchemy/task.h>
+#include <errno.h>
 #include <memory.h>
 #include <sched.h>
 #include <fcntl.h>
+#include <math.h>
 #include "../openglow-cnc.h"
 
 /**
@@ -41,8 +43,21 @@ int32_t sys_position[N_AXIS] = {0};
  */
 static RT_TASK rt_stepgen_loop_task;
 
+/**
+ * @brief Microstep resolution the XY drivers are set to, as a step_shift. See plan_block_t.
+ */
+static uint8_t stepgen_drv_shift = 0;
+
 // Static function declarations
+static void _stepgen_async_idle_tick();
+static void _stepgen_async_start();
+static uint8_t _stepgen_async_tick();
+static bool _stepgen_async_wait();
+static bool _stepgen_microstep_change();
+static ssize_t _stepgen_set_microsteps(uint8_t shift, bool started);
+static void _stepgen_load_segment();
 static void _stepgen_loop();
+static uint8_t _stepgen_tick();
 
 #ifdef DEBUG_STEP_TO_FILE
 FILE *f_step; // 'pulse' file output
@@ -50,6 +65,21 @@ FILE *f_cnt;  // Segment cycles file output
 #endif // DEBUG_STEP_TO_FILE
 
 
+/**
+ * @brief Bresenham kernel. Steps the axes it was generated for and returns the step bits.
+ */
+typedef uint8_t (*stepgen_kernel_t)();
+
+/**
+ * @brief Asynchronous Z move. Runs at its own constant rate, alongside the executing blocks.
+ */
+typedef struct {
+    uint32_t steps;             /*!< Steps remaining, 0 when idle */
+    uint32_t cycles_per_step;   /*!< Step period at the Z maximum rate, in segment cycles */
+    uint32_t cycle_count;       /*!< Segment cycles since the last step */
+    uint8_t direction_bits;     /*!< Z direction bit of the move */
+} stepgen_async_t;
+
 /**
  * @brief Step Generator data struct. Contains the running data for the step generator loop.
  */
@@ -63,9 +93,15 @@ typedef struct {
     uint8_t dir_outbits;    /*!< The next direction bits to be output */
 
     uint16_t step_count;    /*!< Steps remaining in line segment motion */
+    uint16_t step_cycle_count; /*!< Ticks since the last step of the executing segment */
     uint8_t exec_block_index; /*!< Tracks the current st_block index. Change indicates new block. */
+    uint8_t kernel_mask;      /*!< Axis mask of the selected kernel */
+    int32_t xy_step;          /*!< Full resolution steps moved by an X or Y step of the executing block */
+    stepgen_kernel_t kernel;  /*!< Bresenham kernel for the executing block */
+    uint32_t exec_line_id;    /*!< Tracks the current G-Code line ID. Change indicates new line. */
     st_block_t *exec_block;   /*!< Pointer to the block data for the segment being executed */
     segment_t *exec_segment;  /*!< Pointer to the segment being executed */
+    stepgen_async_t async;    /*!< Asynchronous Z move */
 } stepgen_t;
 
 /**
@@ -73,6 +109,65 @@ typedef struct {
  */
 static stepgen_t st;
 
+/**
+ * @brief Bresenham step for the axes in mask
+ *
+ * Inlined into each kernel with a constant mask, so idle axes cost nothing. An axis with no steps never
+ * overflows its counter, so skipping it produces exactly the pulses the XYZ kernel would.
+ * @param mask Axes to step, bit(axis)
+ * @return Step bits for the tick
+ */
+static inline __attribute__((always_inline)) uint8_t _stepgen_bresenham(const uint8_t mask) {
+    uint8_t step_outbits = 0;
+    if (mask & bit(X_AXIS)) {
+        st.counter_x += st.exec_block->steps[X_AXIS];
+        if (st.counter_x > st.exec_block->step_event_count) {
+            step_outbits |= X_AXIS_STEP_BIT;
+            st.counter_x -= st.exec_block->step_event_count;
+            if (st.exec_block->direction_bits & X_AXIS_DIR_BIT) { sys_position[X_AXIS] -= st.xy_step; }
+            else { sys_position[X_AXIS] += st.xy_step; }
+        }
+    }
+    if (mask & bit(Y_AXIS)) {
+        st.counter_y += st.exec_block->steps[Y_AXIS];
+        if (st.counter_y > st.exec_block->step_event_count) {
+            step_outbits |= Y_AXIS_STEP_BIT;
+            st.counter_y -= st.exec_block->step_event_count;
+            if (st.exec_block->direction_bits & Y_AXIS_DIR_BIT) { sys_position[Y_AXIS] -= st.xy_step; }
+            else { sys_position[Y_AXIS] += st.xy_step; }
+        }
+    }
+    if (mask & bit(Z_AXIS)) {
+        st.counter_z += st.exec_block->steps[Z_AXIS];
+        if (st.counter_z > st.exec_block->step_event_count) {
+            step_outbits |= Z_AXIS_STEP_BIT;
+            st.counter_z -= st.exec_block->step_event_count;
+            if (st.exec_block->direction_bits & Z_AXIS_DIR_BIT) { sys_position[Z_AXIS]--; }
+            else { sys_position[Z_AXIS]++; }
+        }
+    }
+    return step_outbits;
+}
+
+// Generate one kernel per axis combination
+#define STEPGEN_KERNEL(mask) static uint8_t _stepgen_kernel_##mask() { return _stepgen_bresenham(mask); }
+STEPGEN_KERNEL(0)
+STEPGEN_KERNEL(1)
+STEPGEN_KERNEL(2)
+STEPGEN_KERNEL(3)
+STEPGEN_KERNEL(4)
+STEPGEN_KERNEL(5)
+STEPGEN_KERNEL(6)
+STEPGEN_KERNEL(7)
+
+/**
+ * @brief Bresenham kernels, indexed by axis mask
+ */
+static const stepgen_kernel_t stepgen_kernels[STEP_GEN_KERNELS] = {
+        _stepgen_kernel_0, _stepgen_kernel_1, _stepgen_kernel_2, _stepgen_kernel_3,
+        _stepgen_kernel_4, _stepgen_kernel_5, _stepgen_kernel_6, _stepgen_kernel_7,
+};
+
 /**
  * @brief Reset and clear step generator variables
  */
@@ -84,10 +179,22 @@ void stepgen_clear() {
     memset(&prep, 0, sizeof(st_prep_t));
     memset(&st, 0, sizeof(stepgen_t));
     st.exec_segment = NULL;
+    st.kernel_mask = STEP_GEN_KERNELS - 1;
+    st.kernel = stepgen_kernels[st.kernel_mask];
+    st.xy_step = 1;
     pl_block = NULL;  // Planner block pointer used by segment buffer
     segment_reset();
 
     st.dir_outbits = 0; // Initialize direction bits.
+
+    // Motion was cleared. Return the drivers to full resolution.
+    if (stepgen_drv_shift) {
+        ssize_t ret = 0;
+        if ((ret = step_drv_set_microsteps(0)) < 0) {
+            fprintf(stderr, "stepgen_clear: step_drv_set_microsteps returned %zd\n", ret);
+        }
+        stepgen_drv_shift = 0;
+    }
 }
 
 /**
@@ -125,12 +232,6 @@ ssize_t stepgen_init() {
         return ret;
     }
 
-    // Initialize the stepper drivers
-    if ((ret = step_drv_init()) < 0) {
-        fprintf(stderr, "stepgen_init: step_drv_init returned %zd\n", ret);
-        return ret;
-    }
-
     // Initialize OpenGlow pulse device
     if ((ret = openglow_clear(OG_CLEAR_ALL)) < 0) {
         fprintf(stderr, "stepgen_init: openglow_clear returned %zd\n", ret);
@@ -157,137 +258,341 @@ ssize_t stepgen_init() {
 static void _stepgen_loop() {
     ssize_t ret = 0;
     bool sdma_run = false;
+    bool sdma_restart = false; // Pulse stream was drained mid-cycle, and must be started again
     uint32_t cycle_count = 0;
     uint32_t segment_count = 0;
-    uint16_t step_cycle_count = 0;
+    rtdiag_task("rt_stepgen_loop_task");
     rt_task_suspend(NULL);
     while (loop_run) {
         cycle_count++;
-        step_cycle_count++;
+        st.step_cycle_count++;
         // If there is no step segment, attempt to pop one from the stepper buffer
         if (st.exec_segment == NULL) {
 #ifdef TARGET_BUILD
             openglow_pulse_flush();
 #endif // TARGET_BUILD
             // Anything in the buffer? If so, load and initialize next step segment.
-            if (segment_buffer_head != segment_buffer_tail) {
+            if (__atomic_load_n(&segment_buffer_head, __ATOMIC_ACQUIRE) != segment_buffer_tail) {
                 // We want at least one second of data before we start the SDMA engine.
 #ifdef TARGET_BUILD
-                if ((sys_state != SYS_STATE_RUN) && (sys_state != SYS_STATE_HOMING)
+                if ((((sys_state != SYS_STATE_RUN) && (sys_state != SYS_STATE_HOMING)) || sdma_restart)
                     && !sdma_run && (cycle_count > STEP_FREQUENCY)) {
                     sdma_run = true;
                     if (verbose) printf("_stepper_loop: SDMA run during cycles\n");
-                    if ((ret = openglow_write_attr_str(ATTR_RUN, "1\n")) < 0)
-                        fprintf(stderr, "_stepper_loop: openglow_write_attr_str returned %zd\n", ret);
+                    if ((ret = openglow_pulse_run()) < 0)
+                        fprintf(stderr, "_stepper_loop: openglow_pulse_run returned %zd\n", ret);
                 }
 #endif // TARGET_BUILD
 
-                // Initialize new step segment and load number of steps to execute
-                st.exec_segment = &segment_buffer[segment_buffer_tail];
-
-                // Initialize step segment timing per step and load number of steps to execute.
-                st.step_count = st.exec_segment->n_step; // NOTE: Can sometimes be zero when moving slow.
-                // If the new segment starts a new motion block, initialize stepper variables and counters.
-                // NOTE: When the segment data index changes, this indicates a new motion block.
-                if (st.exec_block_index != st.exec_segment->st_block_index) {
-                    st.exec_block_index = st.exec_segment->st_block_index;
-                    st.exec_block = &st_block_buffer[st.exec_block_index];
-
-                    // Initialize Bresenham line and distance counters
-                    st.counter_x = st.counter_y = st.counter_z = (st.exec_block->step_event_count >> 1);
+                if (_stepgen_async_wait()) {
+                    // Hold the next block until the asynchronous Z move is complete
+                    _stepgen_async_idle_tick();
+                    continue;
                 }
-                st.dir_outbits = st.exec_block->direction_bits;
-
-                // Set real-time spindle output as segment is loaded, just prior to the first step.
-//            spindle_set_speed(st.exec_segment->spindle_pwm);
-                step_cycle_count = 0;
+                if (_stepgen_microstep_change()) {
+                    // The pulses written play out before the drivers switch, so start again like a new cycle
+                    if (_stepgen_set_microsteps(st_block_buffer[segment_buffer[segment_buffer_tail].st_block_index]
+                                                        .step_shift, sdma_run) < 0) {
+                        // Position is lost if the cycle carries on. Stop it and raise an alarm instead.
+#ifdef TARGET_BUILD
+                        openglow_write_attr_str(ATTR_STOP, "1\n");
+#endif // TARGET_BUILD
+                        motion_state_update(MOT_STATE_ALARM);
+                        cycle_count = 0;
+                        st.step_cycle_count = 0;
+                        rt_task_suspend(NULL);
+                        if (verbose) printf("stepper_loop: resume\n");
+                        sdma_run = false;
+                        sdma_restart = false;
+                        continue;
+                    }
+                    sdma_run = false;
+                    sdma_restart = true;
+                    cycle_count = 0;
+                }
+                rtdiag_begin();
+                _stepgen_load_segment();
+                RTDIAG_END();
 #ifdef DEBUG_STEP_TO_FILE
                 fprintf(f_cnt, "%d\n", st.exec_segment->cycles_per_tick);
 #endif // DEBUG_STEP_TO_FILE
 
+            } else if (segment_prep_pending()) {
+                // Worker hasn't caught up yet. Wait for it instead of ending the cycle.
+                cycle_count--;
+                segment_worker_kick();
+                rt_task_sleep(STEP_GEN_PREP_WAIT);
+                continue;
+            } else if (st.async.steps) {
+                // Finish the asynchronous Z move before ending the cycle
+                _stepgen_async_idle_tick();
+                continue;
             } else {
                 // Segment buffer empty. TODO: Set this to check if motion is still crunching
+                rtdiag_begin();
+                flight_stepgen_empty();
                 // Ensure pwm is set properly upon completion of rate-controlled motion.
                 // TODO: Change the whole way this is working....
-                if (verbose) printf("stepper_loop: suspend after %d cycles, %d segments\n", cycle_count, segment_count);
+                if (verbose) {
+                    printf("stepper_loop: suspend after %d cycles, %d segments, profile cache %u hits %u misses\n",
+                           cycle_count, segment_count, metrics_get(METRIC_SEGMENT_CACHE_HITS),
+                           metrics_get(METRIC_SEGMENT_CACHE_MISSES));
+                }
                 cycle_count = 0;
-                step_cycle_count = 0;
+                st.step_cycle_count = 0;
                 // If over 1 second wasn't written to the buffer, run the SDMA now
-                if ((sys_req_state == SYS_STATE_RUN) && !sdma_run) {
+                if (((sys_req_state == SYS_STATE_RUN) || sdma_restart) && !sdma_run) {
 #ifdef TARGET_BUILD
                     if (verbose) printf("_stepper_loop: SDMA run after cycles\n");
-                    if ((ret = openglow_write_attr_str(ATTR_RUN, "1\n")) < 0)
-                        fprintf(stderr, "_stepper_loop: openglow_write_attr_str returned %zd\n", ret);
+                    if ((ret = openglow_pulse_run()) < 0)
+                        fprintf(stderr, "_stepper_loop: openglow_pulse_run returned %zd\n", ret);
 #endif
                 } else fsm_request(SYS_STATE_IDLE);
+                RTDIAG_END();
                 rt_task_suspend(NULL);
                 if (verbose) printf("stepper_loop: resume\n");
                 sdma_run = false;
+                sdma_restart = false;
                 continue;
             }
         }
 
-        step_cycle_count++;
-        if (step_cycle_count < st.exec_segment->cycles_per_tick) {
-            // Output spacer pulse
+        uint8_t pulse = _stepgen_tick() | _stepgen_async_tick();
 #ifdef DEBUG_STEP_TO_FILE
-            putc(0x00, f_step);
+        putc(pulse, f_step);
 #endif // DEBUG_STEP_TO_FILE
 #ifdef TARGET_BUILD
-            openglow_pulse_write(0x00);
+        openglow_pulse_write(pulse);
 #endif // TARGET_BUILD
-            continue;
-        }
-        step_cycle_count = 0;
-
-        // Reset step out bits.
-        st.step_outbits = 0;
 
-        // Execute step displacement profile by Bresenham line algorithm
-        st.counter_x += st.exec_block->steps[X_AXIS];
-        if (st.counter_x > st.exec_block->step_event_count) {
-            st.step_outbits |= X_AXIS_STEP_BIT;
-            st.counter_x -= st.exec_block->step_event_count;
-            if (st.exec_block->direction_bits & X_AXIS_DIR_BIT) { sys_position[X_AXIS]--; }
-            else { sys_position[X_AXIS]++; }
-        }
-        st.counter_y += st.exec_block->steps[Y_AXIS];
-        if (st.counter_y > st.exec_block->step_event_count) {
-            st.step_outbits |= Y_AXIS_STEP_BIT;
-            st.counter_y -= st.exec_block->step_event_count;
-            if (st.exec_block->direction_bits & Y_AXIS_DIR_BIT) { sys_position[Y_AXIS]--; }
-            else { sys_position[Y_AXIS]++; }
-        }
-        st.counter_z += st.exec_block->steps[Z_AXIS];
-        if (st.counter_z > st.exec_block->step_event_count) {
-            st.step_outbits |= Z_AXIS_STEP_BIT;
-            st.counter_z -= st.exec_block->step_event_count;
-            if (st.exec_block->direction_bits & Z_AXIS_DIR_BIT) { sys_position[Z_AXIS]--; }
-            else { sys_position[Z_AXIS]++; }
+        if (st.exec_segment == NULL) {
+            segment_count++;
+            // Tickle segment worker to keep our buffer full
+            segment_worker_kick();
         }
+    }
+
+}
 
-            // Output step pulse
+/**
+ * @brief Output a tick of the asynchronous Z move alone, while no segment can execute
+ */
+static void _stepgen_async_idle_tick() {
+    uint8_t pulse = _stepgen_async_tick();
 #ifdef DEBUG_STEP_TO_FILE
-        putc(st.step_outbits, f_step);
+    putc(pulse, f_step);
 #endif // DEBUG_STEP_TO_FILE
 #ifdef TARGET_BUILD
-        openglow_pulse_write(st.step_outbits | st.exec_block->direction_bits);
+    openglow_pulse_write(pulse);
 #endif // TARGET_BUILD
+}
+
+/**
+ * @brief Start the asynchronous Z move carried by the executing block
+ *
+ * Runs at the Z maximum rate without a ramp. At Z_MAX_RATE the step rate is well inside the start/stop
+ * rate of the stepper. Timed in the same cycles as segment cycles_per_tick, so Z keeps its rate relative
+ * to the blocks.
+ */
+static void _stepgen_async_start() {
+    st.async.steps = st.exec_block->async_steps;
+    st.async.direction_bits = st.exec_block->async_direction_bits;
+    st.async.cycles_per_step = (uint32_t) ceilf((STEP_FREQUENCY * 60.0f) /
+                                                (settings.max_rate[Z_AXIS] * settings.steps_per_mm[Z_AXIS]));
+    st.async.cycle_count = 0;
+}
+
+/**
+ * @brief Run one pulse tick of the asynchronous Z move
+ * @return Z step and direction bits for the tick, 0x00 when idle.
+ */
+static uint8_t _stepgen_async_tick() {
+    if (st.async.steps == 0) { return 0x00; }
+    st.async.cycle_count += STEP_GEN_CYCLES_PER_TICK;
+    if (st.async.cycle_count < st.async.cycles_per_step) { return st.async.direction_bits; }
+    st.async.cycle_count = 0;
+    st.async.steps--;
+    if (st.async.direction_bits) { sys_position[Z_AXIS]--; }
+    else { sys_position[Z_AXIS]++; }
+    return (uint8_t) (Z_AXIS_STEP_BIT | st.async.direction_bits);
+}
 
-        // During a homing cycle, lock out and prevent desired axes from moving.
+/**
+ * @brief Check if the segment at the tail of the segment buffer must wait for the asynchronous Z move
+ *
+ * Only laser-off rapids without Z motion run alongside the move. Any other block, or a block carrying the
+ * next move, waits at its start. The planner has it start from rest.
+ * @return True if the segment must wait.
+ */
+static bool _stepgen_async_wait() {
+    if (st.async.steps == 0) { return false; }
+    segment_t *segment = &segment_buffer[segment_buffer_tail];
+    if (segment->st_block_index == st.exec_block_index) { return false; }
+    st_block_t *block = &st_block_buffer[segment->st_block_index];
+    return (!block->allows_async || block->async_steps);
+}
+
+/**
+ * @brief Check if the segment at the tail of the segment buffer needs the drivers at another microstep resolution
+ *
+ * Only the first segment of a block can. The planner has it start from rest.
+ * @return True if the drivers must switch before the segment is loaded.
+ */
+static bool _stepgen_microstep_change() {
+    return (st_block_buffer[segment_buffer[segment_buffer_tail].st_block_index].step_shift != stepgen_drv_shift);
+}
+
+/**
+ * @brief Switch the XY drivers' microstep resolution
+ *
+ * The drivers are written over SPI, which can't be timed against the pulse stream, and the stream runs well
+ * ahead of the machine. So the pulses written so far are played out first, with the machine at rest between
+ * blocks, and the step generator then carries on as if starting a new cycle.
+ * @param shift New resolution, as a step_shift
+ * @param started Pulse stream was started for this cycle
+ * @return 0 on success, negative if the pulses didn't drain or the drivers weren't written. The drivers are
+ * left as they were.
+ */
+static ssize_t _stepgen_set_microsteps(uint8_t shift, bool started) {
+    ssize_t ret = 0;
+    if (verbose) printf("_stepgen_set_microsteps: %u to %u\n", stepgen_drv_shift, shift);
+#ifdef TARGET_BUILD
+    if ((ret = openglow_pulse_drain(started)) < 0) {
+        fprintf(stderr, "_stepgen_set_microsteps: openglow_pulse_drain returned %zd\n", ret);
+        return ret;
+    }
+#endif // TARGET_BUILD
+    if ((ret = step_drv_set_microsteps(shift)) < 0) {
+        fprintf(stderr, "_stepgen_set_microsteps: step_drv_set_microsteps returned %zd\n", ret);
+        return ret;
+    }
+    stepgen_drv_shift = shift;
+    metrics_inc(METRIC_MICROSTEP_SWITCHES);
+    return ret;
+}
+
+/**
+ * @brief Load the segment at the tail of the segment buffer for execution
+ */
+static void _stepgen_load_segment() {
+    // Initialize new step segment and load number of steps to execute
+    st.exec_segment = &segment_buffer[segment_buffer_tail];
+    flight_record(FLIGHT_LOAD, st.exec_segment->line_id, segment_queued());
+
+    // Initialize step segment timing per step and load number of steps to execute.
+    st.step_count = st.exec_segment->n_step; // NOTE: Can sometimes be zero when moving slow.
+    // If the new segment starts a new motion block, initialize stepper variables and counters.
+    // NOTE: When the segment data index changes, this indicates a new motion block.
+    if (st.exec_block_index != st.exec_segment->st_block_index) {
+        st.exec_block_index = st.exec_segment->st_block_index;
+        st.exec_block = &st_block_buffer[st.exec_block_index];
+        st.xy_step = (int32_t) 1 << st.exec_block->step_shift;
+
+        // Initialize Bresenham line and distance counters
+        st.counter_x = st.counter_y = st.counter_z = (st.exec_block->step_event_count >> 1);
+
+        // Select the kernel for the axes this block moves
+#ifdef STEPGEN_AXIS_KERNELS
+        st.kernel_mask = st.exec_block->axis_mask;
+#else
+        st.kernel_mask = STEP_GEN_KERNELS - 1;
+#endif // STEPGEN_AXIS_KERNELS
+        st.kernel = stepgen_kernels[st.kernel_mask];
+
+        if (st.exec_block->async_steps) { _stepgen_async_start(); }
+    }
+    st.dir_outbits = st.exec_block->direction_bits;
+    if (st.exec_line_id != st.exec_segment->line_id) {
+        st.exec_line_id = st.exec_segment->line_id;
+        latency_stamp(st.exec_line_id, LAT_TICKED, latency_now());
+    }
+
+    // Set real-time spindle output as segment is loaded, just prior to the first step.
+//            spindle_set_speed(st.exec_segment->spindle_pwm);
+    st.step_cycle_count = 0;
+}
+
+/**
+ * @brief Run one pulse tick of the executing segment
+ *
+ * Shared by the real time loop and offline rendering, so both produce the same pulse stream.
+ * When the segment completes, it is discarded and st.exec_segment is cleared.
+ * @return Pulse byte for the tick. Spacer ticks are 0x00, steps carry the step and direction bits.
+ */
+static uint8_t _stepgen_tick() {
+    st.step_cycle_count++;
+    if (st.step_cycle_count < st.exec_segment->cycles_per_tick) {
+        // Output spacer pulse
+        return 0x00;
+    }
+    st.step_cycle_count = 0;
+
+    // Execute step displacement profile by Bresenham line algorithm
+    st.step_outbits = st.kernel();
+    uint8_t pulse = st.step_outbits | st.exec_block->direction_bits;
+
+    // During a homing cycle, lock out and prevent desired axes from moving.
 //        if (sys.state.mode == STATE_HOMING) { st.step_outbits &= sys.state.homing_axis_lock; }
 
-        st.step_count--; // Decrement step events count
-        if (st.step_count == 0) {
-            // Segment is complete. Discard current segment and advance segment indexing.
-            st.exec_segment = NULL;
-            if (++segment_buffer_tail == SEGMENT_BUFFER_SIZE) { segment_buffer_tail = 0; }
-            segment_count++;
-            // Tickle segment worker to keep our buffer full
-            segment_prep_buffer();
-        }
+    st.step_count--; // Decrement step events count
+    if (st.step_count == 0) {
+        // Segment is complete. Discard current segment and advance segment indexing.
+        st.exec_segment = NULL;
+        // Release the slot only after the last read of it, since the segment worker may refill it at once
+        uint16_t tail = (uint16_t) (segment_buffer_tail + 1);
+        if (tail == SEGMENT_BUFFER_SIZE) { tail = 0; }
+        __atomic_store_n(&segment_buffer_tail, tail, __ATOMIC_RELEASE);
     }
+    return pulse;
+}
 
+/**
+ * @brief Render all queued segments to a pulse stream, without real time pacing
+ *
+ * Used by offline rendering in place of _stepgen_loop(). Pulses are produced exactly as the real time loop
+ * produces them.
+ * @param out Pulse stream output, one byte per tick. NULL to discard.
+ * @param stats Totals to add to
+ * @return 0 on success, negative on error.
+ */
+ssize_t stepgen_render_segments(FILE *out, stepgen_render_stats_t *stats) {
+    uint8_t buf[STEP_GEN_RENDER_BUFFER];
+    size_t len = 0;
+    while (true) {
+        st.step_cycle_count++; // Mirrors the start of each _stepgen_loop() pass.
+        uint8_t pulse;
+        bool empty = (__atomic_load_n(&segment_buffer_head, __ATOMIC_ACQUIRE) == segment_buffer_tail);
+        if ((st.exec_segment == NULL) && (empty || _stepgen_async_wait())) {
+            // Nothing can execute. Run the asynchronous Z move on its own, unless more segments are to come.
+            if ((st.async.steps == 0) || (empty && segment_prep_pending())) { break; }
+            pulse = _stepgen_async_tick();
+        } else {
+            if (st.exec_segment == NULL) { _stepgen_load_segment(); }
+            pulse = _stepgen_tick() | _stepgen_async_tick();
+            if (st.step_cycle_count == 0) { stats->kernel_steps[st.kernel_mask]++; }
+            if (st.exec_segment == NULL) { stats->segments++; }
+        }
+        buf[len++] = pulse;
+        if (pulse & X_AXIS_STEP_BIT) { stats->axis_steps[X_AXIS]++; }
+        if (pulse & Y_AXIS_STEP_BIT) { stats->axis_steps[Y_AXIS]++; }
+        if (pulse & Z_AXIS_STEP_BIT) { stats->axis_steps[Z_AXIS]++; }
+        if (len == sizeof(buf)) {
+            stats->ticks += len;
+            for (size_t i = 0; i < len; i++) { stats->hash = (stats->hash ^ buf[i]) * STEP_GEN_HASH_PRIME; }
+            if ((out != NULL) && (fwrite(buf, 1, len, out) != len)) {
+                fprintf(stderr, "stepgen_render_segments: fwrite failed\n");
+                return -EIO;
+            }
+            len = 0;
+        }
+    }
+    stats->ticks += len;
+    for (size_t i = 0; i < len; i++) { stats->hash = (stats->hash ^ buf[i]) * STEP_GEN_HASH_PRIME; }
+    if ((out != NULL) && (len > 0) && (fwrite(buf, 1, len, out) != len)) {
+        fprintf(stderr, "stepgen_render_segments: fwrite failed\n");
+        return -EIO;
+    }
+    return 0;
 }
 
 /**
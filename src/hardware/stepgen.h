@@ -22,6 +22,24 @@
 
 #include "../common.h"
 
+#define STEP_GEN_PREP_WAIT 100000 // Wait for the segment prep worker when starved (ns)
+#define STEP_GEN_RENDER_BUFFER 65536 // Pulse bytes buffered per write when rendering offline
+#define STEP_GEN_KERNELS (1 << N_AXIS) // One Bresenham kernel per active axis combination
+#define STEP_GEN_HASH_SEED 0xcbf29ce484222325ULL // FNV-1a 64 bit offset basis, seeds the render pulse hash
+#define STEP_GEN_HASH_PRIME 0x100000001b3ULL // FNV-1a 64 bit prime
+#define STEP_GEN_CYCLES_PER_TICK 2 // Segment cycles counted per pulse tick, by _stepgen_loop() and _stepgen_tick()
+
+/**
+ * @brief Offline render totals
+ */
+typedef struct {
+    uint64_t ticks;                 /*!< Pulse ticks rendered */
+    uint64_t axis_steps[N_AXIS];    /*!< Step pulses per axis */
+    uint64_t segments;              /*!< Segments executed */
+    uint64_t kernel_steps[STEP_GEN_KERNELS]; /*!< Step events executed per kernel, indexed by axis mask */
+    uint64_t hash;                  /*!< FNV-1a hash of the pulse stream. Seed with STEP_GEN_HASH_SEED. */
+} stepgen_render_stats_t;
+
 int32_t sys_position[N_AXIS];
 
 void stepgen_clear();
@@ -30,6 +48,8 @@ ssize_t stepgen_go_idle();
 
 ssize_t stepgen_init();
 
+ssize_t stepgen_render_segments(FILE *out, stepgen_render_stats_t *stats);
+
 ssize_t stepgen_wake_up();
 
 #endif //OPENGLOW_CNC_STEPGEN_H
@@ -142,6 +142,7 @@ void _switches_event_loop() {
     struct input_event ev[64];
     ssize_t i, rd;
     fd_set rdfs;
+    rtdiag_task("rt_sw_event_loop_task");
 
     FD_ZERO(&rdfs);
     FD_SET(switches_fd, &rdfs);
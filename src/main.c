@@ -30,14 +30,35 @@ static struct argp_option options[] = {
         {"verbose",     'v', 0,        0, "Produce verbose output"},
         {"daemon",      'd', 0,        0, "Run as daemon"},
         {"socket",      's', 0,        0, "Listen on socket (default console)"},
-        {"listen-port", 'p', "IPADDR", 0, "IP Address to listen on"},
-        {"listen-ip",   'i', "PORT",   0, "IP Port to listen on"},
+        {"batch",       'b', 0,        0, "Run the job piped to STDIN, then exit"},
+        {"listen-port", 'p', "PORT",   0, "IP Port to listen on"},
+        {"listen-ip",   'i', "IPADDR", 0, "IP Address to listen on"},
+        {"unix",        'u', "PATH",   0, "Listen on UNIX socket PATH instead of TCP"},
+        {"optimize",    'O', "FILE",   0, "Optimize travel in G-Code FILE and exit"},
+        {"out",         'o', "FILE",   0, "Output file for offline modes"},
+        {"no-reverse",  'R', 0,        0, "Do not cut open paths in reverse when optimizing"},
+        {"render",      'r', "FILE",   0, "Render G-Code FILE to a pulse stream offline and exit"},
+        {"stats",       'S', 0,        0, "Print detailed statistics for offline modes"},
+        {"compare",     'C', "FILE",   0, "Compare the rendered pulse stream to reference pulse stream FILE"},
+        {"golden",      'G', "FILE",   0, "Check the jobs in corpus FILE against their golden pulse hashes and exit"},
+        {"update",      'U', 0,        0, "Update the golden pulse hashes in the corpus file"},
+        {"fixed-point", 'F', 0,        0, "Use the fixed-point segment generator"},
+        {"planner",     'B', "BACKEND", 0, "Planner backend: grbl (default) or curvature"},
+        {"async-z",     'Z', 0,        0, "Move Z asynchronously with laser-off rapids"},
+        {"job-cache",   'J', "DIR",    0, "Keep compiled job files in DIR"},
+        {"job-cache-size", 'K', "KB",  0, "Compiled job cache size limit"},
+        {"flight-recorder", 'E', "DIR", 0, "Dump the pipeline flight recorder to DIR on underrun or fault"},
+        {"rt-diag",     'D', 0,        0, "Count blocking, faults and heap use in real time tasks, for $D"},
+        {"rapid-microsteps", 'M', 0,   0, "Step long laser-off rapids at a coarser microstep resolution"},
+        {"feed-limiter", 'L', 0,       0, "Reduce feed when the motion buffers are starving. Laser power is not scaled."},
         {0}
 };
 
 typedef struct arguments {
-    uint8_t daemon, socket, verbose;
-    char *listen_ip, *listen_port;
+    uint8_t daemon, socket, batch, verbose, no_reverse, stats, fixed_point, async_z, update, rt_diag,
+            rapid_microsteps, feed_limiter;
+    char *listen_ip, *listen_port, *optimize, *out, *planner, *render, *unix_path, *compare, *golden, *job_cache,
+            *job_cache_size, *flight;
 } arguments_t;
 
 static error_t
@@ -54,6 +75,10 @@ parse_opt(int key, char *arg, struct argp_state *state) {
             arguments->socket = 1;
             break;
         }
+        case 'b': {
+            arguments->batch = 1;
+            break;
+        }
         case 'v': {
             arguments->verbose = 1;
             break;
@@ -66,6 +91,78 @@ parse_opt(int key, char *arg, struct argp_state *state) {
             arguments->listen_port = arg;
             break;
         }
+        case 'u': {
+            arguments->unix_path = arg;
+            break;
+        }
+        case 'O': {
+            arguments->optimize = arg;
+            break;
+        }
+        case 'o': {
+            arguments->out = arg;
+            break;
+        }
+        case 'R': {
+            arguments->no_reverse = 1;
+            break;
+        }
+        case 'r': {
+            arguments->render = arg;
+            break;
+        }
+        case 'S': {
+            arguments->stats = 1;
+            break;
+        }
+        case 'C': {
+            arguments->compare = arg;
+            break;
+        }
+        case 'G': {
+            arguments->golden = arg;
+            break;
+        }
+        case 'U': {
+            arguments->update = 1;
+            break;
+        }
+        case 'E': {
+            arguments->flight = arg;
+            break;
+        }
+        case 'J': {
+            arguments->job_cache = arg;
+            break;
+        }
+        case 'K': {
+            arguments->job_cache_size = arg;
+            break;
+        }
+        case 'F': {
+            arguments->fixed_point = 1;
+            break;
+        }
+        case 'B': {
+            arguments->planner = arg;
+            break;
+        }
+        case 'Z': {
+            arguments->async_z = 1;
+            break;
+        }
+        case 'D': {
+            arguments->rt_diag = 1;
+            break;
+        }
+        case 'M': {
+            arguments->rapid_microsteps = 1;
+            break;
+        }
+        case 'L': {
+            arguments->feed_limiter = 1;
+            break;
+        }
         default:
             return ARGP_ERR_UNKNOWN;
     }
@@ -97,8 +194,27 @@ int main(int argc, char *argv[]) {
                     .verbose = 0,
                     .daemon = 0,
                     .socket = 0,
+                    .batch = 0,
                     .listen_ip = COMM_LISTEN_ADDR,
                     .listen_port = COMM_LISTEN_PORT,
+                    .no_reverse = 0,
+                    .optimize = NULL,
+                    .out = NULL,
+                    .planner = NULL,
+                    .render = NULL,
+                    .unix_path = NULL,
+                    .stats = 0,
+                    .fixed_point = 0,
+                    .async_z = 0,
+                    .compare = NULL,
+                    .golden = NULL,
+                    .update = 0,
+                    .rt_diag = 0,
+                    .rapid_microsteps = 0,
+                    .feed_limiter = 0,
+                    .job_cache = NULL,
+                    .job_cache_size = NULL,
+                    .flight = NULL,
             };
 
     /* Parse arguments */
@@ -106,12 +222,47 @@ int main(int argc, char *argv[]) {
     verbose = arguments.verbose;
     settings.daemon = arguments.daemon;
     settings.cli.listen_port = (uint16_t) strtol(arguments.listen_port, NULL, 10);
-    struct in_addr listen_ip = settings.cli.listen_ip;
-    if (inet_pton(AF_INET, arguments.listen_ip, &listen_ip) == 0) {
+    if (inet_pton(AF_INET, arguments.listen_ip, &settings.cli.listen_ip) == 0) {
         perror("Invalid IP address");
         exit(-1);
     }
-    settings.cli.comm_mode = (uint8_t) ((arguments.socket) ? CLI_SOCKET : CLI_CONSOLE);
+    settings.cli.socket_path = arguments.unix_path;
+    settings.cli.comm_mode = (uint8_t) ((arguments.socket || arguments.unix_path) ? CLI_SOCKET : CLI_CONSOLE);
+    if (arguments.batch) { settings.cli.comm_mode = CLI_BATCH; }
+    settings.segment_generator = (uint8_t) ((arguments.fixed_point) ? SEGMENT_GENERATOR_FIXED
+                                                                    : SEGMENT_GENERATOR_FLOAT);
+    settings.async_z = arguments.async_z;
+    settings.rt_diag = arguments.rt_diag;
+    settings.rapid_microsteps = arguments.rapid_microsteps;
+    settings.feed_limiter = arguments.feed_limiter;
+    settings.job_cache_path = arguments.job_cache;
+    settings.flight_path = arguments.flight;
+    if (arguments.job_cache_size != NULL) {
+        settings.job_cache_size = (uint32_t) strtoul(arguments.job_cache_size, NULL, 10);
+    }
+    if (arguments.planner != NULL) {
+        if (strcmp(arguments.planner, "grbl") == 0) { settings.planner_backend = PLANNER_BACKEND_GRBL; }
+        else if (strcmp(arguments.planner, "curvature") == 0) { settings.planner_backend = PLANNER_BACKEND_CURVATURE; }
+        else {
+            fprintf(stderr, "Invalid planner backend %s\n", arguments.planner);
+            exit(-1);
+        }
+    }
+
+    // Offline modes run without the real time system
+    if (arguments.optimize != NULL) {
+        if (arguments.out == NULL) {
+            fprintf(stderr, "--optimize requires --out\n");
+            exit(-1);
+        }
+        exit((int) optimizer_run(arguments.optimize, arguments.out, !arguments.no_reverse));
+    }
+    if (arguments.render != NULL) {
+        exit((int) render_run(arguments.render, arguments.out, arguments.stats, arguments.compare));
+    }
+    if (arguments.golden != NULL) {
+        exit((int) render_golden(arguments.golden, arguments.update));
+    }
 
     // Turn over control to the loop
     ssize_t ret = 0;
@@ -0,0 +1,176 @@
+/**
+ * @file feed_limiter.c
+ * @brief Starvation-aware automatic feed limiting
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup motion
+ *
+ * @{
+ * @defgroup motion_feed_limiter Feed Limiter
+ *
+ * Watches how much motion is buffered ahead of the step generator. When the socket, parser and planner
+ * can't keep up with short segment motion, the lead runs out and the machine stutters at every buffer
+ * underrun. Before that happens, the feed override is stepped down so the machine runs slower but smoothly,
+ * then stepped back up as the buffers recover.
+ *
+ * Laser power is not scaled with the override, so a throttled cut gets more energy per mm. The limiter is off
+ * unless enabled with --feed-limiter.
+ *
+ * @{
+ */
+
+#include <time.h>
+#include "../openglow-cnc.h"
+
+/**
+ * @brief Feed override currently applied by the limiter
+ */
+static uint8_t feed_limit_override = DEFAULT_FEED_OVERRIDE;
+
+/**
+ * @brief True while the limiter is holding the feed below 100%
+ */
+static bool feed_limit_active = false;
+
+/**
+ * @brief Time of the last controller update (ms)
+ */
+static int64_t feed_limit_last_ms = 0;
+
+/**
+ * @brief Lead time at the last controller update (ms). Negative when the trend must be restarted.
+ */
+static float feed_limit_last_lead = -1.0;
+
+/**
+ * @brief Smoothed lead time trend (ms of lead gained per ms)
+ */
+static float feed_limit_trend = 0.0;
+
+/**
+ * @brief Planner append count at the last time it changed
+ */
+static uint32_t feed_limit_last_appended = 0;
+
+/**
+ * @brief Time the planner append count last changed (ms)
+ */
+static int64_t feed_limit_last_append_ms = 0;
+
+// Static function declarations
+static void _feed_limiter_apply(uint8_t feed_override);
+static int64_t _feed_limiter_now_ms();
+
+/**
+ * @brief Reset the limiter and restore the feed override
+ */
+void feed_limiter_reset() {
+    feed_limit_override = DEFAULT_FEED_OVERRIDE;
+    feed_limit_active = false;
+    feed_limit_last_lead = -1.0;
+    feed_limit_trend = 0.0;
+    metrics_set(METRIC_FEED_LIMIT_OVERRIDE, feed_limit_override);
+}
+
+/**
+ * @brief Run the feed limiter controller
+ *
+ * Called from the segment prep worker loop, outside the segment lock. Rate limited to FEED_LIMIT_PERIOD_MS.
+ *
+ * Lead time is the queued segments plus the planner buffer at nominal speed. Feed is reduced when the lead is
+ * low, or when its trend predicts it will run out within FEED_LIMIT_HORIZON_MS. It's only done while
+ * running and while the producer is still appending blocks. Otherwise an ending job would look like a
+ * starving one.
+ */
+void feed_limiter_update() {
+    int64_t now = _feed_limiter_now_ms();
+    if (now - feed_limit_last_ms < FEED_LIMIT_PERIOD_MS) { return; }
+    int64_t elapsed = now - feed_limit_last_ms;
+    feed_limit_last_ms = now;
+
+    uint32_t appended = plan_get_blocks_appended();
+    if (appended != feed_limit_last_appended) {
+        feed_limit_last_appended = appended;
+        feed_limit_last_append_ms = now;
+    }
+
+    if (!settings.feed_limiter || (sys_state != SYS_STATE_RUN)) {
+        // Nothing is moving, so the override can be restored at once.
+        if (sys_state != SYS_STATE_HOLD && feed_limit_override != DEFAULT_FEED_OVERRIDE) {
+            if (verbose) printf("feed_limiter_update: not running, feed restored to %d%%\n", DEFAULT_FEED_OVERRIDE);
+            _feed_limiter_apply(DEFAULT_FEED_OVERRIDE);
+            feed_limit_active = false;
+        }
+        feed_limit_last_lead = -1.0;
+        return;
+    }
+
+    segment_lock();
+    float lead = segment_queued_time() + plan_get_lead_time();
+    segment_unlock();
+
+    if (feed_limit_last_lead < 0.0) {
+        feed_limit_trend = 0.0;
+    } else {
+        feed_limit_trend = 0.7 * feed_limit_trend + 0.3 * ((lead - feed_limit_last_lead) / elapsed);
+    }
+    feed_limit_last_lead = lead;
+
+    bool producer_active = (now - feed_limit_last_append_ms) < FEED_LIMIT_PRODUCER_IDLE_MS;
+    if (producer_active) { metrics_min(METRIC_FEED_LIMIT_MIN_LEAD, (uint32_t) lead); }
+
+    bool starving = (lead < FEED_LIMIT_LOW_LEAD_MS) ||
+                    ((feed_limit_trend < 0.0) && ((lead / -feed_limit_trend) < FEED_LIMIT_HORIZON_MS));
+
+    if (producer_active && starving) {
+        if (feed_limit_override <= FEED_LIMIT_MIN_OVERRIDE) { return; }
+        if (!feed_limit_active) {
+            feed_limit_active = true;
+            metrics_inc(METRIC_FEED_LIMIT_EVENTS);
+        }
+        uint8_t feed_override = (uint8_t) max(FEED_LIMIT_MIN_OVERRIDE, feed_limit_override - FEED_LIMIT_STEP_DOWN);
+        if (verbose) printf("feed_limiter_update: lead %1.1fms, trend %1.3f, feed reduced to %d%%\n",
+                            lead, feed_limit_trend, feed_override);
+        metrics_inc(METRIC_FEED_LIMIT_STEPS_DOWN);
+        metrics_min(METRIC_FEED_LIMIT_MIN_OVERRIDE, feed_override);
+        _feed_limiter_apply(feed_override);
+    } else if (feed_limit_active &&
+               (!producer_active || ((lead > FEED_LIMIT_HIGH_LEAD_MS) && (feed_limit_trend >= 0.0)))) {
+        uint8_t feed_override = (uint8_t) min(DEFAULT_FEED_OVERRIDE, feed_limit_override + FEED_LIMIT_STEP_UP);
+        if (verbose) printf("feed_limiter_update: lead %1.1fms, feed restored to %d%%\n", lead, feed_override);
+        metrics_inc(METRIC_FEED_LIMIT_STEPS_UP);
+        _feed_limiter_apply(feed_override);
+        if (feed_override == DEFAULT_FEED_OVERRIDE) { feed_limit_active = false; }
+    }
+}
+
+/**
+ * @brief Apply a new feed override
+ *
+ * Changing the override rescales the planner lead, so the trend is restarted.
+ * @param feed_override Feed override in percent
+ */
+static void _feed_limiter_apply(uint8_t feed_override) {
+    feed_limit_override = feed_override;
+    plan_feed_override_set(feed_override);
+    metrics_set(METRIC_FEED_LIMIT_OVERRIDE, feed_override);
+    feed_limit_last_lead = -1.0;
+}
+
+/**
+ * @brief Monotonic clock in ms
+ * @return Current time (ms)
+ */
+static int64_t _feed_limiter_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/** @} */
+/** @} */
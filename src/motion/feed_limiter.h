@@ -0,0 +1,36 @@
+/**
+ * @file feed_limiter.h
+ * @brief Starvation-aware automatic feed limiting
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup motion_feed_limiter
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_FEED_LIMITER_H
+#define OPENGLOW_CNC_FEED_LIMITER_H
+
+#include "../common.h"
+
+#define FEED_LIMIT_PERIOD_MS        10      // Controller update period (ms)
+#define FEED_LIMIT_LOW_LEAD_MS      60      // Reduce feed when buffered motion drops below this (ms)
+#define FEED_LIMIT_HIGH_LEAD_MS     250     // Restore feed once buffered motion is back above this (ms)
+#define FEED_LIMIT_HORIZON_MS       100     // Reduce feed when the lead is predicted to hit zero within this (ms)
+#define FEED_LIMIT_PRODUCER_IDLE_MS 250     // No new blocks for this long means the stream ended, not starved (ms)
+#define FEED_LIMIT_MIN_OVERRIDE     30      // Lowest feed override the limiter will apply (%)
+#define FEED_LIMIT_STEP_DOWN        10      // Override reduction per period (%)
+#define FEED_LIMIT_STEP_UP          5       // Override restoration per period (%)
+
+void feed_limiter_reset();
+
+void feed_limiter_update();
+
+#endif //OPENGLOW_CNC_FEED_LIMITER_H
+
+/** @} */
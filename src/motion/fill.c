@@ -0,0 +1,394 @@
+/**
+ * @file fill.c
+ * @brief Hatch fill
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup motion
+ *
+ * @{
+ * @defgroup motion_fill Hatch Fill
+ *
+ * Fills closed shapes with hatch lines computed on the machine, so an area fill is sent as its outline rather
+ * than as thousands of G1 lines. Sent with $FILL=, in order with the G-Code around it:
+ *
+ * - $FILL=P x,y x,y ...: Start a contour with these points
+ * - $FILL=C x,y ...: Add points to the last contour, for outlines longer than a line
+ * - $FILL=A<angle>D<spacing>B<0|1>S<power>F<feed>: Fill the contours, then forget them
+ * - $FILL=: Forget the contours
+ *
+ * Contours are closed, and filled by the even-odd rule, so a contour inside another is a hole. Points are
+ * absolute job coordinates (mm), placed by the placement transform like any other line. The hatch lines run at
+ * A degrees counterclockwise from X (default 0), D mm apart. B1, the default, burns alternate lines in
+ * opposite directions. S and F are the laser power and feed rate of the burn.
+ *
+ * The contours are rotated so the hatch lines are horizontal, and their edges sorted by their lowest point.
+ * Each scanline takes in the edges starting below it, drops those ending below it, and keeps the active edges
+ * sorted by where they cross it. The crossings move little from one scanline to the next, so the insertion
+ * sort is nearly linear. Crossings are paired into spans, and each span is handed to gc_execute_words() as a
+ * rapid to its start and a burn to its end, as soon as its scanline is computed. That blocks on the planner
+ * like any other line, so the fill is computed only as fast as the machine burns it.
+ *
+ * The fill runs in G21 G90 G94 M4, at its S and F, and turns the laser off (M5) when it ends. The parser modes,
+ * feed rate and power are then restored, so the G-Code after it runs as if the fill wasn't there, from where
+ * the fill ended. An error discards the contours.
+ *
+ * @{
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../openglow-cnc.h"
+
+/**
+ * @brief Contour edge, in scanline coordinates
+ */
+typedef struct {
+    float v0;   /*!< Lowest point, across the scanlines (mm) */
+    float v1;   /*!< Highest point, across the scanlines (mm) */
+    float u0;   /*!< Position along the scanlines at v0 (mm) */
+    float dudv; /*!< Change along the scanlines, per mm across them */
+    float u;    /*!< Crossing of the current scanline (mm) */
+} fill_edge_t;
+
+/**
+ * @brief Contour points (mm)
+ */
+static float fill_points[FILL_MAX_POINTS][2];
+
+/**
+ * @brief First point of each contour
+ */
+static uint16_t fill_contours[FILL_MAX_CONTOURS];
+
+/**
+ * @brief Points stored
+ */
+static uint16_t fill_n_points = 0;
+
+/**
+ * @brief Contours stored
+ */
+static uint16_t fill_n_contours = 0;
+
+/**
+ * @brief Edge table, sorted by lowest point
+ */
+static fill_edge_t fill_edges[FILL_MAX_POINTS];
+
+/**
+ * @brief Active edges, sorted by their crossing of the current scanline
+ */
+static uint16_t fill_active[FILL_MAX_POINTS];
+
+// Static function declarations
+static int _fill_edge_compare(const void *a, const void *b);
+static uint16_t _fill_edges(float c, float s, float *v_min, float *v_max);
+static uint8_t _fill_move(uint8_t motion, float u, float v, float c, float s);
+static uint8_t _fill_points(char *text, bool start);
+static uint8_t _fill_run(char *args);
+static uint8_t _fill_scanline(float v, uint16_t *next, uint16_t n_edges, uint16_t *n_active, bool reverse,
+                              float c, float s, uint32_t *spans);
+
+/**
+ * @brief Run a $FILL= command
+ * @param args Command arguments, as received
+ * @return Status code
+ */
+uint8_t fill_command(char *args) {
+    while ((*args == ' ') || (*args == '\t')) { args++; }
+    uint8_t status;
+    switch (*args) {
+        case '\0':
+            fill_reset();
+            return STATUS_OK;
+        case 'P':
+        case 'p':
+            status = _fill_points(&args[1], true);
+            break;
+        case 'C':
+        case 'c':
+            status = _fill_points(&args[1], false);
+            break;
+        default:
+            status = _fill_run(args);
+            fill_reset();
+            return status;
+    }
+    if (status != STATUS_OK) { fill_reset(); }
+    return status;
+}
+
+/**
+ * @brief Forget the contours
+ */
+void fill_reset() {
+    fill_n_points = 0;
+    fill_n_contours = 0;
+}
+
+/**
+ * @brief Order edges by lowest point
+ * @param a Edge
+ * @param b Edge
+ * @return Negative, zero or positive, as a is below, level with or above b
+ */
+static int _fill_edge_compare(const void *a, const void *b) {
+    float v_a = ((const fill_edge_t *) a)->v0;
+    float v_b = ((const fill_edge_t *) b)->v0;
+    return (v_a > v_b) - (v_a < v_b);
+}
+
+/**
+ * @brief Build the edge table
+ *
+ * Rotates the contours into scanline coordinates, u along the hatch lines and v across them. Edges along a
+ * scanline never cross one, and are left out.
+ * @param c Cosine of the hatch angle
+ * @param s Sine of the hatch angle
+ * @param v_min Lowest point output (mm)
+ * @param v_max Highest point output (mm)
+ * @return Edges in the table
+ */
+static uint16_t _fill_edges(float c, float s, float *v_min, float *v_max) {
+    uint16_t n_edges = 0;
+    *v_min = INFINITY;
+    *v_max = -INFINITY;
+    for (uint16_t k = 0; k < fill_n_contours; k++) {
+        uint16_t first = fill_contours[k];
+        uint16_t last = (uint16_t) ((k + 1 < fill_n_contours) ? fill_contours[k + 1] : fill_n_points);
+        for (uint16_t p = first; p < last; p++) {
+            uint16_t q = (uint16_t) ((p + 1 < last) ? p + 1 : first);
+            float u_a = fill_points[p][0] * c + fill_points[p][1] * s;
+            float v_a = fill_points[p][1] * c - fill_points[p][0] * s;
+            float u_b = fill_points[q][0] * c + fill_points[q][1] * s;
+            float v_b = fill_points[q][1] * c - fill_points[q][0] * s;
+            if (v_a < *v_min) { *v_min = v_a; }
+            if (v_a > *v_max) { *v_max = v_a; }
+            if (v_a == v_b) { continue; }
+            fill_edge_t *edge = &fill_edges[n_edges++];
+            if (v_a < v_b) {
+                edge->v0 = v_a;
+                edge->v1 = v_b;
+                edge->u0 = u_a;
+            } else {
+                edge->v0 = v_b;
+                edge->v1 = v_a;
+                edge->u0 = u_b;
+            }
+            edge->dudv = (u_b - u_a) / (v_b - v_a);
+        }
+    }
+    qsort(fill_edges, n_edges, sizeof(fill_edge_t), _fill_edge_compare);
+    return n_edges;
+}
+
+/**
+ * @brief Move to a point in scanline coordinates
+ * @param motion G0 or G1
+ * @param u Position along the scanlines (mm)
+ * @param v Position across the scanlines (mm)
+ * @param c Cosine of the hatch angle
+ * @param s Sine of the hatch angle
+ * @return Status code
+ */
+static uint8_t _fill_move(uint8_t motion, float u, float v, float c, float s) {
+    gc_word_t words[] = {
+            {'G', motion},
+            {'X', u * c - v * s},
+            {'Y', u * s + v * c},
+    };
+    return gc_execute_words(words, 3);
+}
+
+/**
+ * @brief Add contour points
+ * @param text Points, as x,y pairs separated by spaces
+ * @param start Start a new contour with the points
+ * @return Status code
+ */
+static uint8_t _fill_points(char *text, bool start) {
+    if (start) {
+        if (fill_n_contours >= FILL_MAX_CONTOURS) { return STATUS_OVERFLOW; }
+        fill_contours[fill_n_contours++] = fill_n_points;
+    } else if (fill_n_contours == 0) {
+        return STATUS_INVALID_STATEMENT;
+    }
+    char *next = text;
+    while (true) {
+        while ((*next == ' ') || (*next == '\t')) { next++; }
+        if (*next == '\0') { return STATUS_OK; }
+        char *end;
+        float x = strtof(next, &end);
+        if ((end == next) || (*end != ',')) { return STATUS_BAD_NUMBER_FORMAT; }
+        next = end + 1;
+        float y = strtof(next, &end);
+        if ((end == next) || ((*end != '\0') && (*end != ' ') && (*end != '\t'))) {
+            return STATUS_BAD_NUMBER_FORMAT;
+        }
+        next = end;
+        if (fill_n_points >= FILL_MAX_POINTS) { return STATUS_OVERFLOW; }
+        fill_points[fill_n_points][0] = x;
+        fill_points[fill_n_points][1] = y;
+        fill_n_points++;
+    }
+}
+
+/**
+ * @brief Fill the contours
+ * @param args A, D, B, S and F words
+ * @return Status code
+ */
+static uint8_t _fill_run(char *args) {
+    char buf[CLI_LINE_LENGTH] = {0};
+    gc_word_t words[GC_MAX_WORDS];
+    uint8_t n_words;
+    gc_process_line(args, buf);
+    uint8_t status = gc_parse_line(buf, words, &n_words);
+    if (status != STATUS_OK) { return status; }
+    float angle = 0.0, spacing = 0.0, bidirectional = 1.0, power = 0.0, feed = 0.0;
+    uint8_t seen = 0;
+    for (uint8_t w = 0; w < n_words; w++) {
+        uint8_t word_bit;
+        switch (words[w].letter) {
+            case 'A':
+                word_bit = bit(0);
+                angle = words[w].value;
+                break;
+            case 'D':
+                word_bit = bit(1);
+                spacing = words[w].value;
+                break;
+            case 'B':
+                word_bit = bit(2);
+                bidirectional = words[w].value;
+                break;
+            case 'S':
+                word_bit = bit(3);
+                power = words[w].value;
+                break;
+            case 'F':
+                word_bit = bit(4);
+                feed = words[w].value;
+                break;
+            default:
+                return STATUS_UNUSED_WORDS;
+        }
+        if (seen & word_bit) { return STATUS_WORD_REPEATED; }
+        seen |= word_bit;
+    }
+    if (!(seen & bit(1)) || !(seen & bit(3))) { return STATUS_VALUE_WORD_MISSING; }
+    if (!(seen & bit(4))) { return STATUS_UNDEFINED_FEED_RATE; }
+    if ((spacing <= 0.0) || (power < 0.0) || (feed <= 0.0)) { return STATUS_NEGATIVE_VALUE; }
+    if ((bidirectional != 0.0) && (bidirectional != 1.0)) { return STATUS_COMMAND_VALUE_NOT_INTEGER; }
+    if (fill_n_contours == 0) { return STATUS_INVALID_STATEMENT; }
+    for (uint16_t k = 0; k < fill_n_contours; k++) {
+        uint16_t last = (uint16_t) ((k + 1 < fill_n_contours) ? fill_contours[k + 1] : fill_n_points);
+        if (last - fill_contours[k] < 3) { return STATUS_INVALID_STATEMENT; }
+    }
+
+    float radians = angle * (float) (M_PI / 180.0);
+    float c = cosf(radians);
+    float s = sinf(radians);
+    float v_min, v_max;
+    uint16_t n_edges = _fill_edges(c, s, &v_min, &v_max);
+    // Scanlines sit on a grid fixed in job coordinates, so fills that meet line up
+    float v_start = (floorf(v_min / spacing) + 0.5f) * spacing;
+    if (v_start < v_min) { v_start += spacing; }
+    if ((v_max - v_start) / spacing >= FILL_MAX_LINES) { return STATUS_MAX_VALUE_EXCEEDED; }
+
+    gc_modes_t modes;
+    gc_modes_save(&modes);
+    gc_word_t setup[] = {
+            {'G', 21},
+            {'G', 90},
+            {'G', 94},
+            {'M', 4},
+            {'S', power},
+            {'F', feed},
+    };
+    if ((status = gc_execute_words(setup, 6)) != STATUS_OK) {
+        gc_modes_restore(&modes);
+        return status;
+    }
+
+    uint16_t next = 0, n_active = 0;
+    uint32_t lines = 0, spans = 0;
+    bool reverse = false;
+    for (uint32_t line = 0; status == STATUS_OK; line++) {
+        float v = v_start + line * spacing;
+        if (v >= v_max) { break; }
+        if ((sys_state == SYS_STATE_FAULT) || (sys_state == SYS_STATE_ALARM)) {
+            status = STATUS_SYSTEM_GC_LOCK;
+            break;
+        }
+        uint32_t burned = spans;
+        status = _fill_scanline(v, &next, n_edges, &n_active, reverse, c, s, &spans);
+        if (spans > burned) {
+            lines++;
+            if (bidirectional != 0.0) { reverse = !reverse; }
+        }
+    }
+
+    gc_word_t laser_off[] = {{'M', 5}};
+    uint8_t off_status = gc_execute_words(laser_off, 1);
+    gc_modes_restore(&modes);
+    if (verbose) printf("fill: %u contours, %u edges, %u lines, %u spans\n", fill_n_contours, n_edges, lines, spans);
+    return (status != STATUS_OK) ? status : off_status;
+}
+
+/**
+ * @brief Burn the spans of one scanline
+ * @param v Scanline position (mm)
+ * @param next Next edge in the edge table to take in. Updated.
+ * @param n_edges Edges in the edge table
+ * @param n_active Active edges. Updated.
+ * @param reverse Burn the scanline from high u to low
+ * @param c Cosine of the hatch angle
+ * @param s Sine of the hatch angle
+ * @param spans Spans burned. Updated.
+ * @return Status code
+ */
+static uint8_t _fill_scanline(float v, uint16_t *next, uint16_t n_edges, uint16_t *n_active, bool reverse,
+                              float c, float s, uint32_t *spans) {
+    // Take in the edges starting at or below the scanline
+    while ((*next < n_edges) && (fill_edges[*next].v0 <= v)) { fill_active[(*n_active)++] = (*next)++; }
+
+    // Drop the edges ending at or below it, so a vertex is crossed once, and keep the rest sorted by crossing
+    uint16_t n = 0;
+    for (uint16_t a = 0; a < *n_active; a++) {
+        uint16_t e = fill_active[a];
+        fill_edge_t *edge = &fill_edges[e];
+        if (edge->v1 <= v) { continue; }
+        edge->u = edge->u0 + (v - edge->v0) * edge->dudv;
+        uint16_t i = n++;
+        while ((i > 0) && (fill_edges[fill_active[i - 1]].u > edge->u)) {
+            fill_active[i] = fill_active[i - 1];
+            i--;
+        }
+        fill_active[i] = e;
+    }
+    *n_active = n;
+
+    // Even-odd: each pair of crossings bounds a span inside the shape
+    uint16_t n_spans = (uint16_t) (n / 2);
+    for (uint16_t k = 0; k < n_spans; k++) {
+        uint16_t span = reverse ? (uint16_t) (n_spans - 1 - k) : k;
+        float u_a = fill_edges[fill_active[2 * span]].u;
+        float u_b = fill_edges[fill_active[2 * span + 1]].u;
+        if (u_b - u_a < FILL_MIN_SPAN) { continue; }
+        uint8_t status;
+        if ((status = _fill_move(MOTION_MODE_SEEK, reverse ? u_b : u_a, v, c, s)) != STATUS_OK) { return status; }
+        if ((status = _fill_move(MOTION_MODE_LINEAR, reverse ? u_a : u_b, v, c, s)) != STATUS_OK) { return status; }
+        (*spans)++;
+    }
+    return STATUS_OK;
+}
+
+/** @} */
+/** @} */
@@ -0,0 +1,32 @@
+/**
+ * @file fill.h
+ * @brief Hatch fill
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup motion_fill
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_FILL_H
+#define OPENGLOW_CNC_FILL_H
+
+#include "../common.h"
+
+#define FILL_MAX_POINTS     8192    // Points, across all contours of a fill. Also the most edges.
+#define FILL_MAX_CONTOURS   256     // Contours in a fill
+#define FILL_MAX_LINES      1000000 // Most scanlines in a fill
+#define FILL_MIN_SPAN       0.001   // Shorter hatch spans are not burned (mm)
+
+uint8_t fill_command(char *args);
+
+void fill_reset();
+
+#endif //OPENGLOW_CNC_FILL_H
+
+/** @} */
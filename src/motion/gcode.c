@@ -24,8 +24,10 @@
 
 #include <alchemy/task.h>
 #include <alchemy/queue.h>
+#include <errno.h>
 #include <math.h>
 #include <memory.h>
+#include <semaphore.h>
 #include "../openglow-cnc.h"
 #include "grbl_glue.h"
 
@@ -79,22 +81,6 @@ enum WORD {
     WORD_Z,
 };
 
-// NOTE: When this struct is zeroed, the above defines set the defaults for the system.
-/**
- * @brief Modal values for current G-Code command
- */
-typedef struct {
-    uint8_t motion;          /*!< {G0,G1,G2,G3,G38.2,G80} */
-    uint8_t feed_rate;       /*!< {G93,G94} */
-    uint8_t units;           /*!< {G20,G21} */
-    uint8_t distance;        /*!< {G90,G91} */
-    uint8_t plane_select;    /*!< {G17,G18,G19} */
-    uint8_t coord_select;    /*!< {G54,G55,G56,G57,G58,G59} */
-    uint8_t program_flow;    /*!< {M0,M1,M2,M30} */
-    uint8_t coolant;         /*!< {M7,M8,M9} */
-    uint8_t spindle;         /*!< {M3,M4,M5} */
-} gc_modal_t;
-
 /**
  * @brief Hold values for current G-Code command
  */
@@ -141,6 +127,27 @@ typedef struct {
  */
 parser_block_t gc_block;
 
+/**
+ * @brief G-Code parser queue entry
+ *
+ * Passed by value, so the sender's buffer can be reused as soon as the line is queued.
+ */
+typedef struct {
+    uint32_t line_id;           /*!< Line ID, from the receive sequence */
+    uint8_t command;            /*!< enum GC_COMMANDS */
+    char line[CLI_LINE_LENGTH]; /*!< Groomed G-Code line, or command arguments */
+} gc_line_t;
+
+/**
+ * @brief Receive sequence, the source of line IDs
+ */
+static uint32_t gc_line_seq = 0;
+
+/**
+ * @brief ID of the line being executed
+ */
+static uint32_t gc_exec_line_id = 0;
+
 /**
  * @brief G-Code Parser loop real time task
  */
@@ -151,22 +158,50 @@ static RT_TASK rt_gc_loop_task;
  */
 static RT_QUEUE rt_gc_queue;
 
+/**
+ * @brief Free slots in the G-Code Parser inbound queue
+ */
+static sem_t gc_queue_slots;
+
+/**
+ * @brief Posted by the parser task when it reaches a GC_COMMAND_SYNC entry
+ */
+static sem_t gc_queue_synced;
+
 // Static function declarations
+static uint8_t _gc_command(gc_line_t *entry);
+static void _gc_line_tag(gc_line_t *entry, char *line);
 static void _gc_loop();
-uint8_t _gc_execute_line(char *line);
+static ssize_t _gc_queue(gc_line_t *entry);
 
 /**
  * @brief Executes one line of 0-terminated G-Code.
  *
  * Executes one line of 0-terminated G-Code. The line is assumed to contain only uppercase
  * characters and signed floating point values (no whitespace). Comments and block delete
- * characters have been removed. In this function, all units and positions are converted and
- * exported to grbl's internal functions in terms of (mm, mm/min) and absolute machine
- * coordinates, respectively.
- * @param line
- * @return
+ * characters have been removed. The words are imported, and executed by gc_execute_words().
+ * @param line Groomed G-Code line
+ * @return Status code
  */
-uint8_t _gc_execute_line(char *line) {
+uint8_t gc_execute_line(char *line) {
+    gc_word_t words[GC_MAX_WORDS];
+    uint8_t n_words = 0;
+    uint8_t status = gc_parse_line(line, words, &n_words);
+    if (status != STATUS_OK) { return status; }
+    return gc_execute_words(words, n_words);
+}
+
+/**
+ * @brief Executes one block of G-Code words.
+ *
+ * Executes one block of G-Code words, imported from a line by gc_execute_line(), or evaluated by the ngc
+ * interpreter. In this function, all units and positions are converted and exported to grbl's internal
+ * functions in terms of (mm, mm/min) and absolute machine coordinates, respectively.
+ * @param words Words of the block, in line order
+ * @param n_words Number of words
+ * @return Status code
+ */
+uint8_t gc_execute_words(gc_word_t *words, uint8_t n_words) {
     /* -------------------------------------------------------------------------------------
        STEP 1: Initialize parser block struct and copy current g-code state modes. The parser
        updates these modes and commands as the block line is parser and will only be used and
@@ -190,26 +225,20 @@ uint8_t _gc_execute_line(char *line) {
     uint8_t gc_parser_flags = GC_PARSER_NONE;
 
     /* -------------------------------------------------------------------------------------
-       STEP 2: Import all g-code words in the block line. A g-code word is a letter followed by
+       STEP 2: Import all g-code words in the block. A g-code word is a letter followed by
        a number, which can either be a 'G'/'M' cli or sets/assigns a cli value. Also,
        perform initial error-checks for cli word modal group violations, for any repeated
        words, and for negative values set for the value words F, N, P, T, and S. */
 
     uint8_t word_bit; // Bit-value for assigning tracking variables
-    uint8_t char_counter;
     char letter;
     float value;
     uint8_t int_value = 0;
     uint16_t mantissa = 0;
-    char_counter = 0;
-
-    while (line[char_counter] != 0) { // Loop until no more g-code words in line.
 
-        // Import the next g-code word, expecting a letter followed by a value. Otherwise, error out.
-        letter = line[char_counter];
-        if ((letter < 'A') || (letter > 'Z')) { return STATUS_EXPECTED_COMMAND_LETTER; } // [Expected word letter]
-        char_counter++;
-        if (!read_float(line, &char_counter, &value)) { return STATUS_BAD_NUMBER_FORMAT; } // [Expected word value]
+    for (uint8_t word = 0; word < n_words; word++) { // Loop until no more g-code words in block.
+        letter = words[word].letter;
+        value = words[word].value;
 
         /* Convert values to smaller uint8 significance and mantissa values for parsing this word.
            NOTE: Mantissa is multiplied by 100 to catch non-integer cli values. This is more
@@ -334,8 +363,8 @@ uint8_t _gc_execute_line(char *line) {
                 } // [Unsupported or invalid Gxx.x cli]
                 // Check for more than one cli per modal group violations in the current block
                 // NOTE: Variable 'word_bit' is always assigned, if the cli is valid.
-                if (bit_istrue(command_words, bit(word_bit))) { return STATUS_MODAL_GROUP_VIOLATION; }
-                command_words |= bit(word_bit);
+                if (bit_istrue(command_words, bit16(word_bit))) { return STATUS_MODAL_GROUP_VIOLATION; }
+                command_words |= bit16(word_bit);
                 break;
 
             case 'M':
@@ -391,8 +420,8 @@ uint8_t _gc_execute_line(char *line) {
 
                 // Check for more than one cli per modal group violations in the current block
                 // NOTE: Variable 'word_bit' is always assigned, if the cli is valid.
-                if (bit_istrue(command_words, bit(word_bit))) { return STATUS_MODAL_GROUP_VIOLATION; }
-                command_words |= bit(word_bit);
+                if (bit_istrue(command_words, bit16(word_bit))) { return STATUS_MODAL_GROUP_VIOLATION; }
+                command_words |= bit16(word_bit);
                 break;
 
                 // NOTE: All remaining letters assign values.
@@ -468,13 +497,13 @@ uint8_t _gc_execute_line(char *line) {
                 }
 
                 // NOTE: Variable 'word_bit' is always assigned, if the non-cli letter is valid.
-                if (bit_istrue(value_words, bit(word_bit))) { return STATUS_WORD_REPEATED; } // [Word repeated]
+                if (bit_istrue(value_words, bit16(word_bit))) { return STATUS_WORD_REPEATED; } // [Word repeated]
                 // Check for invalid negative values for words F, N, P, T, and S.
                 // NOTE: Negative value check is done here simply for code-efficiency.
-                if (bit(word_bit) & (bit(WORD_F) | bit(WORD_N) | bit(WORD_P) | bit(WORD_T) | bit(WORD_S))) {
+                if (bit16(word_bit) & (bit16(WORD_F) | bit16(WORD_N) | bit16(WORD_P) | bit16(WORD_T) | bit16(WORD_S))) {
                     if (value < 0.0) { return STATUS_NEGATIVE_VALUE; } // [Word value cannot be negative]
                 }
-                value_words |= bit(word_bit); // Flag to indicate parameter assigned.
+                value_words |= bit16(word_bit); // Flag to indicate parameter assigned.
 
         }
     }
@@ -516,13 +545,13 @@ uint8_t _gc_execute_line(char *line) {
     }
 
     // Check for valid line number N value.
-    if (bit_istrue(value_words, bit(WORD_N))) {
+    if (bit_istrue(value_words, bit16(WORD_N))) {
         // Line number value cannot be less than zero (done) or greater than max line number.
         if (gc_block.values.n > MAX_G_CODE_LINE_NUMBER) {
             return STATUS_INVALID_LINE_NUMBER;
         } // [Exceeds max line number]
     }
-    // bit_false(value_words,bit(WORD_N)); // NOTE: Single-meaning value word. Set at end of error-checking.
+    // bit_false(value_words,bit16(WORD_N)); // NOTE: Single-meaning value word. Set at end of error-checking.
 
     /* Track for unused words at the end of error-checking.
        NOTE: Single-meaning value words are removed all at once at the end of error-checking, because
@@ -539,7 +568,7 @@ uint8_t _gc_execute_line(char *line) {
         // NOTE: G38 can also operate in inverse time, but is undefined as an error. Missing F word check added here.
         if (axis_command == AXIS_COMMAND_MOTION_MODE) {
             if ((gc_block.modal.motion != MOTION_MODE_NONE) && (gc_block.modal.motion != MOTION_MODE_SEEK)) {
-                if (bit_isfalse(value_words, bit(WORD_F))) {
+                if (bit_isfalse(value_words, bit16(WORD_F))) {
                     return STATUS_UNDEFINED_FEED_RATE;
                 } // [F word missing]
             }
@@ -559,18 +588,18 @@ uint8_t _gc_execute_line(char *line) {
     } else { // = G94
         // - In units per mm mode: If F word passed, ensure value is in mm/min, otherwise push last state value.
         if (gc_state.modal.feed_rate == FEED_RATE_MODE_UNITS_PER_MIN) { // Last state is also G94
-            if (bit_istrue(value_words, bit(WORD_F))) {
+            if (bit_istrue(value_words, bit16(WORD_F))) {
                 if (gc_block.modal.units == UNITS_MODE_INCHES) { gc_block.values.f *= MM_PER_INCH; }
             } else {
                 gc_block.values.f = gc_state.feed_rate; // Push last state feed rate
             }
         } // Else, switching to G94 from G93, so don't push last state feed rate. Its undefined or the passed F word value.
     }
-    // bit_false(value_words,bit(WORD_F)); // NOTE: Single-meaning value word. Set at end of error-checking.
+    // bit_false(value_words,bit16(WORD_F)); // NOTE: Single-meaning value word. Set at end of error-checking.
 
     // [4. Set spindle speed ]: S is negative (done.)
-    if (bit_isfalse(value_words, bit(WORD_S))) { gc_block.values.s = gc_state.spindle_speed; }
-    // bit_false(value_words,bit(WORD_S)); // NOTE: Single-meaning value word. Set at end of error-checking.
+    if (bit_isfalse(value_words, bit16(WORD_S))) { gc_block.values.s = gc_state.spindle_speed; }
+    // bit_false(value_words,bit16(WORD_S)); // NOTE: Single-meaning value word. Set at end of error-checking.
 
     // [5. Select tool ]: NOT SUPPORTED.
     // [6. Change tool ]: N/A
@@ -579,8 +608,8 @@ uint8_t _gc_execute_line(char *line) {
     // [9. Override control ]: Not supported except for a Grbl-only parking motion override control.
     // [10. Dwell ]: P value missing. P is negative (done.) NOTE: See below.
     if (gc_block.non_modal_command == NON_MODAL_DWELL) {
-        if (bit_isfalse(value_words, bit(WORD_P))) { return STATUS_VALUE_WORD_MISSING; } // [P word missing]
-        bit_false(value_words, bit(WORD_P));
+        if (bit_isfalse(value_words, bit16(WORD_P))) { return STATUS_VALUE_WORD_MISSING; } // [P word missing]
+        bit_false(value_words, bit16(WORD_P));
     }
 
     // [11. Set active plane ]: N/A
@@ -683,8 +712,8 @@ uint8_t _gc_execute_line(char *line) {
                     y = gc_block.values.xyz[axis_1] -
                         gc_state.position[axis_1]; // Delta y between current position and target
 
-                    if (value_words & bit(WORD_R)) { // Arc Radius Mode
-                        bit_false(value_words, bit(WORD_R));
+                    if (value_words & bit16(WORD_R)) { // Arc Radius Mode
+                        bit_false(value_words, bit16(WORD_R));
                         if (isequal_position_vector(gc_state.position, gc_block.values.xyz)) {
                             return STATUS_INVALID_TARGET;
                         } // [Invalid target]
@@ -781,7 +810,7 @@ uint8_t _gc_execute_line(char *line) {
                         if (!(ijk_words & (bit(axis_0) | bit(axis_1)))) {
                             return STATUS_NO_OFFSETS_IN_PLANE;
                         } // [No offsets in plane]
-                        bit_false(value_words, (bit(WORD_I) | bit(WORD_J) | bit(WORD_K)));
+                        bit_false(value_words, (bit16(WORD_I) | bit16(WORD_J) | bit16(WORD_K)));
 
                         // Convert IJK values to proper units.
                         if (gc_block.modal.units == UNITS_MODE_INCHES) {
@@ -819,8 +848,8 @@ uint8_t _gc_execute_line(char *line) {
     // [0. Non-specific error-checks]: Complete unused value words check, i.e. IJK used when in arc
     // radius mode, or axis words that aren't used in the block.
     bit_false(value_words,
-              (bit(WORD_N) | bit(WORD_F) | bit(WORD_S) | bit(WORD_T))); // Remove single-meaning value words.
-    if (axis_command) { bit_false(value_words, (bit(WORD_X) | bit(WORD_Y) | bit(WORD_Z))); } // Remove axis words.
+              (bit16(WORD_N) | bit16(WORD_F) | bit16(WORD_S) | bit16(WORD_T))); // Remove single-meaning value words.
+    if (axis_command) { bit_false(value_words, (bit16(WORD_X) | bit16(WORD_Y) | bit16(WORD_Z))); } // Remove axis words.
     if (value_words) { return STATUS_UNUSED_WORDS; } // [Unused words]
 
     /* -------------------------------------------------------------------------------------
@@ -833,6 +862,7 @@ uint8_t _gc_execute_line(char *line) {
     plan_line_data_t plan_data;
     plan_line_data_t *pl_data = &plan_data;
     memset(pl_data, 0, sizeof(plan_line_data_t)); // Zero pl_data struct
+    pl_data->line_id = gc_exec_line_id;
 
     // If in laser mode, setup laser power based on current and past parser conditions.
     if (settings.laser_power_correction) {
@@ -868,6 +898,7 @@ uint8_t _gc_execute_line(char *line) {
     // [0. Non-specific/common error-checks and miscellaneous setup]:
     // NOTE: If no line number is present, the value is zero.
     gc_state.line_number = gc_block.values.n;
+    latency_stamp(gc_exec_line_id, LAT_PARSED, latency_now());
     // [1. Comments feedback ]:  NOT SUPPORTED
 
     // [2. Set feed rate mode ]:
@@ -997,13 +1028,14 @@ uint8_t _gc_execute_line(char *line) {
 //                laser_set_state(LASER_DISABLE, 0.0);
 //            }
             message_feedback(MESSAGE_PROGRAM_END);
+            ngc_program_end();
         }
         gc_state.modal.program_flow = PROGRAM_FLOW_RUNNING; // Reset program flow.
     }
 
     // Execute line, if in mdi_mode mode
     if (settings.cli.mdi_mode) {
-        if (verbose) printf("_gc_execute_line: mdi mode wait for run\n");
+        if (verbose) printf("gc_execute_words: mdi mode wait for run\n");
         fsm_request(SYS_STATE_RUN);
 #ifndef TARGET_BUILD
         //        stepgen_wake_up();
@@ -1016,21 +1048,50 @@ uint8_t _gc_execute_line(char *line) {
 /**
  * @brief G-Code Parser loop
  *
- * Pulls G-Code entries from the queue, and sends them to _gc_execute_line().
+ * Pulls G-Code entries from the queue, and sends them to ngc_execute_line(), or job files to job_run().
  *
  * @note Runs as Xenomai Alchemy Task with a priority of 40.
  */
 static void _gc_loop() {
     ssize_t ret = 0;
-    char *line;
-    while ((ret = rt_queue_read(&rt_gc_queue, &line, sizeof(ssize_t), TM_INFINITE))) {
+    gc_line_t entry;
+    rtdiag_task("rt_gc_loop_task");
+    while ((ret = rt_queue_read(&rt_gc_queue, &entry, sizeof(gc_line_t), TM_INFINITE))) {
         if (ret != -ETIMEDOUT) {
-            message_status(_gc_execute_line(line));
+            sem_post(&gc_queue_slots);
+            if (entry.command == GC_COMMAND_SYNC) {
+                sem_post(&gc_queue_synced);
+                continue;
+            }
+            gc_exec_line_id = entry.line_id;
+            message_status(_gc_command(&entry));
         }
     }
     fprintf(stderr, "_gc_loop: rt_queue_read exited %zd\n", ret);
 }
 
+/**
+ * @brief Import the words of a groomed G-Code line
+ * @param line Groomed G-Code line
+ * @param words Words output, GC_MAX_WORDS long
+ * @param n_words Number of words output
+ * @return Status code
+ */
+uint8_t gc_parse_line(char *line, gc_word_t *words, uint8_t *n_words) {
+    uint8_t char_counter = 0;
+    *n_words = 0;
+    while (line[char_counter] != 0) { // Loop until no more g-code words in line.
+        // Import the next g-code word, expecting a letter followed by a value. Otherwise, error out.
+        if (*n_words == GC_MAX_WORDS) { return STATUS_OVERFLOW; } // [Too many words]
+        gc_word_t *word = &words[(*n_words)++];
+        word->letter = line[char_counter];
+        if ((word->letter < 'A') || (word->letter > 'Z')) { return STATUS_EXPECTED_COMMAND_LETTER; } // [Expected word letter]
+        char_counter++;
+        if (!read_float(line, &char_counter, &word->value)) { return STATUS_BAD_NUMBER_FORMAT; } // [Expected word value]
+    }
+    return STATUS_OK;
+}
+
 /**
  * @brief Initialized G-Code parser
  * @return 0 on success, negative on error.
@@ -1038,8 +1099,11 @@ static void _gc_loop() {
 ssize_t gc_init() {
     ssize_t ret = 0;
     memset(&gc_state, 0, sizeof(parser_state_t));
+    sem_init(&gc_queue_slots, 0, GCODE_QUEUE_SIZE);
+    sem_init(&gc_queue_synced, 0, 0);
+    // Pool is doubled to leave room for the queue's per message overhead.
     if ((ret = rt_queue_create(&rt_gc_queue, "rt_gc_queue",
-                               (sizeof(char) * CLI_LINE_LENGTH) * GCODE_QUEUE_SIZE, GCODE_QUEUE_SIZE, Q_PRIO)) < 0) {
+                               sizeof(gc_line_t) * GCODE_QUEUE_SIZE * 2, GCODE_QUEUE_SIZE, Q_PRIO)) < 0) {
         fprintf(stderr, "gc_init: rt_gc_queue returned %zd\n", ret);
         return ret;
     }
@@ -1070,8 +1134,8 @@ void gc_process_line(char *line, char *buf) {
         } else {
             if (line[i] <= ' ') {
                 // Throw away whitepace and control characters
-            } else if (line[i] == '/') {
-                // Block delete NOT SUPPORTED. Ignore character.
+            } else if ((line[i] == '/') && (char_cnt == 0)) {
+                // Block delete NOT SUPPORTED. Ignore character. Elsewhere, '/' is the ngc division operator.
                 // NOTE: If supported, would simply need to check the system if block delete is enabled.
             } else if (line[i] == '(') {
                 // Enable comments flag and ignore all characters until ')' or EOL.
@@ -1100,17 +1164,172 @@ void gc_process_line(char *line, char *buf) {
 
 /**
  * @brief Add G-Code line to parser queue
- * @param line G-Code line to add
+ *
+ * The line is copied into the queue and tagged with its ID. Waits while the queue is full, so a line is never
+ * dropped, and the sender is held back.
+ * @param line Groomed G-Code line to add
  * @return 0 on success, negative on error.
  */
 ssize_t gc_queue_line(char *line) {
+    gc_line_t entry;
+    _gc_line_tag(&entry, line);
+    entry.command = GC_COMMAND_LINE;
+    return _gc_queue(&entry);
+}
+
+/**
+ * @brief Wait until the parser has executed everything queued
+ *
+ * Queues a GC_COMMAND_SYNC entry, and waits for the parser task to reach it. Motion the lines queued may still
+ * be in the planner. Only one caller may wait at a time.
+ * @return 0 on success, negative on error.
+ */
+ssize_t gc_queue_sync() {
     ssize_t ret = 0;
-    if ((ret = rt_queue_write(&rt_gc_queue, &line, sizeof(ssize_t), Q_NORMAL)) < 0) {
-        fprintf(stderr, "gc_queue_line: rt_queue_write returned %zd\n", ret);
+    gc_line_t entry;
+    entry.line_id = gc_line_seq;
+    entry.command = GC_COMMAND_SYNC;
+    entry.line[0] = '\0';
+    if ((ret = _gc_queue(&entry)) < 0) { return ret; }
+    while (sem_wait(&gc_queue_synced) < 0) {
+        if (errno != EINTR) { return -errno; }
     }
     return ret;
 }
 
+/**
+ * @brief Add a command to parser queue
+ *
+ * The command is run by the parser task, in order with the lines queued around it. Its ok or error is sent
+ * when it has been executed.
+ * @param command Command, enum GC_COMMANDS
+ * @param args Command arguments, as received
+ * @return 0 on success, negative on error.
+ */
+ssize_t gc_queue_command(uint8_t command, char *args) {
+    gc_line_t entry;
+    entry.line_id = ++gc_line_seq;
+    entry.command = command;
+    strncpy(entry.line, args, CLI_LINE_LENGTH - 1);
+    entry.line[CLI_LINE_LENGTH - 1] = '\0';
+    return _gc_queue(&entry);
+}
+
+/**
+ * @brief Write an entry to the parser queue, waiting while it is full
+ * @param entry Entry to write
+ * @return 0 on success, negative on error.
+ */
+static ssize_t _gc_queue(gc_line_t *entry) {
+    ssize_t ret = 0;
+    int free_slots = 0;
+    sem_wait(&gc_queue_slots);
+    if ((ret = rt_queue_write(&rt_gc_queue, entry, sizeof(gc_line_t), Q_NORMAL)) < 0) {
+        fprintf(stderr, "gc_queue: rt_queue_write returned %zd\n", ret);
+        sem_post(&gc_queue_slots);
+        return ret;
+    }
+    sem_getvalue(&gc_queue_slots, &free_slots);
+    flight_record(FLIGHT_LINE, entry->line_id, (uint32_t) (GCODE_QUEUE_SIZE - free_slots));
+    return ret;
+}
+
+
+/**
+ * @brief Execute G-Code line in the calling thread
+ *
+ * Bypasses the parser queue and task. Used by offline modes.
+ * @param line Groomed G-Code line to execute
+ * @return Status code
+ */
+uint8_t gc_dispatch_line(char *line) {
+    gc_line_t entry;
+    _gc_line_tag(&entry, line);
+    gc_exec_line_id = entry.line_id;
+    return ngc_execute_line(entry.line);
+}
+
+/**
+ * @brief Restore parser modes
+ *
+ * The position is left where the parser is.
+ * @param in Modes, from gc_modes_save()
+ */
+void gc_modes_restore(const gc_modes_t *in) {
+    gc_state.modal = in->modal;
+    gc_state.spindle_speed = in->spindle_speed;
+    gc_state.feed_rate = in->feed_rate;
+}
+
+/**
+ * @brief Save parser modes
+ * @param out Modes output
+ */
+void gc_modes_save(gc_modes_t *out) {
+    out->modal = gc_state.modal;
+    out->spindle_speed = gc_state.spindle_speed;
+    out->feed_rate = gc_state.feed_rate;
+}
+
+/**
+ * @brief Reset parser state
+ *
+ * Clears modal state, line IDs and the ngc interpreter. The parser position is synced to the system position.
+ */
+void gc_reset() {
+    memset(&gc_state, 0, sizeof(parser_state_t));
+    gc_line_seq = 0;
+    gc_exec_line_id = 0;
+    gc_sync_position();
+    ngc_reset();
+    fill_reset();
+}
+
+/**
+ * @brief Run a parser queue entry
+ * @param entry Queue entry
+ * @return Status code
+ */
+static uint8_t _gc_command(gc_line_t *entry) {
+    switch (entry->command) {
+        case GC_COMMAND_FILL:
+            return fill_command(entry->line);
+        case GC_COMMAND_JOB:
+            return job_run(entry->line);
+        case GC_COMMAND_STEP_REPEAT:
+            return job_repeat(entry->line);
+        case GC_COMMAND_TRANSFORM: {
+            char buf[CLI_LINE_LENGTH] = {0};
+            gc_word_t words[GC_MAX_WORDS];
+            uint8_t n_words;
+            gc_process_line(entry->line, buf);
+            uint8_t status = gc_parse_line(buf, words, &n_words);
+            if (status != STATUS_OK) { return status; }
+            return transform_command(words, n_words);
+        }
+        default:
+            return ngc_execute_line(entry->line);
+    }
+}
+
+/**
+ * @brief Tag a line for the pipeline
+ *
+ * Copies the line and assigns it the next ID in the receive sequence. IDs are unique among lines in flight,
+ * whatever N words the sender uses. The N word is kept with the latency record, for display.
+ * @param entry Entry to fill
+ * @param line Groomed G-Code line
+ */
+static void _gc_line_tag(gc_line_t *entry, char *line) {
+    uint32_t number = 0;
+    if ((line[0] == 'N') && (line[1] >= '0') && (line[1] <= '9')) {
+        number = (uint32_t) strtoul(&line[1], NULL, 10);
+    }
+    entry->line_id = ++gc_line_seq;
+    strncpy(entry->line, line, CLI_LINE_LENGTH - 1);
+    entry->line[CLI_LINE_LENGTH - 1] = '\0';
+    latency_receive(entry->line_id, number, latency_now());
+}
 
 /**
  * @brief Sets g-code parser position in mm.
@@ -24,6 +24,7 @@
 #include "../config.h"
 
 #define GCODE_QUEUE_SIZE 16
+#define GC_MAX_WORDS 32 // Maximum words in a block. More always means a repeated word.
 
 #define LINE_FLAG_COMMENT_PARENTHESES   (1 << 0)
 #define LINE_FLAG_COMMENT_SEMICOLON     (1 << 1)
@@ -80,12 +81,75 @@
 #define GC_PARSER_LASER_DISABLE         bit(6)
 #define GC_PARSER_LASER_ISMOTION        bit(7)
 
+/**
+ * @brief Commands run by the parser task, in order with the G-Code lines around them
+ */
+enum GC_COMMANDS {
+    GC_COMMAND_LINE,        /*!< G-Code line */
+    GC_COMMAND_JOB,         /*!< Run a job file, $JOB= */
+    GC_COMMAND_FILL,        /*!< Hatch fill contours, $FILL= */
+    GC_COMMAND_STEP_REPEAT, /*!< Run a job file at an array of positions, $SR= */
+    GC_COMMAND_TRANSFORM,   /*!< Set the placement transform, $TF= */
+    GC_COMMAND_SYNC,        /*!< Wake gc_queue_sync(). No reply is sent. */
+};
+
+// NOTE: When this struct is zeroed, the above defines set the defaults for the system.
+/**
+ * @brief Modal values for current G-Code command
+ */
+typedef struct {
+    uint8_t motion;          /*!< {G0,G1,G2,G3,G38.2,G80} */
+    uint8_t feed_rate;       /*!< {G93,G94} */
+    uint8_t units;           /*!< {G20,G21} */
+    uint8_t distance;        /*!< {G90,G91} */
+    uint8_t plane_select;    /*!< {G17,G18,G19} */
+    uint8_t coord_select;    /*!< {G54,G55,G56,G57,G58,G59} */
+    uint8_t program_flow;    /*!< {M0,M1,M2,M30} */
+    uint8_t coolant;         /*!< {M7,M8,M9} */
+    uint8_t spindle;         /*!< {M3,M4,M5} */
+} gc_modal_t;
+
+/**
+ * @brief Parser modes, saved around commands that run their own G-Code
+ */
+typedef struct {
+    gc_modal_t modal;       /*!< Modal values */
+    float spindle_speed;    /*!< Laser power */
+    float feed_rate;        /*!< Millimeters/min */
+} gc_modes_t;
+
+/**
+ * @brief G-Code word
+ */
+typedef struct {
+    char letter;    /*!< Word letter */
+    float value;    /*!< Word value */
+} gc_word_t;
+
+uint8_t gc_dispatch_line(char *line);
+
+uint8_t gc_execute_line(char *line);
+
+uint8_t gc_execute_words(gc_word_t *words, uint8_t n_words);
+
 ssize_t gc_init();
 
+void gc_modes_restore(const gc_modes_t *in);
+
+void gc_modes_save(gc_modes_t *out);
+
 void gc_process_line(char *line, char *buf);
 
+uint8_t gc_parse_line(char *line, gc_word_t *words, uint8_t *n_words);
+
+ssize_t gc_queue_command(uint8_t command, char *args);
+
 ssize_t gc_queue_line(char *line);
 
+ssize_t gc_queue_sync();
+
+void gc_reset();
+
 void gc_sync_position();
 
 #endif //OPENGLOW_CNC_GCODE_H
@@ -47,6 +47,8 @@
 #define bit_false(x,mask) (x) &= ~(mask)
 #define bit_istrue(x,mask) ((((x) & (mask)) != 0) ? true : false)
 #define bit_isfalse(x,mask) (((x) & (mask)) == 0)
+// The parser's word and modal group flags are 16 bits wide. Common bit() is only 8.
+#define bit16(n) ((uint16_t)(1 << (n)))
 
 // Time delay increments performed during a dwell. The default value is set at 50ms, which provides
 // a maximum time delay of roughly 55 minutes, more than enough for most any application. Increasing
@@ -73,12 +75,6 @@
 // should not be much greater than zero or to the minimum value necessary for the machine to work.
 #define MINIMUM_JUNCTION_SPEED ((float)0.0) // (mm/min)
 
-// Number of arc generation iterations by small angle approximation before exact arc trajectory
-// correction with expensive sin() and cos() calcualtions. This parameter maybe decreased if there
-// are issues with the accuracy of the arc generations, or increased if arc execution is getting
-// bogged down by too many trig calculations.
-#define N_ARC_CORRECTION 12 // Integer (1-255)
-
 // Read a floating point value from a string. Line points to the input buffer, char_counter
 // is the indexer pointing to the current character of the line, while float_ptr is
 // a pointer to the result variable. Returns true when it succeeds
@@ -145,8 +145,15 @@ ssize_t motion_init() {
 
     gc_init();
     plan_reset();
+    feed_limiter_reset();
     stepgen_clear();
 
+    // The prep worker reads the planner and segment state, so it starts once they are reset
+    if ((ret = segment_worker_init()) < 0) {
+        fprintf(stderr, "motion_init: segment_worker_init returned %zd\n", ret);
+        return ret;
+    }
+
     sem_init(&mot_state_mutex, 0, 1);
 
     fsm_register(FSM_MOTION, mot_state_map);
@@ -159,7 +166,9 @@ ssize_t motion_init() {
  * @brief Reset Motion system
  */
 void motion_reset() {
+    segment_worker_reset();
     plan_reset();
+    feed_limiter_reset();
 }
 
 /**
@@ -24,15 +24,25 @@
 
 #include <alchemy/task.h>
 #include <math.h>
+#include <string.h>
 #include "../openglow-cnc.h"
 #include "grbl_glue.h"
 
+// Static function declarations
+static uint16_t _mc_arc_segments(float angular_travel, float radius, uint8_t axis_0, uint8_t axis_1,
+                                 plan_line_data_t *pl_data);
+static bool _mc_wait_for_buffer();
+
 /**
  * @brief Execute an arc in offset mode format
  *
- * The arc is approximated by generating a huge number of tiny, linear segments. The chordal tolerance
- * of each segment is configured in config.h ARC_TOLERANCE, which is defined to be the maximum normal
- * distance from segment to the circle when the end points both lie on the circle.
+ * The arc is approximated by linear segments, with end points on the arc. The segment count is chosen by
+ * _mc_arc_segments(), from the arc tolerance and the speed the arc is expected to run at.
+ *
+ * End points are computed MC_ARC_BATCH at a time, and handed to the planner as a batch. The rotations by 1 to
+ * MC_ARC_BATCH segments are computed once per arc, in double precision, and each batch rotates an exact
+ * radius vector, from one sinf()/cosf() pair, by all of them. Every point is computed directly, so there is
+ * no error accumulated along the arc, and the iterations are independent, for the compiler to vectorize.
  * @param target target xyz
  * @param pl_data Planner block data
  * @param position current xyz
@@ -60,13 +70,8 @@ void mc_arc(float *target, plan_line_data_t *pl_data, float *position, const flo
         if (angular_travel <= ARC_ANGULAR_TRAVEL_EPSILON) { angular_travel += 2 * M_PI; }
     }
 
-    /* NOTE: Segment end points are on the arc, which can lead to the arc diameter being smaller by up to
-       (2x) config.h ARC_TOLERANCE. For 99% of users, this is just fine. If a different arc segment fit
-       is desired, i.e. least-squares, midpoint on arc, just change the mm_per_arc_segment calculation.
-       For the intended uses of Grbl, this value shouldn't exceed 2000 for the strictest of cases. */
-    uint16_t segments = (uint16_t) floor(fabs(0.5 * angular_travel * radius) /
-                                         sqrt(ARC_TOLERANCE * (2 * radius - ARC_TOLERANCE)));
-
+    // Segments are placed by the transform, so the tolerance applies to the placed arc
+    uint16_t segments = _mc_arc_segments(angular_travel, radius * transform_scale(), axis_0, axis_1, pl_data);
     if (segments) {
         /* Multiply inverse feed_rate to compensate for the fact that this movement is approximated
            by a number of discrete segments. The inverse feed_rate should be correct for the sum of
@@ -76,72 +81,51 @@ void mc_arc(float *target, plan_line_data_t *pl_data, float *position, const flo
             bit_false(pl_data->condition, PL_COND_FLAG_INVERSE_TIME); // Force as feed absolute mode over arc segments.
         }
 
-        float theta_per_segment = angular_travel / segments;
+        double theta_per_segment = (double) angular_travel / segments;
         float linear_per_segment = (target[axis_linear] - position[axis_linear]) / segments;
 
-        /* Vector rotation by transformation matrix: r is the original vector, r_T is the rotated vector,
-           and phi is the angle of rotation. Solution approach by Jens Geisler.
-               r_T = [cos(phi) -sin(phi);
-                      sin(phi)  cos(phi] * r ;
-
-           For arc generation, the center of the circle is the axis of rotation and the radius vector is
-           defined from the circle center to the initial position. Each line segment is formed by successive
-           vector rotations. Single precision values can accumulate error greater than tool precision in rare
-           cases. So, exact arc path correction is implemented. This approach avoids the problem of too many very
-           expensive trig operations [sin(),cos(),tan()] which can take 100-200 usec each to compute.
-
-           Small angle approximation may be used to reduce computation overhead further. A third-order approximation
-           (second order sin() has too much error) holds for most, if not, all CNC applications. Note that this
-           approximation will begin to accumulate a numerical drift error when theta_per_segment is greater than
-           ~0.25 rad(14 deg) AND the approximation is successively used without correction several dozen times. This
-           scenario is extremely unlikely, since segment lengths and theta_per_segment are automatically generated
-           and scaled by the arc tolerance setting. Only a very large arc tolerance setting, unrealistic for CNC
-           applications, would cause this numerical drift error. However, it is best to set N_ARC_CORRECTION from a
-           low of ~4 to a high of ~20 or so to avoid trig operations while keeping arc generation accurate.
-
-           This approximation also allows mc_arc to immediately insert a line segment into the motion
-           without the initial overhead of computing cos() or sin(). By the time the arc needs to be applied
-           a correction, the motion should have caught up to the lag caused by the initial mc_arc overhead.
-           This is important when there are successive arc motions.
-        */
-        // Computes: cos_T = 1 - theta_per_segment^2/2, sin_T = theta_per_segment - theta_per_segment^3/6) in ~52usec
-        float cos_T = (float) 2.0 - theta_per_segment * theta_per_segment;
-        float sin_T = theta_per_segment * (float) 0.16666667 * (cos_T + (float) 4.0);
-        cos_T *= 0.5;
-
-        float sin_Ti;
-        float cos_Ti;
-        float r_axisi;
-        uint16_t i;
-        uint8_t count = 0;
-
-        for (i = 1; i < segments; i++) { // Increment (segments-1).
-
-            if (count < N_ARC_CORRECTION) {
-                // Apply vector rotation matrix. ~40 usec
-                r_axisi = r_axis0 * sin_T + r_axis1 * cos_T;
-                r_axis0 = r_axis0 * cos_T - r_axis1 * sin_T;
-                r_axis1 = r_axisi;
-                count++;
-            } else {
-                // Arc correction to radius vector. Computed only every N_ARC_CORRECTION increments. ~375 usec
-                // Compute exact location by applying transformation matrix from initial radius vector(=-offset).
-                cos_Ti = cosf(i * theta_per_segment);
-                sin_Ti = sinf(i * theta_per_segment);
-                r_axis0 = -offset[axis_0] * cos_Ti + offset[axis_1] * sin_Ti;
-                r_axis1 = -offset[axis_0] * sin_Ti - offset[axis_1] * cos_Ti;
-                count = 0;
-            }
+        // Rotations by 1 to MC_ARC_BATCH segments. The recurrence is exact enough in double precision.
+        float cos_k[MC_ARC_BATCH], sin_k[MC_ARC_BATCH];
+        double cos_T = cos(theta_per_segment), sin_T = sin(theta_per_segment);
+        double cos_Ti = 1.0, sin_Ti = 0.0, tmp;
+        uint16_t k;
+        for (k = 0; k < MC_ARC_BATCH; k++) {
+            tmp = cos_Ti * cos_T - sin_Ti * sin_T;
+            sin_Ti = sin_Ti * cos_T + cos_Ti * sin_T;
+            cos_Ti = tmp;
+            cos_k[k] = (float) cos_Ti;
+            sin_k[k] = (float) sin_Ti;
+        }
+
+        float points[MC_ARC_BATCH][N_AXIS];
+        for (k = 0; k < MC_ARC_BATCH; k++) { memcpy(points[k], position, sizeof(points[k])); }
 
-            // Update arc_target location
-            position[axis_0] = center_axis0 + r_axis0;
-            position[axis_1] = center_axis1 + r_axis1;
-            position[axis_linear] += linear_per_segment;
+        // Segments 1 to (segments - 1). The last segment goes to the target.
+        uint16_t i = 0;
+        while (i < segments - 1) {
+            uint16_t n = (uint16_t) min(MC_ARC_BATCH, segments - 1 - i);
 
-            mc_line(position, pl_data);
+            // Exact radius vector at segment i, the base of this batch
+            float cos_B = cosf((float) (i * theta_per_segment));
+            float sin_B = sinf((float) (i * theta_per_segment));
+            float b_axis0 = r_axis0 * cos_B - r_axis1 * sin_B;
+            float b_axis1 = r_axis0 * sin_B + r_axis1 * cos_B;
+            float linear = position[axis_linear] + i * linear_per_segment;
 
-            // Bail mid-circle on system abort. Runtime cli check already performed by mc_line.
-            if ((sys_state == SYS_STATE_FAULT) || (sys_state == SYS_STATE_ALARM)) { return; }
+            for (k = 0; k < n; k++) {
+                points[k][axis_0] = center_axis0 + b_axis0 * cos_k[k] - b_axis1 * sin_k[k];
+                points[k][axis_1] = center_axis1 + b_axis0 * sin_k[k] + b_axis1 * cos_k[k];
+                points[k][axis_linear] = linear + (k + 1) * linear_per_segment;
+            }
+            for (k = 0; k < n; k++) { transform_apply(points[k], points[k]); }
+
+            uint16_t planned = 0;
+            while (planned < n) {
+                // Bail mid-circle on system abort.
+                if (!_mc_wait_for_buffer()) { return; }
+                planned += plan_buffer_lines(&points[planned], n - planned, pl_data);
+            }
+            i += n;
         }
     }
     // Ensure last segment arrives at target location.
@@ -156,6 +140,10 @@ void mc_dwell(float seconds) {
     if (verbose) printf("mc_dwell: init\n");
 //    if (sys.state.mode & STATE_G_CODE_CHECK) { return; }
 //    protocol_buffer_synchronize();
+    if (settings.offline) {
+        render_dwell(seconds);
+        return;
+    }
     delay_sec(seconds);
 }
 
@@ -168,6 +156,7 @@ void mc_dwell(float seconds) {
  * segments, must pass through this routine before being passed to the motion. The seperation of
  * mc_line and plan_buffer_line is done primarily to place non-motion-type functions from being
  * in the motion and to let backlash compensation or canned cycle integration simple and direct.
+ * Targets are placed by the job placement transform here, except for system motion.
  * @param target target xyz
  * @param pl_data Planner block data
  */
@@ -182,17 +171,14 @@ void mc_line(float *target, plan_line_data_t *pl_data) {
     // If in check gcode mode, prevent motion by blocking motion. Soft limits still work.
 //    if (sys.state.mode & STATE_G_CODE_CHECK) { return; }
 
-    // If the buffer is full: good! That means we are well ahead of the robot.
-    // Remain in this loop until there is room in the buffer.
-    do {
-        if ((sys_state == SYS_STATE_FAULT) || (sys_state == SYS_STATE_ALARM)) { return; } // Bail, if system abort.
-        if (plan_check_full_buffer()) {
-            // Auto-cycle start when buffer is full, and we're not already in STATE_RUN
-            if (settings.cli.auto_cycle && (sys_state != SYS_STATE_RUN)) fsm_request(SYS_STATE_RUN);
-            // TODO: Find a better way than this to wait for room in the buffer - i.e. thread message
-            rt_task_sleep(100000000); // Sleep for .1 seconds to reduce CPU overhead
-        } else { break; }
-    } while (1);
+    if (!_mc_wait_for_buffer()) { return; }
+
+    // Job placement
+    float placed[N_AXIS];
+    if (!(pl_data->condition & PL_COND_FLAG_SYSTEM_MOTION)) {
+        transform_apply(target, placed);
+        target = placed;
+    }
 
     // Plan and queue motion into motion buffer
     if (!plan_buffer_line(target, pl_data)) { // Empty block returned
@@ -206,5 +192,86 @@ void mc_line(float *target, plan_line_data_t *pl_data) {
     }
 }
 
+/**
+ * @brief Arc segment count
+ *
+ * The chord error allowed depends on the speed the arc is expected to run at: the feed rate, at the current
+ * override, limited by centripetal acceleration about the arc radius. At ARC_TOLERANCE_SPEED or faster, it is
+ * ARC_TOLERANCE. Slower arcs may deviate further, up to ARC_TOLERANCE_MAX, so each chord junction turns the
+ * machine no more abruptly than a full speed arc: the change in velocity at a junction is the speed times the
+ * turn, and the turn grows with the square root of the chord error. Slow arcs get fewer, longer chords.
+ *
+ * The turn at each junction must also be gentle enough that junction deviation doesn't hold the machine below
+ * the expected speed. That term never makes segments shorter than MC_ARC_MIN_SEGMENT.
+ * @param angular_travel Arc angle (radians)
+ * @param radius Arc radius (mm)
+ * @param axis_0 First axis of the arc plane
+ * @param axis_1 Second axis of the arc plane
+ * @param pl_data Planner block data
+ * @return Segment count, 0 for a single line to the target
+ */
+static uint16_t _mc_arc_segments(float angular_travel, float radius, uint8_t axis_0, uint8_t axis_1,
+                                 plan_line_data_t *pl_data) {
+    float length = fabsf(angular_travel * radius);
+
+    // Expected speed, using the same acceleration and junction deviation class as the planner
+    bool cut = (pl_data->condition & (PL_COND_FLAG_SPINDLE_CW | PL_COND_FLAG_SPINDLE_CCW)) &&
+               (pl_data->spindle_speed > 0);
+    float *accel_limits = cut ? settings.acceleration : settings.travel_acceleration;
+    float acceleration = min(accel_limits[axis_0], accel_limits[axis_1]);
+    float deviation = cut ? settings.junction_deviation : settings.travel_junction_deviation;
+    float speed = pl_data->feed_rate;
+    if (pl_data->condition & PL_COND_FLAG_INVERSE_TIME) { speed *= length; }
+    speed *= (float) 0.01 * plan_get_feed_override();
+    speed = min(speed, min(settings.max_rate[axis_0], settings.max_rate[axis_1]));
+    speed = min(speed, sqrtf(acceleration * radius));
+
+    // Same speed times turn per chord as at ARC_TOLERANCE_SPEED. The turn goes as the square root of the error.
+    float tolerance = ARC_TOLERANCE_MAX;
+    if (speed > 0.0) {
+        float ratio = (float) ARC_TOLERANCE_SPEED / speed;
+        tolerance = min(ARC_TOLERANCE_MAX, max(ARC_TOLERANCE, ARC_TOLERANCE * ratio * ratio));
+    }
+    tolerance = min(tolerance, radius);
+
+    /* NOTE: Segment end points are on the arc, which can lead to the arc diameter being smaller by up to
+       (2x) the tolerance. If a different arc segment fit is desired, i.e. least-squares, midpoint on arc,
+       just change the mm_per_arc_segment calculation. */
+    float segments = (float) floor(0.5 * length / sqrt(tolerance * (2 * radius - tolerance)));
+
+    /* Junction speed is limited to v^2 = a * d * s / (1 - s), where s is the cosine of half the turn, see
+       plan_buffer_line(). Solved for the largest turn that still allows the expected speed. */
+    if ((speed > 0.0) && (deviation > 0.0)) {
+        float speed_sqr = speed * speed;
+        float max_turn = 2 * acosf(speed_sqr / (speed_sqr + acceleration * deviation));
+        float speed_segments = min(fabsf(angular_travel) / max_turn, length / MC_ARC_MIN_SEGMENT);
+        segments = max(segments, floorf(speed_segments));
+    }
+    return (uint16_t) min(segments, MC_ARC_MAX_SEGMENTS);
+}
+
+/**
+ * @brief Wait for room in the planner buffer
+ * @return False on system abort
+ */
+static bool _mc_wait_for_buffer() {
+    // If the buffer is full: good! That means we are well ahead of the robot.
+    // Remain in this loop until there is room in the buffer.
+    do {
+        if ((sys_state == SYS_STATE_FAULT) || (sys_state == SYS_STATE_ALARM)) { return false; } // Bail, if system abort.
+        if (plan_check_full_buffer()) {
+            // Offline, nothing else will empty the buffer. Render out what's planned to make room.
+            if (settings.offline) {
+                render_drain();
+                continue;
+            }
+            // Auto-cycle start when buffer is full, and we're not already in STATE_RUN
+            if (settings.cli.auto_cycle && (sys_state != SYS_STATE_RUN)) fsm_request(SYS_STATE_RUN);
+            // TODO: Find a better way than this to wait for room in the buffer - i.e. thread message
+            rt_task_sleep(100000000); // Sleep for .1 seconds to reduce CPU overhead
+        } else { return true; }
+    } while (1);
+}
+
 /** @} */
 /** @} */
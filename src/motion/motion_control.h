@@ -23,6 +23,10 @@
 #include "../common.h"
 #include "planner.h"
 
+#define MC_ARC_BATCH        32      // Arc segment end points computed, and planned, at a time
+#define MC_ARC_MIN_SEGMENT  0.05    // Shortest arc segment added to keep up the expected speed (mm)
+#define MC_ARC_MAX_SEGMENTS 65535   // Most segments in one arc
+
 void mc_arc(float *target, plan_line_data_t *pl_data, float *position, const float *offset, float radius,
             uint8_t axis_0, uint8_t axis_1, uint8_t axis_linear, uint8_t is_clockwise_arc);
 
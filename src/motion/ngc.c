@@ -0,0 +1,1057 @@
+/**
+ * @file ngc.c
+ * @brief rs274/ngc parameters, expressions and O-word control flow
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup motion
+ *
+ * @{
+ * @defgroup motion_ngc NGC Interpreter
+ *
+ * LinuxCNC style parameters, expressions, subroutines and loops, in front of the G-Code parser.
+ *
+ * Each line is compiled once into bytecode. A line outside any O-word block is run as soon as it is compiled.
+ * A loop or conditional block is recorded as it arrives, each of its lines replied to once compiled, and run
+ * when the line closing it arrives. A subroutine is kept, and run each time it is called, so a multi pass job
+ * is sent and parsed once. Running evaluates the words of each line, and hands them to gc_execute_words().
+ * That blocks on the planner like any other line, so a loop is expanded only as fast as the machine runs it.
+ *
+ * Supported:
+ * - Numbered parameters #1 - #4999, and named parameters #<name>. Named parameters are all global.
+ * - Expressions in [], with ** * / MOD + - EQ NE GT GE LT LE AND OR XOR, and the functions ABS ACOS ASIN
+ *   ATAN[y]/[x] COS EXP FIX FUP ROUND LN SIN SQRT TAN EXISTS[#<name>]. Angles are in degrees.
+ * - O-word SUB, ENDSUB, CALL, RETURN, WHILE, ENDWHILE, DO, IF, ELSEIF, ELSE, ENDIF, REPEAT, ENDREPEAT, BREAK
+ *   and CONTINUE. A value returned by RETURN or ENDSUB is stored in #<_VALUE>.
+ *
+ * As in LinuxCNC, assignments on a line take effect after all of its values are evaluated, subroutines must
+ * be defined before they are called, and are forgotten at program end (M2, M30). An error in a recorded block
+ * is reported on its line, and again on the line closing the block, which is then discarded without running.
+ *
+ * @{
+ */
+
+#include <math.h>
+#include <string.h>
+#include "../openglow-cnc.h"
+#include "grbl_glue.h"
+
+#define NGC_NO_TARGET UINT32_MAX // End of a jump chain
+#define NGC_TABLE_SIZE(table) (sizeof(table) / sizeof((table)[0]))
+
+/**
+ * @brief Bytecode operations
+ */
+enum NGC_OPS {
+    NGC_OP_PUSH,        /*!< Push value */
+    NGC_OP_GET,         /*!< Pop parameter number, push the numbered parameter */
+    NGC_OP_GET_NAMED,   /*!< Push the named parameter */
+    NGC_OP_EXISTS,      /*!< Push 1 if the named parameter is set, 0 if not */
+    NGC_OP_UNARY,       /*!< Apply function arg to the top of the stack */
+    NGC_OP_BINARY,      /*!< Pop b, pop a, push a (operator arg) b */
+    NGC_OP_WORD,        /*!< Pop value, add it to the block as word letter arg */
+    NGC_OP_SET,         /*!< Pop value, pop parameter number, assign at the next NGC_OP_EXEC */
+    NGC_OP_SET_NAMED,   /*!< Pop value, assign to the named parameter at the next NGC_OP_EXEC */
+    NGC_OP_EXEC,        /*!< Apply assignments, and execute the block, if it has words */
+    NGC_OP_JUMP,        /*!< Jump to target */
+    NGC_OP_JUMP_FALSE,  /*!< Pop value, jump to target if zero */
+    NGC_OP_JUMP_TRUE,   /*!< Pop value, jump to target if not zero */
+    NGC_OP_REPEAT,      /*!< Pop count, start a repeat counter. Jump to target if less than 1. */
+    NGC_OP_ENDREPEAT,   /*!< Decrement the repeat counter. Jump to target until zero, then drop it. */
+    NGC_OP_UNWIND,      /*!< Drop arg repeat counters, to BREAK or CONTINUE an outer loop */
+    NGC_OP_CALL,        /*!< Call subroutine index, with arg arguments from the stack */
+    NGC_OP_RETURN,      /*!< Return from subroutine */
+};
+
+/**
+ * @brief Unary functions
+ */
+enum NGC_FUNCS {
+    NGC_FUNC_NEG,       /*!< Unary minus */
+    NGC_FUNC_ABS,       /*!< ABS */
+    NGC_FUNC_ACOS,      /*!< ACOS */
+    NGC_FUNC_ASIN,      /*!< ASIN */
+    NGC_FUNC_ATAN,      /*!< ATAN[y]/[x], compiled to NGC_OPER_ATAN2 */
+    NGC_FUNC_COS,       /*!< COS */
+    NGC_FUNC_EXISTS,    /*!< EXISTS[#<name>], compiled to NGC_OP_EXISTS */
+    NGC_FUNC_EXP,       /*!< EXP */
+    NGC_FUNC_FIX,       /*!< FIX, round down */
+    NGC_FUNC_FUP,       /*!< FUP, round up */
+    NGC_FUNC_ROUND,     /*!< ROUND */
+    NGC_FUNC_LN,        /*!< LN */
+    NGC_FUNC_SIN,       /*!< SIN */
+    NGC_FUNC_SQRT,      /*!< SQRT */
+    NGC_FUNC_TAN,       /*!< TAN */
+};
+
+/**
+ * @brief Binary operators
+ */
+enum NGC_OPERS {
+    NGC_OPER_POWER,     /*!< ** */
+    NGC_OPER_MUL,       /*!< * */
+    NGC_OPER_DIV,       /*!< / */
+    NGC_OPER_MOD,       /*!< MOD */
+    NGC_OPER_ADD,       /*!< + */
+    NGC_OPER_SUB,       /*!< - */
+    NGC_OPER_EQ,        /*!< EQ */
+    NGC_OPER_NE,        /*!< NE */
+    NGC_OPER_GT,        /*!< GT */
+    NGC_OPER_GE,        /*!< GE */
+    NGC_OPER_LT,        /*!< LT */
+    NGC_OPER_LE,        /*!< LE */
+    NGC_OPER_AND,       /*!< AND */
+    NGC_OPER_OR,        /*!< OR */
+    NGC_OPER_XOR,       /*!< XOR */
+    NGC_OPER_ATAN2,     /*!< ATAN[a]/[b] */
+};
+
+/**
+ * @brief O-word keywords
+ */
+enum NGC_OWORDS {
+    NGC_O_SUB,
+    NGC_O_ENDSUB,
+    NGC_O_CALL,
+    NGC_O_RETURN,
+    NGC_O_WHILE,
+    NGC_O_ENDWHILE,
+    NGC_O_DO,
+    NGC_O_IF,
+    NGC_O_ELSEIF,
+    NGC_O_ELSE,
+    NGC_O_ENDIF,
+    NGC_O_REPEAT,
+    NGC_O_ENDREPEAT,
+    NGC_O_BREAK,
+    NGC_O_CONTINUE,
+};
+
+/**
+ * @brief Keyword table entry
+ */
+typedef struct {
+    const char *name;   /*!< Keyword, as it appears in a groomed line */
+    uint8_t code;       /*!< Function, operator or O-word code */
+    uint8_t precedence; /*!< Operator precedence, higher binds tighter */
+} ngc_keyword_t;
+
+/**
+ * @brief Bytecode operation
+ */
+typedef struct {
+    uint8_t op;         /*!< Operation, NGC_OP_xxx */
+    uint8_t arg;        /*!< Word letter, function, operator, or count */
+    union {
+        float value;    /*!< Value, for NGC_OP_PUSH */
+        uint32_t index; /*!< Jump target, named parameter or subroutine index */
+    };
+} ngc_op_t;
+
+/**
+ * @brief O-word block being compiled
+ */
+typedef struct {
+    uint8_t type;               /*!< O-word opening the block, NGC_O_xxx */
+    char name[NGC_NAME_LENGTH]; /*!< O-word name */
+    uint32_t start;             /*!< Loop start, or subroutine index */
+    uint32_t branch;            /*!< Jump to the next IF arm, NGC_NO_TARGET if none */
+    uint32_t exits;             /*!< Chain of jumps to the end of the block */
+    uint32_t continues;         /*!< Chain of jumps to the next loop iteration */
+    bool has_else;              /*!< IF block has had its ELSE */
+} ngc_block_t;
+
+/**
+ * @brief Subroutine
+ */
+typedef struct {
+    char name[NGC_NAME_LENGTH]; /*!< O-word name */
+    uint32_t start;             /*!< First op */
+    bool defined;               /*!< Definition compiled without error */
+} ngc_sub_t;
+
+/**
+ * @brief Named parameter
+ */
+typedef struct {
+    char name[NGC_NAME_LENGTH]; /*!< Name, without the brackets */
+    double value;               /*!< Value */
+    bool set;                   /*!< Assigned a value */
+} ngc_named_t;
+
+/**
+ * @brief Subroutine call frame
+ */
+typedef struct {
+    uint32_t return_pc;                     /*!< Op to return to */
+    uint8_t counters;                       /*!< Repeat counters active at the call */
+    double locals[NGC_LOCAL_PARAMETERS];    /*!< Caller's #1 - #30 */
+} ngc_frame_t;
+
+/**
+ * @brief Deferred parameter assignment
+ */
+typedef struct {
+    bool named;         /*!< Named parameter */
+    uint32_t index;     /*!< Parameter number, or named parameter index */
+    double value;       /*!< Value */
+} ngc_assignment_t;
+
+/**
+ * @brief Interpreter state
+ */
+typedef struct {
+    uint32_t base;                              /*!< End of subroutine code. Top level code is compiled here. */
+    uint32_t end;                               /*!< End of code */
+    ngc_block_t blocks[NGC_BLOCK_DEPTH];        /*!< O-word blocks being compiled */
+    uint8_t depth;                              /*!< O-word block nesting. Lines are recorded while not zero. */
+    uint8_t error;                              /*!< First error in the block being recorded */
+    bool running;                               /*!< Running bytecode */
+    bool program_end;                           /*!< Program end reached while running */
+    double stack[NGC_STACK_SIZE];               /*!< Expression stack */
+    uint8_t sp;                                 /*!< Expression stack depth */
+    uint32_t counters[NGC_REPEAT_DEPTH];        /*!< Repeat counters */
+    uint8_t n_counters;                         /*!< Active repeat counters */
+    ngc_frame_t frames[NGC_CALL_DEPTH];         /*!< Subroutine call frames */
+    uint8_t n_frames;                           /*!< Subroutine call depth */
+    ngc_assignment_t pending[NGC_PENDING_ASSIGNMENTS]; /*!< Assignments on the current line */
+    uint8_t n_pending;                          /*!< Assignments on the current line */
+    gc_word_t words[GC_MAX_WORDS];              /*!< Words of the current line */
+    uint8_t n_words;                            /*!< Words of the current line */
+} ngc_t;
+
+/**
+ * @brief Operators, longest first where one is a prefix of another
+ */
+static const ngc_keyword_t ngc_operators[] = {
+        {"**", NGC_OPER_POWER, 4}, {"*", NGC_OPER_MUL, 3}, {"/", NGC_OPER_DIV, 3}, {"MOD", NGC_OPER_MOD, 3},
+        {"+", NGC_OPER_ADD, 2}, {"-", NGC_OPER_SUB, 2}, {"EQ", NGC_OPER_EQ, 1}, {"NE", NGC_OPER_NE, 1},
+        {"GT", NGC_OPER_GT, 1}, {"GE", NGC_OPER_GE, 1}, {"LT", NGC_OPER_LT, 1}, {"LE", NGC_OPER_LE, 1},
+        {"AND", NGC_OPER_AND, 0}, {"OR", NGC_OPER_OR, 0}, {"XOR", NGC_OPER_XOR, 0},
+};
+
+/**
+ * @brief Functions
+ */
+static const ngc_keyword_t ngc_functions[] = {
+        {"ABS", NGC_FUNC_ABS}, {"ACOS", NGC_FUNC_ACOS}, {"ASIN", NGC_FUNC_ASIN}, {"ATAN", NGC_FUNC_ATAN},
+        {"COS", NGC_FUNC_COS}, {"EXISTS", NGC_FUNC_EXISTS}, {"EXP", NGC_FUNC_EXP}, {"FIX", NGC_FUNC_FIX},
+        {"FUP", NGC_FUNC_FUP}, {"ROUND", NGC_FUNC_ROUND}, {"LN", NGC_FUNC_LN}, {"SIN", NGC_FUNC_SIN},
+        {"SQRT", NGC_FUNC_SQRT}, {"TAN", NGC_FUNC_TAN},
+};
+
+/**
+ * @brief O-word keywords, longest first where one is a prefix of another
+ */
+static const ngc_keyword_t ngc_owords[] = {
+        {"SUB", NGC_O_SUB}, {"ENDSUB", NGC_O_ENDSUB}, {"CALL", NGC_O_CALL}, {"RETURN", NGC_O_RETURN},
+        {"WHILE", NGC_O_WHILE}, {"ENDWHILE", NGC_O_ENDWHILE}, {"DO", NGC_O_DO}, {"IF", NGC_O_IF},
+        {"ELSEIF", NGC_O_ELSEIF}, {"ELSE", NGC_O_ELSE}, {"ENDIF", NGC_O_ENDIF}, {"REPEAT", NGC_O_REPEAT},
+        {"ENDREPEAT", NGC_O_ENDREPEAT}, {"BREAK", NGC_O_BREAK}, {"CONTINUE", NGC_O_CONTINUE},
+};
+
+/**
+ * @brief Bytecode pool
+ */
+static ngc_op_t ngc_ops[NGC_PROGRAM_SIZE];
+
+/**
+ * @brief Numbered parameters
+ */
+static double ngc_params[NGC_PARAMETERS];
+
+/**
+ * @brief Named parameters
+ */
+static ngc_named_t ngc_named[NGC_NAMED_PARAMETERS];
+
+/**
+ * @brief Number of named parameters
+ */
+static uint8_t ngc_n_named = 0;
+
+/**
+ * @brief Subroutines
+ */
+static ngc_sub_t ngc_subs[NGC_SUBROUTINES];
+
+/**
+ * @brief Number of subroutines
+ */
+static uint8_t ngc_n_subs = 0;
+
+/**
+ * @brief Interpreter state
+ */
+static ngc_t ngc;
+
+// Static function declarations
+static uint8_t _ngc_apply(uint8_t func, double *value);
+static uint8_t _ngc_compile_expression(char *line, uint16_t *pos, uint8_t precedence);
+static uint8_t _ngc_compile_line(char *line);
+static uint8_t _ngc_compile_oword(char *line, uint16_t pos);
+static uint8_t _ngc_compile_value(char *line, uint16_t *pos);
+static ngc_op_t *_ngc_emit(uint8_t op, uint8_t arg);
+static uint8_t _ngc_emit_jump(uint8_t op, uint32_t *chain);
+static uint8_t _ngc_evaluate(uint8_t oper, double a, double b, double *value);
+static const ngc_keyword_t *_ngc_match(const ngc_keyword_t *table, size_t size, const char *text);
+static uint8_t _ngc_named_index(const char *line, uint16_t *pos, uint32_t *index);
+static uint8_t _ngc_open(uint8_t type, const char *name);
+static void _ngc_patch(uint32_t chain, uint32_t target);
+static uint8_t _ngc_run(uint32_t pc, uint32_t end);
+
+/**
+ * @brief Apply a unary function
+ * @param func Function, NGC_FUNC_xxx
+ * @param value Value in, and result out
+ * @return Status code
+ */
+static uint8_t _ngc_apply(uint8_t func, double *value) {
+    double x = *value;
+    switch (func) {
+        case NGC_FUNC_NEG: x = -x; break;
+        case NGC_FUNC_ABS: x = fabs(x); break;
+        case NGC_FUNC_ACOS:
+            if ((x < -1.0) || (x > 1.0)) { return STATUS_NGC_EXPRESSION; }
+            x = acos(x) * 180.0 / M_PI;
+            break;
+        case NGC_FUNC_ASIN:
+            if ((x < -1.0) || (x > 1.0)) { return STATUS_NGC_EXPRESSION; }
+            x = asin(x) * 180.0 / M_PI;
+            break;
+        case NGC_FUNC_COS: x = cos(x * M_PI / 180.0); break;
+        case NGC_FUNC_EXP: x = exp(x); break;
+        case NGC_FUNC_FIX: x = floor(x); break;
+        case NGC_FUNC_FUP: x = ceil(x); break;
+        case NGC_FUNC_ROUND: x = round(x); break;
+        case NGC_FUNC_LN:
+            if (x <= 0.0) { return STATUS_NGC_EXPRESSION; }
+            x = log(x);
+            break;
+        case NGC_FUNC_SIN: x = sin(x * M_PI / 180.0); break;
+        case NGC_FUNC_SQRT:
+            if (x < 0.0) { return STATUS_NGC_EXPRESSION; }
+            x = sqrt(x);
+            break;
+        case NGC_FUNC_TAN: x = tan(x * M_PI / 180.0); break;
+        default: return STATUS_NGC_EXPRESSION;
+    }
+    *value = x;
+    return STATUS_OK;
+}
+
+/**
+ * @brief Compile an expression, up to the first operator binding looser than precedence
+ * @param line Groomed line
+ * @param pos Position in line, advanced past the expression
+ * @param precedence Lowest operator precedence to take
+ * @return Status code
+ */
+static uint8_t _ngc_compile_expression(char *line, uint16_t *pos, uint8_t precedence) {
+    uint8_t status;
+    if ((status = _ngc_compile_value(line, pos)) != STATUS_OK) { return status; }
+    while (true) {
+        const ngc_keyword_t *oper = _ngc_match(ngc_operators, NGC_TABLE_SIZE(ngc_operators), &line[*pos]);
+        if ((oper == NULL) || (oper->precedence < precedence)) { return STATUS_OK; }
+        *pos += strlen(oper->name);
+        // Left associative. The right operand takes only operators binding tighter.
+        if ((status = _ngc_compile_expression(line, pos, (uint8_t) (oper->precedence + 1))) != STATUS_OK) {
+            return status;
+        }
+        if (_ngc_emit(NGC_OP_BINARY, oper->code) == NULL) { return STATUS_NGC_OVERFLOW; }
+    }
+}
+
+/**
+ * @brief Compile one line
+ *
+ * An O-word line is compiled by _ngc_compile_oword(). Any other line is compiled to its assignments and words,
+ * followed by an NGC_OP_EXEC.
+ * @param line Groomed line
+ * @return Status code
+ */
+static uint8_t _ngc_compile_line(char *line) {
+    uint8_t status;
+    uint16_t pos = 0;
+
+    // A line number before an O-word is dropped
+    if (line[pos] == 'N') {
+        do { pos++; } while ((line[pos] >= '0') && (line[pos] <= '9'));
+    }
+    if (line[pos] == 'O') { return _ngc_compile_oword(line, (uint16_t) (pos + 1)); }
+
+    pos = 0;
+    while (line[pos] != '\0') {
+        if (line[pos] == '#') {
+            // Parameter assignment
+            ngc_op_t *set;
+            uint32_t index = 0;
+            bool named = (line[++pos] == '<');
+            if (named) { status = _ngc_named_index(line, &pos, &index); }
+            else { status = _ngc_compile_value(line, &pos); }
+            if (status != STATUS_OK) { return status; }
+            if (line[pos++] != '=') { return STATUS_NGC_EXPRESSION; }
+            if ((status = _ngc_compile_value(line, &pos)) != STATUS_OK) { return status; }
+            if ((set = _ngc_emit(named ? NGC_OP_SET_NAMED : NGC_OP_SET, 0)) == NULL) { return STATUS_NGC_OVERFLOW; }
+            set->index = index;
+        } else if ((line[pos] >= 'A') && (line[pos] <= 'Z')) {
+            // G-Code word
+            char letter = line[pos++];
+            if ((status = _ngc_compile_value(line, &pos)) != STATUS_OK) { return status; }
+            if (_ngc_emit(NGC_OP_WORD, (uint8_t) letter) == NULL) { return STATUS_NGC_OVERFLOW; }
+        } else {
+            return STATUS_EXPECTED_COMMAND_LETTER;
+        }
+    }
+    if (_ngc_emit(NGC_OP_EXEC, 0) == NULL) { return STATUS_NGC_OVERFLOW; }
+    return STATUS_OK;
+}
+
+/**
+ * @brief Compile an O-word line
+ * @param line Groomed line
+ * @param pos Position in line, just past the O
+ * @return Status code
+ */
+static uint8_t _ngc_compile_oword(char *line, uint16_t pos) {
+    uint8_t status = STATUS_OK;
+    char name[NGC_NAME_LENGTH];
+
+    // O-word name, a number, or <name>
+    if (line[pos] == '<') {
+        char *close = strchr(&line[pos], '>');
+        if ((close == NULL) || (close - &line[pos] >= NGC_NAME_LENGTH)) { return STATUS_NGC_OWORD; }
+        memcpy(name, &line[pos], (size_t) (close - &line[pos] + 1));
+        name[close - &line[pos] + 1] = '\0';
+        pos += (uint16_t) (close - &line[pos] + 1);
+    } else {
+        char *end;
+        unsigned long number = strtoul(&line[pos], &end, 10);
+        if (end == &line[pos]) { return STATUS_NGC_OWORD; }
+        snprintf(name, sizeof(name), "%lu", number); // O0100 is O100
+        pos = (uint16_t) (end - line);
+    }
+
+    const ngc_keyword_t *keyword = _ngc_match(ngc_owords, NGC_TABLE_SIZE(ngc_owords), &line[pos]);
+    if (keyword == NULL) { return STATUS_NGC_OWORD; }
+    pos += strlen(keyword->name);
+    ngc_block_t *block = (ngc.depth > 0) ? &ngc.blocks[ngc.depth - 1] : NULL;
+    bool match = (block != NULL) && (strcmp(block->name, name) == 0);
+    ngc_op_t *op;
+
+    switch (keyword->code) {
+        case NGC_O_SUB: {
+            // Subroutines are defined at the top level only
+            if (ngc.depth > 0) { return STATUS_NGC_OWORD; }
+            uint8_t sub = 0;
+            while ((sub < ngc_n_subs) && (strcmp(ngc_subs[sub].name, name) != 0)) { sub++; }
+            if (sub == ngc_n_subs) {
+                if (ngc_n_subs == NGC_SUBROUTINES) { return STATUS_NGC_OVERFLOW; }
+                strcpy(ngc_subs[ngc_n_subs++].name, name);
+            }
+            if ((status = _ngc_open(NGC_O_SUB, name)) != STATUS_OK) { return status; }
+            // Defined from here, so it can call itself
+            ngc_subs[sub].start = ngc.end;
+            ngc_subs[sub].defined = true;
+            ngc.blocks[0].start = sub;
+            break;
+        }
+        case NGC_O_ENDSUB:
+        case NGC_O_RETURN: {
+            if ((ngc.depth == 0) || (ngc.blocks[0].type != NGC_O_SUB) || (strcmp(ngc.blocks[0].name, name) != 0)) {
+                return STATUS_NGC_OWORD;
+            }
+            if ((keyword->code == NGC_O_ENDSUB) && (ngc.depth != 1)) { return STATUS_NGC_OWORD; }
+            if (line[pos] == '[') {
+                // Return value
+                uint16_t value_pos = 0;
+                uint32_t index = 0;
+                if ((status = _ngc_compile_value(line, &pos)) != STATUS_OK) { return status; }
+                if ((status = _ngc_named_index("<_VALUE>", &value_pos, &index)) != STATUS_OK) { return status; }
+                if ((op = _ngc_emit(NGC_OP_SET_NAMED, 0)) == NULL) { return STATUS_NGC_OVERFLOW; }
+                op->index = index;
+                if (_ngc_emit(NGC_OP_EXEC, 0) == NULL) { return STATUS_NGC_OVERFLOW; }
+            }
+            if (_ngc_emit(NGC_OP_RETURN, 0) == NULL) { return STATUS_NGC_OVERFLOW; }
+            if (keyword->code == NGC_O_ENDSUB) {
+                ngc.depth--;
+                // Keep the subroutine, unless its definition failed
+                if (ngc.error == STATUS_OK) { ngc.base = ngc.end; }
+                else { ngc_subs[ngc.blocks[0].start].defined = false; }
+            }
+            break;
+        }
+        case NGC_O_CALL: {
+            uint8_t sub = 0, n_args = 0;
+            while ((sub < ngc_n_subs) && (strcmp(ngc_subs[sub].name, name) != 0)) { sub++; }
+            if ((sub == ngc_n_subs) || !ngc_subs[sub].defined) { return STATUS_NGC_UNDEFINED_SUB; }
+            while (line[pos] == '[') {
+                if (++n_args > NGC_LOCAL_PARAMETERS) { return STATUS_NGC_OVERFLOW; }
+                if ((status = _ngc_compile_value(line, &pos)) != STATUS_OK) { return status; }
+            }
+            if ((op = _ngc_emit(NGC_OP_CALL, n_args)) == NULL) { return STATUS_NGC_OVERFLOW; }
+            op->index = sub;
+            break;
+        }
+        case NGC_O_WHILE: {
+            if (match && (block->type == NGC_O_DO)) {
+                // Closes a DO loop. Loop while true.
+                _ngc_patch(block->continues, ngc.end);
+                if ((status = _ngc_compile_value(line, &pos)) != STATUS_OK) { return status; }
+                if ((op = _ngc_emit(NGC_OP_JUMP_TRUE, 0)) == NULL) { return STATUS_NGC_OVERFLOW; }
+                op->index = block->start;
+                _ngc_patch(block->exits, ngc.end);
+                ngc.depth--;
+                break;
+            }
+            if ((status = _ngc_open(NGC_O_WHILE, name)) != STATUS_OK) { return status; }
+            block = &ngc.blocks[ngc.depth - 1];
+            if ((status = _ngc_compile_value(line, &pos)) != STATUS_OK) { return status; }
+            if ((status = _ngc_emit_jump(NGC_OP_JUMP_FALSE, &block->exits)) != STATUS_OK) { return status; }
+            break;
+        }
+        case NGC_O_ENDWHILE: {
+            if (!match || (block->type != NGC_O_WHILE)) { return STATUS_NGC_OWORD; }
+            if ((op = _ngc_emit(NGC_OP_JUMP, 0)) == NULL) { return STATUS_NGC_OVERFLOW; }
+            op->index = block->start;
+            _ngc_patch(block->continues, block->start);
+            _ngc_patch(block->exits, ngc.end);
+            ngc.depth--;
+            break;
+        }
+        case NGC_O_DO: {
+            status = _ngc_open(NGC_O_DO, name);
+            break;
+        }
+        case NGC_O_IF: {
+            if ((status = _ngc_open(NGC_O_IF, name)) != STATUS_OK) { return status; }
+            block = &ngc.blocks[ngc.depth - 1];
+            if ((status = _ngc_compile_value(line, &pos)) != STATUS_OK) { return status; }
+            status = _ngc_emit_jump(NGC_OP_JUMP_FALSE, &block->branch);
+            break;
+        }
+        case NGC_O_ELSEIF:
+        case NGC_O_ELSE: {
+            if (!match || (block->type != NGC_O_IF) || block->has_else) { return STATUS_NGC_OWORD; }
+            // End of the previous arm
+            if ((status = _ngc_emit_jump(NGC_OP_JUMP, &block->exits)) != STATUS_OK) { return status; }
+            _ngc_patch(block->branch, ngc.end);
+            block->branch = NGC_NO_TARGET;
+            if (keyword->code == NGC_O_ELSE) {
+                block->has_else = true;
+                break;
+            }
+            if ((status = _ngc_compile_value(line, &pos)) != STATUS_OK) { return status; }
+            status = _ngc_emit_jump(NGC_OP_JUMP_FALSE, &block->branch);
+            break;
+        }
+        case NGC_O_ENDIF: {
+            if (!match || (block->type != NGC_O_IF)) { return STATUS_NGC_OWORD; }
+            _ngc_patch(block->branch, ngc.end);
+            _ngc_patch(block->exits, ngc.end);
+            ngc.depth--;
+            break;
+        }
+        case NGC_O_REPEAT: {
+            if ((status = _ngc_open(NGC_O_REPEAT, name)) != STATUS_OK) { return status; }
+            block = &ngc.blocks[ngc.depth - 1];
+            if ((status = _ngc_compile_value(line, &pos)) != STATUS_OK) { return status; }
+            if ((status = _ngc_emit_jump(NGC_OP_REPEAT, &block->exits)) != STATUS_OK) { return status; }
+            block->start = ngc.end;
+            break;
+        }
+        case NGC_O_ENDREPEAT: {
+            if (!match || (block->type != NGC_O_REPEAT)) { return STATUS_NGC_OWORD; }
+            _ngc_patch(block->continues, ngc.end);
+            if ((op = _ngc_emit(NGC_OP_ENDREPEAT, 0)) == NULL) { return STATUS_NGC_OVERFLOW; }
+            op->index = block->start;
+            _ngc_patch(block->exits, ngc.end);
+            ngc.depth--;
+            break;
+        }
+        case NGC_O_BREAK:
+        case NGC_O_CONTINUE: {
+            // Find the loop, counting the repeat counters to drop on the way out
+            uint8_t unwind = 0;
+            int depth = ngc.depth - 1;
+            for (; depth >= 0; depth--) {
+                block = &ngc.blocks[depth];
+                if ((block->type == NGC_O_SUB) || (strcmp(block->name, name) == 0)) { break; }
+                if (block->type == NGC_O_REPEAT) { unwind++; }
+            }
+            if ((depth < 0) || ((block->type != NGC_O_WHILE) && (block->type != NGC_O_DO) &&
+                                (block->type != NGC_O_REPEAT))) {
+                return STATUS_NGC_OWORD;
+            }
+            if ((keyword->code == NGC_O_BREAK) && (block->type == NGC_O_REPEAT)) { unwind++; }
+            if ((unwind > 0) && (_ngc_emit(NGC_OP_UNWIND, unwind) == NULL)) { return STATUS_NGC_OVERFLOW; }
+            status = _ngc_emit_jump(NGC_OP_JUMP, (keyword->code == NGC_O_BREAK) ? &block->exits
+                                                                               : &block->continues);
+            break;
+        }
+        default:
+            return STATUS_NGC_OWORD;
+    }
+    if ((status == STATUS_OK) && (line[pos] != '\0')) { return STATUS_UNUSED_WORDS; }
+    return status;
+}
+
+/**
+ * @brief Compile a value: a number, a parameter, a bracketed expression, or a function
+ * @param line Groomed line
+ * @param pos Position in line, advanced past the value
+ * @return Status code
+ */
+static uint8_t _ngc_compile_value(char *line, uint16_t *pos) {
+    uint8_t status;
+    ngc_op_t *op;
+    char c = line[*pos];
+
+    if (c == '[') {
+        (*pos)++;
+        if ((status = _ngc_compile_expression(line, pos, 0)) != STATUS_OK) { return status; }
+        if (line[(*pos)++] != ']') { return STATUS_NGC_EXPRESSION; }
+        return STATUS_OK;
+    }
+    if (c == '#') {
+        (*pos)++;
+        if (line[*pos] == '<') {
+            uint32_t index = 0;
+            if ((status = _ngc_named_index(line, pos, &index)) != STATUS_OK) { return status; }
+            if ((op = _ngc_emit(NGC_OP_GET_NAMED, 0)) == NULL) { return STATUS_NGC_OVERFLOW; }
+            op->index = index;
+            return STATUS_OK;
+        }
+        // The parameter number is itself a value, so ##1 is the parameter numbered by #1
+        if ((status = _ngc_compile_value(line, pos)) != STATUS_OK) { return status; }
+        if (_ngc_emit(NGC_OP_GET, 0) == NULL) { return STATUS_NGC_OVERFLOW; }
+        return STATUS_OK;
+    }
+    if (((c == '-') || (c == '+')) && ((line[*pos + 1] == '#') || (line[*pos + 1] == '[') ||
+                                       ((line[*pos + 1] >= 'A') && (line[*pos + 1] <= 'Z')))) {
+        (*pos)++;
+        if ((status = _ngc_compile_value(line, pos)) != STATUS_OK) { return status; }
+        if ((c == '-') && (_ngc_emit(NGC_OP_UNARY, NGC_FUNC_NEG) == NULL)) { return STATUS_NGC_OVERFLOW; }
+        return STATUS_OK;
+    }
+    if ((c >= 'A') && (c <= 'Z')) {
+        const ngc_keyword_t *func = _ngc_match(ngc_functions, NGC_TABLE_SIZE(ngc_functions), &line[*pos]);
+        if (func == NULL) { return STATUS_NGC_EXPRESSION; }
+        *pos += strlen(func->name);
+        if (line[*pos] != '[') { return STATUS_NGC_EXPRESSION; }
+        if (func->code == NGC_FUNC_EXISTS) {
+            uint32_t index = 0;
+            if ((line[*pos + 1] != '#') || (line[*pos + 2] != '<')) { return STATUS_NGC_EXPRESSION; }
+            *pos += 2;
+            if ((status = _ngc_named_index(line, pos, &index)) != STATUS_OK) { return status; }
+            if (line[(*pos)++] != ']') { return STATUS_NGC_EXPRESSION; }
+            if ((op = _ngc_emit(NGC_OP_EXISTS, 0)) == NULL) { return STATUS_NGC_OVERFLOW; }
+            op->index = index;
+            return STATUS_OK;
+        }
+        if ((status = _ngc_compile_value(line, pos)) != STATUS_OK) { return status; }
+        if (func->code == NGC_FUNC_ATAN) {
+            if ((line[(*pos)++] != '/') || (line[*pos] != '[')) { return STATUS_NGC_EXPRESSION; }
+            if ((status = _ngc_compile_value(line, pos)) != STATUS_OK) { return status; }
+            if (_ngc_emit(NGC_OP_BINARY, NGC_OPER_ATAN2) == NULL) { return STATUS_NGC_OVERFLOW; }
+            return STATUS_OK;
+        }
+        if (_ngc_emit(NGC_OP_UNARY, func->code) == NULL) { return STATUS_NGC_OVERFLOW; }
+        return STATUS_OK;
+    }
+
+    uint8_t char_counter = 0;
+    float value;
+    if (!read_float(&line[*pos], &char_counter, &value)) { return STATUS_BAD_NUMBER_FORMAT; }
+    *pos += char_counter;
+    if ((op = _ngc_emit(NGC_OP_PUSH, 0)) == NULL) { return STATUS_NGC_OVERFLOW; }
+    op->value = value;
+    return STATUS_OK;
+}
+
+/**
+ * @brief Append an op
+ * @param op Operation, NGC_OP_xxx
+ * @param arg Word letter, function, operator, or count
+ * @return Op, to fill in its operand. NULL if the bytecode pool is full.
+ */
+static ngc_op_t *_ngc_emit(uint8_t op, uint8_t arg) {
+    if (ngc.end == NGC_PROGRAM_SIZE) { return NULL; }
+    ngc_op_t *entry = &ngc_ops[ngc.end++];
+    entry->op = op;
+    entry->arg = arg;
+    entry->index = 0;
+    return entry;
+}
+
+/**
+ * @brief Append a jump to a target not known yet
+ *
+ * The jump is linked into a chain through its target, and the chain is patched by _ngc_patch() once the
+ * target is known.
+ * @param op Jump operation
+ * @param chain Chain to link the jump into
+ * @return Status code
+ */
+static uint8_t _ngc_emit_jump(uint8_t op, uint32_t *chain) {
+    ngc_op_t *jump = _ngc_emit(op, 0);
+    if (jump == NULL) { return STATUS_NGC_OVERFLOW; }
+    jump->index = *chain;
+    *chain = ngc.end - 1;
+    return STATUS_OK;
+}
+
+/**
+ * @brief Evaluate a binary operator
+ * @param oper Operator, NGC_OPER_xxx
+ * @param a Left operand
+ * @param b Right operand
+ * @param value Result
+ * @return Status code
+ */
+static uint8_t _ngc_evaluate(uint8_t oper, double a, double b, double *value) {
+    switch (oper) {
+        case NGC_OPER_POWER:
+            *value = pow(a, b);
+            if (isnan(*value)) { return STATUS_NGC_EXPRESSION; }
+            break;
+        case NGC_OPER_MUL: *value = a * b; break;
+        case NGC_OPER_DIV:
+            if (b == 0.0) { return STATUS_NGC_EXPRESSION; }
+            *value = a / b;
+            break;
+        case NGC_OPER_MOD:
+            if (b == 0.0) { return STATUS_NGC_EXPRESSION; }
+            *value = fmod(a, b);
+            if (*value < 0.0) { *value += fabs(b); } // Never negative, as LinuxCNC
+            break;
+        case NGC_OPER_ADD: *value = a + b; break;
+        case NGC_OPER_SUB: *value = a - b; break;
+        case NGC_OPER_EQ: *value = (fabs(a - b) < NGC_EQUAL_TOLERANCE); break;
+        case NGC_OPER_NE: *value = (fabs(a - b) >= NGC_EQUAL_TOLERANCE); break;
+        case NGC_OPER_GT: *value = (a > b); break;
+        case NGC_OPER_GE: *value = (a >= b); break;
+        case NGC_OPER_LT: *value = (a < b); break;
+        case NGC_OPER_LE: *value = (a <= b); break;
+        case NGC_OPER_AND: *value = ((a != 0.0) && (b != 0.0)); break;
+        case NGC_OPER_OR: *value = ((a != 0.0) || (b != 0.0)); break;
+        case NGC_OPER_XOR: *value = ((a != 0.0) != (b != 0.0)); break;
+        case NGC_OPER_ATAN2: *value = atan2(a, b) * 180.0 / M_PI; break;
+        default: return STATUS_NGC_EXPRESSION;
+    }
+    return STATUS_OK;
+}
+
+/**
+ * @brief Execute a groomed line
+ *
+ * Plain G-Code outside any O-word block goes straight to gc_execute_line(). Anything else is compiled, and
+ * run, unless it is recorded into an O-word block.
+ * @param line Groomed G-Code line
+ * @return Status code
+ */
+uint8_t ngc_execute_line(char *line) {
+    if ((ngc.depth == 0) && (strpbrk(line, NGC_LINE_CHARS) == NULL)) { return gc_execute_line(line); }
+
+    uint8_t status = _ngc_compile_line(line);
+    if (ngc.depth > 0) {
+        // Recording. The block runs when the line closing it arrives.
+        if ((status != STATUS_OK) && (ngc.error == STATUS_OK)) { ngc.error = status; }
+        return status;
+    }
+
+    if ((status == STATUS_OK) && (ngc.error != STATUS_OK)) { status = ngc.error; }
+    if (status == STATUS_OK) {
+        ngc.running = true;
+        status = _ngc_run(ngc.base, ngc.end);
+        ngc.running = false;
+    }
+    ngc.end = ngc.base;
+    ngc.error = STATUS_OK;
+    if (ngc.program_end) { ngc_program_end(); }
+    return status;
+}
+
+/**
+ * @brief Execute a block of words, parsed in advance
+ *
+ * Executed at once outside any O-word block, and recorded like any other line inside one.
+ * @param words Words of the block
+ * @param n_words Number of words
+ * @return Status code
+ */
+uint8_t ngc_execute_words(gc_word_t *words, uint8_t n_words) {
+    if (ngc.depth == 0) { return gc_execute_words(words, n_words); }
+
+    uint8_t status = STATUS_OK;
+    for (uint8_t i = 0; (i < n_words) && (status == STATUS_OK); i++) {
+        ngc_op_t *push = _ngc_emit(NGC_OP_PUSH, 0);
+        if ((push == NULL) || (_ngc_emit(NGC_OP_WORD, (uint8_t) words[i].letter) == NULL)) {
+            status = STATUS_NGC_OVERFLOW;
+        } else {
+            push->value = words[i].value;
+        }
+    }
+    if ((status == STATUS_OK) && (_ngc_emit(NGC_OP_EXEC, 0) == NULL)) { status = STATUS_NGC_OVERFLOW; }
+    if ((status != STATUS_OK) && (ngc.error == STATUS_OK)) { ngc.error = status; }
+    return status;
+}
+
+/**
+ * @brief Find a keyword at the start of text
+ * @param table Keyword table
+ * @param size Keyword table entries
+ * @param text Text
+ * @return Keyword, NULL if none
+ */
+static const ngc_keyword_t *_ngc_match(const ngc_keyword_t *table, size_t size, const char *text) {
+    for (size_t i = 0; i < size; i++) {
+        if (strncmp(text, table[i].name, strlen(table[i].name)) == 0) { return &table[i]; }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Read a parameter name, and find or add its named parameter
+ * @param line Groomed line
+ * @param pos Position of the opening '<', advanced past the closing '>'
+ * @param index Named parameter index
+ * @return Status code
+ */
+static uint8_t _ngc_named_index(const char *line, uint16_t *pos, uint32_t *index) {
+    const char *name = &line[*pos + 1];
+    const char *close = strchr(name, '>');
+    if ((close == NULL) || (close == name) || (close - name >= NGC_NAME_LENGTH)) { return STATUS_NGC_PARAMETER; }
+    size_t len = (size_t) (close - name);
+    *pos += (uint16_t) (len + 2);
+    for (uint8_t i = 0; i < ngc_n_named; i++) {
+        if ((strncmp(ngc_named[i].name, name, len) == 0) && (ngc_named[i].name[len] == '\0')) {
+            *index = i;
+            return STATUS_OK;
+        }
+    }
+    if (ngc_n_named == NGC_NAMED_PARAMETERS) { return STATUS_NGC_PARAMETER; }
+    memcpy(ngc_named[ngc_n_named].name, name, len);
+    ngc_named[ngc_n_named].name[len] = '\0';
+    *index = ngc_n_named++;
+    return STATUS_OK;
+}
+
+/**
+ * @brief Open an O-word block
+ * @param type O-word opening the block, NGC_O_xxx
+ * @param name O-word name
+ * @return Status code
+ */
+static uint8_t _ngc_open(uint8_t type, const char *name) {
+    if (ngc.depth == NGC_BLOCK_DEPTH) { return STATUS_NGC_OVERFLOW; }
+    ngc_block_t *block = &ngc.blocks[ngc.depth++];
+    block->type = type;
+    strcpy(block->name, name);
+    block->start = ngc.end;
+    block->branch = NGC_NO_TARGET;
+    block->exits = NGC_NO_TARGET;
+    block->continues = NGC_NO_TARGET;
+    block->has_else = false;
+    return STATUS_OK;
+}
+
+/**
+ * @brief Patch a chain of jumps to their target
+ * @param chain Chain, from _ngc_emit_jump()
+ * @param target Target
+ */
+static void _ngc_patch(uint32_t chain, uint32_t target) {
+    while (chain != NGC_NO_TARGET) {
+        uint32_t next = ngc_ops[chain].index;
+        ngc_ops[chain].index = target;
+        chain = next;
+    }
+}
+
+/**
+ * @brief Program end
+ *
+ * Called by the parser at M2 and M30. Subroutines are forgotten, once the code running has finished.
+ */
+void ngc_program_end() {
+    if (ngc.running || (ngc.depth > 0)) {
+        ngc.program_end = true;
+        return;
+    }
+    ngc_n_subs = 0;
+    ngc.base = 0;
+    ngc.end = 0;
+    ngc.program_end = false;
+}
+
+/**
+ * @brief Reset the interpreter
+ *
+ * Clears all parameters, subroutines, and any block being recorded.
+ */
+void ngc_reset() {
+    memset(&ngc, 0, sizeof(ngc_t));
+    memset(ngc_params, 0, sizeof(ngc_params));
+    ngc_n_named = 0;
+    ngc_n_subs = 0;
+}
+
+/**
+ * @brief Check a backward jump, which closes a loop or enters a subroutine
+ *
+ * A loop that runs no G-Code never reaches the abort check of NGC_OP_EXEC, so jumps are checked as well.
+ * @param idle Backward jumps since a G-Code line was executed
+ * @return Status code
+ */
+static uint8_t _ngc_loop_check(uint32_t *idle) {
+    // Bail, if system abort.
+    if ((sys_state == SYS_STATE_FAULT) || (sys_state == SYS_STATE_ALARM)) { return STATUS_SYSTEM_GC_LOCK; }
+    if (++(*idle) == NGC_LOOP_LIMIT) { return STATUS_NGC_LOOP; }
+    return STATUS_OK;
+}
+
+/**
+ * @brief Run bytecode
+ * @param pc First op
+ * @param end End of the top level code
+ * @return Status code
+ */
+static uint8_t _ngc_run(uint32_t pc, uint32_t end) {
+    uint8_t status;
+    uint32_t idle = 0;
+    double a, b;
+    ngc.sp = 0;
+    ngc.n_counters = 0;
+    ngc.n_frames = 0;
+    ngc.n_pending = 0;
+    ngc.n_words = 0;
+
+    while (pc != end) {
+        uint32_t at = pc;
+        ngc_op_t *op = &ngc_ops[pc++];
+        switch (op->op) {
+            case NGC_OP_PUSH:
+            case NGC_OP_GET_NAMED:
+            case NGC_OP_EXISTS:
+                if (ngc.sp == NGC_STACK_SIZE) { return STATUS_NGC_OVERFLOW; }
+                if (op->op == NGC_OP_PUSH) { ngc.stack[ngc.sp++] = op->value; }
+                else if (op->op == NGC_OP_EXISTS) { ngc.stack[ngc.sp++] = ngc_named[op->index].set; }
+                else if (ngc_named[op->index].set) { ngc.stack[ngc.sp++] = ngc_named[op->index].value; }
+                else { return STATUS_NGC_PARAMETER; } // [Named parameter not set]
+                break;
+            case NGC_OP_GET: {
+                long number = lround(ngc.stack[ngc.sp - 1]);
+                if ((number < 1) || (number >= NGC_PARAMETERS)) { return STATUS_NGC_PARAMETER; }
+                ngc.stack[ngc.sp - 1] = ngc_params[number];
+                break;
+            }
+            case NGC_OP_UNARY:
+                if ((status = _ngc_apply(op->arg, &ngc.stack[ngc.sp - 1])) != STATUS_OK) { return status; }
+                break;
+            case NGC_OP_BINARY:
+                b = ngc.stack[--ngc.sp];
+                a = ngc.stack[ngc.sp - 1];
+                if ((status = _ngc_evaluate(op->arg, a, b, &ngc.stack[ngc.sp - 1])) != STATUS_OK) { return status; }
+                break;
+            case NGC_OP_WORD:
+                if (ngc.n_words == GC_MAX_WORDS) { return STATUS_OVERFLOW; }
+                ngc.words[ngc.n_words].letter = (char) op->arg;
+                ngc.words[ngc.n_words++].value = (float) ngc.stack[--ngc.sp];
+                break;
+            case NGC_OP_SET:
+            case NGC_OP_SET_NAMED: {
+                if (ngc.n_pending == NGC_PENDING_ASSIGNMENTS) { return STATUS_NGC_OVERFLOW; }
+                ngc_assignment_t *assignment = &ngc.pending[ngc.n_pending++];
+                assignment->value = ngc.stack[--ngc.sp];
+                assignment->named = (op->op == NGC_OP_SET_NAMED);
+                if (assignment->named) {
+                    assignment->index = op->index;
+                } else {
+                    long number = lround(ngc.stack[--ngc.sp]);
+                    if ((number < 1) || (number >= NGC_PARAMETERS)) { return STATUS_NGC_PARAMETER; }
+                    assignment->index = (uint32_t) number;
+                }
+                break;
+            }
+            case NGC_OP_EXEC:
+                // Assignments take effect after the whole line is evaluated
+                for (uint8_t i = 0; i < ngc.n_pending; i++) {
+                    ngc_assignment_t *assignment = &ngc.pending[i];
+                    if (assignment->named) {
+                        ngc_named[assignment->index].value = assignment->value;
+                        ngc_named[assignment->index].set = true;
+                    } else {
+                        ngc_params[assignment->index] = assignment->value;
+                    }
+                }
+                ngc.n_pending = 0;
+                if (ngc.n_words > 0) {
+                    status = gc_execute_words(ngc.words, ngc.n_words);
+                    ngc.n_words = 0;
+                    idle = 0;
+                    if (status != STATUS_OK) { return status; }
+                }
+                // Bail, if system abort.
+                if ((sys_state == SYS_STATE_FAULT) || (sys_state == SYS_STATE_ALARM)) { return STATUS_SYSTEM_GC_LOCK; }
+                break;
+            case NGC_OP_JUMP:
+                pc = op->index;
+                break;
+            case NGC_OP_JUMP_FALSE:
+            case NGC_OP_JUMP_TRUE:
+                if ((ngc.stack[--ngc.sp] != 0.0) == (op->op == NGC_OP_JUMP_TRUE)) { pc = op->index; }
+                break;
+            case NGC_OP_REPEAT: {
+                long count = lround(ngc.stack[--ngc.sp]);
+                if (count < 1) {
+                    pc = op->index;
+                    break;
+                }
+                if (ngc.n_counters == NGC_REPEAT_DEPTH) { return STATUS_NGC_OVERFLOW; }
+                ngc.counters[ngc.n_counters++] = (uint32_t) count;
+                break;
+            }
+            case NGC_OP_ENDREPEAT:
+                if (--ngc.counters[ngc.n_counters - 1] > 0) { pc = op->index; }
+                else { ngc.n_counters--; }
+                break;
+            case NGC_OP_UNWIND:
+                ngc.n_counters -= op->arg;
+                break;
+            case NGC_OP_CALL: {
+                if (ngc.n_frames == NGC_CALL_DEPTH) { return STATUS_NGC_OVERFLOW; }
+                if (!ngc_subs[op->index].defined) { return STATUS_NGC_UNDEFINED_SUB; }
+                ngc_frame_t *frame = &ngc.frames[ngc.n_frames++];
+                frame->return_pc = pc;
+                frame->counters = ngc.n_counters;
+                memcpy(frame->locals, &ngc_params[1], sizeof(frame->locals));
+                // Arguments are #1 - #n. The rest of the locals start at zero.
+                ngc.sp -= op->arg;
+                for (uint8_t i = 0; i < NGC_LOCAL_PARAMETERS; i++) {
+                    ngc_params[i + 1] = (i < op->arg) ? ngc.stack[ngc.sp + i] : 0.0;
+                }
+                pc = ngc_subs[op->index].start;
+                break;
+            }
+            case NGC_OP_RETURN: {
+                ngc_frame_t *frame = &ngc.frames[--ngc.n_frames];
+                memcpy(&ngc_params[1], frame->locals, sizeof(frame->locals));
+                ngc.n_counters = frame->counters;
+                pc = frame->return_pc;
+                break;
+            }
+            default:
+                return STATUS_NGC_EXPRESSION;
+        }
+        if ((pc <= at) && ((status = _ngc_loop_check(&idle)) != STATUS_OK)) { return status; }
+    }
+    return STATUS_OK;
+}
+
+/** @} */
+/** @} */
@@ -0,0 +1,47 @@
+/**
+ * @file ngc.h
+ * @brief rs274/ngc parameters, expressions and O-word control flow
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup motion_ngc
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_NGC_H
+#define OPENGLOW_CNC_NGC_H
+
+#include "../common.h"
+#include "gcode.h"
+
+#define NGC_PROGRAM_SIZE        65536   // Bytecode pool, shared by subroutines and the block being recorded (ops)
+#define NGC_PARAMETERS          5000    // Numbered parameters #1 - #4999
+#define NGC_LOCAL_PARAMETERS    30      // #1 - #30 are subroutine arguments, local to each call
+#define NGC_NAMED_PARAMETERS    64      // Named parameters, #<name>
+#define NGC_NAME_LENGTH         32      // Maximum parameter or O-word name length, including terminator
+#define NGC_SUBROUTINES         64      // Subroutines defined at once
+#define NGC_BLOCK_DEPTH         32      // O-word block nesting
+#define NGC_CALL_DEPTH          16      // Subroutine call nesting
+#define NGC_REPEAT_DEPTH        32      // Active REPEAT loops, across all calls
+#define NGC_STACK_SIZE          64      // Expression evaluation stack
+#define NGC_PENDING_ASSIGNMENTS 16      // Parameter assignments on one line
+#define NGC_LOOP_LIMIT          1000000 // Backward jumps without a G-Code line executed, before a loop is stopped
+#define NGC_EQUAL_TOLERANCE     0.0001  // EQ and NE comparison tolerance, as LinuxCNC
+#define NGC_LINE_CHARS          "#[O"   // A line without any of these is plain G-Code
+
+uint8_t ngc_execute_line(char *line);
+
+uint8_t ngc_execute_words(gc_word_t *words, uint8_t n_words);
+
+void ngc_program_end();
+
+void ngc_reset();
+
+#endif //OPENGLOW_CNC_NGC_H
+
+/** @} */
@@ -0,0 +1,1078 @@
+/**
+ * @file optimizer.c
+ * @brief Offline travel path optimizer for G-Code jobs
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup motion
+ *
+ * @{
+ * @defgroup motion_optimizer Travel Optimizer
+ *
+ * Splits a job into laser-on paths, reorders them to minimize laser-off travel, and rewrites the job.
+ *
+ * Ordering is a nearest neighbor tour refined by 2-opt. Paths nested inside a closed path are always
+ * cut before it, so inner features are finished before the outer cut drops the part.
+ * Jobs using features the optimizer can not safely reorder are written out unchanged.
+ *
+ * Raster rows, runs of collinear laser-on G1 moves mixing lit and zero power moves, are kept in scan order.
+ * Blank row ends are trimmed to an overscan long enough to reach the row feed rate, and long blank gaps
+ * are rapided over, keeping the overscan on both sides, when that is estimated to be faster than sweeping
+ * them. A job with raster rows is not reordered.
+ *
+ * @{
+ */
+
+#include <math.h>
+#include <string.h>
+#include "../openglow-cnc.h"
+#include "grbl_glue.h"
+
+/**
+ * @brief Line classification results
+ */
+enum opt_line_class {
+    OPT_LINE_MODAL,     /*!< Modal state only (or empty) */
+    OPT_LINE_MOTION,    /*!< Linear or arc motion */
+    OPT_LINE_OTHER,     /*!< Anything else. Only allowed before the first and after the last path */
+    OPT_LINE_ERROR,     /*!< Unsupported, optimization not possible */
+};
+
+/**
+ * @brief Parser modal state
+ */
+typedef struct {
+    float position[N_AXIS]; /*!< Current position (mm) */
+    uint8_t motion;         /*!< Motion mode */
+    uint8_t laser;          /*!< Laser M code (3, 4, or 5) */
+    bool inches;            /*!< G20 active */
+    float feed_rate;        /*!< Feed rate (mm/min) */
+    float power;            /*!< Laser power (S word) */
+} opt_state_t;
+
+/**
+ * @brief Single laser-on move
+ */
+typedef struct {
+    uint8_t motion;         /*!< MOTION_MODE_LINEAR, MOTION_MODE_CW_ARC or MOTION_MODE_CCW_ARC */
+    uint8_t laser;          /*!< Laser M code */
+    float start[N_AXIS];    /*!< Start point (mm) */
+    float end[N_AXIS];      /*!< End point (mm) */
+    float center[2];        /*!< XY arc center (mm) */
+    float feed_rate;        /*!< Feed rate (mm/min) */
+    float power;            /*!< Laser power (S word) */
+} opt_move_t;
+
+/**
+ * @brief Continuous laser-on path
+ */
+typedef struct {
+    uint32_t first;         /*!< Index of first move */
+    uint32_t count;         /*!< Number of moves */
+    float min[2], max[2];   /*!< XY bounding box */
+    float cut_time;         /*!< Estimated cutting time (min) */
+    bool closed;            /*!< Path ends where it starts */
+    bool reversed;          /*!< Emit moves in reverse */
+} opt_path_t;
+
+/**
+ * @brief Raster row move
+ */
+typedef struct {
+    float t0, t1;           /*!< Start and end distance along the row (mm) */
+    float end[N_AXIS];      /*!< End point (mm) */
+    float feed_rate;        /*!< Feed rate (mm/min) */
+    float power;            /*!< Laser power (S word). Zero is blank. */
+} opt_raster_move_t;
+
+/**
+ * @brief Raster row being collected
+ */
+typedef struct {
+    uint32_t first, last;       /*!< Input lines of the row */
+    float start[N_AXIS];        /*!< Row start point (mm) */
+    float dir[2];               /*!< XY unit direction */
+    opt_state_t entry;          /*!< Modal state before the row */
+    opt_state_t exit;           /*!< Modal state after the row */
+    opt_raster_move_t *moves;   /*!< Moves along the row */
+    uint32_t count;             /*!< Number of moves */
+} opt_raster_row_t;
+
+/**
+ * @brief Raster blank span totals
+ */
+typedef struct {
+    uint32_t rows;          /*!< Raster rows found */
+    uint32_t trimmed;       /*!< Row ends trimmed */
+    uint32_t skipped;       /*!< Interior gaps rapided over */
+    float trimmed_mm;       /*!< Blank distance trimmed from row ends (mm) */
+    float skipped_mm;       /*!< Blank distance rapided over instead of swept (mm) */
+    float saved;            /*!< Estimated time saved (min) */
+} opt_raster_stats_t;
+
+/**
+ * @brief Inner before outer ordering constraint
+ */
+typedef struct {
+    uint32_t inner, outer;
+} opt_edge_t;
+
+/** @brief Raw input lines */
+static char **opt_lines = NULL;
+/** @brief Number of raw input lines */
+static uint32_t opt_n_lines = 0;
+/** @brief Move table */
+static opt_move_t *opt_moves = NULL;
+/** @brief Number of moves */
+static uint32_t opt_n_moves = 0;
+/** @brief Path table */
+static opt_path_t *opt_paths = NULL;
+/** @brief Number of paths */
+static uint32_t opt_n_paths = 0;
+/** @brief Ordering constraints */
+static opt_edge_t *opt_edges = NULL;
+/** @brief Number of ordering constraints */
+static uint32_t opt_n_edges = 0;
+/** @brief Line table rewritten by the raster pass */
+static char **opt_raster_lines = NULL;
+/** @brief Number of rewritten lines */
+static uint32_t opt_raster_n_lines = 0;
+
+// Static function declarations
+static ssize_t _opt_load(const char *in_path);
+static int8_t _opt_parse_line(char *line, opt_state_t *st, opt_move_t *mv, bool *is_cut, const char **reason);
+static void _opt_path_close(opt_path_t *path);
+static void _opt_build_constraints();
+static void _opt_order(uint32_t *seq, const float *origin, bool allow_reverse);
+static void _opt_two_opt(uint32_t *seq, const float *origin, bool allow_reverse);
+static const float *_opt_path_start(uint32_t p);
+static const float *_opt_path_end(uint32_t p);
+static float _opt_dist(const float *a, const float *b);
+static float _opt_travel_time(const float *a, const float *b);
+static float _opt_move_length(const opt_move_t *mv);
+static float _opt_ramp_time(float length, float rate, float accel);
+static void _opt_raster(opt_raster_stats_t *stats);
+static void _opt_raster_flush(opt_raster_row_t *row, bool trail_free, opt_raster_stats_t *stats);
+static void _opt_raster_line(const char *line);
+static void _opt_raster_point(const opt_raster_row_t *row, float t, float *point);
+static float _opt_raster_sweep_time(const opt_raster_row_t *row, float a, float b);
+static void _opt_report_rendered(const char *in_path, const char *out_path);
+static void _opt_write_path(FILE *out, uint32_t p, opt_state_t *emitted);
+static void _opt_free();
+
+/**
+ * @brief Optimize laser-off travel in a G-Code job
+ *
+ * When the job can not be optimized, it is copied to the output unchanged.
+ * @param in_path Input G-Code file
+ * @param out_path Output G-Code file
+ * @param allow_reverse Allow open paths to be cut in reverse
+ * @return 0 on success, negative on error.
+ */
+ssize_t optimizer_run(const char *in_path, const char *out_path, bool allow_reverse) {
+    ssize_t ret = 0;
+    if ((ret = _opt_load(in_path)) < 0) {
+        _opt_free();
+        return ret;
+    }
+    opt_raster_stats_t raster;
+    _opt_raster(&raster);
+
+    FILE *out = fopen(out_path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "optimizer_run: unable to open %s\n", out_path);
+        _opt_free();
+        return -1;
+    }
+
+    if (raster.rows > 0) {
+        // Reordering would break up the rows. Write them in scan order.
+        for (uint32_t l = 0; l < opt_n_lines; l++) fprintf(out, "%s\n", opt_lines[l]);
+        fclose(out);
+        printf("Optimizer: %u raster rows, kept in scan order\n", raster.rows);
+        printf("Optimizer: %u row ends trimmed %.1fmm, %u blank gaps rapided %.1fmm\n", raster.trimmed,
+               raster.trimmed_mm, raster.skipped, raster.skipped_mm);
+        printf("Optimizer: estimated %.1fs saved\n", raster.saved * 60);
+        _opt_free();
+        _opt_report_rendered(in_path, out_path);
+        return ret;
+    }
+
+    opt_state_t st = {0};
+    st.motion = MOTION_MODE_SEEK;
+    st.laser = 5;
+    opt_state_t header_state = st, trailer_state = st;
+    opt_move_t mv;
+    opt_path_t *path = NULL;
+    int32_t header_end = -1, trailer_start = -1, first_other = -1;
+    const char *reason = NULL;
+    char buf[CLI_LINE_LENGTH];
+
+    for (uint32_t l = 0; (l < opt_n_lines) && (reason == NULL); l++) {
+        bool is_cut = false;
+        opt_state_t prev = st;
+        if (strlen(opt_lines[l]) >= CLI_LINE_LENGTH) {
+            reason = "line too long";
+            break;
+        }
+        memset(buf, 0, sizeof(buf));
+        gc_process_line(opt_lines[l], buf);
+        switch (_opt_parse_line(buf, &st, &mv, &is_cut, &reason)) {
+            case OPT_LINE_MOTION: {
+                if (header_end < 0) {
+                    header_end = l;
+                    header_state = prev;
+                }
+                if (is_cut) {
+                    if (path == NULL) {
+                        opt_paths = realloc(opt_paths, (opt_n_paths + 1) * sizeof(opt_path_t));
+                        path = &opt_paths[opt_n_paths++];
+                        memset(path, 0, sizeof(opt_path_t));
+                        path->first = opt_n_moves;
+                    }
+                    opt_moves = realloc(opt_moves, (opt_n_moves + 1) * sizeof(opt_move_t));
+                    opt_moves[opt_n_moves++] = mv;
+                    path->count++;
+                    trailer_start = l + 1;
+                    trailer_state = st;
+                } else if (path != NULL) {
+                    _opt_path_close(path);
+                    path = NULL;
+                }
+                break;
+            }
+            case OPT_LINE_OTHER: {
+                // Only allowed ahead of the first motion, or after the last cut
+                if ((header_end >= 0) && (first_other < 0)) first_other = l;
+                if (path != NULL) _opt_path_close(path);
+                path = NULL;
+                break;
+            }
+            default:;
+        }
+    }
+    if (path != NULL) _opt_path_close(path);
+
+    if ((reason == NULL) && (first_other >= 0) && (first_other < trailer_start)) {
+        reason = "unsupported command between paths";
+    }
+    if ((reason == NULL) && (opt_n_paths < 2)) reason = "fewer than two paths";
+
+    if (reason != NULL) {
+        printf("Optimizer: %s, job copied unchanged\n", reason);
+        for (uint32_t l = 0; l < opt_n_lines; l++) fprintf(out, "%s\n", opt_lines[l]);
+        fclose(out);
+        _opt_free();
+        return 0;
+    }
+
+    // Travel origin is the position at the end of the header
+    const float *origin = header_state.position;
+
+    // Baseline: original order and direction
+    float cut_time = 0, travel_before = 0, travel_after = 0, dist_before = 0, dist_after = 0;
+    const float *pos = origin;
+    for (uint32_t p = 0; p < opt_n_paths; p++) {
+        cut_time += opt_paths[p].cut_time;
+        travel_before += _opt_travel_time(pos, _opt_path_start(p));
+        dist_before += _opt_dist(pos, _opt_path_start(p));
+        pos = _opt_path_end(p);
+    }
+
+    _opt_build_constraints();
+    uint32_t *seq = malloc(opt_n_paths * sizeof(uint32_t));
+    _opt_order(seq, origin, allow_reverse);
+    if (opt_n_paths <= OPT_2OPT_MAX_PATHS) _opt_two_opt(seq, origin, allow_reverse);
+
+    pos = origin;
+    for (uint32_t k = 0; k < opt_n_paths; k++) {
+        travel_after += _opt_travel_time(pos, _opt_path_start(seq[k]));
+        dist_after += _opt_dist(pos, _opt_path_start(seq[k]));
+        pos = _opt_path_end(seq[k]);
+    }
+
+    // Write job
+    for (uint32_t l = 0; l < (uint32_t) header_end; l++) fprintf(out, "%s\n", opt_lines[l]);
+    opt_state_t emitted = header_state;
+    for (uint32_t k = 0; k < opt_n_paths; k++) _opt_write_path(out, seq[k], &emitted);
+
+    // Restore the modal state the trailer was written against
+    if (emitted.laser != trailer_state.laser) fprintf(out, "M%d\n", trailer_state.laser);
+    fprintf(out, "G%d F%.1f S%.1f\n", (trailer_state.motion == MOTION_MODE_SEEK) ? 0 : 1,
+            trailer_state.feed_rate, trailer_state.power);
+    // The feed rate is in mm/min, so the job's units are restored after it
+    if (emitted.inches != trailer_state.inches) fprintf(out, "G%d\n", trailer_state.inches ? 20 : 21);
+    for (uint32_t l = (uint32_t) trailer_start; l < opt_n_lines; l++) fprintf(out, "%s\n", opt_lines[l]);
+    fclose(out);
+
+    printf("Optimizer: %u paths, %u ordering constraints\n", opt_n_paths, opt_n_edges);
+    printf("Optimizer: travel %.1fmm -> %.1fmm\n", dist_before, dist_after);
+    printf("Optimizer: estimated job time %.1fs -> %.1fs (%.1fs saved)\n",
+           (cut_time + travel_before) * 60, (cut_time + travel_after) * 60, (travel_before - travel_after) * 60);
+
+    free(seq);
+    _opt_free();
+    _opt_report_rendered(in_path, out_path);
+    return ret;
+}
+
+/**
+ * @brief Report the time saved, as rendered by the motion pipeline
+ * @param in_path Input G-Code file
+ * @param out_path Optimized G-Code file
+ */
+static void _opt_report_rendered(const char *in_path, const char *out_path) {
+    double before = 0, after = 0;
+    if ((render_machine_time(in_path, &before) < 0) || (render_machine_time(out_path, &after) < 0)) {
+        printf("Optimizer: job did not render, actual time saved unknown\n");
+        return;
+    }
+    printf("Optimizer: rendered job time %.1fs -> %.1fs (%.1fs saved)\n", before, after, before - after);
+}
+
+/**
+ * @brief Read job file into line table
+ * @param in_path Input G-Code file
+ * @return 0 on success, negative on error.
+ */
+static ssize_t _opt_load(const char *in_path) {
+    FILE *in = fopen(in_path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "_opt_load: unable to open %s\n", in_path);
+        return -1;
+    }
+    char *line = NULL;
+    size_t len = 0;
+    while (getline(&line, &len, in) != -1) {
+        strtok(line, "\r");
+        strtok(line, "\n");
+        if ((line[0] == '\n') || (line[0] == '\r')) line[0] = 0;
+        opt_lines = realloc(opt_lines, (opt_n_lines + 1) * sizeof(char *));
+        opt_lines[opt_n_lines++] = strdup(line);
+    }
+    free(line);
+    fclose(in);
+    if (verbose) printf("_opt_load: read %u lines from %s\n", opt_n_lines, in_path);
+    return 0;
+}
+
+/**
+ * @brief Parse a single groomed G-Code line
+ * @param line Groomed line (upper case, no whitespace or comments)
+ * @param st Parser modal state. Updated.
+ * @param mv Filled in with the move when the line is a laser-on motion
+ * @param is_cut Set true if the line is a laser-on motion
+ * @param reason Set to a description on OPT_LINE_ERROR
+ * @return Line classification
+ */
+static int8_t _opt_parse_line(char *line, opt_state_t *st, opt_move_t *mv, bool *is_cut, const char **reason) {
+    uint8_t char_counter = 0;
+    float value, xyz[N_AXIS], ij[2] = {0}, r = 0;
+    uint8_t axis_words = 0, motion = st->motion;
+    bool other = false, has_r = false;
+    float scale = (st->inches) ? (float) MM_PER_INCH : 1;
+
+    memcpy(xyz, st->position, sizeof(xyz));
+    *is_cut = false;
+
+    // Units may change anywhere in the line, so find them first
+    for (uint8_t i = 0; line[i] != 0; i++) {
+        if ((line[i] == 'G') && (line[i + 1] == '2') && ((line[i + 2] == '0') || (line[i + 2] == '1'))
+            && ((line[i + 3] < '0') || (line[i + 3] > '9')) && (line[i + 3] != '.')) {
+            st->inches = (line[i + 2] == '0');
+            scale = (st->inches) ? (float) MM_PER_INCH : 1;
+        }
+    }
+
+    while (line[char_counter] != 0) {
+        char letter = line[char_counter++];
+        if ((letter < 'A') || (letter > 'Z') || !read_float(line, &char_counter, &value)) {
+            *reason = "malformed line";
+            return OPT_LINE_ERROR;
+        }
+        uint16_t int_value = (uint16_t) truncf(value);
+        switch (letter) {
+            case 'G': {
+                if (value != int_value) {
+                    other = true;
+                    break;
+                }
+                switch (int_value) {
+                    case 0:
+                    case 1:
+                    case 2:
+                    case 3:
+                        motion = (uint8_t) int_value;
+                        break;
+                    case 17:
+                    case 20:
+                    case 21:
+                    case 40:
+                    case 49:
+                    case 54:
+                    case 61:
+                    case 90:
+                    case 94:
+                        break;
+                    case 91:
+                        *reason = "incremental distance mode (G91)";
+                        return OPT_LINE_ERROR;
+                    case 93:
+                        *reason = "inverse time feed mode (G93)";
+                        return OPT_LINE_ERROR;
+                    case 18:
+                    case 19:
+                        *reason = "arc plane other than XY";
+                        return OPT_LINE_ERROR;
+                    default:
+                        other = true;
+                }
+                break;
+            }
+            case 'M': {
+                if ((int_value >= 3) && (int_value <= 5) && (value == int_value)) {
+                    st->laser = (uint8_t) int_value;
+                } else {
+                    other = true;
+                }
+                break;
+            }
+            case 'F':
+                st->feed_rate = value * scale;
+                break;
+            case 'S':
+                st->power = value;
+                break;
+            case 'N':
+                break;
+            case 'X':
+            case 'Y':
+            case 'Z':
+                xyz[letter - 'X'] = value * scale;
+                axis_words |= bit(letter - 'X');
+                break;
+            case 'I':
+            case 'J':
+                ij[letter - 'I'] = value * scale;
+                break;
+            case 'R':
+                r = value * scale;
+                has_r = true;
+                break;
+            default:
+                other = true;
+        }
+    }
+
+    if (other) {
+        // Position tracking for lines we do not model is best effort
+        if (axis_words) memcpy(st->position, xyz, sizeof(xyz));
+        return OPT_LINE_OTHER;
+    }
+    st->motion = motion;
+    if (!axis_words) return OPT_LINE_MODAL;
+
+    memset(mv, 0, sizeof(opt_move_t));
+    mv->motion = motion;
+    mv->laser = st->laser;
+    mv->feed_rate = st->feed_rate;
+    mv->power = st->power;
+    memcpy(mv->start, st->position, sizeof(mv->start));
+    memcpy(mv->end, xyz, sizeof(mv->end));
+
+    if ((motion == MOTION_MODE_CW_ARC) || (motion == MOTION_MODE_CCW_ARC)) {
+        if (has_r) {
+            // Same construction as the G-Code parser, see gcode.c
+            float x = xyz[X_AXIS] - st->position[X_AXIS];
+            float y = xyz[Y_AXIS] - st->position[Y_AXIS];
+            float h_x2_div_d = 4 * r * r - x * x - y * y;
+            if ((h_x2_div_d < 0) || ((x == 0) && (y == 0))) {
+                *reason = "arc radius error";
+                return OPT_LINE_ERROR;
+            }
+            h_x2_div_d = -sqrtf(h_x2_div_d) / hypot_f(x, y);
+            if (motion == MOTION_MODE_CCW_ARC) { h_x2_div_d = -h_x2_div_d; }
+            if (r < 0) { h_x2_div_d = -h_x2_div_d; }
+            ij[0] = 0.5f * (x - (y * h_x2_div_d));
+            ij[1] = 0.5f * (y + (x * h_x2_div_d));
+        }
+        mv->center[X_AXIS] = st->position[X_AXIS] + ij[0];
+        mv->center[Y_AXIS] = st->position[Y_AXIS] + ij[1];
+    }
+    memcpy(st->position, xyz, sizeof(xyz));
+
+    *is_cut = (motion != MOTION_MODE_SEEK) && (st->laser != 5) && (st->power > 0);
+    return OPT_LINE_MOTION;
+}
+
+/**
+ * @brief Find raster rows, and rewrite them without the blank spans worth skipping
+ *
+ * Works on the line table, before paths are collected. If any row was found, the line table is replaced with
+ * the rewritten one. Otherwise, or if the job can't be parsed, it is left as is.
+ * @param stats Raster totals output
+ */
+static void _opt_raster(opt_raster_stats_t *stats) {
+    opt_state_t st = {0}, prev;
+    st.motion = MOTION_MODE_SEEK;
+    st.laser = 5;
+    opt_raster_row_t row = {0};
+    opt_move_t mv;
+    bool is_cut;
+    const char *reason = NULL;
+    char buf[CLI_LINE_LENGTH];
+    memset(stats, 0, sizeof(opt_raster_stats_t));
+
+    for (uint32_t l = 0; (l < opt_n_lines) && (reason == NULL); l++) {
+        prev = st;
+        if (strlen(opt_lines[l]) >= CLI_LINE_LENGTH) {
+            reason = "line too long";
+            break;
+        }
+        memset(buf, 0, sizeof(buf));
+        gc_process_line(opt_lines[l], buf);
+        int8_t line_class = _opt_parse_line(buf, &st, &mv, &is_cut, &reason);
+        if (line_class == OPT_LINE_ERROR) break;
+
+        // A row is laser-on G1 moves in one direction, at one Z. Modal lines in between are carried by the moves.
+        bool laser_on = (st.laser != 5) && (st.laser == prev.laser) && !st.inches;
+        bool flat_feed = (line_class == OPT_LINE_MOTION) && (mv.motion == MOTION_MODE_LINEAR) &&
+                         (mv.feed_rate > 0) && (mv.start[Z_AXIS] == mv.end[Z_AXIS]);
+        float delta[2] = {0, 0}, length = 0;
+        if (line_class == OPT_LINE_MOTION) {
+            delta[X_AXIS] = mv.end[X_AXIS] - mv.start[X_AXIS];
+            delta[Y_AXIS] = mv.end[Y_AXIS] - mv.start[Y_AXIS];
+            length = hypot_f(delta[X_AXIS], delta[Y_AXIS]);
+        }
+        bool on_row = laser_on && (row.count > 0) && ((line_class == OPT_LINE_MODAL) || (flat_feed &&
+                ((length == 0) || ((mv.start[Z_AXIS] == row.start[Z_AXIS]) &&
+                                   (delta[X_AXIS] * row.dir[X_AXIS] + delta[Y_AXIS] * row.dir[Y_AXIS] > 0) &&
+                                   (fabsf(delta[X_AXIS] * row.dir[Y_AXIS] - delta[Y_AXIS] * row.dir[X_AXIS]) <=
+                                    OPT_RASTER_COLLINEAR * length)))));
+
+        if (!on_row) {
+            // Only a linear move leaves the machine where it goes, whatever position the row ended at
+            _opt_raster_flush(&row, (line_class == OPT_LINE_MOTION) && (mv.motion != MOTION_MODE_CW_ARC) &&
+                                    (mv.motion != MOTION_MODE_CCW_ARC), stats);
+            if (!laser_on || !flat_feed || (length == 0)) {
+                _opt_raster_line(opt_lines[l]);
+                continue;
+            }
+            // New row
+            row.first = l;
+            row.entry = prev;
+            memcpy(row.start, mv.start, sizeof(row.start));
+            row.dir[X_AXIS] = delta[X_AXIS] / length;
+            row.dir[Y_AXIS] = delta[Y_AXIS] / length;
+        }
+        row.last = l;
+        row.exit = st;
+        if ((line_class != OPT_LINE_MOTION) || (length == 0)) continue;
+        row.moves = realloc(row.moves, (row.count + 1) * sizeof(opt_raster_move_t));
+        opt_raster_move_t *move = &row.moves[row.count++];
+        move->t0 = (row.count > 1) ? row.moves[row.count - 2].t1 : 0;
+        move->t1 = (mv.end[X_AXIS] - row.start[X_AXIS]) * row.dir[X_AXIS] +
+                   (mv.end[Y_AXIS] - row.start[Y_AXIS]) * row.dir[Y_AXIS];
+        memcpy(move->end, mv.end, sizeof(move->end));
+        move->feed_rate = mv.feed_rate;
+        move->power = mv.power;
+    }
+    if (reason == NULL) { _opt_raster_flush(&row, true, stats); }
+    free(row.moves);
+
+    if ((reason != NULL) || (stats->rows == 0)) {
+        if (verbose && (reason != NULL)) printf("_opt_raster: %s, no raster rows\n", reason);
+        memset(stats, 0, sizeof(opt_raster_stats_t));
+        for (uint32_t l = 0; l < opt_raster_n_lines; l++) free(opt_raster_lines[l]);
+        free(opt_raster_lines);
+    } else {
+        for (uint32_t l = 0; l < opt_n_lines; l++) free(opt_lines[l]);
+        free(opt_lines);
+        opt_lines = opt_raster_lines;
+        opt_n_lines = opt_raster_n_lines;
+    }
+    opt_raster_lines = NULL;
+    opt_raster_n_lines = 0;
+}
+
+/**
+ * @brief Write out a collected raster row
+ *
+ * A row with both lit and blank moves is rewritten with its blank ends trimmed, and long blank gaps rapided
+ * over. Anything else is copied as is.
+ * @param row Row. Emptied.
+ * @param trail_free The line after the row doesn't depend on where the row ends
+ * @param stats Raster totals. Updated.
+ */
+static void _opt_raster_flush(opt_raster_row_t *row, bool trail_free, opt_raster_stats_t *stats) {
+    if (row->count == 0) return;
+    float feed = 0, first_lit = -1, last_lit = 0;
+    bool blank = false;
+    for (uint32_t m = 0; m < row->count; m++) {
+        if (row->moves[m].power <= 0) {
+            blank = true;
+            continue;
+        }
+        feed = max(feed, row->moves[m].feed_rate);
+        if (first_lit < 0) first_lit = row->moves[m].t0;
+        last_lit = row->moves[m].t1;
+    }
+    if ((first_lit < 0) || !blank) {
+        for (uint32_t l = row->first; l <= row->last; l++) _opt_raster_line(opt_lines[l]);
+        row->count = 0;
+        return;
+    }
+    stats->rows++;
+
+    // The overscan brings the head up to speed from rest, at the blank moves' travel acceleration
+    float length = row->moves[row->count - 1].t1;
+    float unit_vec[N_AXIS] = {row->dir[X_AXIS], row->dir[Y_AXIS], 0};
+    float accel = limit_value_by_axis_maximum(settings.travel_acceleration, unit_vec);
+    float overscan = feed * feed / (2 * accel) + (float) OPT_RASTER_OVERSCAN_MARGIN;
+    float pa[N_AXIS], pb[N_AXIS];
+
+    // Spans of the row to sweep, at most one per move plus one
+    float (*keep)[2] = malloc((row->count + 1) * sizeof(float[2]));
+    uint32_t n_keep = 0;
+    float a = 0, b = length;
+    if (first_lit - overscan > 0) {
+        _opt_raster_point(row, first_lit - overscan, pb);
+        float saved = _opt_raster_sweep_time(row, 0, first_lit - overscan) - _opt_travel_time(row->start, pb);
+        if (saved > 0) {
+            a = first_lit - overscan;
+            stats->trimmed++;
+            stats->trimmed_mm += a;
+            stats->saved += saved;
+        }
+    }
+    float lit_end = 0;
+    bool lit_seen = false;
+    for (uint32_t m = 0; m < row->count; m++) {
+        if (row->moves[m].power <= 0) continue;
+        float g0 = lit_end + overscan, g1 = row->moves[m].t0 - overscan;
+        bool gap = lit_seen && (g1 - g0 >= OPT_RASTER_MIN_GAP);
+        lit_seen = true;
+        lit_end = row->moves[m].t1;
+        if (!gap) continue;
+        _opt_raster_point(row, g0, pa);
+        _opt_raster_point(row, g1, pb);
+        float sweep = _opt_raster_sweep_time(row, g0, g1);
+        float skip = _opt_travel_time(pa, pb) + 2 * (_opt_ramp_time(overscan, feed, accel) - overscan / feed);
+        if (skip >= sweep) continue;
+        keep[n_keep][0] = a;
+        keep[n_keep++][1] = g0;
+        a = g1;
+        stats->skipped++;
+        stats->skipped_mm += g1 - g0;
+        stats->saved += sweep - skip;
+    }
+    if (last_lit + overscan < length) {
+        _opt_raster_point(row, last_lit + overscan, pa);
+        float saved = _opt_raster_sweep_time(row, last_lit + overscan, length);
+        if (!trail_free) saved -= _opt_travel_time(pa, row->moves[row->count - 1].end);
+        if (saved > 0) {
+            b = last_lit + overscan;
+            stats->trimmed++;
+            stats->trimmed_mm += length - b;
+            stats->saved += saved;
+        }
+    }
+    keep[n_keep][0] = a;
+    keep[n_keep++][1] = b;
+
+    // Sweep the kept spans, rapiding between them
+    char line[CLI_LINE_LENGTH];
+    opt_state_t emitted = row->entry;
+    float t = 0;
+    for (uint32_t k = 0; k < n_keep; k++) {
+        if (keep[k][0] > t) {
+            _opt_raster_point(row, keep[k][0], pa);
+            snprintf(line, sizeof(line), "G0 X%.4f Y%.4f", pa[X_AXIS], pa[Y_AXIS]);
+            _opt_raster_line(line);
+            emitted.motion = MOTION_MODE_SEEK;
+            t = keep[k][0];
+        }
+        for (uint32_t m = 0; (m < row->count) && (row->moves[m].t0 < keep[k][1]); m++) {
+            opt_raster_move_t *move = &row->moves[m];
+            float t1 = min(move->t1, keep[k][1]);
+            if (t1 <= t) continue;
+            if (t1 == move->t1) memcpy(pb, move->end, sizeof(pb));
+            else _opt_raster_point(row, t1, pb);
+            int len = snprintf(line, sizeof(line), "G1 X%.4f Y%.4f", pb[X_AXIS], pb[Y_AXIS]);
+            if (move->feed_rate != emitted.feed_rate) {
+                len += snprintf(line + len, sizeof(line) - len, " F%.1f", move->feed_rate);
+            }
+            if (move->power != emitted.power) snprintf(line + len, sizeof(line) - len, " S%.1f", move->power);
+            _opt_raster_line(line);
+            emitted.motion = MOTION_MODE_LINEAR;
+            emitted.feed_rate = move->feed_rate;
+            emitted.power = move->power;
+            t = t1;
+        }
+    }
+    free(keep);
+    if (!trail_free && (t < length)) {
+        memcpy(pb, row->moves[row->count - 1].end, sizeof(pb));
+        snprintf(line, sizeof(line), "G0 X%.4f Y%.4f", pb[X_AXIS], pb[Y_AXIS]);
+        _opt_raster_line(line);
+        emitted.motion = MOTION_MODE_SEEK;
+    }
+
+    // Restore the modal state the rest of the job was written against
+    if ((emitted.motion != row->exit.motion) || (emitted.feed_rate != row->exit.feed_rate) ||
+        (emitted.power != row->exit.power)) {
+        snprintf(line, sizeof(line), "G%d F%.1f S%.1f", row->exit.motion, row->exit.feed_rate, row->exit.power);
+        _opt_raster_line(line);
+    }
+    row->count = 0;
+}
+
+/**
+ * @brief Append a line to the rewritten line table
+ * @param line Line to copy
+ */
+static void _opt_raster_line(const char *line) {
+    opt_raster_lines = realloc(opt_raster_lines, (opt_raster_n_lines + 1) * sizeof(char *));
+    opt_raster_lines[opt_raster_n_lines++] = strdup(line);
+}
+
+/**
+ * @brief Point along a raster row
+ * @param row Row
+ * @param t Distance from the row start (mm)
+ * @param point Point output (mm)
+ */
+static void _opt_raster_point(const opt_raster_row_t *row, float t, float *point) {
+    point[X_AXIS] = row->start[X_AXIS] + row->dir[X_AXIS] * t;
+    point[Y_AXIS] = row->start[Y_AXIS] + row->dir[Y_AXIS] * t;
+    point[Z_AXIS] = row->start[Z_AXIS];
+}
+
+/**
+ * @brief Time to sweep part of a raster row at its programmed feed rates
+ * @param row Row
+ * @param a Start distance from the row start (mm)
+ * @param b End distance from the row start (mm)
+ * @return Sweep time (min)
+ */
+static float _opt_raster_sweep_time(const opt_raster_row_t *row, float a, float b) {
+    float time = 0;
+    for (uint32_t m = 0; m < row->count; m++) {
+        float overlap = min(b, row->moves[m].t1) - max(a, row->moves[m].t0);
+        if (overlap > 0) time += overlap / row->moves[m].feed_rate;
+    }
+    return time;
+}
+
+/**
+ * @brief Finish a path: bounding box, closed test and cut time estimate
+ * @param path Path to close
+ */
+static void _opt_path_close(opt_path_t *path) {
+    opt_move_t *first = &opt_moves[path->first];
+    path->min[X_AXIS] = path->max[X_AXIS] = first->start[X_AXIS];
+    path->min[Y_AXIS] = path->max[Y_AXIS] = first->start[Y_AXIS];
+    for (uint32_t m = path->first; m < path->first + path->count; m++) {
+        opt_move_t *mv = &opt_moves[m];
+        float pts[9][2];
+        uint8_t n_pts = 0;
+        pts[n_pts][0] = mv->end[X_AXIS];
+        pts[n_pts++][1] = mv->end[Y_AXIS];
+        if (mv->motion != MOTION_MODE_LINEAR) {
+            // Sample the arc for a close enough box
+            float r0 = mv->start[X_AXIS] - mv->center[X_AXIS], r1 = mv->start[Y_AXIS] - mv->center[Y_AXIS];
+            float radius = hypot_f(r0, r1);
+            float a0 = atan2f(r1, r0);
+            float sweep = _opt_move_length(mv) / ((radius > 0) ? radius : 1);
+            if (mv->motion == MOTION_MODE_CW_ARC) sweep = -sweep;
+            for (uint8_t s = 1; s < 9; s++) {
+                float a = a0 + sweep * s / 9;
+                pts[n_pts][0] = mv->center[X_AXIS] + radius * cosf(a);
+                pts[n_pts++][1] = mv->center[Y_AXIS] + radius * sinf(a);
+            }
+        }
+        for (uint8_t s = 0; s < n_pts; s++) {
+            for (uint8_t i = 0; i < 2; i++) {
+                path->min[i] = min(path->min[i], pts[s][i]);
+                path->max[i] = max(path->max[i], pts[s][i]);
+            }
+        }
+        // Constant feed plus one accelerate/decelerate pair for the path
+        float feed = (mv->feed_rate > 0) ? mv->feed_rate : 1;
+        path->cut_time += _opt_move_length(mv) / feed;
+    }
+    float unit_vec[N_AXIS] = {1, 1, 0};
+    convert_delta_vector_to_unit_vector(unit_vec);
+    float accel = limit_value_by_axis_maximum(settings.acceleration, unit_vec);
+    path->cut_time += first->feed_rate / accel;
+    path->closed = _opt_dist(_opt_path_start((uint32_t) (path - opt_paths)),
+                             _opt_path_end((uint32_t) (path - opt_paths))) <= OPT_CLOSED_PATH_TOLERANCE;
+}
+
+/**
+ * @brief Build inner before outer constraints from closed path bounding boxes
+ */
+static void _opt_build_constraints() {
+    for (uint32_t o = 0; o < opt_n_paths; o++) {
+        if (!opt_paths[o].closed) continue;
+        opt_path_t *outer = &opt_paths[o];
+        for (uint32_t i = 0; i < opt_n_paths; i++) {
+            opt_path_t *inner = &opt_paths[i];
+            if ((i == o) ||
+                (inner->min[X_AXIS] < outer->min[X_AXIS] + OPT_CONTAIN_TOLERANCE) ||
+                (inner->min[Y_AXIS] < outer->min[Y_AXIS] + OPT_CONTAIN_TOLERANCE) ||
+                (inner->max[X_AXIS] > outer->max[X_AXIS] - OPT_CONTAIN_TOLERANCE) ||
+                (inner->max[Y_AXIS] > outer->max[Y_AXIS] - OPT_CONTAIN_TOLERANCE)) {
+                continue;
+            }
+            opt_edges = realloc(opt_edges, (opt_n_edges + 1) * sizeof(opt_edge_t));
+            opt_edges[opt_n_edges++] = (opt_edge_t) {.inner = i, .outer = o};
+        }
+    }
+    if (verbose) printf("_opt_build_constraints: %u constraints\n", opt_n_edges);
+}
+
+/**
+ * @brief Greedy nearest neighbor ordering honoring constraints
+ * @param seq Resulting path sequence
+ * @param origin Starting position
+ * @param allow_reverse Allow open paths to be reversed
+ */
+static void _opt_order(uint32_t *seq, const float *origin, bool allow_reverse) {
+    uint32_t *blocked = calloc(opt_n_paths, sizeof(uint32_t));
+    bool *done = calloc(opt_n_paths, sizeof(bool));
+    for (uint32_t e = 0; e < opt_n_edges; e++) blocked[opt_edges[e].outer]++;
+
+    const float *pos = origin;
+    for (uint32_t k = 0; k < opt_n_paths; k++) {
+        uint32_t best = 0;
+        bool best_rev = false;
+        float best_dist = SOME_LARGE_VALUE;
+        for (uint32_t p = 0; p < opt_n_paths; p++) {
+            if (done[p] || blocked[p]) continue;
+            opt_paths[p].reversed = false;
+            float d = _opt_dist(pos, _opt_path_start(p));
+            if (d < best_dist) {
+                best = p;
+                best_rev = false;
+                best_dist = d;
+            }
+            if (allow_reverse && !opt_paths[p].closed) {
+                d = _opt_dist(pos, _opt_path_end(p));
+                if (d < best_dist) {
+                    best = p;
+                    best_rev = true;
+                    best_dist = d;
+                }
+            }
+        }
+        opt_paths[best].reversed = best_rev;
+        done[best] = true;
+        seq[k] = best;
+        pos = _opt_path_end(best);
+        for (uint32_t e = 0; e < opt_n_edges; e++) {
+            if (opt_edges[e].inner == best) blocked[opt_edges[e].outer]--;
+        }
+    }
+    free(blocked);
+    free(done);
+}
+
+/**
+ * @brief 2-opt refinement of the path sequence
+ *
+ * Reversing a run of paths also reverses each of them, so a run is only eligible if every open path in it
+ * may be reversed, and no constraint has both ends inside it.
+ * @param seq Path sequence to refine
+ * @param origin Starting position
+ * @param allow_reverse Allow open paths to be reversed
+ */
+static void _opt_two_opt(uint32_t *seq, const float *origin, bool allow_reverse) {
+    uint32_t n = opt_n_paths;
+    uint32_t *seq_pos = malloc(n * sizeof(uint32_t));
+    for (uint32_t pass = 0; pass < OPT_2OPT_MAX_PASSES; pass++) {
+        bool improved = false;
+        for (uint32_t k = 0; k < n; k++) seq_pos[seq[k]] = k;
+        for (uint32_t i = 0; i < n - 1; i++) {
+            if (!allow_reverse && !opt_paths[seq[i]].closed) continue;
+            const float *prev_end = (i == 0) ? origin : _opt_path_end(seq[i - 1]);
+            for (uint32_t j = i + 1; j < n; j++) {
+                if (!allow_reverse && !opt_paths[seq[j]].closed) break;
+                const float *next_start = (j == n - 1) ? NULL : _opt_path_start(seq[j + 1]);
+                float before = _opt_dist(prev_end, _opt_path_start(seq[i]));
+                float after = _opt_dist(prev_end, _opt_path_end(seq[j]));
+                if (next_start != NULL) {
+                    before += _opt_dist(_opt_path_end(seq[j]), next_start);
+                    after += _opt_dist(_opt_path_start(seq[i]), next_start);
+                }
+                if (after >= before - 1e-4) continue;
+                bool valid = true;
+                for (uint32_t e = 0; (e < opt_n_edges) && valid; e++) {
+                    uint32_t a = seq_pos[opt_edges[e].inner], b = seq_pos[opt_edges[e].outer];
+                    if ((a >= i) && (a <= j) && (b >= i) && (b <= j)) valid = false;
+                }
+                if (!valid) continue;
+                for (uint32_t a = i, b = j; a < b; a++, b--) {
+                    uint32_t t = seq[a];
+                    seq[a] = seq[b];
+                    seq[b] = t;
+                }
+                for (uint32_t a = i; a <= j; a++) {
+                    if (!opt_paths[seq[a]].closed) opt_paths[seq[a]].reversed = !opt_paths[seq[a]].reversed;
+                    seq_pos[seq[a]] = a;
+                }
+                improved = true;
+            }
+        }
+        if (!improved) break;
+    }
+    free(seq_pos);
+}
+
+/**
+ * @brief Path entry point, honoring direction
+ * @param p Path index
+ * @return Entry point
+ */
+static const float *_opt_path_start(uint32_t p) {
+    opt_path_t *path = &opt_paths[p];
+    return (path->reversed) ? opt_moves[path->first + path->count - 1].end : opt_moves[path->first].start;
+}
+
+/**
+ * @brief Path exit point, honoring direction
+ * @param p Path index
+ * @return Exit point
+ */
+static const float *_opt_path_end(uint32_t p) {
+    opt_path_t *path = &opt_paths[p];
+    return (path->reversed) ? opt_moves[path->first].start : opt_moves[path->first + path->count - 1].end;
+}
+
+/**
+ * @brief XY distance between two points
+ */
+static float _opt_dist(const float *a, const float *b) {
+    return hypot_f(b[X_AXIS] - a[X_AXIS], b[Y_AXIS] - a[Y_AXIS]);
+}
+
+/**
+ * @brief Estimate rapid travel time with the same per axis limits the planner applies
+ * @param a From point
+ * @param b To point
+ * @return Travel time (min)
+ */
+static float _opt_travel_time(const float *a, const float *b) {
+    float unit_vec[N_AXIS];
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) unit_vec[idx] = b[idx] - a[idx];
+    float distance = convert_delta_vector_to_unit_vector(unit_vec);
+    if (distance == 0) return 0;
+    float rate = limit_value_by_axis_maximum(settings.max_rate, unit_vec);
+    float accel = limit_value_by_axis_maximum(settings.travel_acceleration, unit_vec);
+    // Trapezoid (or triangle) from rest to rest
+    if (distance > rate * rate / accel) return distance / rate + rate / accel;
+    return 2 * sqrtf(distance / accel);
+}
+
+/**
+ * @brief Time to cover a distance from rest, accelerating up to a rate. Decelerating to rest takes the same.
+ * @param length Distance (mm)
+ * @param rate Rate to reach (mm/min)
+ * @param accel Acceleration (mm/min^2)
+ * @return Time (min)
+ */
+static float _opt_ramp_time(float length, float rate, float accel) {
+    float ramp = rate * rate / (2 * accel);
+    if (length >= ramp) return rate / accel + (length - ramp) / rate;
+    return sqrtf(2 * length / accel);
+}
+
+/**
+ * @brief Length of a move
+ * @param mv Move
+ * @return Length (mm)
+ */
+static float _opt_move_length(const opt_move_t *mv) {
+    if (mv->motion == MOTION_MODE_LINEAR) {
+        float d[N_AXIS];
+        for (uint8_t idx = 0; idx < N_AXIS; idx++) d[idx] = mv->end[idx] - mv->start[idx];
+        return convert_delta_vector_to_unit_vector(d);
+    }
+    // Arc length, using the same angular travel convention as mc_arc()
+    float r_axis0 = mv->start[X_AXIS] - mv->center[X_AXIS], r_axis1 = mv->start[Y_AXIS] - mv->center[Y_AXIS];
+    float rt_axis0 = mv->end[X_AXIS] - mv->center[X_AXIS], rt_axis1 = mv->end[Y_AXIS] - mv->center[Y_AXIS];
+    float angular_travel = atan2f(r_axis0 * rt_axis1 - r_axis1 * rt_axis0, r_axis0 * rt_axis0 + r_axis1 * rt_axis1);
+    if (mv->motion == MOTION_MODE_CW_ARC) {
+        if (angular_travel >= -ARC_ANGULAR_TRAVEL_EPSILON) { angular_travel -= 2 * M_PI; }
+    } else {
+        if (angular_travel <= ARC_ANGULAR_TRAVEL_EPSILON) { angular_travel += 2 * M_PI; }
+    }
+    return fabsf(angular_travel) * hypot_f(r_axis0, r_axis1);
+}
+
+/**
+ * @brief Write a path, preceded by a rapid to its entry point
+ * @param out Output file
+ * @param p Path index
+ * @param emitted Modal state of the output so far. Updated.
+ */
+static void _opt_write_path(FILE *out, uint32_t p, opt_state_t *emitted) {
+    opt_path_t *path = &opt_paths[p];
+    const float *start = _opt_path_start(p);
+    // Paths are written in mm
+    if (emitted->inches) {
+        fprintf(out, "G21\n");
+        emitted->inches = false;
+    }
+    fprintf(out, "G0 X%.4f Y%.4f", start[X_AXIS], start[Y_AXIS]);
+    if (start[Z_AXIS] != emitted->position[Z_AXIS]) fprintf(out, " Z%.4f", start[Z_AXIS]);
+    fprintf(out, "\n");
+
+    for (uint32_t n = 0; n < path->count; n++) {
+        opt_move_t *mv = &opt_moves[(path->reversed) ? path->first + path->count - 1 - n : path->first + n];
+        const float *from = (path->reversed) ? mv->end : mv->start;
+        const float *to = (path->reversed) ? mv->start : mv->end;
+        uint8_t motion = mv->motion;
+        if (path->reversed && (motion != MOTION_MODE_LINEAR)) {
+            motion = (uint8_t) ((motion == MOTION_MODE_CW_ARC) ? MOTION_MODE_CCW_ARC : MOTION_MODE_CW_ARC);
+        }
+        if (mv->laser != emitted->laser) {
+            fprintf(out, "M%d\n", mv->laser);
+            emitted->laser = mv->laser;
+        }
+        fprintf(out, "G%d X%.4f Y%.4f", motion, to[X_AXIS], to[Y_AXIS]);
+        if (to[Z_AXIS] != from[Z_AXIS]) fprintf(out, " Z%.4f", to[Z_AXIS]);
+        if (motion != MOTION_MODE_LINEAR) {
+            fprintf(out, " I%.4f J%.4f", mv->center[X_AXIS] - from[X_AXIS], mv->center[Y_AXIS] - from[Y_AXIS]);
+        }
+        if (mv->feed_rate != emitted->feed_rate) fprintf(out, " F%.1f", mv->feed_rate);
+        if (mv->power != emitted->power) fprintf(out, " S%.1f", mv->power);
+        fprintf(out, "\n");
+        emitted->feed_rate = mv->feed_rate;
+        emitted->power = mv->power;
+        memcpy(emitted->position, to, sizeof(emitted->position));
+    }
+}
+
+/**
+ * @brief Release all tables
+ */
+static void _opt_free() {
+    for (uint32_t l = 0; l < opt_n_lines; l++) free(opt_lines[l]);
+    free(opt_lines);
+    free(opt_moves);
+    free(opt_paths);
+    free(opt_edges);
+    opt_lines = NULL;
+    opt_moves = NULL;
+    opt_paths = NULL;
+    opt_edges = NULL;
+    opt_n_lines = opt_n_moves = opt_n_paths = opt_n_edges = 0;
+}
+
+/** @} */
+/** @} */
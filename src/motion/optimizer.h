@@ -0,0 +1,33 @@
+/**
+ * @file optimizer.h
+ * @brief Offline travel path optimizer for G-Code jobs
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup motion_optimizer
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_OPTIMIZER_H
+#define OPENGLOW_CNC_OPTIMIZER_H
+
+#include "../common.h"
+
+#define OPT_CLOSED_PATH_TOLERANCE   0.01    // Path start/end distance to treat as closed (mm)
+#define OPT_CONTAIN_TOLERANCE       0.001   // Bounding box margin for inner/outer containment test (mm)
+#define OPT_2OPT_MAX_PATHS          2000    // Skip 2-opt refinement above this many paths
+#define OPT_2OPT_MAX_PASSES         50      // Maximum number of 2-opt improvement passes
+#define OPT_RASTER_OVERSCAN_MARGIN  0.5     // Raster overscan beyond the distance to reach the row feed rate (mm)
+#define OPT_RASTER_MIN_GAP          1.0     // Shortest blank run, between overscans, worth a rapid (mm)
+#define OPT_RASTER_COLLINEAR        0.001   // Sideways deviation per mm of a move still on a raster row
+
+ssize_t optimizer_run(const char *in_path, const char *out_path, bool allow_reverse);
+
+#endif //OPENGLOW_CNC_OPTIMIZER_H
+
+/** @} */
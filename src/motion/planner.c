@@ -22,8 +22,10 @@
  * @{
  */
 
+#include <errno.h>
 #include <math.h>
 #include <memory.h>
+#include <unistd.h>
 #include "../openglow-cnc.h"
 #include "grbl_glue.h"
 
@@ -77,6 +79,13 @@ typedef struct {
                                      i.e. arcs, canned cycles, and backlash compensation. */
     float previous_unit_vec[N_AXIS];   /*!< Unit vector of previous path line segment */
     float previous_nominal_speed;      /*!< Nominal speed of previous path line segment */
+    uint8_t previous_accel_class;      /*!< Acceleration class of previous path line segment */
+    float previous_millimeters;        /*!< Length of previous path line segment */
+    float previous_curvature;          /*!< Path curvature at the previous junction, 0 if not on a curve (1/mm) */
+    bool async_pending;                /*!< An asynchronous Z move may still be running at the next block */
+    uint8_t previous_step_shift;       /*!< Microstep resolution of the previous block, see plan_block_t */
+    uint8_t feed_override;             /*!< Feed rate override value in percent */
+    uint32_t blocks_appended;          /*!< Number of blocks appended since reset */
 } planner_t;
 
 /**
@@ -84,6 +93,28 @@ typedef struct {
  */
 static planner_t pl;
 
+/**
+ * @brief Trajectory preview sampler state
+ */
+typedef struct {
+    plan_preview_sample_t *samples; /*!< Output samples */
+    uint16_t max_samples;           /*!< Size of samples */
+    uint16_t count;                 /*!< Samples written */
+    float time;                     /*!< Time at the start of the current phase (ms) */
+    float next;                     /*!< Time of the next sample (ms) */
+    float interval;                 /*!< Time between samples (ms) */
+    float horizon;                  /*!< Time of the last sample (ms) */
+    float position[N_AXIS];         /*!< Position at the start of the current phase (mm) */
+    float unit_vec[N_AXIS];         /*!< Direction of the current block */
+} plan_preview_t;
+
+// Static function declarations
+static bool _plan_buffer_line(float *target, plan_line_data_t *pl_data, bool replan);
+static float _plan_curve_curvature(float junction_cos_theta, float millimeters);
+static void _plan_preview_block(plan_preview_t *pv, plan_block_t *block, float entry_speed, float exit_speed);
+static ssize_t _plan_preview_collect(plan_preview_t *pv);
+static bool _plan_preview_phase(plan_preview_t *pv, float distance, float start_speed, float end_speed);
+
 /**
  * @brief IDX of next block in ring buffer
  *
@@ -175,10 +206,15 @@ static uint16_t plan_prev_block_index(uint16_t block_index) {
  * the faster it can go. (3) Maximize the motion buffer size. This also will increase the combined distance
  * for the motion to compute over. It also increases the number of computations the motion has to perform
  * to compute an optimal plan, so select carefully.
+ *
+ * @note Cut and travel blocks have different accelerations. Both passes ramp over a block with that block's
+ * own acceleration, so a travel block brakes hard into a cut, and the cut then ramps gently. The junction
+ * between classes is limited in plan_buffer_line() with the gentler of the two classes.
  */
 static void planner_recalculate() {
     // Initialize block index to the last block in the motion buffer.
     uint16_t block_index = plan_prev_block_index(block_buffer_head);
+    uint32_t walked = 1;
 
     // Bail. Can't do anything with one only one plan-able block.
     if (block_index == block_buffer_planned) { return; }
@@ -202,6 +238,7 @@ static void planner_recalculate() {
             next = current;
             current = &block_buffer[block_index];
             block_index = plan_prev_block_index(block_index);
+            walked++;
 
             // Check if next block is the tail block(=planned block). If so, update current stepper parameters.
             if (block_index == block_buffer_tail) { st_update_plan_block_parameters(); }
@@ -218,6 +255,8 @@ static void planner_recalculate() {
         }
     }
 
+    flight_record(FLIGHT_REPLAN, block_buffer[plan_prev_block_index(block_buffer_head)].line_id, walked);
+
     // Forward Pass: Forward plan the acceleration curve from the planned pointer onward.
     // Also scans for optimal plan breakpoints and appropriately updates the planned pointer.
     next = &block_buffer[block_buffer_planned]; // Begin at buffer planned pointer
@@ -252,6 +291,7 @@ static void planner_recalculate() {
  */
 void plan_reset() {
     memset(&pl, 0, sizeof(planner_t));
+    pl.feed_override = DEFAULT_FEED_OVERRIDE;
     plan_reset_buffer();
 }
 
@@ -299,6 +339,20 @@ plan_block_t *plan_get_current_block() {
     return (&block_buffer[block_buffer_tail]);
 }
 
+/**
+ * @brief Check if a block is behind the optimally planned pointer.
+ *
+ * The profiles of these blocks can no longer be changed by new blocks.
+ * @param block Motion block to check
+ * @return True if the block's plan is final
+ */
+bool plan_block_is_planned(plan_block_t *block) {
+    uint16_t block_index = (uint16_t) (block - block_buffer);
+    if (block_index >= BLOCK_BUFFER_SIZE) { return false; }
+    return ((block_index + BLOCK_BUFFER_SIZE - block_buffer_tail) % BLOCK_BUFFER_SIZE) <
+           ((block_buffer_planned + BLOCK_BUFFER_SIZE - block_buffer_tail) % BLOCK_BUFFER_SIZE);
+}
+
 /**
  * @brief Called by step segment buffer when computing executing block velocity profile.
  *
@@ -338,8 +392,9 @@ bool plan_check_full_buffer() {
  */
 float plan_compute_profile_nominal_speed(plan_block_t *block) {
     float nominal_speed = block->programmed_rate;
-    if (!(block->condition & PL_COND_FLAG_RAPID_MOTION) & (nominal_speed > block->rapid_rate)) {
-        nominal_speed = block->rapid_rate;
+    if (!(block->condition & PL_COND_FLAG_RAPID_MOTION)) {
+        nominal_speed *= (0.01 * pl.feed_override);
+        if (nominal_speed > block->rapid_rate) { nominal_speed = block->rapid_rate; }
     }
     if (nominal_speed > MINIMUM_FEED_RATE) { return (nominal_speed); }
     return (MINIMUM_FEED_RATE);
@@ -363,6 +418,41 @@ static void plan_compute_profile_parameters(plan_block_t *block, float nominal_s
         block->max_junction_speed_sqr) { block->max_entry_speed_sqr = block->max_junction_speed_sqr; }
 }
 
+/**
+ * @brief Re-calculates buffered motions profile parameters upon a feed override change.
+ *
+ * @note Caller must hold segment_lock().
+ */
+static void plan_update_velocity_profile_parameters() {
+    uint16_t block_index = block_buffer_tail;
+    plan_block_t *block;
+    float nominal_speed;
+    float prev_nominal_speed = SOME_LARGE_VALUE; // Set high for first block nominal speed calculation.
+    while (block_index != block_buffer_head) {
+        block = &block_buffer[block_index];
+        nominal_speed = plan_compute_profile_nominal_speed(block);
+        plan_compute_profile_parameters(block, nominal_speed, prev_nominal_speed);
+        prev_nominal_speed = nominal_speed;
+        block_index = plan_next_block_index(block_index);
+    }
+    pl.previous_nominal_speed = prev_nominal_speed; // Update prev nominal speed for next incoming block.
+}
+
+/**
+ * @brief Re-initialize the plan from the executing block onward.
+ *
+ * Resets the optimally planned pointer, so the whole buffer is replanned from the current speed of the
+ * executing block.
+ * @note Caller must hold segment_lock().
+ */
+static void plan_cycle_reinitialize() {
+    // Planner buffer is drained, or only the system motion block. Nothing to replan.
+    if (block_buffer_head == block_buffer_tail) { return; }
+    st_update_plan_block_parameters();
+    block_buffer_planned = block_buffer_tail;
+    planner_recalculate();
+}
+
 /**
  * @brief Add a new linear movement to the motion buffer.
  *
@@ -388,12 +478,57 @@ static void plan_compute_profile_parameters(plan_block_t *block, float nominal_s
  * @return True on success, false if empty block.
  */
 bool plan_buffer_line(float *target, plan_line_data_t *pl_data) {
+    return _plan_buffer_line(target, pl_data, true);
+}
+
+/**
+ * @brief Add a batch of linear movements to the motion buffer.
+ *
+ * Same as plan_buffer_line() for each target, up to the free space in the buffer, but the plan is only
+ * recalculated once, for the whole batch. Until then, the new blocks are planned to start from rest, which
+ * the step generator can always execute. Used for arc segments, where recalculating after every short
+ * block is most of the cost of planning.
+ * @param targets Signed, absolute target positions in millimeters
+ * @param n_targets Number of targets
+ * @param pl_data Planner line data, the same for every target
+ * @return Number of targets consumed, including empty blocks. Less than n_targets if the buffer filled.
+ */
+uint16_t plan_buffer_lines(float (*targets)[N_AXIS], uint16_t n_targets, plan_line_data_t *pl_data) {
+    uint16_t consumed;
+    for (consumed = 0; (consumed < n_targets) && !plan_check_full_buffer(); consumed++) {
+        _plan_buffer_line(targets[consumed], pl_data, false);
+    }
+    segment_lock();
+    planner_recalculate();
+    segment_unlock();
+    segment_worker_kick();
+    return consumed;
+}
+
+/**
+ * @brief Add a new linear movement to the motion buffer.
+ * @param target target[N_AXIS] is the signed, absolute target position in millimeters
+ * @param pl_data Planner line data
+ * @param replan Recalculate the plan with the new block. Otherwise the caller must, with planner_recalculate().
+ * @return True on success, false if empty block.
+ */
+static bool _plan_buffer_line(float *target, plan_line_data_t *pl_data, bool replan) {
     // Prepare and initialize new block. Copy relevant pl_data for block execution.
     plan_block_t *block = &block_buffer[block_buffer_head];
     memset(block, 0, sizeof(plan_block_t)); // Zero all block values.
     block->condition = pl_data->condition;
+    block->line_id = pl_data->line_id;
     block->spindle_speed = pl_data->spindle_speed;
 
+    // Laser-on moves use the gentle cut acceleration. Everything else is travel.
+    float *accel_limits = settings.travel_acceleration;
+    block->accel_class = PLAN_CLASS_TRAVEL;
+    if ((block->condition & (PL_COND_FLAG_SPINDLE_CW | PL_COND_FLAG_SPINDLE_CCW)) &&
+        !(block->condition & PL_COND_FLAG_RAPID_MOTION) && (block->spindle_speed > 0)) {
+        accel_limits = settings.acceleration;
+        block->accel_class = PLAN_CLASS_CUT;
+    }
+
     // Compute and store initial move distance data.
     int32_t target_steps[N_AXIS], position_steps[N_AXIS];
     float unit_vec[N_AXIS], delta_mm;
@@ -421,13 +556,47 @@ bool plan_buffer_line(float *target, plan_line_data_t *pl_data) {
     // Bail if this is a zero-length block. Highly unlikely to occur.
     if (block->step_event_count == 0) { return false; }
 
+    /* Z only changes focus, and at Z_MAX_RATE it would dominate a combined rapid. With async_z, a laser-off
+       rapid moving XY and Z is planned as XY only, and the step generator runs the Z steps alongside it,
+       and any following laser-off rapids, at the Z maximum rate. */
+    if (settings.async_z && (block->condition & PL_COND_FLAG_RAPID_MOTION) &&
+        !(block->condition & PL_COND_FLAG_SYSTEM_MOTION) && block->steps[Z_AXIS] &&
+        (block->steps[X_AXIS] || block->steps[Y_AXIS])) {
+        block->async_steps = block->steps[Z_AXIS];
+        block->async_direction_bits = (uint8_t) (block->direction_bits & direction_bits[Z_AXIS]);
+        block->direction_bits &= ~direction_bits[Z_AXIS];
+        block->steps[Z_AXIS] = 0;
+        block->step_event_count = max(block->steps[X_AXIS], block->steps[Y_AXIS]);
+        unit_vec[Z_AXIS] = 0.0;
+    }
+    block->allows_async = (uint8_t) ((block->condition & PL_COND_FLAG_RAPID_MOTION) && !block->steps[Z_AXIS]);
+
+    /* A long laser-off rapid in XY is stepped at a coarser microstep resolution, so the step rate doesn't cap its
+       speed. The block takes the whole coarse steps of the move, and the rest follows as a full resolution block,
+       so it needs room for two. Position stays in full resolution steps. */
+    if (settings.rapid_microsteps && (block->condition & PL_COND_FLAG_RAPID_MOTION) &&
+        !(block->condition & PL_COND_FLAG_SYSTEM_MOTION) && !block->steps[Z_AXIS] &&
+        (plan_next_block_index(next_buffer_head) != block_buffer_tail) &&
+        (hypotf(unit_vec[X_AXIS], unit_vec[Y_AXIS]) >= RAPID_MICROSTEP_MIN_TRAVEL)) {
+        block->step_shift = RAPID_MICROSTEP_SHIFT;
+        for (idx = X_AXIS; idx <= Y_AXIS; idx++) {
+            block->steps[idx] >>= block->step_shift;
+            int32_t delta_steps = (int32_t) (block->steps[idx] << block->step_shift);
+            if (block->direction_bits & direction_bits[idx]) { delta_steps = -delta_steps; }
+            target_steps[idx] = position_steps[idx] + delta_steps;
+            unit_vec[idx] = delta_steps / settings.steps_per_mm[idx];
+        }
+        block->step_event_count = max(block->steps[X_AXIS], block->steps[Y_AXIS]);
+    }
+
     /* Calculate the unit vector of the line move and the block maximum feed rate and acceleration scaled
        down such that no individual axes maximum values are exceeded with respect to the line direction.
        NOTE: This calculation assumes all axes are orthogonal (Cartesian) and works with ABC-axes,
        if they are also orthogonal/independent. Operates on the absolute value of the unit vector. */
     block->millimeters = convert_delta_vector_to_unit_vector(unit_vec);
-    block->acceleration = limit_value_by_axis_maximum(settings.acceleration, unit_vec);
-    block->rapid_rate = limit_value_by_axis_maximum(settings.max_rate, unit_vec);
+    block->acceleration = limit_value_by_axis_maximum(accel_limits, unit_vec);
+    block->rapid_rate = limit_value_by_axis_maximum(block->step_shift ? settings.rapid_max_rate : settings.max_rate,
+                                                    unit_vec);
 
     // Store programmed rate.
     if (block->condition & PL_COND_FLAG_RAPID_MOTION) { block->programmed_rate = block->rapid_rate; }
@@ -443,6 +612,7 @@ bool plan_buffer_line(float *target, plan_line_data_t *pl_data) {
         // If system motion, the system motion block always is assumed to start from rest and end at a complete stop.
         block->entry_speed_sqr = 0.0;
         block->max_junction_speed_sqr = 0.0; // Starting from rest. Enforce start from zero velocity.
+        pl.previous_curvature = 0.0;
 
     } else {
         /* Compute maximum allowable entry speed at junction by centripetal acceleration approximation.
@@ -469,6 +639,7 @@ bool plan_buffer_line(float *target, plan_line_data_t *pl_data) {
 
         float junction_unit_vec[N_AXIS];
         float junction_cos_theta = 0.0;
+        float curvature = 0.0;
         for (idx = 0; idx < N_AXIS; idx++) {
             junction_cos_theta -= pl.previous_unit_vec[idx] * unit_vec[idx];
             junction_unit_vec[idx] = unit_vec[idx] - pl.previous_unit_vec[idx];
@@ -484,36 +655,333 @@ bool plan_buffer_line(float *target, plan_line_data_t *pl_data) {
                 block->max_junction_speed_sqr = SOME_LARGE_VALUE;
             } else {
                 convert_delta_vector_to_unit_vector(junction_unit_vec);
-                float junction_acceleration = limit_value_by_axis_maximum(settings.acceleration, junction_unit_vec);
+                // A junction between classes takes the gentler acceleration and tighter deviation of the two.
+                float junction_acceleration = limit_value_by_axis_maximum(accel_limits, junction_unit_vec);
+                float junction_deviation = (block->accel_class == PLAN_CLASS_CUT) ?
+                                           settings.junction_deviation : settings.travel_junction_deviation;
+                if (block->accel_class != pl.previous_accel_class) {
+                    float *prev_limits = (pl.previous_accel_class == PLAN_CLASS_CUT) ?
+                                         settings.acceleration : settings.travel_acceleration;
+                    float prev_deviation = (pl.previous_accel_class == PLAN_CLASS_CUT) ?
+                                           settings.junction_deviation : settings.travel_junction_deviation;
+                    junction_acceleration = min(junction_acceleration,
+                                                limit_value_by_axis_maximum(prev_limits, junction_unit_vec));
+                    junction_deviation = min(junction_deviation, prev_deviation);
+                }
                 float sin_theta_d2 = sqrtf(
                         (float) 0.5 * ((float) 1.0 - junction_cos_theta)); // Trig half angle identity. Always positive.
                 block->max_junction_speed_sqr = max(MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED,
-                                                    (junction_acceleration * (float) JUNCTION_DEVIATION *
+                                                    (junction_acceleration * junction_deviation *
                                                      sin_theta_d2) / ((float) 1.0 - sin_theta_d2));
+
+                /* On a smooth curve, the path is a polyline sampling the curve, and the direction change at
+                   each junction is just the centripetal acceleration of the curve, delivered a chord at a
+                   time. Junction deviation treats each of them as a corner. That crawls through coarsely
+                   sampled curves, and overspeeds finely sampled ones, where the tiny turns look almost
+                   straight. Instead, estimate the curve radius over the window of this and the previous
+                   junction, and limit speed by centripetal acceleration about it. */
+                if (settings.planner_backend == PLANNER_BACKEND_CURVATURE) {
+                    curvature = _plan_curve_curvature(junction_cos_theta, block->millimeters);
+                    if ((curvature > 0.0) && (pl.previous_curvature > 0.0) &&
+                        (curvature <= pl.previous_curvature * PLAN_CURVE_MAX_RATIO) &&
+                        (pl.previous_curvature <= curvature * PLAN_CURVE_MAX_RATIO)) {
+                        block->max_junction_speed_sqr = max(MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED,
+                                                            junction_acceleration /
+                                                            max(curvature, pl.previous_curvature));
+                    }
+                }
             }
         }
+        pl.previous_curvature = curvature;
+    }
+
+    /* The step generator holds a block that can't run alongside the asynchronous Z move until the move is
+       complete, and a block with a new move until the previous one is. Such a block must start from rest. */
+    if (pl.async_pending && (!block->allows_async || block->async_steps)) {
+        block->max_junction_speed_sqr = 0.0;
     }
 
+    // The driver resolution can only change at rest
+    if (block->step_shift != pl.previous_step_shift) { block->max_junction_speed_sqr = 0.0; }
+
     // Block system motion from updating this data to ensure next g-code motion is computed correctly.
     if (!(block->condition & PL_COND_FLAG_SYSTEM_MOTION)) {
         float nominal_speed = plan_compute_profile_nominal_speed(block);
         plan_compute_profile_parameters(block, nominal_speed, pl.previous_nominal_speed);
         pl.previous_nominal_speed = nominal_speed;
+        pl.previous_accel_class = block->accel_class;
+        pl.previous_millimeters = block->millimeters;
+        pl.previous_step_shift = block->step_shift;
+        if (block->async_steps) { pl.async_pending = true; }
+        else if (!block->allows_async) { pl.async_pending = false; }
 
-        // Update previous path unit_vector and motion position.
+        // Update previous path unit_vector.
         memcpy(pl.previous_unit_vec, unit_vec, sizeof(unit_vec)); // pl.previous_unit_vec[] = unit_vec[]
-        memcpy(pl.position, target_steps, sizeof(target_steps)); // pl.position[] = target_steps[]
 
-        // New block is all set. Update buffer head and next buffer head indices.
+        // New block is all set. Update motion position, buffer head and next buffer head indices.
+        // Position is updated with the head, so plan_preview() sees them change together.
+        segment_lock();
+        memcpy(pl.position, target_steps, sizeof(target_steps)); // pl.position[] = target_steps[]
         block_buffer_head = next_buffer_head;
         next_buffer_head = plan_next_block_index(block_buffer_head);
+        pl.blocks_appended++;
+        flight_record(FLIGHT_BLOCK, block->line_id,
+                      (uint32_t) ((block_buffer_head + BLOCK_BUFFER_SIZE - block_buffer_tail) % BLOCK_BUFFER_SIZE));
 
         // Finish up by recalculating the plan with the new block.
-        planner_recalculate();
+        if (replan) { planner_recalculate(); }
+        segment_unlock();
+        if (replan) { segment_worker_kick(); }
+        latency_stamp(block->line_id, LAT_PLANNED, latency_now());
+
+        // Plan the rest of a coarse rapid at full resolution
+        if (block->step_shift) { _plan_buffer_line(target, pl_data, replan); }
     }
     return true;
 }
 
+/**
+ * @brief Number of blocks appended to the buffer since the last reset
+ *
+ * Lets observers tell a stalled producer from a finished one.
+ * @return Block count. Wraps.
+ */
+uint32_t plan_get_blocks_appended() {
+    return pl.blocks_appended;
+}
+
+/**
+ * @brief Current feed override
+ * @return Feed override in percent
+ */
+uint8_t plan_get_feed_override() {
+    return pl.feed_override;
+}
+
+/**
+ * @brief Estimates the time to execute everything in the buffer
+ *
+ * Sums remaining distance over nominal speed for each block. Acceleration is ignored, so this is a
+ * lower bound on the real execution time.
+ * @note Caller must hold segment_lock().
+ * @return Buffered motion time in ms
+ */
+float plan_get_lead_time() {
+    float minutes = 0.0;
+    uint16_t block_index = block_buffer_tail;
+    while (block_index != block_buffer_head) {
+        plan_block_t *block = &block_buffer[block_index];
+        minutes += block->millimeters / plan_compute_profile_nominal_speed(block);
+        block_index = plan_next_block_index(block_index);
+    }
+    return minutes * 60000;
+}
+
+/**
+ * @brief Change the feed override and replan the buffer.
+ *
+ * Blocks already in the buffer, including the one executing, take up the new nominal speeds.
+ * The planner ramps to them at the block acceleration limits, so changes are never abrupt.
+ * @param feed_override Feed rate override in percent. Clamped to MIN/MAX_FEED_RATE_OVERRIDE.
+ */
+void plan_feed_override_set(uint8_t feed_override) {
+    if (feed_override < MIN_FEED_RATE_OVERRIDE) { feed_override = MIN_FEED_RATE_OVERRIDE; }
+    if (feed_override > MAX_FEED_RATE_OVERRIDE) { feed_override = MAX_FEED_RATE_OVERRIDE; }
+    segment_lock();
+    if (feed_override != pl.feed_override) {
+        pl.feed_override = feed_override;
+        plan_update_velocity_profile_parameters();
+        plan_cycle_reinitialize();
+    }
+    segment_unlock();
+    segment_worker_kick();
+}
+
+/**
+ * @brief Preview the planned trajectory
+ *
+ * Walks the plan from the block being prepped through the buffer head and samples position and speed every
+ * interval, out to horizon. Profiles are computed from the planned entry speeds, nominal speeds and
+ * accelerations, the same way the segment generator will, so the preview matches execution unless new
+ * blocks raise the planned exit speed of the last block.
+ *
+ * The producer isn't locked. The walk is retried if the planner or segment prep changed the plan under it.
+ *
+ * @note Time zero is now. Motion already in the segment buffer isn't sampled, so the first sample is at the
+ * time those segments end, and at the position segment prep has reached.
+ * @param samples Output samples
+ * @param max_samples Size of samples
+ * @param horizon Time to preview (ms)
+ * @param interval Time between samples (ms)
+ * @return Number of samples on success, negative on error.
+ */
+ssize_t plan_preview(plan_preview_sample_t *samples, uint16_t max_samples, float horizon, float interval) {
+    plan_preview_t pv = {
+            .samples = samples,
+            .max_samples = max_samples,
+            .interval = interval,
+            .horizon = horizon,
+    };
+    if ((interval <= 0.0) || (max_samples == 0)) { return -EINVAL; }
+    for (uint8_t attempt = 0; attempt < PLAN_PREVIEW_RETRIES; attempt++) {
+        uint32_t seq = segment_read_begin();
+        if (!(seq & 1)) {
+            ssize_t ret = _plan_preview_collect(&pv);
+            if (!segment_read_retry(seq)) { return ret; }
+        }
+        usleep(PLAN_PREVIEW_RETRY_WAIT);
+    }
+    return -EAGAIN;
+}
+
+/**
+ * @brief Walk the plan and sample it
+ * @param pv Sampler state
+ * @return Number of samples
+ */
+static ssize_t _plan_preview_collect(plan_preview_t *pv) {
+    uint16_t tail = block_buffer_tail;
+    uint16_t head = block_buffer_head;
+    uint16_t block_index;
+    uint8_t idx;
+
+    pv->count = 0;
+    pv->time = segment_queued_time();
+    pv->next = pv->time;
+
+    // The plan ends at the planner position. Back out the distance left in every block to find the start.
+    for (idx = 0; idx < N_AXIS; idx++) { pv->position[idx] = pl.position[idx] / settings.steps_per_mm[idx]; }
+    for (block_index = tail; block_index != head; block_index = plan_next_block_index(block_index)) {
+        plan_block_t *block = &block_buffer[block_index];
+        float block_mm = 0.0;
+        float delta[N_AXIS];
+        for (idx = 0; idx < N_AXIS; idx++) {
+            delta[idx] = block->steps[idx] / settings.steps_per_mm[idx];
+            if (block->direction_bits & direction_bits[idx]) { delta[idx] = -delta[idx]; }
+            block_mm += delta[idx] * delta[idx];
+        }
+        block_mm = sqrtf(block_mm);
+        for (idx = 0; idx < N_AXIS; idx++) { pv->position[idx] -= delta[idx] / block_mm * block->millimeters; }
+    }
+
+    // The block being prepped continues from the current prep speed.
+    float entry_speed = 0.0;
+    if ((tail != head) && (pl_block == &block_buffer[tail])) { entry_speed = prep.current_speed; }
+    else if (tail != head) { entry_speed = sqrtf(block_buffer[tail].entry_speed_sqr); }
+
+    for (block_index = tail; block_index != head; block_index = plan_next_block_index(block_index)) {
+        uint16_t next_index = plan_next_block_index(block_index);
+        float exit_speed = (next_index == head) ? 0.0 : sqrtf(block_buffer[next_index].entry_speed_sqr);
+        _plan_preview_block(pv, &block_buffer[block_index], entry_speed, exit_speed);
+        if ((pv->count == pv->max_samples) || (pv->next > pv->horizon)) { return pv->count; }
+        entry_speed = exit_speed;
+    }
+
+    // Plan ends at rest. Report the final position.
+    if (pv->next <= pv->horizon) {
+        plan_preview_sample_t *sample = &pv->samples[pv->count++];
+        sample->time = max(pv->time, pv->next);
+        memcpy(sample->position, pv->position, sizeof(sample->position));
+        sample->speed = 0.0;
+    }
+    return pv->count;
+}
+
+/**
+ * @brief Path curvature at the junction into a new block, if it looks like a sample of a smooth curve
+ *
+ * The junction and its neighbors lie on a circle with radius chord / (2 * sin(turn / 2)). The shorter of the two
+ * chords gives the tighter, conservative, radius.
+ * @param junction_cos_theta Negative cosine of the turn at the junction, as computed by plan_buffer_line()
+ * @param millimeters Length of the new block
+ * @return Curvature (1/mm), 0 if the junction is a corner
+ */
+static float _plan_curve_curvature(float junction_cos_theta, float millimeters) {
+    float chord = min(millimeters, pl.previous_millimeters);
+    if ((chord <= 0.0) || (chord > PLAN_CURVE_MAX_CHORD)) { return 0.0; }
+    float sin_turn_d2 = sqrtf((float) 0.5 * ((float) 1.0 + junction_cos_theta)); // Half angle identity
+    if (sin_turn_d2 > PLAN_CURVE_MAX_SIN_D2) { return 0.0; }
+    return (float) 2.0 * sin_turn_d2 / chord;
+}
+
+/**
+ * @brief Sample one block's velocity profile
+ *
+ * Splits the block into its ramp and cruise phases, following the same cases as segment prep.
+ * @param pv Sampler state
+ * @param block Block to sample
+ * @param entry_speed Block entry speed (mm/min)
+ * @param exit_speed Block exit speed (mm/min)
+ */
+static void _plan_preview_block(plan_preview_t *pv, plan_block_t *block, float entry_speed, float exit_speed) {
+    float delta_mm = 0.0;
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        pv->unit_vec[idx] = block->steps[idx] / settings.steps_per_mm[idx];
+        if (block->direction_bits & direction_bits[idx]) { pv->unit_vec[idx] = -pv->unit_vec[idx]; }
+        delta_mm += pv->unit_vec[idx] * pv->unit_vec[idx];
+    }
+    delta_mm = sqrtf(delta_mm);
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) { pv->unit_vec[idx] /= delta_mm; }
+
+    float length = block->millimeters;
+    float inv_2_accel = (float) 0.5 / block->acceleration;
+    float nominal_speed = plan_compute_profile_nominal_speed(block);
+    float entry_sqr = entry_speed * entry_speed;
+    float exit_sqr = exit_speed * exit_speed;
+    float nominal_sqr = nominal_speed * nominal_speed;
+    float ramp_up, ramp_down, peak_speed = nominal_speed;
+
+    if (entry_sqr > nominal_sqr) { // Only occurs during override reductions.
+        ramp_up = inv_2_accel * (entry_sqr - nominal_sqr);
+        if (ramp_up >= length) { // Deceleration-only.
+            _plan_preview_phase(pv, length, entry_speed, sqrtf(max(0.0, entry_sqr - 2 * block->acceleration * length)));
+            return;
+        }
+        ramp_down = min(length - ramp_up, inv_2_accel * (nominal_sqr - exit_sqr));
+    } else {
+        ramp_up = inv_2_accel * (nominal_sqr - entry_sqr);
+        ramp_down = inv_2_accel * (nominal_sqr - exit_sqr);
+        if (ramp_up + ramp_down > length) { // Triangle
+            float peak_sqr = max(max(entry_sqr, exit_sqr), 0.5 * (2 * block->acceleration * length + entry_sqr + exit_sqr));
+            peak_speed = sqrtf(peak_sqr);
+            ramp_up = min(length, inv_2_accel * (peak_sqr - entry_sqr));
+            ramp_down = length - ramp_up;
+        }
+    }
+    if (!_plan_preview_phase(pv, ramp_up, entry_speed, peak_speed)) { return; }
+    if (!_plan_preview_phase(pv, length - ramp_up - ramp_down, peak_speed, peak_speed)) { return; }
+    _plan_preview_phase(pv, ramp_down, peak_speed, exit_speed);
+}
+
+/**
+ * @brief Sample one constant acceleration phase
+ * @param pv Sampler state
+ * @param distance Phase length (mm)
+ * @param start_speed Speed at start of phase (mm/min)
+ * @param end_speed Speed at end of phase (mm/min)
+ * @return False once the sample buffer is full or the horizon is reached.
+ */
+static bool _plan_preview_phase(plan_preview_t *pv, float distance, float start_speed, float end_speed) {
+    if ((distance <= 0.0) || (start_speed + end_speed <= 0.0)) { return true; }
+    float duration = 120000.0 * distance / (start_speed + end_speed); // ms
+    float v0 = start_speed / 60000.0; // mm/ms
+    float accel = (end_speed - start_speed) / 60000.0 / duration; // mm/ms^2
+    while ((pv->next < pv->time + duration) && (pv->next <= pv->horizon) && (pv->count < pv->max_samples)) {
+        float t = pv->next - pv->time;
+        float s = (v0 + 0.5 * accel * t) * t;
+        plan_preview_sample_t *sample = &pv->samples[pv->count++];
+        sample->time = pv->next;
+        for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+            sample->position[idx] = pv->position[idx] + pv->unit_vec[idx] * s;
+        }
+        sample->speed = (v0 + accel * t) * 60000.0;
+        pv->next += pv->interval;
+    }
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) { pv->position[idx] += pv->unit_vec[idx] * distance; }
+    pv->time += duration;
+    return (pv->count < pv->max_samples) && (pv->next <= pv->horizon);
+}
+
 /**
  * @brief Reset the motion position vectors.
  *
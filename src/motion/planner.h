@@ -31,6 +31,11 @@
  */
 #define BLOCK_BUFFER_SIZE 512
 
+// Feed rate override limits, in percent.
+#define DEFAULT_FEED_OVERRIDE   100
+#define MAX_FEED_RATE_OVERRIDE  200
+#define MIN_FEED_RATE_OVERRIDE  10
+
 // Define motion data condition flags. Used to denote running conditions of a block.
 #define PL_COND_FLAG_RAPID_MOTION      bit(0) /*!< Rapid Motion */
 #define PL_COND_FLAG_SYSTEM_MOTION     bit(1) /*!< Single motion. Circumvents planner state. Used by home/park. */
@@ -40,6 +45,31 @@
 #define PL_COND_FLAG_COOLANT_FLOOD     bit(6) /*!< Flood Coolant */
 #define PL_COND_FLAG_COOLANT_MIST      bit(7) /*!< Mist Coolant */
 
+#define PLAN_PREVIEW_RETRIES        8       // Attempts to read a consistent plan before giving up
+#define PLAN_PREVIEW_RETRY_WAIT     50      // Wait between attempts (us)
+
+// Curvature planner backend. Lines this short, turning this little, are samples of a curve rather than corners.
+#define PLAN_CURVE_MAX_CHORD        1.0     // Longest line treated as a curve sample (mm)
+#define PLAN_CURVE_MAX_SIN_D2       0.1305  // Sine of half the largest turn treated as a curve sample (15 degrees)
+#define PLAN_CURVE_MAX_RATIO        2.0     // Largest curvature change between neighboring curve junctions
+
+/**
+ * @brief Planner backends
+ */
+enum PLANNER_BACKENDS {
+    PLANNER_BACKEND_GRBL,       /*!< Junction speeds limited by junction deviation only */
+    PLANNER_BACKEND_CURVATURE,  /*!< Junctions on smooth curves limited by centripetal acceleration */
+    N_PLANNER_BACKENDS,
+};
+
+/**
+ * @brief Block acceleration classes
+ */
+enum PLAN_ACCEL_CLASS {
+    PLAN_CLASS_CUT,     /*!< Laser-on. Uses settings.acceleration and junction_deviation */
+    PLAN_CLASS_TRAVEL,  /*!< Laser-off. Uses settings.travel_acceleration and travel_junction_deviation */
+};
+
 /**
  * @brief Linear movement block
  *
@@ -52,9 +82,17 @@ typedef struct {
     uint32_t steps[N_AXIS];    /*!< Step count along each axis */
     uint32_t step_event_count; /*!< The maximum step axis count and number of steps required to complete this block. */
     uint8_t direction_bits;    /*!< The direction bit set for this block (refers to *_DIRECTION_BIT in config.h) */
+    uint8_t step_shift;        /*!< XY steps are 1 << step_shift full resolution steps. Non-zero on coarse rapids. */
+
+    // Asynchronous Z. Set on laser-off rapids when settings.async_z is enabled.
+    uint32_t async_steps;          /*!< Z steps split out of the block, run alongside it by the step generator */
+    uint8_t async_direction_bits;  /*!< Z direction bit of async_steps */
+    uint8_t allows_async;          /*!< Block may execute while an asynchronous Z move is still running */
 
     // Block condition data to ensure correct execution depending on states and overrides.
     uint8_t condition;      /*!< Block bitflag variable defining block run conditions. Copied from pl_line_data. */
+    uint32_t line_id;       /*!< ID of the G-Code line this block came from. Copied from pl_line_data. */
+    uint8_t accel_class;    /*!< Acceleration class, see PLAN_ACCEL_CLASS */
 
     // Fields used by the motion motion to manage acceleration. Some of these values may be updated
     // by the stepper module during execution of special motion cases for replanning purposes.
@@ -83,25 +121,49 @@ typedef struct {
     float feed_rate;          /*!< Desired feed rate for line motion. Value is ignored, if rapid motion. */
     float spindle_speed;      /*!< Desired spindle speed through line motion. */
     uint8_t condition;        /*!<  Bitflag variable to indicate motion conditions. See defines above. */
+    uint32_t line_id;         /*!< ID of the G-Code line, for latency attribution */
 } plan_line_data_t;
 
 
+/**
+ * @brief Planned trajectory preview sample
+ */
+typedef struct {
+    float time;             /*!< Time from now (ms) */
+    float position[N_AXIS]; /*!< Machine position (mm) */
+    float speed;            /*!< Feed speed (mm/min) */
+} plan_preview_sample_t;
+
+bool plan_block_is_planned(plan_block_t *block);
+
 bool plan_buffer_line(float *target, plan_line_data_t *pl_data);
 
+uint16_t plan_buffer_lines(float (*targets)[N_AXIS], uint16_t n_targets, plan_line_data_t *pl_data);
+
 bool plan_check_full_buffer();
 
+void plan_feed_override_set(uint8_t feed_override);
+
 float plan_compute_profile_nominal_speed(plan_block_t *block);
 
 void plan_discard_current_block();
 
+uint32_t plan_get_blocks_appended();
+
 plan_block_t *plan_get_current_block();
 
 float plan_get_exec_block_exit_speed_sqr();
 
+uint8_t plan_get_feed_override();
+
+float plan_get_lead_time();
+
 plan_block_t *plan_get_system_motion_block();
 
 uint16_t plan_next_block_index(uint16_t block_index);
 
+ssize_t plan_preview(plan_preview_sample_t *samples, uint16_t max_samples, float horizon, float interval);
+
 void plan_reset(); // Reset all
 
 void plan_reset_buffer(); // Reset buffer only.
@@ -22,7 +22,12 @@
  * @{
  */
 
+#include <alchemy/task.h>
 #include <math.h>
+#include <memory.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
 #include "../openglow-cnc.h"
 #include "grbl_glue.h"
 
@@ -30,6 +35,13 @@
 #define DT_SEGMENT (1.0/(ACCELERATION_TICKS_PER_SECOND*60.0)) // min/segment
 #define REQ_MM_INCREMENT_SCALAR 1.25
 
+// Fixed-point segment generator units: distance in Q32 steps, speed in Q32 steps/tick,
+// acceleration in Q40 steps/tick^2 and time in Q16 ticks.
+#define SEGMENT_FX_ONE ((int64_t) 1 << 32)
+#define SEGMENT_FX_DT ((int64_t) (STEP_FREQUENCY / ACCELERATION_TICKS_PER_SECOND) << 16) // Q16 ticks/segment
+#define SEGMENT_FX_MIN_DISTANCE ((int64_t) (REQ_MM_INCREMENT_SCALAR * SEGMENT_FX_ONE))
+#define SEGMENT_FX_CEIL(distance) (((distance) + SEGMENT_FX_ONE - 1) >> 32)
+
 /**
  * @brief Define step segment ramp flags.
  */
@@ -87,6 +99,9 @@ segment_t segment_buffer[SEGMENT_BUFFER_SIZE];
 
 /**
  * @brief Points to the beginning of the segment buffer. First to be executed or being executed.
+ *
+ * Advanced by the step generator, with a release store once it is done with the segment. The segment worker
+ * reads it with an acquire load before it reuses the slot.
  */
 volatile uint16_t segment_buffer_tail;
 
@@ -94,6 +109,9 @@ volatile uint16_t segment_buffer_tail;
  * @brief Points to the segment after the last segment in the buffer.
  * Used to indicate whether the buffer is full or empty.
  * As described for standard ring buffers, this block is always empty.
+ *
+ * Advanced by the segment worker, with a release store once the segment and its block are written. The step
+ * generator reads it with an acquire load before it loads the segment.
  */
 volatile uint16_t segment_buffer_head;
 
@@ -120,6 +138,122 @@ static st_block_t *st_prep_block;
  */
 st_prep_t prep;
 
+/**
+ * @brief Segment profile cache key
+ *
+ * Everything the velocity profile and segment sequence of a freshly loaded block depend on.
+ */
+typedef struct {
+    uint32_t step_event_count;
+    uint8_t is_pwm_rate_adjusted;
+    uint8_t generator;
+    float millimeters;
+    float acceleration;
+    float entry_speed_sqr;
+    float exit_speed_sqr;
+    float nominal_speed;
+    float programmed_rate;
+} segment_cache_key_t;
+
+/**
+ * @brief Cached segment, with the prep state it leaves behind
+ */
+typedef struct {
+    uint16_t n_step;
+    uint8_t spindle_pwm;
+    uint32_t cycles_per_tick;
+    union {
+        struct {
+            float mm_remaining;     /*!< pl_block->millimeters after this segment */
+            float current_speed;    /*!< prep.current_speed after this segment */
+            float steps_remaining;  /*!< prep.steps_remaining after this segment */
+            float dt_remainder;     /*!< prep.dt_remainder after this segment */
+        };
+        struct {
+            int64_t distance;       /*!< prep.fx.distance after this segment */
+            int64_t speed;          /*!< prep.fx.speed after this segment */
+            int64_t dt_remainder;   /*!< prep.fx.dt_remainder after this segment */
+        } fx;                       /*!< Fixed-point generator state */
+    };
+} segment_cache_seg_t;
+
+/**
+ * @brief Segment profile cache entry
+ */
+typedef struct {
+    bool valid;
+    uint16_t count;
+    segment_cache_key_t key;
+    segment_cache_seg_t segments[SEGMENT_CACHE_MAX_SEGMENTS];
+} segment_cache_entry_t;
+
+/**
+ * @brief Segment profile cache, direct mapped by key hash
+ */
+static segment_cache_entry_t segment_cache[SEGMENT_CACHE_ENTRIES];
+
+/**
+ * @brief Entry being recorded for the block being prepped
+ */
+static segment_cache_entry_t segment_cache_record;
+
+/**
+ * @brief True while recording the block being prepped
+ */
+static bool segment_cache_recording = false;
+
+/**
+ * @brief Entry being replayed for the block being prepped, NULL when computing
+ */
+static segment_cache_entry_t *segment_cache_replay = NULL;
+
+/**
+ * @brief Next segment to replay
+ */
+static uint16_t segment_cache_replay_pos;
+
+/**
+ * @brief ID of the G-Code line last prepped, for latency attribution
+ */
+static uint32_t segment_prep_line_id = 0;
+
+/**
+ * @brief Segment prep worker real time task
+ */
+static RT_TASK rt_segment_worker_task;
+
+/**
+ * @brief Segment prep worker CPU set
+ */
+static cpu_set_t segment_worker_cpus;
+
+/**
+ * @brief Wakes the segment prep worker ahead of its poll period
+ */
+static sem_t segment_worker_sem;
+
+/**
+ * @brief Serializes segment prep against planner recalculation
+ */
+static pthread_mutex_t segment_mutex;
+
+/**
+ * @brief Plan sequence count. Odd while segment_lock() is held.
+ */
+static volatile uint32_t segment_seq = 0;
+
+// Static function declarations
+static uint32_t _segment_cache_hash(const segment_cache_key_t *key);
+static void _segment_cache_load(float exit_speed_sqr, float nominal_speed);
+static void _segment_cache_store();
+static void _segment_fixed_profile(bool new_block);
+static void _segment_fixed_sync(bool complete);
+static bool _segment_generate_fixed(segment_t *prep_segment, bool *complete);
+static bool _segment_generate_float(segment_t *prep_segment, bool *complete);
+static void _segment_prep(bool speculative);
+static void _segment_prep_pwm(segment_t *prep_segment);
+static void _segment_worker_loop();
+
 /**
  * @brief Increments the step segment buffer block data ring buffer.
  * @param block_index Index to calculate from
@@ -133,9 +267,31 @@ static uint8_t segment_next_block_index(uint8_t block_index) {
 
 /**
  * @brief Prepares step segment buffer.
+ *
+ * Fills the segment buffer regardless of plan state. Used to charge the buffer before a cycle starts.
  */
 void segment_prep_buffer() {
-    while (segment_buffer_tail != segment_next_head) { // Check if we need to fill the buffer.
+    segment_lock();
+    _segment_prep(false);
+    segment_unlock();
+}
+
+/**
+ * @brief Prepares step segment buffer.
+ *
+ * When speculative, only blocks behind the planner's optimally planned pointer are prepped freely,
+ * since their profiles can no longer change. Blocks the planner may still revise are prepped just in time,
+ * once the queued segments drop below SEGMENT_PREP_LOW_WATERMARK.
+ * @note Caller must hold segment_lock().
+ * @param speculative Run ahead only on finalized blocks
+ */
+static void _segment_prep(bool speculative) {
+    // Check if we need to fill the buffer. Acquire, so the step generator is done with the slot reused.
+    while (__atomic_load_n(&segment_buffer_tail, __ATOMIC_ACQUIRE) != segment_next_head) {
+        if (speculative && (segment_queued() >= SEGMENT_PREP_LOW_WATERMARK)) {
+            plan_block_t *block = (pl_block != NULL) ? pl_block : plan_get_current_block();
+            if ((block == NULL) || !plan_block_is_planned(block)) { goto segment_prep_buffer_exit; }
+        }
 
         // Determine if we need to load a new motion block or if the block needs to be recomputed.
         if (pl_block == NULL) {
@@ -145,10 +301,19 @@ void segment_prep_buffer() {
             else { pl_block = plan_get_current_block(); }
             if (pl_block == NULL) { goto segment_prep_buffer_exit; } // No motion blocks. Exit.
 
+            // Any recorded or replayed profile no longer applies once the block is reloaded or recomputed.
+            bool fresh_block = false;
+            bool new_block = false;
+            segment_cache_recording = false;
+            segment_cache_replay = NULL;
+
             // Check if we need to only recompute the velocity profile or load a new block.
             if (prep.recalculate_flag & PREP_FLAG_RECALCULATE) {
                 prep.recalculate_flag = false;
             } else {
+                new_block = true;
+                fresh_block = !(step_control & STEP_CONTROL_EXECUTE_HOLD) &&
+                              !(prep.recalculate_flag & PREP_FLAG_DECEL_OVERRIDE);
 
                 // Load the Bresenham stepping data for the block.
                 prep.st_block_index = segment_next_block_index(prep.st_block_index);
@@ -158,8 +323,16 @@ void segment_prep_buffer() {
                 // segment buffer finishes the prepped block, but the stepper ISR is still executing it.
                 st_prep_block = &st_block_buffer[prep.st_block_index];
                 st_prep_block->direction_bits = pl_block->direction_bits;
+                st_prep_block->step_shift = pl_block->step_shift;
+                st_prep_block->async_steps = pl_block->async_steps;
+                st_prep_block->async_direction_bits = pl_block->async_direction_bits;
+                st_prep_block->allows_async = pl_block->allows_async;
                 uint8_t idx;
-                for (idx=0; idx<N_AXIS; idx++) { st_prep_block->steps[idx] = (pl_block->steps[idx] << 1); }
+                st_prep_block->axis_mask = 0;
+                for (idx=0; idx<N_AXIS; idx++) {
+                    st_prep_block->steps[idx] = (pl_block->steps[idx] << 1);
+                    if (pl_block->steps[idx]) { st_prep_block->axis_mask |= bit(idx); }
+                }
                 st_prep_block->step_event_count = (pl_block->step_event_count << 1);
 
                 // Initialize segment buffer data for generating the segments.
@@ -285,7 +458,11 @@ void segment_prep_buffer() {
                     // prep.decelerate_after = 0.0;
                     prep.maximum_speed = prep.exit_speed;
                 }
+                if (fresh_block && settings.segment_cache && !(step_control & STEP_CONTROL_EXECUTE_SYS_MOTION)) {
+                    _segment_cache_load(exit_speed_sqr, nominal_speed);
+                }
             }
+            if (settings.segment_generator == SEGMENT_GENERATOR_FIXED) { _segment_fixed_profile(new_block); }
             bit_true(step_control, STEP_CONTROL_UPDATE_SPINDLE_PWM); // Force update whenever updating block.
         }
 
@@ -294,176 +471,76 @@ void segment_prep_buffer() {
 
         // Set new segment to point to the current segment data block.
         prep_segment->st_block_index = prep.st_block_index;
+        prep_segment->line_id = pl_block->line_id;
+        if (pl_block->line_id != segment_prep_line_id) {
+            segment_prep_line_id = pl_block->line_id;
+            latency_stamp(segment_prep_line_id, LAT_SEGMENTED, latency_now());
+        }
 
-        /*------------------------------------------------------------------------------------
-            Compute the average velocity of this new segment by determining the total distance
-          traveled over the segment time DT_SEGMENT. The following code first attempts to create
-          a full segment based on the current ramp conditions. If the segment time is incomplete
-          when terminating at a ramp state change, the code will continue to loop through the
-          progressing ramp states to fill the remaining segment execution time. However, if
-          an incomplete segment terminates at the end of the velocity profile, the segment is
-          considered completed despite having a truncated execution time less than DT_SEGMENT.
-            The velocity profile is always assumed to progress through the ramp sequence:
-          acceleration ramp, cruising state, and deceleration ramp. Each ramp's travel distance
-          may range from zero to the length of the block. Velocity profiles can end either at
-          the end of motion block (typical) or mid-block at the end of a forced deceleration,
-          such as from a feed hold.
-        */
-        float dt_max = (float) DT_SEGMENT; // Maximum segment time
-        float dt = 0.0; // Initialize segment time
-        float time_var = dt_max; // Time worker variable
-        float mm_var; // mm-Distance worker variable
-        float speed_var; // Speed worker variable
-        float mm_remaining = pl_block->millimeters; // New segment distance from end of block.
-        float minimum_mm = mm_remaining - prep.req_mm_increment; // Guarantee at least one step.
-        if (minimum_mm < 0.0) { minimum_mm = 0.0; }
-
-        do {
-            switch (prep.ramp_type) {
-                case RAMP_DECEL_OVERRIDE:
-                    speed_var = pl_block->acceleration * time_var;
-                    if (prep.current_speed - prep.maximum_speed <= speed_var) {
-                        // Cruise or cruise-deceleration types only for deceleration override.
-                        mm_remaining = prep.accelerate_until;
-                        time_var = (float) 2.0 * (pl_block->millimeters - mm_remaining) /
-                                   (prep.current_speed + prep.maximum_speed);
-                        prep.ramp_type = RAMP_CRUISE;
-                        prep.current_speed = prep.maximum_speed;
-                    } else { // Mid-deceleration override ramp.
-                        mm_remaining -= time_var * (prep.current_speed - 0.5 * speed_var);
-                        prep.current_speed -= speed_var;
-                    }
-                    break;
-                case RAMP_ACCEL:
-                    // NOTE: Acceleration ramp only computes during first do-while loop.
-                    speed_var = pl_block->acceleration * time_var;
-                    mm_remaining -= time_var * (prep.current_speed + 0.5 * speed_var);
-                    if (mm_remaining < prep.accelerate_until) { // End of acceleration ramp.
-                        // Acceleration-cruise, acceleration-deceleration ramp junction, or end of block.
-                        mm_remaining = prep.accelerate_until; // NOTE: 0.0 at EOB
-                        time_var = (float) 2.0 * (pl_block->millimeters - mm_remaining) /
-                                   (prep.current_speed + prep.maximum_speed);
-                        if (mm_remaining == prep.decelerate_after) { prep.ramp_type = RAMP_DECEL; }
-                        else { prep.ramp_type = RAMP_CRUISE; }
-                        prep.current_speed = prep.maximum_speed;
-                    } else { // Acceleration only.
-                        prep.current_speed += speed_var;
-                    }
-                    break;
-                case RAMP_CRUISE:
-                    // NOTE: mm_var used to retain the last mm_remaining for incomplete segment time_var calculations.
-                    // NOTE: If maximum_speed*time_var value is too low, round-off can cause mm_var to not change. To
-                    //   prevent this, simply enforce a minimum speed threshold in the motion.
-                    mm_var = mm_remaining - prep.maximum_speed * time_var;
-                    if (mm_var < prep.decelerate_after) { // End of cruise.
-                        // Cruise-deceleration junction or end of block.
-                        time_var = (mm_remaining - prep.decelerate_after) / prep.maximum_speed;
-                        mm_remaining = prep.decelerate_after; // NOTE: 0.0 at EOB
-                        prep.ramp_type = RAMP_DECEL;
-                    } else { // Cruising only.
-                        mm_remaining = mm_var;
-                    }
-                    break;
-                default: // case RAMP_DECEL:
-                    // NOTE: mm_var used as a misc worker variable to prevent errors when near zero speed.
-                    speed_var = pl_block->acceleration * time_var; // Used as delta speed (mm/min)
-                    if (prep.current_speed > speed_var) { // Check if at or below zero speed.
-                        // Compute distance from end of segment to end of block.
-                        mm_var = mm_remaining - time_var * (prep.current_speed - (float) 0.5 * speed_var); // (mm)
-                        if (mm_var > prep.mm_complete) { // Typical case. In deceleration ramp.
-                            mm_remaining = mm_var;
-                            prep.current_speed -= speed_var;
-                            break; // Segment complete. Exit switch-case statement. Continue do-while loop.
-                        }
-                    }
-                    // Otherwise, at end of block or end of forced-deceleration.
-                    time_var = (float) 2.0 * (mm_remaining - prep.mm_complete) / (prep.current_speed + prep.exit_speed);
-                    mm_remaining = prep.mm_complete;
-                    prep.current_speed = prep.exit_speed;
+        // Replay the block from the profile cache. Prep state is restored exactly, so a replan mid-block
+        // picks up just as if the segments had been computed.
+        if (segment_cache_replay != NULL) {
+            segment_cache_seg_t *cached = &segment_cache_replay->segments[segment_cache_replay_pos++];
+            prep_segment->n_step = cached->n_step;
+            prep_segment->cycles_per_tick = cached->cycles_per_tick;
+            prep_segment->spindle_pwm = cached->spindle_pwm;
+
+            __atomic_store_n(&segment_buffer_head, segment_next_head, __ATOMIC_RELEASE);
+            if (++segment_next_head == SEGMENT_BUFFER_SIZE) { segment_next_head = 0; }
+
+            if (settings.segment_generator == SEGMENT_GENERATOR_FIXED) {
+                prep.fx.distance = cached->fx.distance;
+                prep.fx.speed = cached->fx.speed;
+                prep.fx.dt_remainder = cached->fx.dt_remainder;
+                _segment_fixed_sync(prep.fx.distance == prep.fx.complete);
+            } else {
+                pl_block->millimeters = cached->mm_remaining;
+                prep.current_speed = cached->current_speed;
+                prep.steps_remaining = cached->steps_remaining;
+                prep.dt_remainder = cached->dt_remainder;
             }
-            dt += time_var; // Add computed ramp time to total segment time.
-            if (dt < dt_max) { time_var = dt_max - dt; } // **Incomplete** At ramp junction.
-            else {
-                if (mm_remaining > minimum_mm) { // Check for very slow segments with zero steps.
-                    // Increase segment time to ensure at least one step in segment. Override and loop
-                    // through distance calculations until minimum_mm or mm_complete.
-                    dt_max += DT_SEGMENT;
-                    time_var = dt_max - dt;
-                } else {
-                    break; // **Complete** Exit loop. Segment execution time maxed.
-                }
+
+            if (segment_cache_replay_pos == segment_cache_replay->count) {
+                segment_cache_replay = NULL;
+                pl_block = NULL;
+                plan_discard_current_block();
             }
-        } while (mm_remaining > prep.mm_complete); // **Complete** Exit loop. Profile complete.
-
-        /* -----------------------------------------------------------------------------------
-        Compute spindle speed PWM output for step segment
-      */
-        if (st_prep_block->is_pwm_rate_adjusted || (step_control & STEP_CONTROL_UPDATE_SPINDLE_PWM)) {
-//            if (pl_block->condition & (PL_COND_FLAG_SPINDLE_CW | PL_COND_FLAG_SPINDLE_CCW)) {
-//                float rpm = pl_block->spindle_speed;
-                // NOTE: Feed and rapid overrides are independent of PWM value and do not alter laser power/rate.
-//                if (st_prep_block->is_pwm_rate_adjusted) { rpm *= (prep.current_speed * prep.inv_rate); }
-                // If current_speed is zero, then may need to be rpm_min*(100/MAX_SPINDLE_SPEED_OVERRIDE)
-                // but this would be instantaneous only and during a motion. May not matter at all.
-//                prep.current_spindle_pwm = spindle_compute_pwm_value(rpm);
-//            } else {
-//                sys.spindle_speed = 0.0;
-//                prep.current_spindle_pwm = SPINDLE_PWM_OFF_VALUE;
-//            }
-            bit_false(step_control, STEP_CONTROL_UPDATE_SPINDLE_PWM);
+            continue;
         }
-        prep_segment->spindle_pwm = prep.current_spindle_pwm; // Reload segment PWM value
-
-        /* -----------------------------------------------------------------------------------
-           Compute segment step rate, steps to execute, and apply necessary rate corrections.
-           NOTE: Steps are computed by direct scalar conversion of the millimeter distance
-           remaining in the block, rather than incrementally tallying the steps executed per
-           segment. This helps in removing floating point round-off issues of several additions.
-        */
-        float step_dist_remaining = (prep.step_per_mm * mm_remaining); // Convert mm_remaining to steps
-        float n_steps_remaining = ceilf(step_dist_remaining); // Round-up current steps remaining
-        float last_n_steps_remaining = ceilf(prep.steps_remaining); // Round-up last steps remaining
-        prep_segment->n_step = (uint16_t) (last_n_steps_remaining -
-                                           n_steps_remaining); // Compute number of steps to execute.
-
-        // Bail if we are at the end of a feed hold and don't have a step to execute.
-        if (prep_segment->n_step == 0) {
-            if (step_control & STEP_CONTROL_EXECUTE_HOLD) {
-                // Less than one step to decelerate to zero speed, but already very close. AMASS
-                // requires full steps to execute. So, just bail.
-                bit_true(step_control, STEP_CONTROL_END_MOTION);
-                goto segment_prep_buffer_exit; // Segment not generated, but current step data still retained.
-            }
+
+        bool complete;
+        if (settings.segment_generator == SEGMENT_GENERATOR_FIXED) {
+            if (!_segment_generate_fixed(prep_segment, &complete)) { goto segment_prep_buffer_exit; }
+        } else {
+            if (!_segment_generate_float(prep_segment, &complete)) { goto segment_prep_buffer_exit; }
         }
 
-        /* Compute segment step rate. Since steps are integers and mm distances traveled are not,
-           the end of every segment can have a partial step of varying magnitudes that are not
-           executed, because the stepper ISR requires whole steps due to the AMASS algorithm. To
-           compensate, we track the time to execute the previous segment's partial step and simply
-           apply it with the partial step distance to the current segment, so that it minutely
-           adjusts the whole segment rate to keep step output exact. These rate adjustments are
-           typically very small and do not adversely effect performance, but ensures that Grbl
-           outputs the exact acceleration and velocity profiles as computed by the motion. */
-        dt += prep.dt_remainder; // Apply previous segment partial step execute time
-        float inv_rate = dt / (last_n_steps_remaining - step_dist_remaining); // Compute adjusted step rate inverse
-
-        // Compute CPU cycles per step for the prepped segment.
-        uint32_t cycles = (uint32_t) ceilf(STEP_FREQUENCY * 60 * inv_rate); // (cycles/step)
-        prep_segment->cycles_per_tick = cycles;
-
-        // Segment complete! Increment segment buffer indices, so stepper ISR can immediately execute it.
-        segment_buffer_head = segment_next_head;
-        if (++segment_next_head == SEGMENT_BUFFER_SIZE) { segment_next_head = 0; }
-
-        // Update the appropriate motion and segment data.
-        pl_block->millimeters = mm_remaining;
-        prep.steps_remaining = n_steps_remaining;
-        prep.dt_remainder = (n_steps_remaining - step_dist_remaining) * inv_rate;
+        if (segment_cache_recording) {
+            if (segment_cache_record.count < SEGMENT_CACHE_MAX_SEGMENTS) {
+                segment_cache_seg_t *cached = &segment_cache_record.segments[segment_cache_record.count++];
+                cached->n_step = prep_segment->n_step;
+                cached->cycles_per_tick = prep_segment->cycles_per_tick;
+                cached->spindle_pwm = prep_segment->spindle_pwm;
+                if (settings.segment_generator == SEGMENT_GENERATOR_FIXED) {
+                    cached->fx.distance = prep.fx.distance;
+                    cached->fx.speed = prep.fx.speed;
+                    cached->fx.dt_remainder = prep.fx.dt_remainder;
+                } else {
+                    cached->mm_remaining = pl_block->millimeters;
+                    cached->current_speed = prep.current_speed;
+                    cached->steps_remaining = prep.steps_remaining;
+                    cached->dt_remainder = prep.dt_remainder;
+                }
+            } else {
+                segment_cache_recording = false;
+            }
+        }
 
         // Check for exit conditions and flag to load next motion block.
-        if (mm_remaining == prep.mm_complete) {
+        if (complete) {
             // End of motion block or forced-termination. No more distance to be executed.
-            if (mm_remaining > 0.0) { // At end of forced-termination.
+            if (prep.mm_complete > 0.0) { // At end of forced-termination.
+                segment_cache_recording = false;
                 // Reset prep parameters for resuming and then bail. Allow the stepper ISR to complete
                 // the segment queue, where realtime protocol will set new state upon receiving the
                 // cycle stop flag from the ISR. Prep_segment is blocked until then.
@@ -475,6 +552,7 @@ void segment_prep_buffer() {
                     bit_true(step_control, STEP_CONTROL_END_MOTION);
                     goto segment_prep_buffer_exit;
                 }
+                if (segment_cache_recording) { _segment_cache_store(); }
                 pl_block = NULL; // Set pointer to indicate check and load next motion block.
                 plan_discard_current_block();
             }
@@ -485,10 +563,609 @@ segment_prep_buffer_exit:
     return;
 }
 
+/**
+ * @brief Convert a profile distance to fixed-point
+ * @param mm Distance from end of block (mm)
+ * @param scale Q32 steps per mm
+ * @return Distance from end of block (Q32 steps), limited to the distance remaining
+ */
+static int64_t _segment_fixed_distance(float mm, double scale) {
+    int64_t distance = (int64_t) (mm * scale);
+    if (distance < 0) { return 0; }
+    if (distance > prep.fx.distance) { return prep.fx.distance; }
+    return distance;
+}
+
+/**
+ * @brief Convert the velocity profile just computed for pl_block to fixed-point
+ *
+ * Runs once per block load or recompute, so it is free to use floating point. The distance, speed and partial
+ * step time carried between segments stay in fixed-point across recomputes, so nothing is lost to round-off.
+ * @param new_block True if the block was just loaded
+ */
+static void _segment_fixed_profile(bool new_block) {
+    st_prep_fixed_t *fx = &prep.fx;
+    double distance = prep.step_per_mm * (double) SEGMENT_FX_ONE;  // mm to Q32 steps
+    double speed = distance / (60.0 * STEP_FREQUENCY);              // mm/min to Q32 steps/tick
+
+    if (new_block) {
+        fx->distance = (int64_t) pl_block->step_event_count << 32;
+        fx->speed = (int64_t) (prep.current_speed * speed);
+        fx->dt_remainder = 0;
+    }
+    fx->mm_per_distance = (float) (1.0 / distance);
+    fx->mm_min_per_speed = (float) (1.0 / speed);
+    fx->acceleration = (int64_t) (pl_block->acceleration * speed / (60.0 * STEP_FREQUENCY) * 256.0);
+    fx->maximum_speed = (int64_t) (prep.maximum_speed * speed);
+    fx->exit_speed = (int64_t) (prep.exit_speed * speed);
+    fx->accelerate_until = _segment_fixed_distance(prep.accelerate_until, distance);
+    fx->decelerate_after = _segment_fixed_distance(prep.decelerate_after, distance);
+    // The profile must end on a whole step
+    fx->complete = _segment_fixed_distance(roundf(prep.mm_complete * prep.step_per_mm), (double) SEGMENT_FX_ONE);
+}
+
+/**
+ * @brief Update the floating point prep state the planner reads from the fixed-point state
+ * @param complete True if the velocity profile is complete
+ */
+static void _segment_fixed_sync(bool complete) {
+    pl_block->millimeters = complete ? prep.mm_complete : (float) prep.fx.distance * prep.fx.mm_per_distance;
+    prep.current_speed = (float) prep.fx.speed * prep.fx.mm_min_per_speed;
+    prep.steps_remaining = (float) SEGMENT_FX_CEIL(prep.fx.distance);
+}
+
+/**
+ * @brief Speed change over a time at the block acceleration
+ * @param time Time (Q16 ticks)
+ * @return Speed change (Q32 steps/tick)
+ */
+static inline int64_t _segment_fx_dv(int64_t time) {
+    return (prep.fx.acceleration * time) >> 24;
+}
+
+/**
+ * @brief Distance covered over a time at a speed
+ * @param time Time (Q16 ticks)
+ * @param speed Average speed (Q32 steps/tick)
+ * @return Distance (Q32 steps)
+ */
+static inline int64_t _segment_fx_dist(int64_t time, int64_t speed) {
+    return (time * speed) >> 16;
+}
+
+/**
+ * @brief Time to cover a distance while the speed changes linearly
+ * @param distance Distance (Q32 steps)
+ * @param speed_sum Sum of the start and end speeds (Q32 steps/tick)
+ * @return Time (Q16 ticks)
+ */
+static inline int64_t _segment_fx_time(int64_t distance, int64_t speed_sum) {
+    if ((distance <= 0) || (speed_sum <= 0)) { return 0; }
+    return (distance << 17) / speed_sum;
+}
+
+/**
+ * @brief Compute the next segment of the prepped block in fixed-point
+ *
+ * Follows the same ramp sequence as _segment_generate_float(), in integer steps and ticks. The distance remaining
+ * is exact, so every block executes exactly step_event_count steps. Cost per segment doesn't depend on the data:
+ * no square roots or float conversions, and a few 64 bit multiplies and divides.
+ * @param prep_segment Segment to fill
+ * @param complete Set true when the segment ends the velocity profile
+ * @return False if no segment was generated, at the end of a feed hold.
+ */
+static bool _segment_generate_fixed(segment_t *prep_segment, bool *complete) {
+    st_prep_fixed_t *fx = &prep.fx;
+    int64_t dt_max = SEGMENT_FX_DT; // Maximum segment time
+    int64_t dt = 0; // Segment time
+    int64_t time_var = dt_max; // Time worker variable
+    int64_t dist_var; // Distance worker variable
+    int64_t speed_var; // Speed worker variable
+    int64_t remaining = fx->distance; // New segment distance from end of block.
+    int64_t minimum = remaining - SEGMENT_FX_MIN_DISTANCE; // Guarantee at least one step.
+    if (minimum < 0) { minimum = 0; }
+
+    do {
+        switch (prep.ramp_type) {
+            case RAMP_DECEL_OVERRIDE:
+                speed_var = _segment_fx_dv(time_var);
+                if (fx->speed - fx->maximum_speed <= speed_var) {
+                    remaining = fx->accelerate_until;
+                    time_var = _segment_fx_time(fx->distance - remaining, fx->speed + fx->maximum_speed);
+                    prep.ramp_type = RAMP_CRUISE;
+                    fx->speed = fx->maximum_speed;
+                } else { // Mid-deceleration override ramp.
+                    remaining -= _segment_fx_dist(time_var, fx->speed - speed_var / 2);
+                    fx->speed -= speed_var;
+                }
+                break;
+            case RAMP_ACCEL:
+                speed_var = _segment_fx_dv(time_var);
+                remaining -= _segment_fx_dist(time_var, fx->speed + speed_var / 2);
+                if (remaining < fx->accelerate_until) { // End of acceleration ramp.
+                    remaining = fx->accelerate_until;
+                    time_var = _segment_fx_time(fx->distance - remaining, fx->speed + fx->maximum_speed);
+                    if (remaining == fx->decelerate_after) { prep.ramp_type = RAMP_DECEL; }
+                    else { prep.ramp_type = RAMP_CRUISE; }
+                    fx->speed = fx->maximum_speed;
+                } else { // Acceleration only.
+                    fx->speed += speed_var;
+                }
+                break;
+            case RAMP_CRUISE:
+                dist_var = remaining - _segment_fx_dist(time_var, fx->maximum_speed);
+                if (dist_var < fx->decelerate_after) { // End of cruise.
+                    time_var = _segment_fx_time(remaining - fx->decelerate_after, 2 * fx->maximum_speed);
+                    remaining = fx->decelerate_after;
+                    prep.ramp_type = RAMP_DECEL;
+                } else { // Cruising only.
+                    remaining = dist_var;
+                }
+                break;
+            default: // case RAMP_DECEL:
+                speed_var = _segment_fx_dv(time_var);
+                if (fx->speed > speed_var) { // Check if at or below zero speed.
+                    dist_var = remaining - _segment_fx_dist(time_var, fx->speed - speed_var / 2);
+                    if (dist_var > fx->complete) { // Typical case. In deceleration ramp.
+                        remaining = dist_var;
+                        fx->speed -= speed_var;
+                        break;
+                    }
+                }
+                // Otherwise, at end of block or end of forced-deceleration.
+                time_var = _segment_fx_time(remaining - fx->complete, fx->speed + fx->exit_speed);
+                remaining = fx->complete;
+                fx->speed = fx->exit_speed;
+        }
+        dt += time_var; // Add computed ramp time to total segment time.
+        if (dt < dt_max) { time_var = dt_max - dt; } // **Incomplete** At ramp junction.
+        else {
+            if (remaining > minimum) { // Very slow segment with zero steps. Extend it.
+                dt_max += SEGMENT_FX_DT;
+                time_var = dt_max - dt;
+            } else {
+                break; // **Complete** Exit loop. Segment execution time maxed.
+            }
+        }
+    } while (remaining > fx->complete); // **Complete** Exit loop. Profile complete.
+
+    _segment_prep_pwm(prep_segment);
+
+    // Steps are whole steps crossed since the last segment. Since the distance is exact, they always add
+    // up to the block's step_event_count.
+    int64_t n_steps_remaining = SEGMENT_FX_CEIL(remaining);
+    int64_t last_n_steps_remaining = SEGMENT_FX_CEIL(fx->distance);
+    prep_segment->n_step = (uint16_t) (last_n_steps_remaining - n_steps_remaining);
+
+    // Bail if we are at the end of a feed hold and don't have a step to execute.
+    if (prep_segment->n_step == 0) {
+        if (step_control & STEP_CONTROL_EXECUTE_HOLD) {
+            segment_cache_recording = false;
+            bit_true(step_control, STEP_CONTROL_END_MOTION);
+            return false; // Segment not generated, but current step data still retained.
+        }
+    }
+
+    // Step rate, with the previous segment's partial step time carried over as in _segment_generate_float()
+    dt += fx->dt_remainder;
+    int64_t step_dist = ((last_n_steps_remaining << 32) - remaining) >> 16; // (Q16 steps)
+    int64_t inv_rate = (step_dist > 0) ? (dt << 16) / step_dist : dt; // (Q16 ticks/step)
+    prep_segment->cycles_per_tick = (uint32_t) ((inv_rate + 0xFFFF) >> 16);
+
+    // Segment complete! Increment segment buffer indices, so stepper ISR can immediately execute it.
+    __atomic_store_n(&segment_buffer_head, segment_next_head, __ATOMIC_RELEASE);
+    if (++segment_next_head == SEGMENT_BUFFER_SIZE) { segment_next_head = 0; }
+
+    // Update the appropriate motion and segment data.
+    fx->distance = remaining;
+    fx->dt_remainder = ((((n_steps_remaining << 32) - remaining) >> 16) * inv_rate) >> 16;
+    *complete = (remaining == fx->complete);
+    _segment_fixed_sync(*complete);
+    return true;
+}
+
+/**
+ * @brief Compute the next segment of the prepped block in floating point
+ * @param prep_segment Segment to fill
+ * @param complete Set true when the segment ends the velocity profile
+ * @return False if no segment was generated, at the end of a feed hold.
+ */
+static bool _segment_generate_float(segment_t *prep_segment, bool *complete) {
+    /*------------------------------------------------------------------------------------
+        Compute the average velocity of this new segment by determining the total distance
+      traveled over the segment time DT_SEGMENT. The following code first attempts to create
+      a full segment based on the current ramp conditions. If the segment time is incomplete
+      when terminating at a ramp state change, the code will continue to loop through the
+      progressing ramp states to fill the remaining segment execution time. However, if
+      an incomplete segment terminates at the end of the velocity profile, the segment is
+      considered completed despite having a truncated execution time less than DT_SEGMENT.
+        The velocity profile is always assumed to progress through the ramp sequence:
+      acceleration ramp, cruising state, and deceleration ramp. Each ramp's travel distance
+      may range from zero to the length of the block. Velocity profiles can end either at
+      the end of motion block (typical) or mid-block at the end of a forced deceleration,
+      such as from a feed hold.
+    */
+    float dt_max = (float) DT_SEGMENT; // Maximum segment time
+    float dt = 0.0; // Initialize segment time
+    float time_var = dt_max; // Time worker variable
+    float mm_var; // mm-Distance worker variable
+    float speed_var; // Speed worker variable
+    float mm_remaining = pl_block->millimeters; // New segment distance from end of block.
+    float minimum_mm = mm_remaining - prep.req_mm_increment; // Guarantee at least one step.
+    if (minimum_mm < 0.0) { minimum_mm = 0.0; }
+
+    do {
+        switch (prep.ramp_type) {
+            case RAMP_DECEL_OVERRIDE:
+                speed_var = pl_block->acceleration * time_var;
+                if (prep.current_speed - prep.maximum_speed <= speed_var) {
+                    // Cruise or cruise-deceleration types only for deceleration override.
+                    mm_remaining = prep.accelerate_until;
+                    time_var = (float) 2.0 * (pl_block->millimeters - mm_remaining) /
+                               (prep.current_speed + prep.maximum_speed);
+                    prep.ramp_type = RAMP_CRUISE;
+                    prep.current_speed = prep.maximum_speed;
+                } else { // Mid-deceleration override ramp.
+                    mm_remaining -= time_var * (prep.current_speed - 0.5 * speed_var);
+                    prep.current_speed -= speed_var;
+                }
+                break;
+            case RAMP_ACCEL:
+                // NOTE: Acceleration ramp only computes during first do-while loop.
+                speed_var = pl_block->acceleration * time_var;
+                mm_remaining -= time_var * (prep.current_speed + 0.5 * speed_var);
+                if (mm_remaining < prep.accelerate_until) { // End of acceleration ramp.
+                    // Acceleration-cruise, acceleration-deceleration ramp junction, or end of block.
+                    mm_remaining = prep.accelerate_until; // NOTE: 0.0 at EOB
+                    time_var = (float) 2.0 * (pl_block->millimeters - mm_remaining) /
+                               (prep.current_speed + prep.maximum_speed);
+                    if (mm_remaining == prep.decelerate_after) { prep.ramp_type = RAMP_DECEL; }
+                    else { prep.ramp_type = RAMP_CRUISE; }
+                    prep.current_speed = prep.maximum_speed;
+                } else { // Acceleration only.
+                    prep.current_speed += speed_var;
+                }
+                break;
+            case RAMP_CRUISE:
+                // NOTE: mm_var used to retain the last mm_remaining for incomplete segment time_var calculations.
+                // NOTE: If maximum_speed*time_var value is too low, round-off can cause mm_var to not change. To
+                //   prevent this, simply enforce a minimum speed threshold in the motion.
+                mm_var = mm_remaining - prep.maximum_speed * time_var;
+                if (mm_var < prep.decelerate_after) { // End of cruise.
+                    // Cruise-deceleration junction or end of block.
+                    time_var = (mm_remaining - prep.decelerate_after) / prep.maximum_speed;
+                    mm_remaining = prep.decelerate_after; // NOTE: 0.0 at EOB
+                    prep.ramp_type = RAMP_DECEL;
+                } else { // Cruising only.
+                    mm_remaining = mm_var;
+                }
+                break;
+            default: // case RAMP_DECEL:
+                // NOTE: mm_var used as a misc worker variable to prevent errors when near zero speed.
+                speed_var = pl_block->acceleration * time_var; // Used as delta speed (mm/min)
+                if (prep.current_speed > speed_var) { // Check if at or below zero speed.
+                    // Compute distance from end of segment to end of block.
+                    mm_var = mm_remaining - time_var * (prep.current_speed - (float) 0.5 * speed_var); // (mm)
+                    if (mm_var > prep.mm_complete) { // Typical case. In deceleration ramp.
+                        mm_remaining = mm_var;
+                        prep.current_speed -= speed_var;
+                        break; // Segment complete. Exit switch-case statement. Continue do-while loop.
+                    }
+                }
+                // Otherwise, at end of block or end of forced-deceleration.
+                time_var = (float) 2.0 * (mm_remaining - prep.mm_complete) / (prep.current_speed + prep.exit_speed);
+                mm_remaining = prep.mm_complete;
+                prep.current_speed = prep.exit_speed;
+        }
+        dt += time_var; // Add computed ramp time to total segment time.
+        if (dt < dt_max) { time_var = dt_max - dt; } // **Incomplete** At ramp junction.
+        else {
+            if (mm_remaining > minimum_mm) { // Check for very slow segments with zero steps.
+                // Increase segment time to ensure at least one step in segment. Override and loop
+                // through distance calculations until minimum_mm or mm_complete.
+                dt_max += DT_SEGMENT;
+                time_var = dt_max - dt;
+            } else {
+                break; // **Complete** Exit loop. Segment execution time maxed.
+            }
+        }
+    } while (mm_remaining > prep.mm_complete); // **Complete** Exit loop. Profile complete.
+
+    _segment_prep_pwm(prep_segment);
+
+    /* -----------------------------------------------------------------------------------
+       Compute segment step rate, steps to execute, and apply necessary rate corrections.
+       NOTE: Steps are computed by direct scalar conversion of the millimeter distance
+       remaining in the block, rather than incrementally tallying the steps executed per
+       segment. This helps in removing floating point round-off issues of several additions.
+    */
+    float step_dist_remaining = (prep.step_per_mm * mm_remaining); // Convert mm_remaining to steps
+    float n_steps_remaining = ceilf(step_dist_remaining); // Round-up current steps remaining
+    float last_n_steps_remaining = ceilf(prep.steps_remaining); // Round-up last steps remaining
+    prep_segment->n_step = (uint16_t) (last_n_steps_remaining -
+                                       n_steps_remaining); // Compute number of steps to execute.
+
+    // Bail if we are at the end of a feed hold and don't have a step to execute.
+    if (prep_segment->n_step == 0) {
+        if (step_control & STEP_CONTROL_EXECUTE_HOLD) {
+            segment_cache_recording = false;
+            // Less than one step to decelerate to zero speed, but already very close. AMASS
+            // requires full steps to execute. So, just bail.
+            bit_true(step_control, STEP_CONTROL_END_MOTION);
+            return false; // Segment not generated, but current step data still retained.
+        }
+    }
+
+    /* Compute segment step rate. Since steps are integers and mm distances traveled are not,
+       the end of every segment can have a partial step of varying magnitudes that are not
+       executed, because the stepper ISR requires whole steps due to the AMASS algorithm. To
+       compensate, we track the time to execute the previous segment's partial step and simply
+       apply it with the partial step distance to the current segment, so that it minutely
+       adjusts the whole segment rate to keep step output exact. These rate adjustments are
+       typically very small and do not adversely effect performance, but ensures that Grbl
+       outputs the exact acceleration and velocity profiles as computed by the motion. */
+    dt += prep.dt_remainder; // Apply previous segment partial step execute time
+    float inv_rate = dt / (last_n_steps_remaining - step_dist_remaining); // Compute adjusted step rate inverse
+
+    // Compute CPU cycles per step for the prepped segment.
+    uint32_t cycles = (uint32_t) ceilf(STEP_FREQUENCY * 60 * inv_rate); // (cycles/step)
+    prep_segment->cycles_per_tick = cycles;
+
+    // Segment complete! Increment segment buffer indices, so stepper ISR can immediately execute it.
+    __atomic_store_n(&segment_buffer_head, segment_next_head, __ATOMIC_RELEASE);
+    if (++segment_next_head == SEGMENT_BUFFER_SIZE) { segment_next_head = 0; }
+
+    // Update the appropriate motion and segment data.
+    pl_block->millimeters = mm_remaining;
+    prep.steps_remaining = n_steps_remaining;
+    prep.dt_remainder = (n_steps_remaining - step_dist_remaining) * inv_rate;
+
+    *complete = (mm_remaining == prep.mm_complete);
+    return true;
+}
+
+
+/**
+ * @brief Compute spindle speed PWM output for step segment
+ * @param prep_segment Segment to set the PWM value of
+ */
+static void _segment_prep_pwm(segment_t *prep_segment) {
+    if (st_prep_block->is_pwm_rate_adjusted || (step_control & STEP_CONTROL_UPDATE_SPINDLE_PWM)) {
+//        if (pl_block->condition & (PL_COND_FLAG_SPINDLE_CW | PL_COND_FLAG_SPINDLE_CCW)) {
+//            float rpm = pl_block->spindle_speed;
+            // NOTE: Feed and rapid overrides are independent of PWM value and do not alter laser power/rate.
+//            if (st_prep_block->is_pwm_rate_adjusted) { rpm *= (prep.current_speed * prep.inv_rate); }
+            // If current_speed is zero, then may need to be rpm_min*(100/MAX_SPINDLE_SPEED_OVERRIDE)
+            // but this would be instantaneous only and during a motion. May not matter at all.
+//            prep.current_spindle_pwm = spindle_compute_pwm_value(rpm);
+//        } else {
+//            sys.spindle_speed = 0.0;
+//            prep.current_spindle_pwm = SPINDLE_PWM_OFF_VALUE;
+//        }
+        bit_false(step_control, STEP_CONTROL_UPDATE_SPINDLE_PWM);
+    }
+    prep_segment->spindle_pwm = prep.current_spindle_pwm; // Reload segment PWM value
+}
+
+/**
+ * @brief FNV-1a hash of a cache key
+ * @param key Key to hash
+ * @return Hash
+ */
+static uint32_t _segment_cache_hash(const segment_cache_key_t *key) {
+    const uint8_t *bytes = (const uint8_t *) key;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(segment_cache_key_t); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Look up the freshly loaded block in the profile cache
+ *
+ * On a hit, the block is replayed. On a miss, recording starts.
+ * @param exit_speed_sqr Block exit speed used by the profile
+ * @param nominal_speed Block nominal speed used by the profile
+ */
+static void _segment_cache_load(float exit_speed_sqr, float nominal_speed) {
+    segment_cache_key_t key;
+    memset(&key, 0, sizeof(key)); // Clear padding, the key is hashed and compared as bytes
+    key.step_event_count = pl_block->step_event_count;
+    key.is_pwm_rate_adjusted = st_prep_block->is_pwm_rate_adjusted;
+    key.generator = settings.segment_generator;
+    key.millimeters = pl_block->millimeters;
+    key.acceleration = pl_block->acceleration;
+    key.entry_speed_sqr = pl_block->entry_speed_sqr;
+    key.exit_speed_sqr = exit_speed_sqr;
+    key.nominal_speed = nominal_speed;
+    key.programmed_rate = pl_block->programmed_rate;
+
+    segment_cache_entry_t *entry = &segment_cache[_segment_cache_hash(&key) & (SEGMENT_CACHE_ENTRIES - 1)];
+    if (entry->valid && (memcmp(&entry->key, &key, sizeof(key)) == 0)) {
+        metrics_inc(METRIC_SEGMENT_CACHE_HITS);
+        segment_cache_replay = entry;
+        segment_cache_replay_pos = 0;
+    } else {
+        metrics_inc(METRIC_SEGMENT_CACHE_MISSES);
+        segment_cache_record.key = key;
+        segment_cache_record.count = 0;
+        segment_cache_recording = true;
+    }
+}
+
+/**
+ * @brief Store the recorded block profile, replacing whatever shared its slot
+ */
+static void _segment_cache_store() {
+    segment_cache_entry_t *entry =
+            &segment_cache[_segment_cache_hash(&segment_cache_record.key) & (SEGMENT_CACHE_ENTRIES - 1)];
+    entry->valid = true;
+    entry->key = segment_cache_record.key;
+    entry->count = segment_cache_record.count;
+    memcpy(entry->segments, segment_cache_record.segments, entry->count * sizeof(segment_cache_seg_t));
+    segment_cache_recording = false;
+}
+
+/**
+ * @brief Number of segments queued for the step generator
+ * @return Queued segments
+ */
+uint16_t segment_queued() {
+    uint16_t head = __atomic_load_n(&segment_buffer_head, __ATOMIC_ACQUIRE);
+    uint16_t tail = __atomic_load_n(&segment_buffer_tail, __ATOMIC_ACQUIRE);
+    return (uint16_t) ((head + SEGMENT_BUFFER_SIZE - tail) % SEGMENT_BUFFER_SIZE);
+}
+
+/**
+ * @brief Execution time of the segments queued for the step generator
+ * @return Queued time (ms)
+ */
+float segment_queued_time() {
+    uint64_t cycles = 0;
+    uint16_t head = __atomic_load_n(&segment_buffer_head, __ATOMIC_ACQUIRE);
+    uint16_t tail = __atomic_load_n(&segment_buffer_tail, __ATOMIC_ACQUIRE);
+    for (uint16_t idx = tail; idx != head; idx = (uint16_t) ((idx + 1) % SEGMENT_BUFFER_SIZE)) {
+        cycles += (uint64_t) segment_buffer[idx].n_step * segment_buffer[idx].cycles_per_tick;
+    }
+    return (float) cycles * 1000 / STEP_FREQUENCY;
+}
+
+/**
+ * @brief Check for motion that has not been prepped yet
+ * @return True if a block is being prepped or waiting in the planner
+ */
+bool segment_prep_pending() {
+    return (pl_block != NULL) || (plan_get_current_block() != NULL);
+}
+
+/**
+ * @brief Take the segment prep lock
+ *
+ * Held by the planner while it recalculates, so the worker never preps from a half updated plan.
+ */
+void segment_lock() {
+    pthread_mutex_lock(&segment_mutex);
+    __atomic_add_fetch(&segment_seq, 1, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * @brief Begin a lock free read of the plan
+ *
+ * For readers that must not hold up the planner or segment prep. Copy what's needed, then check
+ * segment_read_retry().
+ * @return Sequence count. Odd if the plan is being changed, and the read should be retried.
+ */
+uint32_t segment_read_begin() {
+    return __atomic_load_n(&segment_seq, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Check a lock free read of the plan
+ * @param seq Sequence count from segment_read_begin()
+ * @return True if the plan changed during the read, and it must be retried.
+ */
+bool segment_read_retry(uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&segment_seq, __ATOMIC_RELAXED) != seq;
+}
+
+/**
+ * @brief Release the segment prep lock
+ */
+void segment_unlock() {
+    __atomic_add_fetch(&segment_seq, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&segment_mutex);
+}
+
+/**
+ * @brief Wake the segment prep worker
+ */
+void segment_worker_kick() {
+    int val = 0;
+    sem_getvalue(&segment_worker_sem, &val);
+    if (val == 0) sem_post(&segment_worker_sem);
+}
+
+/**
+ * @brief Initialize the segment prep lock and worker wake up
+ *
+ * Enough to prep segments from the calling thread, as offline rendering does.
+ */
+void segment_init() {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&segment_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    sem_init(&segment_worker_sem, 0, 0);
+}
+
+/**
+ * @brief Initialize and start the segment prep worker
+ * @return 0 on success, negative on error.
+ */
+ssize_t segment_worker_init() {
+    ssize_t ret = 0;
+    segment_init();
+
+    if ((ret = rt_task_spawn(&rt_segment_worker_task, "rt_segment_worker_task", 0,
+                             SEGMENT_PREP_PRIORITY, 0, &_segment_worker_loop, 0)) < 0) {
+        fprintf(stderr, "segment_worker_init: rt_task_spawn returned %zd\n", ret);
+        return ret;
+    }
+
+    CPU_ZERO(&segment_worker_cpus);
+    CPU_SET(SEGMENT_PREP_CPU_AFFINITY, &segment_worker_cpus);
+    rt_task_set_affinity(&rt_segment_worker_task, &segment_worker_cpus);
+    return ret;
+}
+
+/**
+ * @brief Stop the segment prep worker
+ */
+void segment_worker_reset() {
+    rt_task_delete(&rt_segment_worker_task);
+}
+
+/**
+ * @brief Segment prep worker loop
+ *
+ * The single producer for the segment buffer. Woken by the planner when blocks are added and by the step
+ * generator as segments are consumed, and otherwise polls every SEGMENT_PREP_PERIOD.
+ * Also drives the feed limiter, which watches the same buffers.
+ *
+ * @note Runs as Xenomai Alchemy Task with a priority of SEGMENT_PREP_PRIORITY.
+ */
+static void _segment_worker_loop() {
+    struct timespec ts;
+    rtdiag_task("rt_segment_worker_task");
+    while (loop_run) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += SEGMENT_PREP_PERIOD;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        sem_timedwait(&segment_worker_sem, &ts);
+        rtdiag_begin();
+        uint16_t head = segment_buffer_head;
+        segment_lock();
+        _segment_prep(true);
+        segment_unlock();
+        if (segment_buffer_head != head) { flight_record(FLIGHT_SEGMENT, segment_prep_line_id, segment_queued()); }
+        feed_limiter_update();
+        RTDIAG_END();
+    }
+}
+
 /**
  * @brief Reset Segment buffer
  */
 void segment_reset() {
+    segment_cache_recording = false;
+    segment_cache_replay = NULL;
     segment_buffer_tail = 0;
     segment_buffer_head = 0;
     segment_next_head = 1;
@@ -26,6 +26,16 @@
 
 #define SEGMENT_BUFFER_SIZE 256
 
+/**
+ * @brief Segment Prep Low Watermark
+ *
+ * Number of queued segments (~1ms each) below which the worker preps blocks the planner may still change.
+ */
+#define SEGMENT_PREP_LOW_WATERMARK 64
+
+#define SEGMENT_CACHE_ENTRIES       512 // Direct mapped segment profile cache entries. Must be a power of 2.
+#define SEGMENT_CACHE_MAX_SEGMENTS  64  // Blocks that prep into more segments than this are not cached.
+
 volatile uint16_t segment_buffer_tail;
 volatile uint16_t segment_buffer_head;
 
@@ -36,6 +46,11 @@ typedef struct {
     uint32_t steps[N_AXIS];
     uint32_t step_event_count;
     uint8_t direction_bits;
+    uint8_t step_shift;           /*!< XY steps are 1 << step_shift full resolution steps, see plan_block_t */
+    uint32_t async_steps;         /*!< Z steps to start asynchronously with this block */
+    uint8_t async_direction_bits; /*!< Z direction bit of async_steps */
+    uint8_t allows_async;         /*!< Block may execute while an asynchronous Z move is still running */
+    uint8_t axis_mask;            /*!< Axes with steps in this block, bit(axis). Selects the stepgen kernel. */
     uint8_t is_pwm_rate_adjusted; /*!< Tracks motions that require constant laser power/rate */
 } st_block_t;
 
@@ -49,10 +64,39 @@ typedef struct {
     uint32_t cycles_per_tick;  /*!< Step distance traveled per ISR tick, aka step rate. */
     uint8_t st_block_index;    /*!<  Stepper block data index. Uses this information to execute this segment. */
     uint8_t spindle_pwm;
+    uint32_t line_id;          /*!< ID of the G-Code line this segment came from */
 } segment_t;
 
 segment_t segment_buffer[SEGMENT_BUFFER_SIZE];
 
+/**
+ * @brief Segment generators
+ */
+enum SEGMENT_GENERATORS {
+    SEGMENT_GENERATOR_FLOAT,    /*!< Floating point ramp math, as Grbl */
+    SEGMENT_GENERATOR_FIXED,    /*!< Fixed-point integer ramp math, with exact step accounting */
+};
+
+/**
+ * @brief Fixed-point segment generator data
+ *
+ * Distances in Q32 steps from end of block, speeds in Q32 steps/tick, acceleration in Q40 steps/tick^2 and
+ * times in Q16 ticks.
+ */
+typedef struct {
+    int64_t distance;           /*!< Distance remaining in block */
+    int64_t speed;              /*!< Current speed at the end of the segment buffer */
+    int64_t dt_remainder;       /*!< Partial step time carried to the next segment */
+    int64_t acceleration;       /*!< Block acceleration */
+    int64_t maximum_speed;      /*!< Maximum speed of executing block */
+    int64_t exit_speed;         /*!< Exit speed of executing block */
+    int64_t accelerate_until;   /*!< Acceleration ramp end */
+    int64_t decelerate_after;   /*!< Deceleration ramp start */
+    int64_t complete;           /*!< End of velocity profile. Always a whole step. */
+    float mm_per_distance;      /*!< Converts distance to mm */
+    float mm_min_per_speed;     /*!< Converts speed to mm/min */
+} st_prep_fixed_t;
+
 /**
  * @brief Segment preparation data struct.
  *
@@ -78,16 +122,40 @@ typedef struct {
 
     float inv_rate;    /*!< Used by PWM laser mode to speed up segment calculations. */
     uint8_t current_spindle_pwm;
+
+    st_prep_fixed_t fx;     /*!< Fixed-point generator data */
 } st_prep_t;
 
 st_prep_t prep;
 
 plan_block_t *pl_block;
 
-void segment_reset();
+void segment_init();
+
+void segment_lock();
+
+bool segment_prep_pending();
 
 void segment_prep_buffer();
 
+uint16_t segment_queued();
+
+float segment_queued_time();
+
+uint32_t segment_read_begin();
+
+bool segment_read_retry(uint32_t seq);
+
+void segment_reset();
+
+void segment_unlock();
+
+void segment_worker_kick();
+
+ssize_t segment_worker_init();
+
+void segment_worker_reset();
+
 void st_update_plan_block_parameters();
 
 #endif //OPENGLOW_CNC_SEGMENT_H
@@ -0,0 +1,161 @@
+/**
+ * @file transform.c
+ * @brief Job placement transform
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup motion
+ *
+ * @{
+ * @defgroup motion_transform Placement Transform
+ *
+ * Places a job on the machine without regenerating its G-Code. Set with $TF=, from the words:
+ *
+ * - X, Y: Translation (mm)
+ * - R: Rotation, counterclockwise about the job origin (degrees)
+ * - S: Scale, about the job origin
+ *
+ * The job is scaled, then rotated, then translated. The words are composed into one matrix, which motion
+ * control applies to every line and arc segment end point, between the parser and the planner. The parser
+ * and the coordinate systems work in job coordinates, and reported positions are machine positions.
+ * System motions, like homing, are not transformed. $TF= without words removes the transform.
+ *
+ * It is set in the parser task, in order with the G-Code around it. Begin a job, or each copy placed by
+ * step-and-repeat, with a rapid, so the machine moves to the new placement before any arc.
+ *
+ * @{
+ */
+
+#include <math.h>
+#include <string.h>
+#include "../openglow-cnc.h"
+
+/**
+ * @brief Current placement transform
+ */
+static transform_t transform = {
+        .m = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}},
+        .scale = 1.0,
+        .active = false,
+};
+
+/**
+ * @brief Apply the placement transform
+ * @param target Job position, all axes (mm)
+ * @param out Machine position output, all axes (mm). May be target.
+ */
+void transform_apply(const float *target, float *out) {
+    float x = target[X_AXIS];
+    float y = target[Y_AXIS];
+    if (out != target) { memcpy(out, target, sizeof(float) * N_AXIS); }
+    if (!transform.active) { return; }
+    out[X_AXIS] = transform.m[0][0] * x + transform.m[0][1] * y + transform.m[0][2];
+    out[Y_AXIS] = transform.m[1][0] * x + transform.m[1][1] * y + transform.m[1][2];
+}
+
+/**
+ * @brief Set the placement transform from $TF= words
+ * @param words X, Y, R and S words. None removes the transform.
+ * @param n_words Number of words
+ * @return Status code
+ */
+uint8_t transform_command(gc_word_t *words, uint8_t n_words) {
+    float x = 0.0, y = 0.0, rotation = 0.0, scale = 1.0;
+    uint8_t seen = 0;
+    for (uint8_t w = 0; w < n_words; w++) {
+        uint8_t word_bit;
+        switch (words[w].letter) {
+            case 'X':
+                word_bit = bit(0);
+                x = words[w].value;
+                break;
+            case 'Y':
+                word_bit = bit(1);
+                y = words[w].value;
+                break;
+            case 'R':
+                word_bit = bit(2);
+                rotation = words[w].value;
+                break;
+            case 'S':
+                word_bit = bit(3);
+                scale = words[w].value;
+                break;
+            default:
+                return STATUS_UNUSED_WORDS;
+        }
+        if (seen & word_bit) { return STATUS_WORD_REPEATED; }
+        seen |= word_bit;
+    }
+    if (scale <= 0.0) { return STATUS_NEGATIVE_VALUE; }
+
+    float radians = rotation * (float) (M_PI / 180.0);
+    float c = cosf(radians) * scale;
+    float s = sinf(radians) * scale;
+    transform_t composed = {
+            .m = {{c, -s, x}, {s, c, y}},
+            .scale = scale,
+    };
+    transform_set(&composed);
+    if (verbose) printf("transform_command: X%.3f Y%.3f R%.3f S%.4f\n", x, y, rotation, scale);
+    return STATUS_OK;
+}
+
+/**
+ * @brief Get the placement transform
+ * @param out Transform output
+ */
+void transform_get(transform_t *out) {
+    *out = transform;
+}
+
+/**
+ * @brief Remove the placement transform
+ */
+void transform_reset() {
+    transform_t identity = {
+            .m = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}},
+            .scale = 1.0,
+    };
+    transform_set(&identity);
+}
+
+/**
+ * @brief Scale of the placement transform
+ *
+ * Lengths in job coordinates are this much longer on the machine.
+ * @return Scale
+ */
+float transform_scale() {
+    return transform.scale;
+}
+
+/**
+ * @brief Set the placement transform
+ * @param in Transform. active is recomputed.
+ */
+void transform_set(const transform_t *in) {
+    transform = *in;
+    transform.active = (transform.m[0][0] != 1.0) || (transform.m[0][1] != 0.0) || (transform.m[0][2] != 0.0) ||
+                       (transform.m[1][0] != 0.0) || (transform.m[1][1] != 1.0) || (transform.m[1][2] != 0.0);
+}
+
+/**
+ * @brief Translate a transform in job coordinates
+ *
+ * The job is moved by x, y before it is placed, so the offset turns and scales with the placement.
+ * @param t Transform to update
+ * @param x X offset (mm)
+ * @param y Y offset (mm)
+ */
+void transform_translate(transform_t *t, float x, float y) {
+    t->m[0][2] += t->m[0][0] * x + t->m[0][1] * y;
+    t->m[1][2] += t->m[1][0] * x + t->m[1][1] * y;
+}
+
+/** @} */
+/** @} */
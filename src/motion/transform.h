@@ -0,0 +1,50 @@
+/**
+ * @file transform.h
+ * @brief Job placement transform
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup motion_transform
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_TRANSFORM_H
+#define OPENGLOW_CNC_TRANSFORM_H
+
+#include "../common.h"
+#include "gcode.h"
+
+/**
+ * @brief Placement transform
+ *
+ * XY affine matrix, row major: x' = m[0][0] * x + m[0][1] * y + m[0][2], y' = m[1][0] * x + m[1][1] * y + m[1][2].
+ * Z is not transformed.
+ */
+typedef struct {
+    float m[2][3];  /*!< Composed matrix */
+    float scale;    /*!< Scale of the matrix */
+    bool active;    /*!< False for the identity. Motion skips the transform. */
+} transform_t;
+
+void transform_apply(const float *target, float *out);
+
+uint8_t transform_command(gc_word_t *words, uint8_t n_words);
+
+void transform_get(transform_t *out);
+
+void transform_reset();
+
+float transform_scale();
+
+void transform_set(const transform_t *in);
+
+void transform_translate(transform_t *t, float x, float y);
+
+#endif //OPENGLOW_CNC_TRANSFORM_H
+
+/** @} */
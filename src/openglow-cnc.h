@@ -17,6 +17,7 @@
 #define OPENGLOW_CNC_OPENGLOW_CNC_H
 
 #include "config.h"
+#include "cli/batch.h"
 #include "cli/console.h"
 #include "cli/socket.h"
 #include "cli/cli.h"
@@ -28,11 +29,22 @@
 #include "hardware/step_drv.h"
 #include "hardware/switches.h"
 #include "hardware/stepgen.h"
+#include "motion/feed_limiter.h"
+#include "motion/fill.h"
 #include "motion/gcode.h"
 #include "motion/motion.h"
 #include "motion/motion_control.h"
+#include "motion/ngc.h"
+#include "motion/optimizer.h"
 #include "motion/planner.h"
 #include "motion/segment.h"
+#include "motion/transform.h"
+#include "system/flight.h"
+#include "system/job.h"
+#include "system/latency.h"
+#include "system/metrics.h"
+#include "system/render.h"
+#include "system/rtdiag.h"
 #include "system/system.h"
 #include "system/settings.h"
 #include "system/fsm.h"
@@ -0,0 +1,225 @@
+/**
+ * @file flight.c
+ * @brief Pipeline flight recorder
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system
+ *
+ * @{
+ * @defgroup system_flight Flight Recorder
+ *
+ * Keeps the last few seconds of pipeline events in a ring that is continuously overwritten: lines queued for
+ * the parser, blocks added to the plan, replans, segments prepared and segments loaded by the step generator.
+ * Each is timestamped, with its line ID and the fill level of the stage's buffer.
+ *
+ * When the segment buffer runs empty while running, with blocks still arriving, or the system faults, the
+ * recorder is frozen and dumped to a file in settings.flight_path, flight-N.csv, by a low priority thread.
+ * It is armed again once the dump is written. The fill levels leading up to the trigger show which stage
+ * starved: segments draining with blocks planned points at segment prep, blocks draining with lines queued
+ * at the parser and planner, and an empty parser queue at the sender. $FR dumps on demand.
+ *
+ * Recording is lock free. Each event claims a slot with an atomic increment, so any task may record.
+ *
+ * @{
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include "../openglow-cnc.h"
+
+/**
+ * @brief Recorded event
+ */
+typedef struct {
+    int64_t time;       /*!< Time, from latency_now() (ns) */
+    uint32_t line_id;   /*!< Line ID */
+    uint32_t value;     /*!< Event value, see enum FLIGHT_EVENTS */
+    uint8_t type;       /*!< enum FLIGHT_EVENTS */
+} flight_event_t;
+
+/**
+ * @brief Event names, as written to the dump
+ */
+static const char *flight_event_names[N_FLIGHT_EVENTS] = {
+        [FLIGHT_LINE]       = "line",
+        [FLIGHT_BLOCK]      = "block",
+        [FLIGHT_REPLAN]     = "replan",
+        [FLIGHT_SEGMENT]    = "segment",
+        [FLIGHT_LOAD]       = "load",
+        [FLIGHT_UNDERRUN]   = "underrun",
+        [FLIGHT_FAULT]      = "fault",
+        [FLIGHT_REQUEST]    = "request",
+};
+
+/**
+ * @brief Event ring
+ */
+static flight_event_t flight_events[FLIGHT_RING_SIZE];
+
+/**
+ * @brief Events recorded since start. The next event goes in slot flight_seq % FLIGHT_RING_SIZE.
+ */
+static uint32_t flight_seq = 0;
+
+/**
+ * @brief Recording, and not frozen
+ */
+static bool flight_armed = false;
+
+/**
+ * @brief Event that froze the recorder
+ */
+static enum FLIGHT_EVENTS flight_trigger;
+
+/**
+ * @brief Time the recorder froze (ns)
+ */
+static int64_t flight_trigger_time;
+
+/**
+ * @brief Time the last block was added to the plan (ns)
+ */
+static int64_t flight_last_block = 0;
+
+/**
+ * @brief Dumps written
+ */
+static uint32_t flight_dumps = 0;
+
+/**
+ * @brief Signalled when the recorder freezes
+ */
+static sem_t flight_dump_sem;
+
+/**
+ * @brief Dump thread
+ */
+static pthread_t flight_thread;
+
+// Static function declarations
+static ssize_t _flight_dump();
+static void *_flight_dump_loop(void *arg);
+
+/**
+ * @brief Start the flight recorder
+ *
+ * Does nothing if settings.flight_path isn't set.
+ * @return 0 on success, negative on error.
+ */
+ssize_t flight_init() {
+    ssize_t ret = 0;
+    if (settings.flight_path == NULL) { return 0; }
+    sem_init(&flight_dump_sem, 0, 0);
+    if ((ret = pthread_create(&flight_thread, NULL, _flight_dump_loop, NULL)) != 0) {
+        fprintf(stderr, "flight_init: pthread_create returned %zd\n", ret);
+        return -ret;
+    }
+    __atomic_store_n(&flight_armed, true, __ATOMIC_RELEASE);
+    return ret;
+}
+
+/**
+ * @brief Freeze the recorder and dump it
+ * @param trigger Event that froze the recorder, recorded last
+ * @return False if the recorder isn't armed: disabled, or already frozen.
+ */
+bool flight_freeze(enum FLIGHT_EVENTS trigger) {
+    bool armed = true;
+    flight_record(trigger, 0, 0);
+    if (!__atomic_compare_exchange_n(&flight_armed, &armed, false, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    flight_trigger = trigger;
+    flight_trigger_time = latency_now();
+    sem_post(&flight_dump_sem);
+    return true;
+}
+
+/**
+ * @brief Record an event
+ * @param type Event type
+ * @param line_id Line ID
+ * @param value Event value, see enum FLIGHT_EVENTS
+ */
+void flight_record(enum FLIGHT_EVENTS type, uint32_t line_id, uint32_t value) {
+    bool armed = __atomic_load_n(&flight_armed, __ATOMIC_ACQUIRE);
+    if (!armed && (type != FLIGHT_BLOCK)) { return; }
+    int64_t now = latency_now();
+    if (type == FLIGHT_BLOCK) { flight_last_block = now; }
+    if (!armed) { return; }
+    flight_event_t *event = &flight_events[__atomic_fetch_add(&flight_seq, 1, __ATOMIC_RELAXED) &
+                                           (FLIGHT_RING_SIZE - 1)];
+    event->time = now;
+    event->line_id = line_id;
+    event->value = value;
+    event->type = (uint8_t) type;
+}
+
+/**
+ * @brief Called by the step generator when the segment buffer runs empty
+ *
+ * An underrun, if running and blocks were still arriving. Otherwise the stream has ended.
+ */
+void flight_stepgen_empty() {
+    if ((sys_state != SYS_STATE_RUN) ||
+        ((latency_now() - flight_last_block) > (int64_t) FLIGHT_STREAM_IDLE_MS * 1000000)) { return; }
+    metrics_inc(METRIC_UNDERRUNS);
+    flight_freeze(FLIGHT_UNDERRUN);
+}
+
+/**
+ * @brief Write the frozen recorder to the next dump file
+ * @return 0 on success, negative on error.
+ */
+static ssize_t _flight_dump() {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/flight-%u.csv", settings.flight_path, ++flight_dumps);
+    FILE *out = fopen(path, "w");
+    if (out == NULL) { return -errno; }
+
+    uint32_t end = __atomic_load_n(&flight_seq, __ATOMIC_ACQUIRE);
+    uint32_t start = (end > FLIGHT_RING_SIZE) ? end - FLIGHT_RING_SIZE : 0;
+    fprintf(out, "# OpenGlow-CNC flight recorder, %s\n", flight_event_names[flight_trigger]);
+    fprintf(out, "time_us,event,line,value\n");
+    for (uint32_t seq = start; seq != end; seq++) {
+        flight_event_t *event = &flight_events[seq & (FLIGHT_RING_SIZE - 1)];
+        fprintf(out, "%.1f,%s,%u,%u\n", (event->time - flight_trigger_time) / 1e3,
+                (event->type < N_FLIGHT_EVENTS) ? flight_event_names[event->type] : "?", event->line_id,
+                event->value);
+    }
+    if (fclose(out) != 0) { return -errno; }
+    metrics_inc(METRIC_FLIGHT_DUMPS);
+    if (verbose) printf("flight_dump: %u events to %s\n", end - start, path);
+    return 0;
+}
+
+/**
+ * @brief Dump thread loop
+ *
+ * Writes the recorder out each time it freezes, and arms it again.
+ * @param arg Unused
+ * @return NULL
+ */
+static void *_flight_dump_loop(void *arg) {
+    ssize_t ret;
+    while (true) {
+        if (sem_wait(&flight_dump_sem) < 0) { continue; }
+        usleep(FLIGHT_SETTLE_US);
+        if ((ret = _flight_dump()) < 0) {
+            fprintf(stderr, "flight_dump_loop: _flight_dump returned %zd\n", ret);
+        }
+        __atomic_store_n(&flight_armed, true, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/** @} */
+/** @} */
@@ -0,0 +1,50 @@
+/**
+ * @file flight.h
+ * @brief Pipeline flight recorder
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system_flight
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_FLIGHT_H
+#define OPENGLOW_CNC_FLIGHT_H
+
+#include "../common.h"
+
+#define FLIGHT_RING_SIZE        16384   // Events recorded, about 3 seconds of a busy pipeline. Must be a power of 2.
+#define FLIGHT_STREAM_IDLE_MS   250     // No new blocks for this long means the stream ended, not starved (ms)
+#define FLIGHT_SETTLE_US        1000    // Wait for events being recorded as the recorder froze (us)
+
+/**
+ * @brief Recorded pipeline events
+ */
+enum FLIGHT_EVENTS {
+    FLIGHT_LINE,        /*!< Line or command queued for the parser. Value is the lines queued. */
+    FLIGHT_BLOCK,       /*!< Block added to the plan. Value is the blocks planned. */
+    FLIGHT_REPLAN,      /*!< Plan recalculated. Value is the blocks the reverse pass walked. */
+    FLIGHT_SEGMENT,     /*!< Segments prepared. Value is the segments buffered. */
+    FLIGHT_LOAD,        /*!< Segment loaded by the step generator. Value is the segments still buffered. */
+    FLIGHT_UNDERRUN,    /*!< Segment buffer ran empty while running */
+    FLIGHT_FAULT,       /*!< System entered FAULT or ALARM */
+    FLIGHT_REQUEST,     /*!< Dump requested with $FR */
+    N_FLIGHT_EVENTS,
+};
+
+ssize_t flight_init();
+
+bool flight_freeze(enum FLIGHT_EVENTS trigger);
+
+void flight_record(enum FLIGHT_EVENTS type, uint32_t line_id, uint32_t value);
+
+void flight_stepgen_empty();
+
+#endif //OPENGLOW_CNC_FLIGHT_H
+
+/** @} */
@@ -27,6 +27,11 @@
  */
 static RT_QUEUE rt_fsm_queue;
 
+/**
+ * @brief Exit status, set by fsm_exit()
+ */
+static ssize_t fsm_exit_ret = 0;
+
 // Static declarations
 static bool _all_fsm_initialized();
 static void _fsm_loop();
@@ -129,8 +134,15 @@ ssize_t fsm_init() {
 static void _fsm_loop() {
     ssize_t ret = 0;
     sub_fsm_message_t status;
+    rtdiag_task("rt_fsm_loop");
     while ((ret = rt_queue_read(&rt_fsm_queue, &status, sizeof(sub_fsm_message_t), 0)) > 0) {
+        rtdiag_begin();
         if (verbose) printf("_fsm_loop: read sub_fsm %d state %d from queue\n", status.sub_fsm, status.sub_state);
+        if (status.sub_fsm == N_FSM) {
+            // Exit requested by fsm_exit()
+            ret = 0;
+            break;
+        }
         _sub_state[status.sub_fsm] = status.sub_state;
 
         if (_all_fsm_initialized()) {
@@ -199,10 +211,34 @@ static void _fsm_loop() {
             for (uint8_t i = 0; i < N_FSM; i++) printf("%d ", _sub_state[i]);
             printf("\n");
         }
+        RTDIAG_END();
     }
     fprintf(stderr, "state_loop: exited %zd\n", ret);
 }
 
+/**
+ * @brief Request the FSM loop to exit
+ *
+ * Ends the loop, which returns control to main() for shutdown.
+ * @param status Exit status, returned by fsm_exit_status()
+ */
+void fsm_exit(ssize_t status) {
+    ssize_t ret = 0;
+    sub_fsm_message_t message = {.sub_fsm = N_FSM, .sub_state = 0};
+    fsm_exit_ret = status;
+    if ((ret = rt_queue_write(&rt_fsm_queue, &message, sizeof(sub_fsm_message_t), Q_NORMAL)) < 0) {
+        fprintf(stderr, "fsm_exit: rt_fsm_queue return %zd\n", ret);
+    }
+}
+
+/**
+ * @brief Exit status
+ * @return Status passed to fsm_exit(), 0 if it wasn't called
+ */
+ssize_t fsm_exit_status() {
+    return fsm_exit_ret;
+}
+
 /**
  * @brief Register sub state to system state mappings
  *
@@ -253,7 +289,7 @@ ssize_t fsm_update(enum sub_fsm subfsm, uint8_t state) {
     status.sub_fsm = subfsm;
     status.sub_state = state;
 
-    if (status.sub_fsm > N_FSM) {
+    if (status.sub_fsm >= N_FSM) {
         fprintf(stderr, "fsm_update: sub_fsm %d invalid\n", status.sub_fsm);
         return -1;
     }
@@ -293,6 +329,7 @@ static void _update_system_state(enum system_state state) {
         if (verbose) printf("_update_system_state: state changed from %d to %d\n", sys_state, state);
         sys_state = state;
         if (sys_state == sys_req_state) sys_req_state = FSM_STATE_NO_REQ;
+        if ((sys_state == SYS_STATE_FAULT) || (sys_state == SYS_STATE_ALARM)) { flight_freeze(FLIGHT_FAULT); }
         _system_state_notify();
     }
 }
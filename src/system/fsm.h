@@ -79,6 +79,10 @@ volatile enum system_state sys_req_state;
 
 ssize_t fsm_init(void);
 
+void fsm_exit(ssize_t status);
+
+ssize_t fsm_exit_status(void);
+
 void fsm_register(enum sub_fsm sub_fsm, sub_state_map_t map);
 
 void fsm_request(enum system_state state);
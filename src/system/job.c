@@ -0,0 +1,526 @@
+/**
+ * @file job.c
+ * @brief Job files and the compiled job cache
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system
+ *
+ * @{
+ * @defgroup system_job Job Files
+ *
+ * Runs G-Code job files stored on the machine, started with $JOB=path. A job runs in the parser task, in order
+ * with the lines sent around it, and its ok or error is sent once it has been executed. It stops at the first
+ * line with an error.
+ *
+ * A job file is compiled before it runs: each line is groomed, and its words imported, once. The compiled job
+ * is kept in a content addressed cache in settings.job_cache_path, named by the FNV-1a hash of the file, so a
+ * job that has run before, under any name, skips straight to execution. The least recently run jobs are
+ * evicted to keep the cache under settings.job_cache_size. A compiled job is only loaded by the build that
+ * compiled it, and only once its records are checked. Lines with ngc parameters, expressions or O-words
+ * are kept as groomed text, since their words depend on parameter values at run time.
+ *
+ * Cache hits, misses, evictions and size are reported with the metrics.
+ *
+ * Step-and-repeat, $SR=I<columns>J<rows>X<column pitch>Y<row pitch>:path, runs a job at an array of positions
+ * on a sheet, through the placement transform. The job is loaded and compiled once for all the copies. Rows
+ * are run in alternating directions, to keep the travel between copies short.
+ *
+ * @{
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include "../openglow-cnc.h"
+
+/**
+ * @brief Compiled job record types
+ */
+enum JOB_RECORDS {
+    JOB_RECORD_WORDS,   /*!< Imported words. count words follow. */
+    JOB_RECORD_TEXT,    /*!< Groomed line, for the ngc interpreter. length bytes of text follow. */
+    JOB_RECORD_ERROR,   /*!< Line that can't be run, with status count */
+};
+
+/**
+ * @brief Compiled job record header
+ */
+typedef struct {
+    uint8_t type;       /*!< Record type, enum JOB_RECORDS */
+    uint8_t count;      /*!< Words, or error status */
+    uint16_t length;    /*!< Length of what follows (bytes) */
+    uint32_t line;      /*!< Line number in the job file */
+} job_record_t;
+
+/**
+ * @brief Compiled job cache file header
+ */
+typedef struct {
+    uint32_t magic;         /*!< JOB_CACHE_MAGIC */
+    uint32_t version;       /*!< JOB_CACHE_VERSION */
+    uint64_t hash;          /*!< Job file hash */
+    uint64_t source_size;   /*!< Job file size (bytes) */
+    uint64_t size;          /*!< Records size (bytes) */
+    uint32_t records;       /*!< Number of records */
+    uint32_t word_size;     /*!< sizeof(gc_word_t) */
+    uint64_t build;         /*!< Build hash. The parser output is only valid for the build that wrote it. */
+} job_cache_header_t;
+
+/**
+ * @brief Compiled job
+ */
+typedef struct {
+    char *records;          /*!< Records */
+    size_t size;            /*!< Records size (bytes) */
+    uint32_t n_records;     /*!< Number of records */
+} job_compiled_t;
+
+/**
+ * @brief Hash of the running build, 0 until computed
+ */
+static uint64_t job_build_hash = 0;
+
+// Static function declarations
+static uint64_t _job_build_hash();
+static bool _job_cache_check(job_cache_header_t *header, job_compiled_t *job);
+static bool _job_cache_load(uint64_t hash, size_t source_size, job_compiled_t *job);
+static void _job_cache_path(char *path, size_t len, uint64_t hash, const char *suffix);
+static void _job_cache_store(uint64_t hash, size_t source_size, job_compiled_t *job);
+static void _job_cache_trim();
+static ssize_t _job_compile(char *source, size_t source_size, job_compiled_t *job);
+static uint8_t _job_execute(job_compiled_t *job, const char *path);
+static uint8_t _job_load(const char *path, job_compiled_t *job);
+static char *_job_read(const char *path, size_t *size);
+
+/**
+ * @brief Hash of the running build
+ *
+ * The FNV-1a hash of the executable, computed once. A parser change in a new build changes it, so jobs
+ * compiled by an old build are recompiled. If the executable can't be read, the compile time is used.
+ * @return Build hash
+ */
+static uint64_t _job_build_hash() {
+    if (job_build_hash != 0) { return job_build_hash; }
+    uint64_t hash = JOB_HASH_SEED;
+    FILE *in = fopen(JOB_BUILD_PATH, "r");
+    if (in != NULL) {
+        uint8_t buf[4096];
+        size_t len;
+        while ((len = fread(buf, 1, sizeof(buf), in)) > 0) {
+            for (size_t i = 0; i < len; i++) { hash = (hash ^ buf[i]) * JOB_HASH_PRIME; }
+        }
+        fclose(in);
+    } else {
+        const char *stamp = OPENGLOW_CNC_VER " " __DATE__ " " __TIME__;
+        for (size_t i = 0; stamp[i] != '\0'; i++) { hash = (hash ^ (uint8_t) stamp[i]) * JOB_HASH_PRIME; }
+    }
+    job_build_hash = hash;
+    return job_build_hash;
+}
+
+/**
+ * @brief Check the records of a compiled job loaded from the cache
+ *
+ * Every record must fit in what remains of the records, and hold what its type says, so a corrupt file is
+ * never executed.
+ * @param header Cache file header
+ * @param job Loaded records
+ * @return True if the records are valid.
+ */
+static bool _job_cache_check(job_cache_header_t *header, job_compiled_t *job) {
+    size_t pos = 0;
+    for (uint32_t r = 0; r < header->records; r++) {
+        if (job->size - pos < sizeof(job_record_t)) { return false; }
+        job_record_t *record = (job_record_t *) &job->records[pos];
+        pos += sizeof(job_record_t);
+        if (job->size - pos < record->length) { return false; }
+        switch (record->type) {
+            case JOB_RECORD_WORDS:
+                if ((record->count > GC_MAX_WORDS) || (record->length != record->count * sizeof(gc_word_t))) {
+                    return false;
+                }
+                break;
+            case JOB_RECORD_TEXT:
+                if ((record->length == 0) || (job->records[pos + record->length - 1] != '\0')) { return false; }
+                break;
+            case JOB_RECORD_ERROR:
+                if (record->length != 0) { return false; }
+                break;
+            default:
+                return false;
+        }
+        pos += record->length;
+    }
+    return (pos == job->size);
+}
+
+/**
+ * @brief Load a compiled job from the cache
+ *
+ * A file that doesn't match the job or the build, or fails the record check, is a miss, and is deleted.
+ * @param hash Job file hash
+ * @param source_size Job file size (bytes)
+ * @param job Compiled job output. Free job->records with free().
+ * @return True on a hit.
+ */
+static bool _job_cache_load(uint64_t hash, size_t source_size, job_compiled_t *job) {
+    char path[PATH_MAX];
+    _job_cache_path(path, sizeof(path), hash, JOB_CACHE_EXT);
+    FILE *in = fopen(path, "r");
+    if (in == NULL) { return false; }
+
+    job_cache_header_t header;
+    struct stat st;
+    bool hit = false;
+    if ((fstat(fileno(in), &st) == 0) && (fread(&header, sizeof(header), 1, in) == 1) &&
+        (header.magic == JOB_CACHE_MAGIC) && (header.version == JOB_CACHE_VERSION) && (header.hash == hash) &&
+        (header.source_size == source_size) && (header.word_size == sizeof(gc_word_t)) &&
+        (header.build == _job_build_hash()) && (header.size == (uint64_t) st.st_size - sizeof(header)) &&
+        ((job->records = malloc(header.size)) != NULL)) {
+        job->size = header.size;
+        if ((fread(job->records, 1, header.size, in) == header.size) && _job_cache_check(&header, job)) {
+            job->n_records = header.records;
+            hit = true;
+        } else {
+            free(job->records);
+        }
+    }
+    fclose(in);
+    if (hit) {
+        // Most recently run
+        utime(path, NULL);
+    } else {
+        if (verbose) printf("job_cache_load: %s is stale or corrupt, deleting\n", path);
+        unlink(path);
+    }
+    return hit;
+}
+
+/**
+ * @brief Build the path of a cache file
+ * @param path Path output
+ * @param len Size of path
+ * @param hash Job file hash
+ * @param suffix File name suffix
+ */
+static void _job_cache_path(char *path, size_t len, uint64_t hash, const char *suffix) {
+    snprintf(path, len, "%s/%016llx%s", settings.job_cache_path, (unsigned long long) hash, suffix);
+}
+
+/**
+ * @brief Store a compiled job in the cache
+ *
+ * Written to a temporary file and renamed, so a partly written file is never loaded.
+ * @param hash Job file hash
+ * @param source_size Job file size (bytes)
+ * @param job Compiled job
+ */
+static void _job_cache_store(uint64_t hash, size_t source_size, job_compiled_t *job) {
+    char tmp_path[PATH_MAX], path[PATH_MAX];
+    _job_cache_path(tmp_path, sizeof(tmp_path), hash, JOB_CACHE_EXT ".tmp");
+    _job_cache_path(path, sizeof(path), hash, JOB_CACHE_EXT);
+    if ((mkdir(settings.job_cache_path, 0755) < 0) && (errno != EEXIST)) {
+        fprintf(stderr, "job_cache_store: unable to create %s\n", settings.job_cache_path);
+        return;
+    }
+
+    job_cache_header_t header = {
+            .magic = JOB_CACHE_MAGIC,
+            .version = JOB_CACHE_VERSION,
+            .hash = hash,
+            .source_size = source_size,
+            .size = job->size,
+            .records = job->n_records,
+            .word_size = sizeof(gc_word_t),
+            .build = _job_build_hash(),
+    };
+    FILE *out = fopen(tmp_path, "w");
+    if ((out == NULL) || (fwrite(&header, sizeof(header), 1, out) != 1) ||
+        (fwrite(job->records, 1, job->size, out) != job->size) || (fclose(out) != 0) ||
+        (rename(tmp_path, path) < 0)) {
+        fprintf(stderr, "job_cache_store: unable to write %s\n", path);
+        unlink(tmp_path);
+        return;
+    }
+    _job_cache_trim();
+}
+
+/**
+ * @brief Evict the least recently run jobs, until the cache is within its size limit
+ */
+static void _job_cache_trim() {
+    uint64_t limit = (uint64_t) settings.job_cache_size * 1024;
+    uint64_t total;
+    while (true) {
+        DIR *dir = opendir(settings.job_cache_path);
+        if (dir == NULL) { return; }
+        char oldest[PATH_MAX] = "", path[PATH_MAX];
+        struct timespec oldest_time = {0, 0};
+        struct dirent *entry;
+        struct stat st;
+        uint32_t entries = 0;
+        total = 0;
+        while ((entry = readdir(dir)) != NULL) {
+            size_t len = strlen(entry->d_name);
+            if ((len <= strlen(JOB_CACHE_EXT)) ||
+                (strcmp(&entry->d_name[len - strlen(JOB_CACHE_EXT)], JOB_CACHE_EXT) != 0)) { continue; }
+            snprintf(path, sizeof(path), "%s/%s", settings.job_cache_path, entry->d_name);
+            if (stat(path, &st) < 0) { continue; }
+            total += (uint64_t) st.st_size;
+            entries++;
+            if ((oldest[0] == '\0') || (st.st_mtim.tv_sec < oldest_time.tv_sec) ||
+                ((st.st_mtim.tv_sec == oldest_time.tv_sec) && (st.st_mtim.tv_nsec < oldest_time.tv_nsec))) {
+                strcpy(oldest, path);
+                oldest_time = st.st_mtim;
+            }
+        }
+        closedir(dir);
+        // The job just stored is kept, even if it is over the limit on its own
+        if ((total <= limit) || (entries <= 1)) { break; }
+        if (verbose) printf("job_cache_trim: evicting %s\n", oldest);
+        if (unlink(oldest) < 0) { break; }
+        metrics_inc(METRIC_JOB_CACHE_EVICTIONS);
+    }
+    metrics_set(METRIC_JOB_CACHE_KB, (uint32_t) (total / 1024));
+}
+
+/**
+ * @brief Compile a job
+ * @param source Job file contents, 0-terminated
+ * @param source_size Job file size (bytes)
+ * @param job Compiled job output. Free job->records with free().
+ * @return 0 on success, negative on error.
+ */
+static ssize_t _job_compile(char *source, size_t source_size, job_compiled_t *job) {
+    size_t size = 0;
+    FILE *out = open_memstream(&job->records, &size);
+    if (out == NULL) { return -1; }
+    job->n_records = 0;
+
+    char line[CLI_LINE_LENGTH];
+    char buf[CLI_LINE_LENGTH];
+    gc_word_t words[GC_MAX_WORDS];
+    uint32_t line_number = 0;
+    char *next = source;
+    while (next < source + source_size) {
+        char *end = memchr(next, '\n', (size_t) (source + source_size - next));
+        if (end == NULL) { end = source + source_size; }
+        size_t len = (size_t) (end - next);
+        job_record_t record = {.line = ++line_number};
+        const void *payload = NULL;
+
+        if (len >= CLI_LINE_LENGTH) {
+            record.type = JOB_RECORD_ERROR;
+            record.count = STATUS_LINE_LENGTH_EXCEEDED;
+        } else {
+            memcpy(line, next, len);
+            line[len] = '\0';
+            memset(buf, 0, sizeof(buf));
+            gc_process_line(line, buf);
+            if (buf[0] == '\0') {
+                next = end + 1;
+                continue;
+            }
+            if ((strpbrk(buf, NGC_LINE_CHARS) != NULL) || (gc_parse_line(buf, words, &record.count) != STATUS_OK)) {
+                // Compiled by the ngc interpreter at run time. An error is found there, in order.
+                record.type = JOB_RECORD_TEXT;
+                record.count = 0;
+                // Padded to keep the records aligned. buf is zeroed past the line.
+                record.length = (uint16_t) ((strlen(buf) + JOB_RECORD_ALIGN) & ~(JOB_RECORD_ALIGN - 1));
+                payload = buf;
+            } else {
+                record.type = JOB_RECORD_WORDS;
+                record.length = (uint16_t) (record.count * sizeof(gc_word_t));
+                payload = words;
+            }
+        }
+        fwrite(&record, sizeof(record), 1, out);
+        if (record.length > 0) { fwrite(payload, 1, record.length, out); }
+        job->n_records++;
+        next = end + 1;
+    }
+    if (fclose(out) != 0) {
+        free(job->records);
+        return -1;
+    }
+    job->size = size;
+    return 0;
+}
+
+/**
+ * @brief Execute a compiled job
+ * @param job Compiled job
+ * @param path Job file path, for error messages
+ * @return Status code
+ */
+static uint8_t _job_execute(job_compiled_t *job, const char *path) {
+    char *next = job->records;
+    for (uint32_t r = 0; r < job->n_records; r++) {
+        job_record_t *record = (job_record_t *) next;
+        next += sizeof(job_record_t);
+        uint8_t status;
+        switch (record->type) {
+            case JOB_RECORD_WORDS:
+                status = ngc_execute_words((gc_word_t *) next, record->count);
+                break;
+            case JOB_RECORD_TEXT:
+                status = ngc_execute_line(next);
+                break;
+            default:
+                status = record->count;
+        }
+        next += record->length;
+        if (status != STATUS_OK) {
+            fprintf(stderr, "job_execute: %s line %u error:%d\n", path, record->line, status);
+            return status;
+        }
+    }
+    return STATUS_OK;
+}
+
+/**
+ * @brief Load a job file, from the cache if it has been compiled before
+ *
+ * Otherwise compiles it, and stores it for next time.
+ * @param path Job file path
+ * @param job Compiled job output. Free job->records with free().
+ * @return Status code
+ */
+static uint8_t _job_load(const char *path, job_compiled_t *job) {
+    size_t source_size = 0;
+    char *source = _job_read(path, &source_size);
+    if (source == NULL) {
+        fprintf(stderr, "job_load: unable to read %s\n", path);
+        return STATUS_INVALID_STATEMENT;
+    }
+    uint64_t hash = JOB_HASH_SEED;
+    for (size_t i = 0; i < source_size; i++) { hash = (hash ^ (uint8_t) source[i]) * JOB_HASH_PRIME; }
+
+    if ((settings.job_cache_path != NULL) && _job_cache_load(hash, source_size, job)) {
+        metrics_inc(METRIC_JOB_CACHE_HITS);
+        if (verbose) printf("job_load: %s is cached as %016llx\n", path, (unsigned long long) hash);
+    } else {
+        ssize_t ret;
+        if ((ret = _job_compile(source, source_size, job)) < 0) {
+            fprintf(stderr, "job_load: _job_compile returned %zd\n", ret);
+            free(source);
+            return STATUS_OVERFLOW;
+        }
+        if (settings.job_cache_path != NULL) {
+            metrics_inc(METRIC_JOB_CACHE_MISSES);
+            _job_cache_store(hash, source_size, job);
+        }
+    }
+    free(source);
+    return STATUS_OK;
+}
+
+/**
+ * @brief Read a job file
+ * @param path Job file path
+ * @param size Job file size output (bytes)
+ * @return Job file contents, 0-terminated, NULL on error. Free with free().
+ */
+static char *_job_read(const char *path, size_t *size) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL) { return NULL; }
+    char *source = NULL;
+    struct stat st;
+    if ((fstat(fileno(in), &st) == 0) && ((source = malloc((size_t) st.st_size + 1)) != NULL)) {
+        *size = fread(source, 1, (size_t) st.st_size, in);
+        if (ferror(in)) {
+            free(source);
+            source = NULL;
+        } else {
+            source[*size] = '\0';
+        }
+    }
+    fclose(in);
+    return source;
+}
+
+/**
+ * @brief Run a job file at an array of positions
+ * @param args I<columns>J<rows>X<column pitch>Y<row pitch>:path. Words are optional, and default to one copy.
+ * @return Status code
+ */
+uint8_t job_repeat(char *args) {
+    char *path = strchr(args, ':');
+    if (path == NULL) { return STATUS_INVALID_STATEMENT; }
+    *path++ = '\0';
+
+    char buf[CLI_LINE_LENGTH] = {0};
+    gc_word_t words[GC_MAX_WORDS];
+    uint8_t n_words;
+    gc_process_line(args, buf);
+    uint8_t status = gc_parse_line(buf, words, &n_words);
+    if (status != STATUS_OK) { return status; }
+    float columns = 1.0, rows = 1.0, pitch_x = 0.0, pitch_y = 0.0;
+    for (uint8_t w = 0; w < n_words; w++) {
+        switch (words[w].letter) {
+            case 'I':
+                columns = words[w].value;
+                break;
+            case 'J':
+                rows = words[w].value;
+                break;
+            case 'X':
+                pitch_x = words[w].value;
+                break;
+            case 'Y':
+                pitch_y = words[w].value;
+                break;
+            default:
+                return STATUS_UNUSED_WORDS;
+        }
+    }
+    if ((columns != truncf(columns)) || (rows != truncf(rows))) { return STATUS_COMMAND_VALUE_NOT_INTEGER; }
+    if ((columns < 1) || (rows < 1)) { return STATUS_NEGATIVE_VALUE; }
+    if ((columns > JOB_REPEAT_MAX) || (rows > JOB_REPEAT_MAX)) { return STATUS_MAX_VALUE_EXCEEDED; }
+
+    job_compiled_t job;
+    if ((status = _job_load(path, &job)) != STATUS_OK) { return status; }
+
+    // Each copy is placed by offsetting the current placement, in job coordinates
+    transform_t placement, copy;
+    transform_get(&placement);
+    for (uint16_t row = 0; (row < rows) && (status == STATUS_OK); row++) {
+        for (uint16_t i = 0; (i < columns) && (status == STATUS_OK); i++) {
+            uint16_t column = (uint16_t) ((row & 1) ? (columns - 1 - i) : i);
+            copy = placement;
+            transform_translate(&copy, column * pitch_x, row * pitch_y);
+            transform_set(&copy);
+            if (verbose) printf("job_repeat: %s column %u row %u\n", path, column, row);
+            status = _job_execute(&job, path);
+        }
+    }
+    transform_set(&placement);
+    free(job.records);
+    return status;
+}
+
+/**
+ * @brief Run a job file
+ * @param path Job file path
+ * @return Status code
+ */
+uint8_t job_run(const char *path) {
+    job_compiled_t job;
+    uint8_t status;
+    if ((status = _job_load(path, &job)) != STATUS_OK) { return status; }
+    status = _job_execute(&job, path);
+    free(job.records);
+    return status;
+}
+
+/** @} */
+/** @} */
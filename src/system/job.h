@@ -0,0 +1,37 @@
+/**
+ * @file job.h
+ * @brief Job files and the compiled job cache
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system_job
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_JOB_H
+#define OPENGLOW_CNC_JOB_H
+
+#include "../common.h"
+
+#define JOB_CACHE_MAGIC     0x314a474f  // "OGJ1"
+#define JOB_CACHE_VERSION   2           // Bump when the compiled format changes
+#define JOB_CACHE_EXT       ".ogj"      // Compiled job file extension
+#define JOB_CACHE_SIZE      65536       // Default cache size limit (KB)
+#define JOB_RECORD_ALIGN    8           // Compiled record alignment (bytes). Must be a power of 2.
+#define JOB_REPEAT_MAX      1000        // Most step-and-repeat columns, or rows
+#define JOB_HASH_SEED       0xcbf29ce484222325ULL // FNV-1a 64 bit offset basis
+#define JOB_HASH_PRIME      0x100000001b3ULL      // FNV-1a 64 bit prime
+#define JOB_BUILD_PATH      "/proc/self/exe"      // Hashed to tie the cache to the build that wrote it
+
+uint8_t job_repeat(char *args);
+
+uint8_t job_run(const char *path);
+
+#endif //OPENGLOW_CNC_JOB_H
+
+/** @} */
@@ -0,0 +1,207 @@
+/**
+ * @file latency.c
+ * @brief Per-line latency attribution across the motion pipeline
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system
+ *
+ * @{
+ * @defgroup system_latency Latency Attribution
+ *
+ * Every G-Code line is tagged with an ID, from the receive sequence, that is carried through the parser
+ * queue, planner blocks and segments to the step generator. Each stage stamps the line as it first sees it.
+ * The time between stamps goes into a log2 histogram per stage, and the lines slowest to reach the step
+ * generator are kept, reported with the '$L' command. Shows whether a slow job is bound by the sender, the
+ * parser, the planner or segment generation.
+ *
+ * Each stamp is taken by a single task, so records need no locking. A line's slot is reused once
+ * LATENCY_TRACK_LINES newer lines have been received. The line's N word is kept for the report.
+ *
+ * @{
+ */
+
+#include <string.h>
+#include <time.h>
+#include "../openglow-cnc.h"
+
+/**
+ * @brief Pipeline timestamps for one line
+ */
+typedef struct {
+    uint32_t line_id;               /*!< ID of the line using this slot */
+    uint32_t number;                /*!< N word of the line. Zero if it had none. */
+    int64_t time[N_LAT_STAMPS];     /*!< Timestamps (ns). Zero until taken. */
+} latency_line_t;
+
+/**
+ * @brief Slow line report entry
+ */
+typedef struct {
+    uint32_t line_id;               /*!< Line ID */
+    uint32_t number;                /*!< N word of the line. Zero if it had none. */
+    int64_t stage[N_LAT_STAGES];    /*!< Stage latencies (ns) */
+} latency_slow_t;
+
+/**
+ * @brief Stage names, as reported to the CLI
+ */
+static const char *latency_stage_names[N_LAT_STAGES] = {
+        [LAT_STAGE_PARSE]   = "parse",
+        [LAT_STAGE_PLAN]    = "plan",
+        [LAT_STAGE_SEGMENT] = "segment",
+        [LAT_STAGE_STEPGEN] = "stepgen",
+        [LAT_STAGE_TOTAL]   = "total",
+};
+
+/**
+ * @brief Timestamps of lines in flight, indexed by line ID
+ */
+static latency_line_t latency_lines[LATENCY_TRACK_LINES];
+
+/**
+ * @brief Per stage log2 histograms. Bucket n counts latencies below 2^n us.
+ */
+static uint32_t latency_hist[N_LAT_STAGES][LATENCY_HIST_BUCKETS];
+
+/**
+ * @brief Per stage maximum latency (ns)
+ */
+static int64_t latency_max[N_LAT_STAGES];
+
+/**
+ * @brief Slowest lines, by total latency. Sorted slowest first.
+ */
+static latency_slow_t latency_slow[LATENCY_SLOW_LINES];
+
+// Static function declarations
+static void _latency_hist_add(enum LATENCY_STAGES stage, int64_t ns);
+static void _latency_slow_add(latency_line_t *line);
+
+/**
+ * @brief Monotonic clock in ns, for timestamps
+ * @return Current time (ns)
+ */
+int64_t latency_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/**
+ * @brief Write the stage histograms and slowest lines to the CLI
+ *
+ * Histogram lines are [LAT:stage:<bucket:count], followed by the stage maximum. Slow lines are
+ * [SLOW:id:Nnumber:total:parse,plan,segment,stepgen], N0 for a line without an N word. All times in us.
+ */
+void latency_report() {
+    for (uint8_t stage = 0; stage < N_LAT_STAGES; stage++) {
+        for (uint8_t bucket = 0; bucket < LATENCY_HIST_BUCKETS; bucket++) {
+            if (latency_hist[stage][bucket]) {
+                message_write(MSG_LATENCY_HIST, latency_stage_names[stage], 1u << bucket,
+                              latency_hist[stage][bucket]);
+            }
+        }
+        message_write(MSG_LATENCY_MAX, latency_stage_names[stage], (uint32_t) (latency_max[stage] / 1000));
+    }
+    for (uint8_t i = 0; i < LATENCY_SLOW_LINES; i++) {
+        latency_slow_t *slow = &latency_slow[i];
+        if (slow->stage[LAT_STAGE_TOTAL] == 0) { break; }
+        message_write(MSG_LATENCY_SLOW, slow->line_id, slow->number,
+                      (uint32_t) (slow->stage[LAT_STAGE_TOTAL] / 1000),
+                      (uint32_t) (slow->stage[LAT_STAGE_PARSE] / 1000),
+                      (uint32_t) (slow->stage[LAT_STAGE_PLAN] / 1000),
+                      (uint32_t) (slow->stage[LAT_STAGE_SEGMENT] / 1000),
+                      (uint32_t) (slow->stage[LAT_STAGE_STEPGEN] / 1000));
+    }
+    message_write(MSG_OK);
+}
+
+/**
+ * @brief Record a line being received
+ *
+ * Claims the line's slot, and restarts its record.
+ * @param line_id Line ID
+ * @param number N word of the line. Zero if it has none.
+ * @param time Time, from latency_now()
+ */
+void latency_receive(uint32_t line_id, uint32_t number, int64_t time) {
+    latency_line_t *line = &latency_lines[line_id & (LATENCY_TRACK_LINES - 1)];
+    memset(line->time, 0, sizeof(line->time));
+    line->line_id = line_id;
+    line->number = number;
+    line->time[LAT_RECEIVED] = time;
+}
+
+/**
+ * @brief Clear all latency records and statistics
+ */
+void latency_reset() {
+    memset(latency_lines, 0, sizeof(latency_lines));
+    memset(latency_hist, 0, sizeof(latency_hist));
+    memset(latency_max, 0, sizeof(latency_max));
+    memset(latency_slow, 0, sizeof(latency_slow));
+}
+
+/**
+ * @brief Record a pipeline timestamp for a line
+ *
+ * Only the first stamp of each kind counts, so arcs and other multi-block lines are timed by their first block.
+ * The received stamp is taken by latency_receive().
+ * @param line_id Line ID
+ * @param stamp Timestamp to record, after LAT_RECEIVED
+ * @param time Time, from latency_now()
+ */
+void latency_stamp(uint32_t line_id, enum LATENCY_STAMPS stamp, int64_t time) {
+    latency_line_t *line = &latency_lines[line_id & (LATENCY_TRACK_LINES - 1)];
+    if ((stamp == LAT_RECEIVED) || (line->line_id != line_id) || (line->time[stamp] != 0) ||
+        (line->time[stamp - 1] == 0)) {
+        return; // Slot reused, already stamped, or previous stage missed.
+    }
+    line->time[stamp] = time;
+    _latency_hist_add((enum LATENCY_STAGES) (stamp - 1), time - line->time[stamp - 1]);
+    if (stamp == LAT_TICKED) {
+        _latency_hist_add(LAT_STAGE_TOTAL, time - line->time[LAT_RECEIVED]);
+        _latency_slow_add(line);
+    }
+}
+
+/**
+ * @brief Add a stage latency to its histogram
+ * @param stage Pipeline stage
+ * @param ns Latency (ns)
+ */
+static void _latency_hist_add(enum LATENCY_STAGES stage, int64_t ns) {
+    uint8_t bucket = 0;
+    int64_t us = ns / 1000;
+    while ((us >> bucket) && (bucket < (LATENCY_HIST_BUCKETS - 1))) { bucket++; }
+    latency_hist[stage][bucket]++;
+    if (ns > latency_max[stage]) { latency_max[stage] = ns; }
+}
+
+/**
+ * @brief Insert a completed line into the slow line list, if it qualifies
+ * @param line Line record. All stamps taken.
+ */
+static void _latency_slow_add(latency_line_t *line) {
+    int64_t total = line->time[LAT_TICKED] - line->time[LAT_RECEIVED];
+    if (total <= latency_slow[LATENCY_SLOW_LINES - 1].stage[LAT_STAGE_TOTAL]) { return; }
+    int8_t i = LATENCY_SLOW_LINES - 1;
+    while ((i > 0) && (latency_slow[i - 1].stage[LAT_STAGE_TOTAL] < total)) {
+        latency_slow[i] = latency_slow[i - 1];
+        i--;
+    }
+    latency_slow[i].line_id = line->line_id;
+    latency_slow[i].number = line->number;
+    for (uint8_t stage = LAT_STAGE_PARSE; stage < LAT_STAGE_TOTAL; stage++) {
+        latency_slow[i].stage[stage] = line->time[stage + 1] - line->time[stage];
+    }
+    latency_slow[i].stage[LAT_STAGE_TOTAL] = total;
+}
+
+/** @} */
+/** @} */
@@ -0,0 +1,61 @@
+/**
+ * @file latency.h
+ * @brief Per-line latency attribution across the motion pipeline
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system_latency
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_LATENCY_H
+#define OPENGLOW_CNC_LATENCY_H
+
+#include "../common.h"
+
+#define LATENCY_TRACK_LINES     1024    // Lines in flight that can be tracked. Must be a power of 2.
+#define LATENCY_HIST_BUCKETS    24      // Log2 histogram buckets, from 1us up
+#define LATENCY_SLOW_LINES      10      // Number of slowest lines kept for the report
+
+/**
+ * @brief Pipeline timestamps taken for each line
+ */
+enum LATENCY_STAMPS {
+    LAT_RECEIVED,       /*!< Line received by the CLI */
+    LAT_PARSED,         /*!< Line parsed and error checked */
+    LAT_PLANNED,        /*!< First block of the line added to the plan */
+    LAT_SEGMENTED,      /*!< First segment of the line prepared */
+    LAT_TICKED,         /*!< First step tick of the line emitted */
+    N_LAT_STAMPS,
+};
+
+/**
+ * @brief Pipeline stages, measured between consecutive timestamps
+ */
+enum LATENCY_STAGES {
+    LAT_STAGE_PARSE,    /*!< Received to parsed. Includes the parser queue wait. */
+    LAT_STAGE_PLAN,     /*!< Parsed to planned. Includes waiting for a free planner block. */
+    LAT_STAGE_SEGMENT,  /*!< Planned to first segment */
+    LAT_STAGE_STEPGEN,  /*!< First segment to first tick. Time spent queued in the segment buffer. */
+    LAT_STAGE_TOTAL,    /*!< Received to first tick */
+    N_LAT_STAGES,
+};
+
+int64_t latency_now();
+
+void latency_report();
+
+void latency_receive(uint32_t line_id, uint32_t number, int64_t time);
+
+void latency_reset();
+
+void latency_stamp(uint32_t line_id, enum LATENCY_STAMPS stamp, int64_t time);
+
+#endif //OPENGLOW_CNC_LATENCY_H
+
+/** @} */
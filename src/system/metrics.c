@@ -0,0 +1,116 @@
+/**
+ * @file metrics.c
+ * @brief Runtime metrics
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system
+ *
+ * @{
+ * @defgroup system_metrics Runtime Metrics
+ *
+ * Counters and gauges kept by the motion and hardware subsystems, reported with the '$M' command.
+ *
+ * @{
+ */
+
+#include "../openglow-cnc.h"
+
+/**
+ * @brief Metric names, as reported to the CLI
+ */
+static const char *metric_names[N_METRICS] = {
+        [METRIC_SEGMENT_CACHE_HITS]         = "segment_cache_hits",
+        [METRIC_SEGMENT_CACHE_MISSES]       = "segment_cache_misses",
+        [METRIC_JOB_CACHE_HITS]             = "job_cache_hits",
+        [METRIC_JOB_CACHE_MISSES]           = "job_cache_misses",
+        [METRIC_JOB_CACHE_EVICTIONS]        = "job_cache_evictions",
+        [METRIC_JOB_CACHE_KB]               = "job_cache_kb",
+        [METRIC_UNDERRUNS]                  = "underruns",
+        [METRIC_FLIGHT_DUMPS]               = "flight_dumps",
+        [METRIC_RT_DIAG_EVENTS]             = "rt_diag_events",
+        [METRIC_MICROSTEP_SWITCHES]         = "microstep_switches",
+        [METRIC_FEED_LIMIT_EVENTS]          = "feed_limit_events",
+        [METRIC_FEED_LIMIT_STEPS_DOWN]      = "feed_limit_steps_down",
+        [METRIC_FEED_LIMIT_STEPS_UP]        = "feed_limit_steps_up",
+        [METRIC_FEED_LIMIT_OVERRIDE]        = "feed_limit_override",
+        [METRIC_FEED_LIMIT_MIN_OVERRIDE]    = "feed_limit_min_override",
+        [METRIC_FEED_LIMIT_MIN_LEAD]        = "feed_limit_min_lead_ms",
+        [METRIC_STARTUP_FSM]                = "startup_fsm_us",
+        [METRIC_STARTUP_OPENGLOW]           = "startup_openglow_us",
+        [METRIC_STARTUP_SWITCHES]           = "startup_switches_us",
+        [METRIC_STARTUP_LIMITS]             = "startup_limits_us",
+        [METRIC_STARTUP_STEP_DRV]           = "startup_step_drv_us",
+        [METRIC_STARTUP_STEPGEN]            = "startup_stepgen_us",
+        [METRIC_STARTUP_MOTION]             = "startup_motion_us",
+        [METRIC_STARTUP_CLI]                = "startup_cli_us",
+        [METRIC_STARTUP_READY]              = "startup_ready_ms",
+};
+
+/**
+ * @brief Metric values. Gauges have a single writer, so plain 32 bit stores are sufficient. Counters are
+ * incremented from several tasks at once, so they are incremented atomically.
+ */
+static volatile uint32_t metric_values[N_METRICS];
+
+/**
+ * @brief Read a metric
+ * @param metric Metric to read
+ * @return Value
+ */
+uint32_t metrics_get(enum METRICS metric) {
+    return metric_values[metric];
+}
+
+/**
+ * @brief Increment a counter metric
+ * @param metric Metric to increment
+ */
+void metrics_inc(enum METRICS metric) {
+    __atomic_add_fetch(&metric_values[metric], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Lower a gauge metric if value is smaller
+ * @param metric Metric to update
+ * @param value New candidate minimum
+ */
+void metrics_min(enum METRICS metric, uint32_t value) {
+    if (value < metric_values[metric]) metric_values[metric] = value;
+}
+
+/**
+ * @brief Write all metrics to the CLI
+ */
+void metrics_report() {
+    for (uint8_t i = 0; i < N_METRICS; i++) {
+        message_write(MSG_METRIC, metric_names[i], metric_values[i]);
+    }
+    message_write(MSG_OK);
+}
+
+/**
+ * @brief Reset all metrics to their initial values
+ */
+void metrics_reset() {
+    for (uint8_t i = 0; i < N_METRICS; i++) metric_values[i] = 0;
+    metric_values[METRIC_FEED_LIMIT_OVERRIDE] = 100;
+    metric_values[METRIC_FEED_LIMIT_MIN_OVERRIDE] = 100;
+    metric_values[METRIC_FEED_LIMIT_MIN_LEAD] = UINT32_MAX;
+}
+
+/**
+ * @brief Set a gauge metric
+ * @param metric Metric to set
+ * @param value New value
+ */
+void metrics_set(enum METRICS metric, uint32_t value) {
+    metric_values[metric] = value;
+}
+
+/** @} */
+/** @} */
@@ -0,0 +1,67 @@
+/**
+ * @file metrics.h
+ * @brief Runtime metrics
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system_metrics
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_METRICS_H
+#define OPENGLOW_CNC_METRICS_H
+
+#include "../common.h"
+
+/**
+ * @brief Metric identifiers
+ */
+enum METRICS {
+    METRIC_SEGMENT_CACHE_HITS,      /*!< Blocks replayed from the segment profile cache */
+    METRIC_SEGMENT_CACHE_MISSES,    /*!< Blocks prepped from scratch */
+    METRIC_JOB_CACHE_HITS,          /*!< Job files run from the compiled job cache */
+    METRIC_JOB_CACHE_MISSES,        /*!< Job files compiled and stored in the compiled job cache */
+    METRIC_JOB_CACHE_EVICTIONS,     /*!< Compiled jobs evicted from the cache */
+    METRIC_JOB_CACHE_KB,            /*!< Compiled job cache size (KB) */
+    METRIC_UNDERRUNS,               /*!< Segment buffer ran empty while running, with blocks still arriving */
+    METRIC_FLIGHT_DUMPS,            /*!< Flight recorder dumps written */
+    METRIC_RT_DIAG_EVENTS,          /*!< Real time diagnostic events charged to a site, see $D */
+    METRIC_MICROSTEP_SWITCHES,      /*!< Driver microstep resolution switches for coarse rapids */
+    METRIC_FEED_LIMIT_EVENTS,       /*!< Times the feed limiter started reducing feed */
+    METRIC_FEED_LIMIT_STEPS_DOWN,   /*!< Feed override reductions applied by the feed limiter */
+    METRIC_FEED_LIMIT_STEPS_UP,     /*!< Feed override restorations applied by the feed limiter */
+    METRIC_FEED_LIMIT_OVERRIDE,     /*!< Current feed limiter override (%) */
+    METRIC_FEED_LIMIT_MIN_OVERRIDE, /*!< Lowest feed limiter override applied (%) */
+    METRIC_FEED_LIMIT_MIN_LEAD,     /*!< Lowest predicted lead time seen while running (ms) */
+    METRIC_STARTUP_FSM,             /*!< Startup time of the FSM phase (us) */
+    METRIC_STARTUP_OPENGLOW,        /*!< Startup time of the OpenGlow controller phase (us) */
+    METRIC_STARTUP_SWITCHES,        /*!< Startup time of the switch input phase (us) */
+    METRIC_STARTUP_LIMITS,          /*!< Startup time of the limit input phase (us) */
+    METRIC_STARTUP_STEP_DRV,        /*!< Startup time of the stepper driver programming phase (us) */
+    METRIC_STARTUP_STEPGEN,         /*!< Startup time of the step generator phase (us) */
+    METRIC_STARTUP_MOTION,          /*!< Startup time of the motion phase (us) */
+    METRIC_STARTUP_CLI,             /*!< Startup time of the CLI phase (us) */
+    METRIC_STARTUP_READY,           /*!< Time from start of initialization to ready (ms) */
+    N_METRICS,
+};
+
+uint32_t metrics_get(enum METRICS metric);
+
+void metrics_inc(enum METRICS metric);
+
+void metrics_min(enum METRICS metric, uint32_t value);
+
+void metrics_report();
+
+void metrics_reset();
+
+void metrics_set(enum METRICS metric, uint32_t value);
+
+#endif //OPENGLOW_CNC_METRICS_H
+
+/** @} */
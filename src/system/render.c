@@ -0,0 +1,508 @@
+/**
+ * @file render.c
+ * @brief Headless offline render mode
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system
+ *
+ * @{
+ * @defgroup system_render Offline Render
+ *
+ * Runs a G-Code job through the parser, planner, segment prep and step generator in the calling thread, as
+ * fast as possible, with no real time tasks or hardware access. The pulse stream is written exactly as the
+ * step generator would send it to the pulse device, one byte per tick at STEP_FREQUENCY.
+ *
+ * Used to pre-render jobs, profile the motion pipeline and diff its output between versions. The timing
+ * report doubles as a CPU benchmark.
+ *
+ * Every render reports an FNV-1a hash of its pulse stream. A golden corpus file pins the hash of each job in a
+ * set, so any change to the pipeline that alters the output of any job is caught in one fast run. When a
+ * change is intended, comparing the new pulse stream to the old one quantifies it, as the maximum position
+ * deviation and timing drift, before the golden hashes are updated.
+ *
+ * @{
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include "../openglow-cnc.h"
+
+/**
+ * @brief Offline render state
+ */
+typedef struct {
+    FILE *out;                      /*!< Pulse stream output. NULL to discard. */
+    bool io_error;                  /*!< Pulse stream write failed */
+    stepgen_render_stats_t pulses;  /*!< Step generator totals */
+    uint32_t lines;                 /*!< Lines read */
+    uint32_t errors;                /*!< Lines that returned an error status */
+    float dwell;                    /*!< Total dwell time (s) */
+    int64_t prep_time;              /*!< Wall time spent in segment prep (ns) */
+    int64_t stepgen_time;           /*!< Wall time spent in the step generator (ns) */
+    int64_t wall_time;              /*!< Total wall time (ns) */
+} render_t;
+
+/**
+ * @brief Pulse stream replay cursor
+ */
+typedef struct {
+    uint8_t *pulses;            /*!< Pulse stream */
+    size_t len;                 /*!< Pulse stream length (ticks) */
+    size_t tick;                /*!< Next tick */
+    int32_t position[N_AXIS];   /*!< Position (steps) */
+} render_cursor_t;
+
+/**
+ * @brief Offline render state
+ */
+static render_t render;
+
+// Static function declarations
+static ssize_t _render_compare(const char *ref_path, FILE *out);
+static bool _render_cursor_tick(render_cursor_t *cursor);
+static ssize_t _render_job(FILE *in, const char *name);
+static uint8_t *_render_read_pulses(FILE *in, size_t *len);
+static void _render_report(bool stats);
+
+/**
+ * @brief Prep and render everything the planner can give up
+ *
+ * Called by mc_line() in offline mode when the planner buffer is full, and at the end of the job.
+ */
+void render_drain() {
+    int64_t start = latency_now();
+    segment_prep_buffer();
+    int64_t prepped = latency_now();
+    if (stepgen_render_segments(render.out, &render.pulses) < 0) { render.io_error = true; }
+    render.prep_time += prepped - start;
+    render.stepgen_time += latency_now() - prepped;
+}
+
+/**
+ * @brief Account for a dwell without waiting
+ * @param seconds Dwell time
+ */
+void render_dwell(float seconds) {
+    render.dwell += seconds;
+}
+
+/**
+ * @brief Run a G-Code job through the pipeline, into render.out
+ *
+ * Starts from a clean pipeline at the origin, so a job renders the same on its own or in a corpus.
+ * @param in G-Code input
+ * @param name Job name for error messages
+ * @return 0 on success, negative on error.
+ */
+static ssize_t _render_job(FILE *in, const char *name) {
+    ssize_t ret = 0;
+    render.pulses.hash = STEP_GEN_HASH_SEED;
+
+    // Nothing runs in the background offline. Lines are executed as read, and motion is rendered on demand.
+    settings.offline = true;
+    settings.cli.auto_cycle = false;
+    settings.cli.mdi_mode = false;
+    segment_init();
+    latency_reset();
+    metrics_reset();
+    plan_reset();
+    stepgen_clear();
+    memset(sys_position, 0, sizeof(sys_position));
+    plan_sync_position();
+    gc_reset();
+
+    int64_t start = latency_now();
+    char line[CLI_LINE_LENGTH];
+    char buf[CLI_LINE_LENGTH];
+    while (!render.io_error && (fgets(line, sizeof(line), in) != NULL)) {
+        render.lines++;
+        memset(buf, 0, sizeof(buf));
+        gc_process_line(line, buf);
+        if (buf[0] == '\0') { continue; }
+        uint8_t status = gc_dispatch_line(buf);
+        if (status != STATUS_OK) {
+            render.errors++;
+            fprintf(stderr, "render_job: %s line %u error:%d\n", name, render.lines, status);
+        }
+    }
+
+    // End of job. Render whatever is left in the planner.
+    while (!render.io_error && (segment_prep_pending() || (segment_queued() > 0))) {
+        uint64_t ticks = render.pulses.ticks;
+        render_drain();
+        if (render.pulses.ticks == ticks) {
+            fprintf(stderr, "render_job: %s segment prep stalled with motion pending\n", name);
+            ret = -1;
+            break;
+        }
+    }
+    render.wall_time = latency_now() - start;
+    return ret;
+}
+
+/**
+ * @brief Render a G-Code job offline
+ * @param in_path Input G-Code file
+ * @param out_path Pulse stream output file. NULL to discard.
+ * @param stats Print the detailed statistics report
+ * @param compare_path Reference pulse stream to compare the output to. NULL for none.
+ * @return 0 on success, negative on error.
+ */
+ssize_t render_run(const char *in_path, const char *out_path, bool stats, const char *compare_path) {
+    ssize_t ret = 0;
+    FILE *in = fopen(in_path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "render_run: unable to open %s\n", in_path);
+        return -1;
+    }
+    memset(&render, 0, sizeof(render_t));
+    if (out_path != NULL) {
+        if ((render.out = fopen(out_path, (compare_path != NULL) ? "w+" : "w")) == NULL) {
+            fprintf(stderr, "render_run: unable to open %s\n", out_path);
+            fclose(in);
+            return -1;
+        }
+    } else if ((compare_path != NULL) && ((render.out = tmpfile()) == NULL)) {
+        fprintf(stderr, "render_run: unable to create pulse stream file\n");
+        fclose(in);
+        return -1;
+    }
+
+    ret = _render_job(in, in_path);
+    fclose(in);
+
+    if ((render.out != NULL) && (fflush(render.out) != 0)) { render.io_error = true; }
+    if (render.io_error) {
+        fprintf(stderr, "render_run: unable to write %s\n", (out_path != NULL) ? out_path : "pulse stream");
+        if (render.out != NULL) { fclose(render.out); }
+        return -EIO;
+    }
+    _render_report(stats);
+    if (compare_path != NULL) {
+        rewind(render.out);
+        if (_render_compare(compare_path, render.out) < 0) { ret = -1; }
+    }
+    if ((render.out != NULL) && (fclose(render.out) != 0)) {
+        fprintf(stderr, "render_run: unable to write %s\n", out_path);
+        return -EIO;
+    }
+    if (render.errors) { ret = -EINVAL; }
+    return ret;
+}
+
+/**
+ * @brief Render a G-Code job offline for its machine time only
+ *
+ * The pulse stream is discarded, and nothing is printed.
+ * @param in_path Input G-Code file
+ * @param seconds Machine time output (s)
+ * @return 0 on success, negative on error.
+ */
+ssize_t render_machine_time(const char *in_path, double *seconds) {
+    ssize_t ret = 0;
+    FILE *in = fopen(in_path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "render_machine_time: unable to open %s\n", in_path);
+        return -1;
+    }
+    memset(&render, 0, sizeof(render_t));
+    ret = _render_job(in, in_path);
+    fclose(in);
+    *seconds = (double) render.pulses.ticks / STEP_FREQUENCY + render.dwell;
+    if (render.errors) { ret = -EINVAL; }
+    return ret;
+}
+
+/**
+ * @brief Check a G-Code corpus against its golden pulse stream hashes
+ *
+ * The corpus file lists one job per line, as the hash of its pulse stream in hex, followed by the job file,
+ * relative to the corpus file. A job without a hash is new. Blank lines and lines starting with # are kept
+ * as is. Each job is rendered and its hash compared. With update, the corpus file is rewritten with the new
+ * hashes, to accept an intentional change after quantifying it with render_run() and a reference stream.
+ * @param corpus_path Corpus file
+ * @param update Rewrite the corpus file with the new hashes
+ * @return 0 if every job matched, or on a successful update, negative otherwise.
+ */
+ssize_t render_golden(const char *corpus_path, bool update) {
+    FILE *corpus = fopen(corpus_path, "r");
+    if (corpus == NULL) {
+        fprintf(stderr, "render_golden: unable to open %s\n", corpus_path);
+        return -1;
+    }
+    // Job files are relative to the corpus file
+    char dir[PATH_MAX];
+    strncpy(dir, corpus_path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    char *slash = strrchr(dir, '/');
+    if (slash != NULL) { slash[1] = '\0'; } else { dir[0] = '\0'; }
+
+    char line[RENDER_GOLDEN_LINE];
+    char *out = NULL;
+    size_t out_len = 0;
+    FILE *updated = open_memstream(&out, &out_len);
+    uint32_t jobs = 0, passed = 0, failed = 0, added = 0, errors = 0;
+    int64_t start = latency_now();
+
+    while (fgets(line, sizeof(line), corpus) != NULL) {
+        char job[RENDER_GOLDEN_LINE], hex[RENDER_GOLDEN_LINE];
+        uint64_t golden = 0;
+        bool has_hash = false;
+        strtok(line, "\r\n");
+        if ((line[0] == '#') || (sscanf(line, "%s", job) != 1)) {
+            fprintf(updated, "%s\n", (line[0] == '\n') ? "" : line);
+            continue;
+        }
+        if ((sscanf(line, "%s %s", hex, job) == 2) && (strlen(hex) == 16)) {
+            golden = strtoull(hex, NULL, 16);
+            has_hash = true;
+        }
+
+        char path[PATH_MAX];
+        int path_len = snprintf(path, sizeof(path), "%s%s", (job[0] == '/') ? "" : dir, job);
+        jobs++;
+        if ((path_len < 0) || (path_len >= (int) sizeof(path))) {
+            fprintf(stderr, "render_golden: path too long for %s\n", job);
+            errors++;
+            fprintf(updated, "%s\n", line);
+            continue;
+        }
+        FILE *in = fopen(path, "r");
+        if (in == NULL) {
+            fprintf(stderr, "render_golden: unable to open %s\n", path);
+            errors++;
+            fprintf(updated, "%s\n", line);
+            continue;
+        }
+        memset(&render, 0, sizeof(render_t));
+        ssize_t ret = _render_job(in, job);
+        fclose(in);
+        if ((ret < 0) || render.errors) { errors++; }
+
+        if (!has_hash) {
+            added++;
+            printf("Golden: NEW  %016llx %s\n", (unsigned long long) render.pulses.hash, job);
+        } else if (render.pulses.hash == golden) {
+            passed++;
+            printf("Golden: PASS %016llx %s\n", (unsigned long long) render.pulses.hash, job);
+        } else {
+            failed++;
+            printf("Golden: FAIL %016llx %s, expected %016llx\n", (unsigned long long) render.pulses.hash, job,
+                   (unsigned long long) golden);
+        }
+        fprintf(updated, "%016llx %s\n", (unsigned long long) render.pulses.hash, job);
+    }
+    fclose(corpus);
+    fclose(updated);
+
+    printf("Golden: %u jobs, %u passed, %u failed, %u new, %u errors in %.3fs\n", jobs, passed, failed, added,
+           errors, (latency_now() - start) / 1e9);
+    ssize_t ret = (failed || errors) ? -1 : 0;
+    if (update && !errors) {
+        if (((corpus = fopen(corpus_path, "w")) == NULL) || (fwrite(out, 1, out_len, corpus) != out_len) ||
+            (fclose(corpus) != 0)) {
+            fprintf(stderr, "render_golden: unable to write %s\n", corpus_path);
+            ret = -EIO;
+        } else {
+            printf("Golden: updated %s\n", corpus_path);
+            ret = 0;
+        }
+    }
+    free(out);
+    return ret;
+}
+
+/**
+ * @brief Read a pulse stream into memory
+ * @param in Pulse stream
+ * @param len Length output (ticks)
+ * @return Pulse stream on success, NULL on error. Free with free().
+ */
+static uint8_t *_render_read_pulses(FILE *in, size_t *len) {
+    size_t size = RENDER_READ_CHUNK;
+    uint8_t *pulses = malloc(size);
+    *len = 0;
+    size_t ret;
+    while ((pulses != NULL) && ((ret = fread(pulses + *len, 1, size - *len, in)) > 0)) {
+        *len += ret;
+        if (*len == size) {
+            size *= 2;
+            uint8_t *grown = realloc(pulses, size);
+            if (grown == NULL) { free(pulses); }
+            pulses = grown;
+        }
+    }
+    if ((pulses != NULL) && ferror(in)) {
+        free(pulses);
+        pulses = NULL;
+    }
+    return pulses;
+}
+
+/**
+ * @brief Step a pulse stream cursor one tick
+ * @param cursor Cursor to step. Holds its last position past the end of the stream.
+ * @return True if the tick had a step.
+ */
+static bool _render_cursor_tick(render_cursor_t *cursor) {
+    if (cursor->tick >= cursor->len) { return false; }
+    uint8_t pulse = cursor->pulses[cursor->tick++];
+    static const uint8_t step_bits[N_AXIS] = {X_AXIS_STEP_BIT, Y_AXIS_STEP_BIT, Z_AXIS_STEP_BIT};
+    static const uint8_t dir_bits[N_AXIS] = {X_AXIS_DIR_BIT, Y_AXIS_DIR_BIT, Z_AXIS_DIR_BIT};
+    bool step = false;
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        if (pulse & step_bits[idx]) {
+            cursor->position[idx] += (pulse & dir_bits[idx]) ? -1 : 1;
+            step = true;
+        }
+    }
+    return step;
+}
+
+/**
+ * @brief Quantify the difference between a pulse stream and a reference
+ *
+ * Replays both streams. Position deviation is the distance between them at the same tick. Timing drift is
+ * the time between them reaching the same step event, which is meaningful as long as both take the same
+ * path.
+ * @param ref_path Reference pulse stream file
+ * @param out Pulse stream to compare
+ * @return 0 on success, negative on error.
+ */
+static ssize_t _render_compare(const char *ref_path, FILE *out) {
+    FILE *ref_file = fopen(ref_path, "r");
+    if (ref_file == NULL) {
+        fprintf(stderr, "render_compare: unable to open %s\n", ref_path);
+        return -1;
+    }
+    render_cursor_t ref = {0}, cur = {0};
+    ref.pulses = _render_read_pulses(ref_file, &ref.len);
+    fclose(ref_file);
+    cur.pulses = _render_read_pulses(out, &cur.len);
+    if ((ref.pulses == NULL) || (cur.pulses == NULL)) {
+        fprintf(stderr, "render_compare: unable to read pulse streams\n");
+        free(ref.pulses);
+        free(cur.pulses);
+        return -1;
+    }
+    if ((ref.len == cur.len) && (memcmp(ref.pulses, cur.pulses, ref.len) == 0)) {
+        printf("Compare: identical to %s\n", ref_path);
+        free(ref.pulses);
+        free(cur.pulses);
+        return 0;
+    }
+
+    // Position deviation at the same tick
+    double max_deviation = 0.0;
+    size_t max_deviation_tick = 0, first_diff = 0;
+    while ((first_diff < ref.len) && (first_diff < cur.len) && (ref.pulses[first_diff] == cur.pulses[first_diff])) {
+        first_diff++;
+    }
+    size_t ticks = max(ref.len, cur.len);
+    for (size_t tick = 0; tick < ticks; tick++) {
+        _render_cursor_tick(&ref);
+        _render_cursor_tick(&cur);
+        double deviation = 0.0;
+        for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+            double d = (cur.position[idx] - ref.position[idx]) / settings.steps_per_mm[idx];
+            deviation += d * d;
+        }
+        if (deviation > max_deviation) {
+            max_deviation = deviation;
+            max_deviation_tick = tick;
+        }
+    }
+    int32_t final_delta[N_AXIS];
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) { final_delta[idx] = cur.position[idx] - ref.position[idx]; }
+
+    // Timing drift at the same step event
+    memset(ref.position, 0, sizeof(ref.position));
+    memset(cur.position, 0, sizeof(cur.position));
+    ref.tick = cur.tick = 0;
+    int64_t max_drift = 0;
+    uint64_t events = 0, max_drift_event = 0;
+    while (true) {
+        while ((ref.tick < ref.len) && !_render_cursor_tick(&ref)) {}
+        while ((cur.tick < cur.len) && !_render_cursor_tick(&cur)) {}
+        if ((ref.tick >= ref.len) || (cur.tick >= cur.len)) { break; }
+        int64_t drift = (int64_t) cur.tick - (int64_t) ref.tick;
+        if (llabs(drift) > llabs(max_drift)) {
+            max_drift = drift;
+            max_drift_event = events;
+        }
+        events++;
+    }
+
+    printf("Compare: differs from %s at %.6fs\n", ref_path, (double) first_diff / STEP_FREQUENCY);
+    printf("Compare: %zu ticks, reference %zu, end time drift %+.3fms\n", cur.len, ref.len,
+           ((double) cur.len - (double) ref.len) * 1000 / STEP_FREQUENCY);
+    printf("Compare: max position deviation %.4fmm at %.6fs\n", sqrt(max_deviation),
+           (double) max_deviation_tick / STEP_FREQUENCY);
+    printf("Compare: max timing drift %+.3fms at step event %llu\n", (double) max_drift * 1000 / STEP_FREQUENCY,
+           (unsigned long long) max_drift_event);
+    printf("Compare: final position delta X %d, Y %d, Z %d steps\n", final_delta[X_AXIS], final_delta[Y_AXIS],
+           final_delta[Z_AXIS]);
+    free(ref.pulses);
+    free(cur.pulses);
+    return 0;
+}
+
+/**
+ * @brief Print the timing and statistics report
+ * @param stats Print the detailed statistics report
+ */
+static void _render_report(bool stats) {
+    int64_t wall_time = render.wall_time;
+    double wall = wall_time / 1e9;
+    double machine = (double) render.pulses.ticks / STEP_FREQUENCY + render.dwell;
+    printf("Render: %u lines, %u errors, %u blocks, %llu segments, %llu ticks\n", render.lines, render.errors,
+           plan_get_blocks_appended(), (unsigned long long) render.pulses.segments,
+           (unsigned long long) render.pulses.ticks);
+    printf("Render: machine time %.3fs, wall time %.3fs, %.1fx real time\n", machine, wall,
+           (wall > 0) ? machine / wall : 0.0);
+    printf("Render: pulse hash %016llx\n", (unsigned long long) render.pulses.hash);
+    if (!stats) { return; }
+
+    double prep = render.prep_time / 1e9, stepgen = render.stepgen_time / 1e9;
+    printf("Render: wall time parse/plan %.3fs, segment prep %.3fs, stepgen %.3fs\n", wall - prep - stepgen, prep,
+           stepgen);
+    printf("Render: %.0f lines/s, %.0f blocks/s, %.0f segments/s, %.2f Mticks/s\n",
+           (wall > 0) ? render.lines / wall : 0.0, (wall > 0) ? plan_get_blocks_appended() / wall : 0.0,
+           (wall > 0) ? render.pulses.segments / wall : 0.0, (wall > 0) ? render.pulses.ticks / wall / 1e6 : 0.0);
+    printf("Render: steps X %llu, Y %llu, Z %llu, dwell %.3fs\n",
+           (unsigned long long) render.pulses.axis_steps[X_AXIS],
+           (unsigned long long) render.pulses.axis_steps[Y_AXIS],
+           (unsigned long long) render.pulses.axis_steps[Z_AXIS], render.dwell);
+    printf("Render: stepgen %.1fns/tick, step events by kernel", (render.pulses.ticks > 0) ?
+           render.stepgen_time / (double) render.pulses.ticks : 0.0);
+    for (uint8_t mask = 0; mask < STEP_GEN_KERNELS; mask++) {
+        if (render.pulses.kernel_steps[mask] == 0) { continue; }
+        printf(" %s%s%s%s %llu", (mask & bit(X_AXIS)) ? "X" : "", (mask & bit(Y_AXIS)) ? "Y" : "",
+               (mask & bit(Z_AXIS)) ? "Z" : "", mask ? "" : "-",
+               (unsigned long long) render.pulses.kernel_steps[mask]);
+    }
+    printf("\n");
+    printf("Render: final position X %.3f, Y %.3f, Z %.3f\n",
+           sys_position[X_AXIS] / settings.steps_per_mm[X_AXIS],
+           sys_position[Y_AXIS] / settings.steps_per_mm[Y_AXIS],
+           sys_position[Z_AXIS] / settings.steps_per_mm[Z_AXIS]);
+    printf("Render: segment cache %u hits, %u misses\n", metrics_get(METRIC_SEGMENT_CACHE_HITS),
+           metrics_get(METRIC_SEGMENT_CACHE_MISSES));
+    printf("Render: %s planner, %.0fns/block parse and plan\n",
+           (settings.planner_backend == PLANNER_BACKEND_CURVATURE) ? "curvature" : "grbl",
+           (plan_get_blocks_appended() > 0) ? (wall_time - render.prep_time - render.stepgen_time) /
+                                              (double) plan_get_blocks_appended() : 0.0);
+    printf("Render: %s segment generator, %.0fns/segment\n",
+           (settings.segment_generator == SEGMENT_GENERATOR_FIXED) ? "fixed-point" : "float",
+           (render.pulses.segments > 0) ? render.prep_time / (double) render.pulses.segments : 0.0);
+}
+
+/** @} */
+/** @} */
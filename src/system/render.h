@@ -0,0 +1,36 @@
+/**
+ * @file render.h
+ * @brief Headless offline render mode
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system_render
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_RENDER_H
+#define OPENGLOW_CNC_RENDER_H
+
+#include "../common.h"
+
+#define RENDER_GOLDEN_LINE  1024        // Maximum golden corpus file line length
+#define RENDER_READ_CHUNK   (1 << 20)   // Initial buffer when reading a pulse stream for comparison (bytes)
+
+void render_drain();
+
+void render_dwell(float seconds);
+
+ssize_t render_machine_time(const char *in_path, double *seconds);
+
+ssize_t render_golden(const char *corpus_path, bool update);
+
+ssize_t render_run(const char *in_path, const char *out_path, bool stats, const char *compare_path);
+
+#endif //OPENGLOW_CNC_RENDER_H
+
+/** @} */
@@ -0,0 +1,343 @@
+/**
+ * @file rtdiag.c
+ * @brief Real time context diagnostics
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system
+ *
+ * @{
+ * @defgroup system_rtdiag Real Time Diagnostics
+ *
+ * Finds what a real time task does that it shouldn't: block, fault, or use the heap. Enabled with --rt-diag,
+ * and reported with $D, per task and call site.
+ *
+ * Each real time task registers itself with rtdiag_task() when it starts. Then:
+ *
+ * - Sections of a task that must not block are marked with rtdiag_begin() and RTDIAG_END(). Context switches
+ *   and page faults in a section are taken from the thread's rusage, and charged to the RTDIAG_END() site.
+ * - malloc(), calloc(), realloc() and free() are interposed. A call from a registered task is charged to the
+ *   caller of the allocator, which is often in libc: getline(), fopen() and printf() all allocate.
+ * - On Cobalt, each task also sets T_WARNSW, and SIGDEBUG charges each switch to secondary mode to the code
+ *   that switched. Mercury, which we build for, has no modes. The section counters cover it there.
+ *
+ * When disabled, no task registers, and the allocator hooks cost a thread local test.
+ *
+ * @{
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "../openglow-cnc.h"
+
+/**
+ * @brief Registered real time task
+ */
+typedef struct {
+    const char *name;                   /*!< Task name */
+    uint32_t events[N_RTDIAG_EVENTS];   /*!< Events seen, by enum RTDIAG_EVENTS */
+} rtdiag_task_t;
+
+/**
+ * @brief Call site
+ *
+ * Sections are identified by func and line, other events by pc.
+ */
+typedef struct {
+    uint8_t task;       /*!< Task index */
+    uint8_t event;      /*!< enum RTDIAG_EVENTS */
+    const char *func;   /*!< Function of a section end, or NULL */
+    uint32_t line;      /*!< Line of a section end */
+    const void *pc;     /*!< Code address of an allocation or mode switch */
+    uint32_t count;     /*!< Events seen */
+    bool valid;         /*!< Entry has been filled in */
+} rtdiag_site_t;
+
+/**
+ * @brief Event names, as reported
+ */
+static const char *rtdiag_event_names[N_RTDIAG_EVENTS] = {
+        [RTDIAG_BLOCK]          = "block",
+        [RTDIAG_PREEMPT]        = "preempt",
+        [RTDIAG_FAULT]          = "fault",
+        [RTDIAG_ALLOC]          = "alloc",
+        [RTDIAG_MODE_SWITCH]    = "mode_switch",
+};
+
+/**
+ * @brief Registered tasks
+ */
+static rtdiag_task_t rtdiag_tasks[RTDIAG_TASKS];
+
+/**
+ * @brief Tasks registered. May exceed RTDIAG_TASKS.
+ */
+static uint8_t rtdiag_n_tasks = 0;
+
+/**
+ * @brief Call sites
+ */
+static rtdiag_site_t rtdiag_sites[RTDIAG_SITES];
+
+/**
+ * @brief Call sites claimed. May exceed RTDIAG_SITES.
+ */
+static uint32_t rtdiag_n_sites = 0;
+
+/**
+ * @brief Index of the calling thread's task, -1 if it isn't a registered real time task
+ */
+static __thread int8_t rtdiag_self = -1;
+
+/**
+ * @brief Calling thread's usage at the start of its open section
+ */
+static __thread struct rusage rtdiag_usage;
+
+/**
+ * @brief Calling thread has an open section
+ */
+static __thread bool rtdiag_open = false;
+
+// glibc's allocator, behind the interposed functions
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_malloc(size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+// Static function declarations
+static void _rtdiag_count(enum RTDIAG_EVENTS event, const char *func, uint32_t line, const void *pc, uint32_t n);
+static void _rtdiag_site_name(rtdiag_site_t *site, char *buf, size_t len);
+#ifdef SIGDEBUG
+static void _rtdiag_sigdebug(int sig, siginfo_t *info, void *context);
+#endif // SIGDEBUG
+
+/**
+ * @brief Start a section of the calling task that must not block, fault or allocate
+ */
+void rtdiag_begin() {
+    if (rtdiag_self < 0) { return; }
+    getrusage(RUSAGE_THREAD, &rtdiag_usage);
+    rtdiag_open = true;
+}
+
+/**
+ * @brief End the section started by rtdiag_begin(). Use RTDIAG_END().
+ * @param func Function of the section end
+ * @param line Line of the section end
+ */
+void rtdiag_end(const char *func, uint32_t line) {
+    struct rusage usage;
+    if ((rtdiag_self < 0) || !rtdiag_open) { return; }
+    rtdiag_open = false;
+    getrusage(RUSAGE_THREAD, &usage);
+    uint32_t block = (uint32_t) (usage.ru_nvcsw - rtdiag_usage.ru_nvcsw);
+    uint32_t preempt = (uint32_t) (usage.ru_nivcsw - rtdiag_usage.ru_nivcsw);
+    uint32_t fault = (uint32_t) ((usage.ru_minflt - rtdiag_usage.ru_minflt) +
+                                 (usage.ru_majflt - rtdiag_usage.ru_majflt));
+    if (block) { _rtdiag_count(RTDIAG_BLOCK, func, line, NULL, block); }
+    if (preempt) { _rtdiag_count(RTDIAG_PREEMPT, func, line, NULL, preempt); }
+    if (fault) { _rtdiag_count(RTDIAG_FAULT, func, line, NULL, fault); }
+}
+
+/**
+ * @brief Initialize the diagnostics
+ *
+ * Does nothing unless settings.rt_diag is set.
+ * @return 0 on success, negative on error.
+ */
+ssize_t rtdiag_init() {
+    if (!settings.rt_diag) { return 0; }
+    // backtrace() loads libgcc on first use. Get that out of the way now.
+    void *frames[1];
+    backtrace(frames, 1);
+#ifdef SIGDEBUG
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = _rtdiag_sigdebug;
+    action.sa_flags = SA_SIGINFO;
+    if (sigaction(SIGDEBUG, &action, NULL) < 0) {
+        perror("rtdiag_init: sigaction error");
+        return -errno;
+    }
+#endif // SIGDEBUG
+    return 0;
+}
+
+/**
+ * @brief Report the diagnostics to the CLI
+ *
+ * One line per task and event with the total, then one per call site.
+ */
+void rtdiag_report() {
+    char site[CLI_LINE_LENGTH / 2];
+    if (!settings.rt_diag) {
+        message_status(STATUS_UNSUPPORTED_COMMAND);
+        return;
+    }
+    // The report allocates. Don't charge that to the task running it.
+    int8_t self = rtdiag_self;
+    rtdiag_self = -1;
+    uint8_t n_tasks = min(__atomic_load_n(&rtdiag_n_tasks, __ATOMIC_ACQUIRE), RTDIAG_TASKS);
+    uint32_t n_sites = min(__atomic_load_n(&rtdiag_n_sites, __ATOMIC_ACQUIRE), RTDIAG_SITES);
+    for (uint8_t t = 0; t < n_tasks; t++) {
+        for (uint8_t e = 0; e < N_RTDIAG_EVENTS; e++) {
+            message_write(MSG_RTDIAG, rtdiag_tasks[t].name, rtdiag_event_names[e], "total",
+                          __atomic_load_n(&rtdiag_tasks[t].events[e], __ATOMIC_RELAXED));
+        }
+    }
+    for (uint32_t s = 0; s < n_sites; s++) {
+        if (!__atomic_load_n(&rtdiag_sites[s].valid, __ATOMIC_ACQUIRE)) { continue; }
+        _rtdiag_site_name(&rtdiag_sites[s], site, sizeof(site));
+        message_write(MSG_RTDIAG, rtdiag_tasks[rtdiag_sites[s].task].name, rtdiag_event_names[rtdiag_sites[s].event],
+                      site, __atomic_load_n(&rtdiag_sites[s].count, __ATOMIC_RELAXED));
+    }
+    rtdiag_self = self;
+    message_write(MSG_OK);
+}
+
+/**
+ * @brief Register the calling thread as a real time task
+ *
+ * Called by each real time task when it starts. Does nothing unless settings.rt_diag is set.
+ * @param name Task name
+ */
+void rtdiag_task(const char *name) {
+    if (!settings.rt_diag) { return; }
+    uint8_t index = __atomic_fetch_add(&rtdiag_n_tasks, 1, __ATOMIC_ACQ_REL);
+    if (index >= RTDIAG_TASKS) {
+        fprintf(stderr, "rtdiag_task: no room for %s\n", name);
+        return;
+    }
+    rtdiag_tasks[index].name = name;
+    rtdiag_self = (int8_t) index;
+#ifdef SIGDEBUG
+    ssize_t ret;
+    if ((ret = rt_task_set_mode(0, T_WARNSW, NULL)) < 0) {
+        fprintf(stderr, "rtdiag_task: rt_task_set_mode returned %zd\n", ret);
+    }
+#endif // SIGDEBUG
+    if (verbose) printf("rtdiag_task: %s registered\n", name);
+}
+
+/**
+ * @brief Charge events to the calling task and a call site
+ *
+ * Safe to call from the allocator and signal handlers. It neither allocates nor locks.
+ * @param event Event type
+ * @param func Function of a section end, or NULL
+ * @param line Line of a section end
+ * @param pc Code address of an allocation or mode switch
+ * @param n Number of events
+ */
+static void _rtdiag_count(enum RTDIAG_EVENTS event, const char *func, uint32_t line, const void *pc, uint32_t n) {
+    int8_t task = rtdiag_self;
+    __atomic_add_fetch(&rtdiag_tasks[task].events[event], n, __ATOMIC_RELAXED);
+    metrics_inc(METRIC_RT_DIAG_EVENTS);
+
+    uint32_t n_sites = min(__atomic_load_n(&rtdiag_n_sites, __ATOMIC_ACQUIRE), RTDIAG_SITES);
+    for (uint32_t s = 0; s < n_sites; s++) {
+        rtdiag_site_t *site = &rtdiag_sites[s];
+        if (__atomic_load_n(&site->valid, __ATOMIC_ACQUIRE) && (site->task == task) && (site->event == event) &&
+            (site->func == func) && (site->line == line) && (site->pc == pc)) {
+            __atomic_add_fetch(&site->count, n, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    // New site. Two tasks racing to add the same one get an entry each, which the report lists twice.
+    uint32_t s = __atomic_fetch_add(&rtdiag_n_sites, 1, __ATOMIC_ACQ_REL);
+    if (s >= RTDIAG_SITES) { return; }
+    rtdiag_site_t *site = &rtdiag_sites[s];
+    site->task = (uint8_t) task;
+    site->event = (uint8_t) event;
+    site->func = func;
+    site->line = line;
+    site->pc = pc;
+    site->count = n;
+    __atomic_store_n(&site->valid, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Name a call site
+ *
+ * A section end is named function:line. A code address is named symbol+offset if it has an exported symbol,
+ * otherwise object+offset, for addr2line. An address dladdr() can't resolve is printed bare.
+ * @param site Call site
+ * @param buf Name output
+ * @param len Length of buf
+ */
+static void _rtdiag_site_name(rtdiag_site_t *site, char *buf, size_t len) {
+    Dl_info info;
+    if (site->func != NULL) {
+        snprintf(buf, len, "%s:%u", site->func, site->line);
+    } else if (!dladdr(site->pc, &info)) {
+        snprintf(buf, len, "%p", site->pc);
+    } else if (info.dli_sname != NULL) {
+        snprintf(buf, len, "%s+0x%zx", info.dli_sname, (size_t) ((char *) site->pc - (char *) info.dli_saddr));
+    } else if (info.dli_fname != NULL) {
+        const char *object = strrchr(info.dli_fname, '/');
+        snprintf(buf, len, "%s+0x%zx", (object != NULL) ? object + 1 : info.dli_fname,
+                 (size_t) ((char *) site->pc - (char *) info.dli_fbase));
+    } else {
+        snprintf(buf, len, "%p", site->pc);
+    }
+}
+
+#ifdef SIGDEBUG
+/**
+ * @brief SIGDEBUG handler. Charges a switch to secondary mode to the code that switched.
+ * @param sig Signal
+ * @param info Unused
+ * @param context Unused
+ */
+static void _rtdiag_sigdebug(int sig, siginfo_t *info, void *context) {
+    void *frames[3];
+    if (rtdiag_self < 0) { return; }
+    // Frames are this handler, the signal trampoline, and the code that was running
+    int n = backtrace(frames, 3);
+    _rtdiag_count(RTDIAG_MODE_SWITCH, NULL, 0, (n == 3) ? frames[2] : NULL, 1);
+}
+#endif // SIGDEBUG
+
+/**
+ * @brief Interposed calloc(). Counts calls from real time tasks.
+ */
+void *calloc(size_t nmemb, size_t size) {
+    if (rtdiag_self >= 0) { _rtdiag_count(RTDIAG_ALLOC, NULL, 0, __builtin_return_address(0), 1); }
+    return __libc_calloc(nmemb, size);
+}
+
+/**
+ * @brief Interposed free(). Counts calls from real time tasks.
+ */
+void free(void *ptr) {
+    if ((rtdiag_self >= 0) && (ptr != NULL)) { _rtdiag_count(RTDIAG_ALLOC, NULL, 0, __builtin_return_address(0), 1); }
+    __libc_free(ptr);
+}
+
+/**
+ * @brief Interposed malloc(). Counts calls from real time tasks.
+ */
+void *malloc(size_t size) {
+    if (rtdiag_self >= 0) { _rtdiag_count(RTDIAG_ALLOC, NULL, 0, __builtin_return_address(0), 1); }
+    return __libc_malloc(size);
+}
+
+/**
+ * @brief Interposed realloc(). Counts calls from real time tasks.
+ */
+void *realloc(void *ptr, size_t size) {
+    if (rtdiag_self >= 0) { _rtdiag_count(RTDIAG_ALLOC, NULL, 0, __builtin_return_address(0), 1); }
+    return __libc_realloc(ptr, size);
+}
+
+/** @} */
+/** @} */
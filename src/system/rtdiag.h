@@ -0,0 +1,50 @@
+/**
+ * @file rtdiag.h
+ * @brief Real time context diagnostics
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @addtogroup system_rtdiag
+ *
+ * @{
+ */
+
+#ifndef OPENGLOW_CNC_RTDIAG_H
+#define OPENGLOW_CNC_RTDIAG_H
+
+#include "../common.h"
+
+#define RTDIAG_TASKS    16  // Real time tasks tracked
+#define RTDIAG_SITES    128 // Call sites tracked, across all tasks
+
+#define RTDIAG_END()    rtdiag_end(__func__, __LINE__) // End a section, charging what it did to this site
+
+/**
+ * @brief Diagnosed events
+ */
+enum RTDIAG_EVENTS {
+    RTDIAG_BLOCK,       /*!< Voluntary context switch in a section: a blocking syscall, or a lock */
+    RTDIAG_PREEMPT,     /*!< Involuntary context switch in a section */
+    RTDIAG_FAULT,       /*!< Page fault in a section */
+    RTDIAG_ALLOC,       /*!< Heap call from a real time task. The site is the caller of malloc(). */
+    RTDIAG_MODE_SWITCH, /*!< Switch to secondary mode (Cobalt only). The site is where it switched. */
+    N_RTDIAG_EVENTS,
+};
+
+void rtdiag_begin();
+
+void rtdiag_end(const char *func, uint32_t line);
+
+ssize_t rtdiag_init();
+
+void rtdiag_report();
+
+void rtdiag_task(const char *name);
+
+#endif //OPENGLOW_CNC_RTDIAG_H
+
+/** @} */
@@ -31,6 +31,9 @@ settings_t settings = {
     },
     .soft_limits = true,
     .laser_power_correction = true,
+    .feed_limiter = false,
+    .segment_cache = true,
+    .job_cache_size = JOB_CACHE_SIZE,
 
     .steps_per_mm[X_AXIS] = X_STEPS_PER_MM,
     .steps_per_mm[Y_AXIS] = Y_STEPS_PER_MM,
@@ -40,10 +43,21 @@ settings_t settings = {
     .max_rate[Y_AXIS] = Y_MAX_RATE,
     .max_rate[Z_AXIS] = Z_MAX_RATE,
 
+    .rapid_max_rate[X_AXIS] = X_RAPID_MAX_RATE,
+    .rapid_max_rate[Y_AXIS] = Y_RAPID_MAX_RATE,
+    .rapid_max_rate[Z_AXIS] = Z_MAX_RATE,
+
     .acceleration[X_AXIS] = X_ACCELERATION,
     .acceleration[Y_AXIS] = Y_ACCELERATION,
     .acceleration[Z_AXIS] = Z_ACCELERATION,
 
+    .travel_acceleration[X_AXIS] = X_TRAVEL_ACCELERATION,
+    .travel_acceleration[Y_AXIS] = Y_TRAVEL_ACCELERATION,
+    .travel_acceleration[Z_AXIS] = Z_TRAVEL_ACCELERATION,
+
+    .junction_deviation = JUNCTION_DEVIATION,
+    .travel_junction_deviation = TRAVEL_JUNCTION_DEVIATION,
+
     .max_travel[X_AXIS] = (-X_MAX_TRAVEL),
     .max_travel[Y_AXIS] = (-Y_MAX_TRAVEL),
     .max_travel[Z_AXIS] = (-Z_MAX_TRAVEL)
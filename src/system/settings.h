@@ -27,6 +27,7 @@ typedef struct cli_s {
     // Socket settings
     struct in_addr listen_ip;   /*!< IP to listen on for socket mode */
     uint16_t listen_port;       /*!< Port to listen on for socket mode */
+    char *socket_path;          /*!< UNIX socket to listen on for socket mode. TCP when NULL. */
 
     // Interface defaults
     bool auto_cycle;    /*!< et to true, machine will automatically cycle start when motion buffer fills. */
@@ -40,13 +41,28 @@ typedef struct cli_s {
 typedef struct settings_s {
     cli_t cli;  /*!< CLI settings */
 
+    bool async_z;   /*!< Run Z focus moves asynchronously with laser-off rapids */
     bool daemon;    /*!< Run in dameon mode */
+    bool feed_limiter;  /*!< Automatically reduce feed when the motion buffers are starving */
+    char *job_cache_path;   /*!< Compiled job cache directory. NULL disables the cache. */
+    uint32_t job_cache_size;    /*!< Compiled job cache size limit (KB) */
+    char *flight_path;  /*!< Flight recorder dump directory. NULL disables the recorder. */
     bool laser_power_correction;    /*!< Laser power correction for speed */
+    bool offline;   /*!< Running an offline mode. No real time tasks or hardware access. */
+    uint8_t planner_backend;    /*!< Junction speed model, enum PLANNER_BACKENDS */
+    bool rapid_microsteps;  /*!< Step long laser-off rapids at a coarser microstep resolution */
+    bool rt_diag;       /*!< Count blocking, faults and heap use in real time tasks */
+    bool segment_cache; /*!< Replay cached segment profiles for repeated blocks */
+    uint8_t segment_generator;  /*!< Segment generator, enum SEGMENT_GENERATORS */
     bool soft_limits;   /*!< Enable soft limit checks */
 
     float steps_per_mm[N_AXIS];
-    float acceleration[N_AXIS];
+    float acceleration[N_AXIS];         /*!< Laser-on acceleration (mm/min^2) */
+    float travel_acceleration[N_AXIS];  /*!< Laser-off acceleration (mm/min^2) */
+    float junction_deviation;           /*!< Laser-on junction deviation (mm) */
+    float travel_junction_deviation;    /*!< Laser-off junction deviation (mm) */
     float max_rate[N_AXIS];
+    float rapid_max_rate[N_AXIS];       /*!< Maximum rate of coarse resolution rapids (mm/min) */
     float max_travel[N_AXIS];
 } settings_t;
 
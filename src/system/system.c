@@ -22,8 +22,90 @@
  * @{
  */
 
+#include <errno.h>
+#include <pthread.h>
 #include "../openglow-cnc.h"
 
+/**
+ * @brief Startup phases
+ */
+enum INIT_PHASES {
+    INIT_FSM,           /*!< System FSM queue and loop */
+    INIT_OPENGLOW,      /*!< OpenGlow controller enable and state polling */
+    INIT_SWITCHES,      /*!< Switch input device */
+    INIT_LIMITS,        /*!< Limit switch input device */
+    INIT_STEP_DRV,      /*!< Stepper driver programming */
+    INIT_STEPGEN,       /*!< Step generator task and pulse device */
+    INIT_MOTION,        /*!< G-Code queue, segment worker and planner */
+    INIT_CLI,           /*!< Console or socket interface */
+    N_INIT_PHASES,
+};
+
+/**
+ * @brief Startup phase definition
+ */
+typedef struct {
+    const char *name;           /*!< Phase name, for error and verbose output */
+    ssize_t (*init)();          /*!< Init function */
+    uint16_t deps;              /*!< Mask of phases that must complete first */
+    enum METRICS metric;        /*!< Metric receiving the phase duration */
+} init_phase_t;
+
+/**
+ * @brief Startup phase status
+ */
+typedef struct {
+    pthread_t thread;           /*!< Thread running the phase */
+    bool done;                  /*!< Phase has finished, successfully or not */
+    ssize_t ret;                /*!< Init function return, or -ECANCELED if a dependency failed */
+    int64_t start;              /*!< Start time (ns since init start) */
+    int64_t end;                /*!< End time (ns since init start) */
+} init_status_t;
+
+/**
+ * @brief Startup phases and their dependencies.
+ *
+ * Everything registers with the FSM, so it comes first. The stepper drivers and pulse device
+ * need the controller enabled. Motion clears the step generator state, so it waits for the step
+ * generator task to be started. The CLI is started last so no line can arrive before the G-Code
+ * queue exists. Input devices, driver programming and the CLI socket run concurrently.
+ */
+static const init_phase_t init_phases[N_INIT_PHASES] = {
+        [INIT_FSM]      = {"fsm", fsm_init, 0, METRIC_STARTUP_FSM},
+        [INIT_OPENGLOW] = {"openglow", openglow_init, bit(INIT_FSM), METRIC_STARTUP_OPENGLOW},
+        [INIT_SWITCHES] = {"switches", switches_init, bit(INIT_FSM), METRIC_STARTUP_SWITCHES},
+        [INIT_LIMITS]   = {"limits", limits_init, bit(INIT_FSM), METRIC_STARTUP_LIMITS},
+        [INIT_STEP_DRV] = {"step_drv", step_drv_init, bit(INIT_OPENGLOW), METRIC_STARTUP_STEP_DRV},
+        [INIT_STEPGEN]  = {"stepgen", stepgen_init, bit(INIT_OPENGLOW), METRIC_STARTUP_STEPGEN},
+        [INIT_MOTION]   = {"motion", motion_init, bit(INIT_FSM) | bit(INIT_STEPGEN), METRIC_STARTUP_MOTION},
+        [INIT_CLI]      = {"cli", cli_init, bit(INIT_FSM) | bit(INIT_MOTION), METRIC_STARTUP_CLI},
+};
+
+/**
+ * @brief Startup phase status
+ */
+static init_status_t init_status[N_INIT_PHASES];
+
+/**
+ * @brief Protects init_status, signalled as each phase finishes
+ */
+static pthread_mutex_t init_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Signalled when a startup phase finishes
+ */
+static pthread_cond_t init_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Start of initialization (ns)
+ */
+static int64_t init_start;
+
+// Static function declarations
+static void *_system_init_phase(void *arg);
+
+static ssize_t _system_init_phases();
+
 /**
  * @brief Start all subsystems
  * @return 0 on success, negative on error.
@@ -31,38 +113,39 @@
 ssize_t system_control_init() {
     ssize_t ret = 0;
 
-    // Sync cleared gcode and motion positions to current system position.
-    plan_sync_position();
-    gc_sync_position();
-
-    // Startup FSM
-    if ((ret = fsm_init()) < 0) {
-        fprintf(stderr, "system_control_init: fsm_init returned %zd\n", ret);
+    init_start = latency_now();
+    latency_reset();
+    metrics_reset();
+    if ((ret = rtdiag_init()) < 0) {
+        fprintf(stderr, "system_control_init: rtdiag_init returned %zd\n", ret);
         return ret;
     }
-
-    // Startup CLI
-    if ((ret = cli_init()) < 0) {
-        fprintf(stderr, "system_control_init: cli_init returned %zd\n", ret);
+    if ((ret = flight_init()) < 0) {
+        fprintf(stderr, "system_control_init: flight_init returned %zd\n", ret);
         return ret;
     }
 
-    // Startup Hardware
-    if ((ret = hardware_init()) < 0) {
-        fprintf(stderr, "system_control_init: hardware_init returned %zd\n", ret);
-        return ret;
-    }
+    // Sync cleared gcode and motion positions to current system position.
+    plan_sync_position();
+    gc_sync_position();
 
-    // Startup Motion
-    if ((ret = motion_init()) < 0) {
-        fprintf(stderr, "system_control_init: motion_init returned %zd\n", ret);
+    // Startup FSM, hardware, motion and CLI
+    if ((ret = _system_init_phases()) < 0) {
+        fprintf(stderr, "system_control_init: _system_init_phases returned %zd\n", ret);
         return ret;
     }
 
     // Everything initialized, send out the welcome message
+    uint32_t ready = (uint32_t) ((latency_now() - init_start) / 1000000);
+    metrics_set(METRIC_STARTUP_READY, ready);
     message_write(MSG_WELCOME_BANNER, OPENGLOW_CNC_VER);
+    message_write(MSG_READY, ready);
 
-    return rt_task_join(&rt_fsm_loop);
+    if ((ret = rt_task_join(&rt_fsm_loop)) < 0) {
+        fprintf(stderr, "system_control_init: rt_task_join returned %zd\n", ret);
+        return ret;
+    }
+    return fsm_exit_status();
 }
 
 /**
@@ -79,5 +162,85 @@ void system_buffer_synchronize() {
 //    } while (plan_get_current_block() || (sys.state.mode == STATE_CYCLE));
 }
 
+/**
+ * @brief Run a startup phase once its dependencies have finished
+ * @param arg Phase, as enum INIT_PHASES
+ * @return NULL
+ */
+static void *_system_init_phase(void *arg) {
+    enum INIT_PHASES phase = (enum INIT_PHASES) (intptr_t) arg;
+    const init_phase_t *def = &init_phases[phase];
+    init_status_t *status = &init_status[phase];
+    ssize_t ret = 0;
+
+    // Wait for dependencies
+    pthread_mutex_lock(&init_mutex);
+    for (uint8_t i = 0; i < N_INIT_PHASES; i++) {
+        if (!(def->deps & bit(i))) continue;
+        while (!init_status[i].done) pthread_cond_wait(&init_cond, &init_mutex);
+        if (init_status[i].ret < 0) ret = -ECANCELED;
+    }
+    pthread_mutex_unlock(&init_mutex);
+
+    status->start = latency_now() - init_start;
+    if (ret == 0 && (ret = def->init()) < 0) {
+        fprintf(stderr, "system_control_init: %s init returned %zd\n", def->name, ret);
+    }
+    status->end = latency_now() - init_start;
+    metrics_set(def->metric, (uint32_t) ((status->end - status->start) / 1000));
+    if (verbose) printf("_system_init_phase: %s %1.3f-%1.3fms (%zd)\n", def->name,
+                        status->start / 1e6, status->end / 1e6, ret);
+
+    pthread_mutex_lock(&init_mutex);
+    status->ret = ret;
+    status->done = true;
+    pthread_cond_broadcast(&init_cond);
+    pthread_mutex_unlock(&init_mutex);
+    return NULL;
+}
+
+/**
+ * @brief Run all startup phases, each as soon as its dependencies allow
+ * @return 0 on success, first phase error otherwise.
+ */
+static ssize_t _system_init_phases() {
+    ssize_t ret = 0;
+
+    for (uint8_t i = 0; i < N_INIT_PHASES; i++) {
+        init_status[i].done = false;
+        init_status[i].ret = 0;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, INIT_PHASE_STACK_SIZE);
+
+    // Phases wait on their dependencies, so spawn order doesn't matter
+    uint8_t spawned;
+    for (spawned = 0; spawned < N_INIT_PHASES; spawned++) {
+        if ((ret = -pthread_create(&init_status[spawned].thread, &attr, _system_init_phase,
+                                   (void *) (intptr_t) spawned)) < 0) {
+            fprintf(stderr, "_system_init_phases: pthread_create returned %zd\n", ret);
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    // Phases that never spawned still count as finished, so nothing waits on them forever
+    pthread_mutex_lock(&init_mutex);
+    for (uint8_t i = spawned; i < N_INIT_PHASES; i++) {
+        init_status[i].ret = -ECANCELED;
+        init_status[i].done = true;
+    }
+    pthread_cond_broadcast(&init_cond);
+    pthread_mutex_unlock(&init_mutex);
+
+    for (uint8_t i = 0; i < spawned; i++) {
+        pthread_join(init_status[i].thread, NULL);
+        if (ret == 0 && init_status[i].ret < 0) ret = init_status[i].ret;
+    }
+    return ret;
+}
+
 /** @} */
 /** @} */
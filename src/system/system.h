@@ -19,6 +19,8 @@
 #include <arpa/inet.h>
 #include "../cli/cli.h"
 
+#define INIT_PHASE_STACK_SIZE   262144  // Startup phase thread stack. Kept small, since memory is locked.
+
 void system_buffer_synchronize();
 
 ssize_t system_control_init();
@@ -0,0 +1,441 @@
+/**
+ * @file stream.c
+ * @brief G-Code streaming client and load generator
+ *
+ * Part of OpenGlow-CNC
+ *
+ * @copyright Copyright (c) 2018 Scott Wiederhold <s.e.wiederhold@gmail.com>
+ *
+ * SPDX-License-Identifier:    GPL-3.0-or-later
+ *
+ * @defgroup tools_stream Streaming Client
+ *
+ * Streams a G-Code file to the daemon's socket, over TCP or a UNIX socket.
+ *
+ * Uses character counting flow control: Lines are sent as long as the unacknowledged bytes fit the daemon's
+ * receive buffer, and each ok or error acknowledges the oldest line. Reports lines/s and the latency from
+ * sending a line to its acknowledgement. Observer clients can be run alongside, polling status, to load the
+ * server as a pendant or UI would.
+ *
+ * @{
+ */
+
+#include <argp.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+
+#include "../config.h"
+#include "../cli/socket.h"
+
+#define STREAM_LINE_LENGTH      512     // Maximum line length, as CLI_LINE_LENGTH
+#define STREAM_OBSERVER_POLL    200     // Default observer status poll interval (ms)
+
+/**
+ * @brief Line sent and waiting for its acknowledgement
+ */
+typedef struct {
+    size_t len;         /*!< Bytes sent, including the line break */
+    int64_t sent;       /*!< Time sent (ns) */
+} stream_pending_t;
+
+/**
+ * @brief Observer client
+ */
+typedef struct {
+    pthread_t thread;   /*!< Observer thread */
+    uint64_t polls;     /*!< Status polls sent */
+    uint64_t reports;   /*!< Status reports received */
+} stream_observer_t;
+
+/**
+ * @brief Streaming client options
+ */
+typedef struct arguments {
+    char *file, *host, *port, *unix_path;
+    long rx_buffer, observers, poll_interval, repeat;
+    uint8_t verbose;
+} arguments_t;
+
+// Arparse handling
+static struct argp_option options[] = {
+        {"host",      'H', "HOST",  0, "Daemon address (default " COMM_LISTEN_ADDR ")"},
+        {"port",      'p', "PORT",  0, "Daemon port (default " COMM_LISTEN_PORT ")"},
+        {"unix",      'u', "PATH",  0, "Connect to UNIX socket PATH instead of TCP"},
+        {"rx-buffer", 'b', "BYTES", 0, "Daemon receive buffer to fill"},
+        {"observers", 'n', "N",     0, "Run N observer clients polling status"},
+        {"poll",      'i', "MS",    0, "Observer status poll interval"},
+        {"repeat",    'r', "N",     0, "Stream the file N times"},
+        {"verbose",   'v', 0,       0, "Print every line sent and received"},
+        {0}
+};
+
+/**
+ * @brief Streaming client options
+ */
+static arguments_t arguments;
+
+/**
+ * @brief Set when streaming is done, to stop the observers
+ */
+static volatile bool stream_done = false;
+
+// Static function declarations
+static int _stream_connect();
+static int _stream_latency_cmp(const void *a, const void *b);
+static ssize_t _stream_next_line(FILE *in, char *line);
+static int64_t _stream_now();
+static void *_stream_observer(void *arg);
+static error_t _stream_parse_opt(int key, char *arg, struct argp_state *state);
+static ssize_t _stream_take_line(char *buf, size_t *len, char *line);
+
+static struct argp argp = {options, _stream_parse_opt, "FILE", "Stream a G-Code FILE to the OpenGlow-CNC daemon"};
+
+/**
+ * @brief Parse a command line option
+ */
+static error_t _stream_parse_opt(int key, char *arg, struct argp_state *state) {
+    arguments_t *args = state->input;
+    switch (key) {
+        case 'H': {
+            args->host = arg;
+            break;
+        }
+        case 'p': {
+            args->port = arg;
+            break;
+        }
+        case 'u': {
+            args->unix_path = arg;
+            break;
+        }
+        case 'b': {
+            args->rx_buffer = strtol(arg, NULL, 10);
+            break;
+        }
+        case 'n': {
+            args->observers = strtol(arg, NULL, 10);
+            break;
+        }
+        case 'i': {
+            args->poll_interval = strtol(arg, NULL, 10);
+            break;
+        }
+        case 'r': {
+            args->repeat = strtol(arg, NULL, 10);
+            break;
+        }
+        case 'v': {
+            args->verbose = 1;
+            break;
+        }
+        case ARGP_KEY_ARG: {
+            if (state->arg_num > 0) { argp_usage(state); }
+            args->file = arg;
+            break;
+        }
+        case ARGP_KEY_END: {
+            if (args->file == NULL) { argp_usage(state); }
+            break;
+        }
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+/**
+ * @brief Monotonic time
+ * @return Time (ns)
+ */
+static int64_t _stream_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Connect to the daemon
+ * @return Socket descriptor on success, negative on error.
+ */
+static int _stream_connect() {
+    int sock;
+    if (arguments.unix_path != NULL) {
+        struct sockaddr_un sock_un;
+        memset(&sock_un, 0, sizeof(sock_un));
+        sock_un.sun_family = AF_UNIX;
+        strncpy(sock_un.sun_path, arguments.unix_path, sizeof(sock_un.sun_path) - 1);
+        if ((sock = socket(PF_UNIX, SOCK_STREAM, 0)) < 0) {
+            perror("stream_connect: socket creation error");
+            return -1;
+        }
+        if (connect(sock, (struct sockaddr *) &sock_un, sizeof(sock_un)) < 0) {
+            perror("stream_connect: connect error");
+            close(sock);
+            return -1;
+        }
+        return sock;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int ret;
+    if ((ret = getaddrinfo(arguments.host, arguments.port, &hints, &res)) != 0) {
+        fprintf(stderr, "stream_connect: getaddrinfo returned %s\n", gai_strerror(ret));
+        return -1;
+    }
+    if ((sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0) {
+        perror("stream_connect: socket creation error");
+        freeaddrinfo(res);
+        return -1;
+    }
+    if (connect(sock, res->ai_addr, res->ai_addrlen) < 0) {
+        perror("stream_connect: connect error");
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(res);
+    return sock;
+}
+
+/**
+ * @brief Take a line received from the daemon
+ * @param buf Receive buffer
+ * @param len Bytes in the receive buffer
+ * @param line Line output, without line break
+ * @return Line length on success, negative if no complete line has been received.
+ */
+static ssize_t _stream_take_line(char *buf, size_t *len, char *line) {
+    char *end = memchr(buf, '\n', *len);
+    if (end == NULL) { return -1; }
+    size_t line_len = end - buf;
+    memcpy(line, buf, line_len);
+    if ((line_len > 0) && (line[line_len - 1] == '\r')) { line_len--; }
+    line[line_len] = '\0';
+    *len -= end - buf + 1;
+    memmove(buf, end + 1, *len);
+    return line_len;
+}
+
+/**
+ * @brief Read the next line to send from the G-Code file
+ *
+ * Strips surrounding white space, and skips empty lines.
+ * @param in G-Code file
+ * @param line Line output, with line break
+ * @return Line length on success, 0 at end of file.
+ */
+static ssize_t _stream_next_line(FILE *in, char *line) {
+    char buf[STREAM_LINE_LENGTH];
+    while (fgets(buf, sizeof(buf) - 1, in) != NULL) {
+        char *start = buf;
+        while ((*start == ' ') || (*start == '\t')) { start++; }
+        size_t len = strlen(start);
+        while ((len > 0) && ((start[len - 1] == '\n') || (start[len - 1] == '\r') ||
+                             (start[len - 1] == ' ') || (start[len - 1] == '\t'))) { len--; }
+        if (len == 0) { continue; }
+        memcpy(line, start, len);
+        line[len++] = '\n';
+        line[len] = '\0';
+        return len;
+    }
+    return 0;
+}
+
+/**
+ * @brief Observer client thread
+ *
+ * Polls status until streaming is done, and counts the reports received.
+ * @param arg Observer
+ * @return NULL
+ */
+static void *_stream_observer(void *arg) {
+    stream_observer_t *observer = arg;
+    int sock = _stream_connect();
+    if (sock < 0) { return NULL; }
+    char buf[STREAM_LINE_LENGTH];
+    struct pollfd fds = {.fd = sock, .events = POLLIN};
+    int64_t next_poll = _stream_now();
+    while (!stream_done) {
+        int64_t now = _stream_now();
+        if (now >= next_poll) {
+            if (send(sock, "?\n", 2, MSG_NOSIGNAL) != 2) { break; }
+            observer->polls++;
+            next_poll = now + arguments.poll_interval * 1000000;
+        }
+        // Take everything sent to us until the next poll, including the oks for the streamed lines
+        if (poll(&fds, 1, (int) ((next_poll - now) / 1000000) + 1) > 0) {
+            ssize_t ret = recv(sock, buf, sizeof(buf), 0);
+            if (ret <= 0) { break; }
+            for (ssize_t i = 0; i < ret; i++) { if (buf[i] == '<') { observer->reports++; }}
+        }
+    }
+    close(sock);
+    return NULL;
+}
+
+/**
+ * @brief Compare latencies for qsort()
+ */
+static int _stream_latency_cmp(const void *a, const void *b) {
+    int64_t d = *(const int64_t *) a - *(const int64_t *) b;
+    return (d > 0) - (d < 0);
+}
+
+int main(int argc, char *argv[]) {
+    arguments.host = COMM_LISTEN_ADDR;
+    arguments.port = COMM_LISTEN_PORT;
+    arguments.rx_buffer = SOCKET_RX_BUFFER;
+    arguments.poll_interval = STREAM_OBSERVER_POLL;
+    arguments.repeat = 1;
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+    if ((arguments.rx_buffer <= 0) || (arguments.repeat <= 0) || (arguments.observers < 0) ||
+        (arguments.poll_interval <= 0)) {
+        fprintf(stderr, "Invalid option value\n");
+        exit(-1);
+    }
+
+    FILE *in = fopen(arguments.file, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Unable to open %s\n", arguments.file);
+        exit(-1);
+    }
+    int sock = _stream_connect();
+    if (sock < 0) { exit(-1); }
+
+    stream_observer_t *observers = calloc((size_t) arguments.observers + 1, sizeof(stream_observer_t));
+    for (long i = 0; i < arguments.observers; i++) {
+        pthread_create(&observers[i].thread, NULL, _stream_observer, &observers[i]);
+    }
+
+    // Every line in flight uses at least 2 bytes, so the rx buffer bounds the pending queue.
+    size_t pending_size = (size_t) arguments.rx_buffer / 2 + 1;
+    stream_pending_t *pending = calloc(pending_size, sizeof(stream_pending_t));
+    size_t pending_head = 0, pending_tail = 0, pending_count = 0, in_flight = 0;
+    size_t latency_size = 1024, acked = 0;
+    int64_t *latency = malloc(latency_size * sizeof(int64_t));
+    uint64_t sent = 0, errors = 0, other = 0, bytes = 0;
+    long pass = 0;
+
+    char line[STREAM_LINE_LENGTH + 1];
+    char rx_buf[STREAM_LINE_LENGTH];
+    size_t rx_len = 0;
+    ssize_t line_len = _stream_next_line(in, line);
+    int64_t start = _stream_now();
+
+    size_t line_sent = 0;
+    char response[STREAM_LINE_LENGTH];
+
+    /* Send and receive without blocking. The daemon stops reading while its parser queue is full, and waits
+       for us to take the oks, so blocking on either side could deadlock. */
+    while ((line_len > 0) || (pending_count > 0)) {
+        // Send as long as the line fits the daemon's receive buffer. A line longer than the buffer goes alone.
+        bool fits = (line_len > 0) && (pending_count < pending_size) &&
+                    ((in_flight + line_len <= (size_t) arguments.rx_buffer) || (pending_count == 0));
+        struct pollfd fds = {.fd = sock, .events = (short) (POLLIN | ((fits || line_sent) ? POLLOUT : 0))};
+        if (poll(&fds, 1, -1) < 0) {
+            if (errno == EINTR) { continue; }
+            perror("stream: poll error");
+            exit(-1);
+        }
+
+        while ((fds.revents & POLLOUT) && (fits || line_sent)) {
+            ssize_t ret = send(sock, line + line_sent, line_len - line_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (ret < 0) {
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) { break; }
+                perror("stream: send error");
+                exit(-1);
+            }
+            line_sent += ret;
+            if (line_sent < (size_t) line_len) { continue; }
+            if (arguments.verbose) printf("> %s", line);
+            // Cycle start has no response, so it isn't counted
+            if (strcmp(line, "~\n") != 0) {
+                pending[pending_head].len = (size_t) line_len;
+                pending[pending_head].sent = _stream_now();
+                pending_head = (pending_head + 1) % pending_size;
+                pending_count++;
+                in_flight += line_len;
+            }
+            bytes += line_len;
+            sent++;
+            line_sent = 0;
+            line_len = _stream_next_line(in, line);
+            if ((line_len == 0) && (++pass < arguments.repeat)) {
+                rewind(in);
+                line_len = _stream_next_line(in, line);
+            }
+            fits = (line_len > 0) && (pending_count < pending_size) &&
+                   (in_flight + line_len <= (size_t) arguments.rx_buffer);
+        }
+
+        if (!(fds.revents & (POLLIN | POLLHUP | POLLERR))) { continue; }
+        ssize_t ret = recv(sock, rx_buf + rx_len, sizeof(rx_buf) - rx_len, MSG_DONTWAIT);
+        if ((ret == 0) || ((ret < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+            fprintf(stderr, "stream: connection closed with %zu lines pending\n", pending_count);
+            exit(-1);
+        }
+        if (ret > 0) { rx_len += ret; }
+        while (_stream_take_line(rx_buf, &rx_len, response) >= 0) {
+            if (arguments.verbose) printf("< %s\n", response);
+            bool ok = (strcmp(response, "ok") == 0);
+            if ((!ok && (strncmp(response, "error", 5) != 0)) || (pending_count == 0)) {
+                other++; // Reports and feedback, or not ours, such as the ok for an observer's command
+                continue;
+            }
+            if (!ok) {
+                errors++;
+                fprintf(stderr, "stream: line %zu %s\n", acked + 1, response);
+            }
+            if (acked == latency_size) {
+                latency_size *= 2;
+                latency = realloc(latency, latency_size * sizeof(int64_t));
+            }
+            latency[acked++] = _stream_now() - pending[pending_tail].sent;
+            in_flight -= pending[pending_tail].len;
+            pending_tail = (pending_tail + 1) % pending_size;
+            pending_count--;
+        }
+        if (rx_len == sizeof(rx_buf)) { rx_len = 0; } // Overlong line. Discard it.
+    }
+    int64_t elapsed = _stream_now() - start;
+
+    stream_done = true;
+    uint64_t polls = 0, reports = 0;
+    for (long i = 0; i < arguments.observers; i++) {
+        pthread_join(observers[i].thread, NULL);
+        polls += observers[i].polls;
+        reports += observers[i].reports;
+    }
+    close(sock);
+    fclose(in);
+
+    qsort(latency, acked, sizeof(int64_t), _stream_latency_cmp);
+    printf("Stream: %lu lines, %lu bytes, %lu errors, %lu other responses in %.3fs\n",
+           (unsigned long) sent, (unsigned long) bytes, (unsigned long) errors, (unsigned long) other,
+           elapsed / 1e9);
+    printf("Stream: %.0f lines/s, %.0f bytes/s, rx buffer %ld bytes\n",
+           sent / (elapsed / 1e9), bytes / (elapsed / 1e9), arguments.rx_buffer);
+    if (acked > 0) {
+        printf("Stream: ok latency p50 %.0fus, p90 %.0fus, p99 %.0fus, max %.0fus\n",
+               latency[acked / 2] / 1e3, latency[acked * 9 / 10] / 1e3, latency[acked * 99 / 100] / 1e3,
+               latency[acked - 1] / 1e3);
+    }
+    if (arguments.observers > 0) {
+        printf("Stream: %ld observers, %lu polls, %lu status reports\n",
+               arguments.observers, (unsigned long) polls, (unsigned long) reports);
+    }
+    free(latency);
+    free(pending);
+    free(observers);
+    return (errors > 0) ? 1 : 0;
+}
+
+/** @} */
@@ -0,0 +1,164 @@
+; Arc segmentation benchmark: full circles of 0.5, 2, 5, 12 and 25 mm radius, 3 of each, at F300, F600,
+; F1500, F3000 and F6000. Render with --render arcs.gcode --stats, and compare the planned blocks.
+;
+; Blocks planned, x86-64 host build, fixed tolerance (0.002 mm) -> speed dependent tolerance:
+;   F300   1923 -> 861
+;   F600   1923 -> 861
+;   F1500  1923 -> 948
+;   F3000  1923 -> 1611
+;   F6000  1923 -> 1611
+;   Total  9616 -> 5893, machine time 198.95s -> 200.04s
+G21 G90
+M4 S600
+G0 X6.000 Y-30.000
+G2 X6.000 Y-30.000 I-0.500 J0 F300
+G0 X10.000 Y-30.000
+G3 X10.000 Y-30.000 I-0.500 J0 F300
+G0 X14.000 Y-30.000
+G2 X14.000 Y-30.000 I-0.500 J0 F300
+G0 X21.000 Y-30.000
+G2 X21.000 Y-30.000 I-2.000 J0 F300
+G0 X28.000 Y-30.000
+G3 X28.000 Y-30.000 I-2.000 J0 F300
+G0 X35.000 Y-30.000
+G2 X35.000 Y-30.000 I-2.000 J0 F300
+G0 X48.000 Y-30.000
+G2 X48.000 Y-30.000 I-5.000 J0 F300
+G0 X61.000 Y-30.000
+G3 X61.000 Y-30.000 I-5.000 J0 F300
+G0 X74.000 Y-30.000
+G2 X74.000 Y-30.000 I-5.000 J0 F300
+G0 X101.000 Y-30.000
+G2 X101.000 Y-30.000 I-12.000 J0 F300
+G0 X128.000 Y-30.000
+G3 X128.000 Y-30.000 I-12.000 J0 F300
+G0 X155.000 Y-30.000
+G2 X155.000 Y-30.000 I-12.000 J0 F300
+G0 X208.000 Y-30.000
+G2 X208.000 Y-30.000 I-25.000 J0 F300
+G0 X261.000 Y-30.000
+G3 X261.000 Y-30.000 I-25.000 J0 F300
+G0 X314.000 Y-30.000
+G2 X314.000 Y-30.000 I-25.000 J0 F300
+G0 X6.000 Y-82.000
+G2 X6.000 Y-82.000 I-0.500 J0 F600
+G0 X10.000 Y-82.000
+G3 X10.000 Y-82.000 I-0.500 J0 F600
+G0 X14.000 Y-82.000
+G2 X14.000 Y-82.000 I-0.500 J0 F600
+G0 X21.000 Y-82.000
+G2 X21.000 Y-82.000 I-2.000 J0 F600
+G0 X28.000 Y-82.000
+G3 X28.000 Y-82.000 I-2.000 J0 F600
+G0 X35.000 Y-82.000
+G2 X35.000 Y-82.000 I-2.000 J0 F600
+G0 X48.000 Y-82.000
+G2 X48.000 Y-82.000 I-5.000 J0 F600
+G0 X61.000 Y-82.000
+G3 X61.000 Y-82.000 I-5.000 J0 F600
+G0 X74.000 Y-82.000
+G2 X74.000 Y-82.000 I-5.000 J0 F600
+G0 X101.000 Y-82.000
+G2 X101.000 Y-82.000 I-12.000 J0 F600
+G0 X128.000 Y-82.000
+G3 X128.000 Y-82.000 I-12.000 J0 F600
+G0 X155.000 Y-82.000
+G2 X155.000 Y-82.000 I-12.000 J0 F600
+G0 X208.000 Y-82.000
+G2 X208.000 Y-82.000 I-25.000 J0 F600
+G0 X261.000 Y-82.000
+G3 X261.000 Y-82.000 I-25.000 J0 F600
+G0 X314.000 Y-82.000
+G2 X314.000 Y-82.000 I-25.000 J0 F600
+G0 X6.000 Y-134.000
+G2 X6.000 Y-134.000 I-0.500 J0 F1500
+G0 X10.000 Y-134.000
+G3 X10.000 Y-134.000 I-0.500 J0 F1500
+G0 X14.000 Y-134.000
+G2 X14.000 Y-134.000 I-0.500 J0 F1500
+G0 X21.000 Y-134.000
+G2 X21.000 Y-134.000 I-2.000 J0 F1500
+G0 X28.000 Y-134.000
+G3 X28.000 Y-134.000 I-2.000 J0 F1500
+G0 X35.000 Y-134.000
+G2 X35.000 Y-134.000 I-2.000 J0 F1500
+G0 X48.000 Y-134.000
+G2 X48.000 Y-134.000 I-5.000 J0 F1500
+G0 X61.000 Y-134.000
+G3 X61.000 Y-134.000 I-5.000 J0 F1500
+G0 X74.000 Y-134.000
+G2 X74.000 Y-134.000 I-5.000 J0 F1500
+G0 X101.000 Y-134.000
+G2 X101.000 Y-134.000 I-12.000 J0 F1500
+G0 X128.000 Y-134.000
+G3 X128.000 Y-134.000 I-12.000 J0 F1500
+G0 X155.000 Y-134.000
+G2 X155.000 Y-134.000 I-12.000 J0 F1500
+G0 X208.000 Y-134.000
+G2 X208.000 Y-134.000 I-25.000 J0 F1500
+G0 X261.000 Y-134.000
+G3 X261.000 Y-134.000 I-25.000 J0 F1500
+G0 X314.000 Y-134.000
+G2 X314.000 Y-134.000 I-25.000 J0 F1500
+G0 X6.000 Y-186.000
+G2 X6.000 Y-186.000 I-0.500 J0 F3000
+G0 X10.000 Y-186.000
+G3 X10.000 Y-186.000 I-0.500 J0 F3000
+G0 X14.000 Y-186.000
+G2 X14.000 Y-186.000 I-0.500 J0 F3000
+G0 X21.000 Y-186.000
+G2 X21.000 Y-186.000 I-2.000 J0 F3000
+G0 X28.000 Y-186.000
+G3 X28.000 Y-186.000 I-2.000 J0 F3000
+G0 X35.000 Y-186.000
+G2 X35.000 Y-186.000 I-2.000 J0 F3000
+G0 X48.000 Y-186.000
+G2 X48.000 Y-186.000 I-5.000 J0 F3000
+G0 X61.000 Y-186.000
+G3 X61.000 Y-186.000 I-5.000 J0 F3000
+G0 X74.000 Y-186.000
+G2 X74.000 Y-186.000 I-5.000 J0 F3000
+G0 X101.000 Y-186.000
+G2 X101.000 Y-186.000 I-12.000 J0 F3000
+G0 X128.000 Y-186.000
+G3 X128.000 Y-186.000 I-12.000 J0 F3000
+G0 X155.000 Y-186.000
+G2 X155.000 Y-186.000 I-12.000 J0 F3000
+G0 X208.000 Y-186.000
+G2 X208.000 Y-186.000 I-25.000 J0 F3000
+G0 X261.000 Y-186.000
+G3 X261.000 Y-186.000 I-25.000 J0 F3000
+G0 X314.000 Y-186.000
+G2 X314.000 Y-186.000 I-25.000 J0 F3000
+G0 X6.000 Y-238.000
+G2 X6.000 Y-238.000 I-0.500 J0 F6000
+G0 X10.000 Y-238.000
+G3 X10.000 Y-238.000 I-0.500 J0 F6000
+G0 X14.000 Y-238.000
+G2 X14.000 Y-238.000 I-0.500 J0 F6000
+G0 X21.000 Y-238.000
+G2 X21.000 Y-238.000 I-2.000 J0 F6000
+G0 X28.000 Y-238.000
+G3 X28.000 Y-238.000 I-2.000 J0 F6000
+G0 X35.000 Y-238.000
+G2 X35.000 Y-238.000 I-2.000 J0 F6000
+G0 X48.000 Y-238.000
+G2 X48.000 Y-238.000 I-5.000 J0 F6000
+G0 X61.000 Y-238.000
+G3 X61.000 Y-238.000 I-5.000 J0 F6000
+G0 X74.000 Y-238.000
+G2 X74.000 Y-238.000 I-5.000 J0 F6000
+G0 X101.000 Y-238.000
+G2 X101.000 Y-238.000 I-12.000 J0 F6000
+G0 X128.000 Y-238.000
+G3 X128.000 Y-238.000 I-12.000 J0 F6000
+G0 X155.000 Y-238.000
+G2 X155.000 Y-238.000 I-12.000 J0 F6000
+G0 X208.000 Y-238.000
+G2 X208.000 Y-238.000 I-25.000 J0 F6000
+G0 X261.000 Y-238.000
+G3 X261.000 Y-238.000 I-25.000 J0 F6000
+G0 X314.000 Y-238.000
+G2 X314.000 Y-238.000 I-25.000 J0 F6000
+M5
+G0 X0 Y0
@@ -0,0 +1,127 @@
+G21
+G90
+M4 S800
+F1500
+G0 X309.289 Y12.505
+G1 X315.289 Y14.505 S400
+S800
+G0 X193.701 Y198.170
+G2 X193.701 Y198.170 I5 J0
+G0 X46.605 Y16.803
+G1 X76.605 Y16.803
+G1 X76.605 Y46.803
+G1 X46.605 Y46.803
+G1 X46.605 Y16.803
+G0 X185.701 Y185.170
+G1 X191.701 Y187.170 S400
+S800
+G0 X317.872 Y86.217
+G2 X317.872 Y86.217 I5 J0
+G0 X363.557 Y19.342
+G1 X369.557 Y21.342 S400
+S800
+G0 X64.402 Y215.384
+G1 X70.402 Y217.384 S400
+S800
+G0 X307.289 Y10.505
+G1 X337.289 Y10.505
+G1 X337.289 Y40.505
+G1 X307.289 Y40.505
+G1 X307.289 Y10.505
+G0 X274.121 Y214.294
+G2 X274.121 Y214.294 I5 J0
+G0 X203.220 Y117.878
+G1 X233.220 Y117.878
+G1 X233.220 Y147.878
+G1 X203.220 Y147.878
+G1 X203.220 Y117.878
+G0 X205.220 Y119.878
+G1 X211.220 Y121.878 S400
+S800
+G0 X317.289 Y25.505
+G2 X317.289 Y25.505 I5 J0
+G0 X345.948 Y128.864
+G2 X345.948 Y128.864 I5 J0
+G0 X101.217 Y238.865
+G1 X107.217 Y240.865 S400
+S800
+G0 X376.268 Y101.489
+G1 X406.268 Y101.489
+G1 X406.268 Y131.489
+G1 X376.268 Y131.489
+G1 X376.268 Y101.489
+G0 X99.217 Y236.865
+G1 X129.217 Y236.865
+G1 X129.217 Y266.865
+G1 X99.217 Y266.865
+G1 X99.217 Y236.865
+G0 X309.872 Y73.217
+G1 X315.872 Y75.217 S400
+S800
+G0 X307.872 Y71.217
+G1 X337.872 Y71.217
+G1 X337.872 Y101.217
+G1 X307.872 Y101.217
+G1 X307.872 Y71.217
+G0 X29.924 Y154.939
+G2 X29.924 Y154.939 I5 J0
+G0 X378.268 Y103.489
+G1 X384.268 Y105.489 S400
+S800
+G0 X62.402 Y213.384
+G1 X92.402 Y213.384
+G1 X92.402 Y243.384
+G1 X62.402 Y243.384
+G1 X62.402 Y213.384
+G0 X264.121 Y199.294
+G1 X294.121 Y199.294
+G1 X294.121 Y229.294
+G1 X264.121 Y229.294
+G1 X264.121 Y199.294
+G0 X21.924 Y141.939
+G1 X27.924 Y143.939 S400
+S800
+G0 X109.217 Y251.865
+G2 X109.217 Y251.865 I5 J0
+G0 X183.701 Y183.170
+G1 X213.701 Y183.170
+G1 X213.701 Y213.170
+G1 X183.701 Y213.170
+G1 X183.701 Y183.170
+G0 X386.268 Y116.489
+G2 X386.268 Y116.489 I5 J0
+G0 X266.121 Y201.294
+G1 X272.121 Y203.294 S400
+S800
+G0 X213.220 Y132.878
+G2 X213.220 Y132.878 I5 J0
+G0 X337.948 Y115.864
+G1 X343.948 Y117.864 S400
+S800
+G0 X335.948 Y113.864
+G1 X365.948 Y113.864
+G1 X365.948 Y143.864
+G1 X335.948 Y143.864
+G1 X335.948 Y113.864
+G0 X19.924 Y139.939
+G1 X49.924 Y139.939
+G1 X49.924 Y169.939
+G1 X19.924 Y169.939
+G1 X19.924 Y139.939
+G0 X371.557 Y32.342
+G2 X371.557 Y32.342 I5 J0
+G0 X48.605 Y18.803
+G1 X54.605 Y20.803 S400
+S800
+G0 X72.402 Y228.384
+G2 X72.402 Y228.384 I5 J0
+G0 X361.557 Y17.342
+G1 X391.557 Y17.342
+G1 X391.557 Y47.342
+G1 X361.557 Y47.342
+G1 X361.557 Y17.342
+G0 X56.605 Y31.803
+G2 X56.605 Y31.803 I5 J0
+M5
+G0 X0 Y0
+M2
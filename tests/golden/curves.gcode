@@ -0,0 +1,393 @@
+G21
+G90
+M4 S800
+F3000
+G0 X60.000 Y50.000
+G1 X59.962 Y50.872 S400
+G1 X59.848 Y51.736 S400
+G1 X59.659 Y52.588 S400
+G1 X59.397 Y53.420 S400
+G1 X59.063 Y54.226 S400
+G1 X58.660 Y55.000 S400
+G1 X58.192 Y55.736 S400
+G1 X57.660 Y56.428 S400
+G1 X57.071 Y57.071 S400
+G1 X56.428 Y57.660 S400
+G1 X55.736 Y58.192 S400
+G1 X55.000 Y58.660 S400
+G1 X54.226 Y59.063 S400
+G1 X53.420 Y59.397 S400
+G1 X52.588 Y59.659 S400
+G1 X51.736 Y59.848 S400
+G1 X50.872 Y59.962 S400
+G1 X50.000 Y60.000 S400
+G1 X49.128 Y59.962 S400
+G1 X48.264 Y59.848 S400
+G1 X47.412 Y59.659 S400
+G1 X46.580 Y59.397 S400
+G1 X45.774 Y59.063 S400
+G1 X45.000 Y58.660 S400
+G1 X44.264 Y58.192 S400
+G1 X43.572 Y57.660 S400
+G1 X42.929 Y57.071 S400
+G1 X42.340 Y56.428 S400
+G1 X41.808 Y55.736 S400
+G1 X41.340 Y55.000 S400
+G1 X40.937 Y54.226 S400
+G1 X40.603 Y53.420 S400
+G1 X40.341 Y52.588 S400
+G1 X40.152 Y51.736 S400
+G1 X40.038 Y50.872 S400
+G1 X40.000 Y50.000 S400
+G1 X40.038 Y49.128 S400
+G1 X40.152 Y48.264 S400
+G1 X40.341 Y47.412 S400
+G1 X40.603 Y46.580 S400
+G1 X40.937 Y45.774 S400
+G1 X41.340 Y45.000 S400
+G1 X41.808 Y44.264 S400
+G1 X42.340 Y43.572 S400
+G1 X42.929 Y42.929 S400
+G1 X43.572 Y42.340 S400
+G1 X44.264 Y41.808 S400
+G1 X45.000 Y41.340 S400
+G1 X45.774 Y40.937 S400
+G1 X46.580 Y40.603 S400
+G1 X47.412 Y40.341 S400
+G1 X48.264 Y40.152 S400
+G1 X49.128 Y40.038 S400
+G1 X50.000 Y40.000 S400
+G1 X50.872 Y40.038 S400
+G1 X51.736 Y40.152 S400
+G1 X52.588 Y40.341 S400
+G1 X53.420 Y40.603 S400
+G1 X54.226 Y40.937 S400
+G1 X55.000 Y41.340 S400
+G1 X55.736 Y41.808 S400
+G1 X56.428 Y42.340 S400
+G1 X57.071 Y42.929 S400
+G1 X57.660 Y43.572 S400
+G1 X58.192 Y44.264 S400
+G1 X58.660 Y45.000 S400
+G1 X59.063 Y45.774 S400
+G1 X59.397 Y46.580 S400
+G1 X59.659 Y47.412 S400
+G1 X59.848 Y48.264 S400
+G1 X59.962 Y49.128 S400
+G1 X60.000 Y50.000 S400
+G0 X120.000 Y50.000
+G1 X119.951 Y51.395 S400
+G1 X119.805 Y52.783 S400
+G1 X119.563 Y54.158 S400
+G1 X119.225 Y55.513 S400
+G1 X118.794 Y56.840 S400
+G1 X118.271 Y58.135 S400
+G1 X117.659 Y59.389 S400
+G1 X116.961 Y60.598 S400
+G1 X116.180 Y61.756 S400
+G1 X115.321 Y62.856 S400
+G1 X114.387 Y63.893 S400
+G1 X113.383 Y64.863 S400
+G1 X112.313 Y65.760 S400
+G1 X111.184 Y66.581 S400
+G1 X110.000 Y67.321 S400
+G1 X108.767 Y67.976 S400
+G1 X107.492 Y68.544 S400
+G1 X106.180 Y69.021 S400
+G1 X104.838 Y69.406 S400
+G1 X103.473 Y69.696 S400
+G1 X102.091 Y69.890 S400
+G1 X100.698 Y69.988 S400
+G1 X99.302 Y69.988 S400
+G1 X97.909 Y69.890 S400
+G1 X96.527 Y69.696 S400
+G1 X95.162 Y69.406 S400
+G1 X93.820 Y69.021 S400
+G1 X92.508 Y68.544 S400
+G1 X91.233 Y67.976 S400
+G1 X90.000 Y67.321 S400
+G1 X88.816 Y66.581 S400
+G1 X87.687 Y65.760 S400
+G1 X86.617 Y64.863 S400
+G1 X85.613 Y63.893 S400
+G1 X84.679 Y62.856 S400
+G1 X83.820 Y61.756 S400
+G1 X83.039 Y60.598 S400
+G1 X82.341 Y59.389 S400
+G1 X81.729 Y58.135 S400
+G1 X81.206 Y56.840 S400
+G1 X80.775 Y55.513 S400
+G1 X80.437 Y54.158 S400
+G1 X80.195 Y52.783 S400
+G1 X80.049 Y51.395 S400
+G1 X80.000 Y50.000 S400
+G1 X80.049 Y48.605 S400
+G1 X80.195 Y47.217 S400
+G1 X80.437 Y45.842 S400
+G1 X80.775 Y44.487 S400
+G1 X81.206 Y43.160 S400
+G1 X81.729 Y41.865 S400
+G1 X82.341 Y40.611 S400
+G1 X83.039 Y39.402 S400
+G1 X83.820 Y38.244 S400
+G1 X84.679 Y37.144 S400
+G1 X85.613 Y36.107 S400
+G1 X86.617 Y35.137 S400
+G1 X87.687 Y34.240 S400
+G1 X88.816 Y33.419 S400
+G1 X90.000 Y32.679 S400
+G1 X91.233 Y32.024 S400
+G1 X92.508 Y31.456 S400
+G1 X93.820 Y30.979 S400
+G1 X95.162 Y30.594 S400
+G1 X96.527 Y30.304 S400
+G1 X97.909 Y30.110 S400
+G1 X99.302 Y30.012 S400
+G1 X100.698 Y30.012 S400
+G1 X102.091 Y30.110 S400
+G1 X103.473 Y30.304 S400
+G1 X104.838 Y30.594 S400
+G1 X106.180 Y30.979 S400
+G1 X107.492 Y31.456 S400
+G1 X108.767 Y32.024 S400
+G1 X110.000 Y32.679 S400
+G1 X111.184 Y33.419 S400
+G1 X112.313 Y34.240 S400
+G1 X113.383 Y35.137 S400
+G1 X114.387 Y36.107 S400
+G1 X115.321 Y37.144 S400
+G1 X116.180 Y38.244 S400
+G1 X116.961 Y39.402 S400
+G1 X117.659 Y40.611 S400
+G1 X118.271 Y41.865 S400
+G1 X118.794 Y43.160 S400
+G1 X119.225 Y44.487 S400
+G1 X119.563 Y45.842 S400
+G1 X119.805 Y47.217 S400
+G1 X119.951 Y48.605 S400
+G1 X120.000 Y50.000 S400
+G0 X155.000 Y50.000
+G1 X154.924 Y50.868 S400
+G1 X154.698 Y51.710 S400
+G1 X154.330 Y52.500 S400
+G1 X153.830 Y53.214 S400
+G1 X153.214 Y53.830 S400
+G1 X152.500 Y54.330 S400
+G1 X151.710 Y54.698 S400
+G1 X150.868 Y54.924 S400
+G1 X150.000 Y55.000 S400
+G1 X149.132 Y54.924 S400
+G1 X148.290 Y54.698 S400
+G1 X147.500 Y54.330 S400
+G1 X146.786 Y53.830 S400
+G1 X146.170 Y53.214 S400
+G1 X145.670 Y52.500 S400
+G1 X145.302 Y51.710 S400
+G1 X145.076 Y50.868 S400
+G1 X145.000 Y50.000 S400
+G1 X145.076 Y49.132 S400
+G1 X145.302 Y48.290 S400
+G1 X145.670 Y47.500 S400
+G1 X146.170 Y46.786 S400
+G1 X146.786 Y46.170 S400
+G1 X147.500 Y45.670 S400
+G1 X148.290 Y45.302 S400
+G1 X149.132 Y45.076 S400
+G1 X150.000 Y45.000 S400
+G1 X150.868 Y45.076 S400
+G1 X151.710 Y45.302 S400
+G1 X152.500 Y45.670 S400
+G1 X153.214 Y46.170 S400
+G1 X153.830 Y46.786 S400
+G1 X154.330 Y47.500 S400
+G1 X154.698 Y48.290 S400
+G1 X154.924 Y49.132 S400
+G1 X155.000 Y50.000 S400
+G0 X80.000 Y120.000
+G1 X79.959 Y121.570 S400
+G1 X79.836 Y123.136 S400
+G1 X79.631 Y124.693 S400
+G1 X79.344 Y126.237 S400
+G1 X78.978 Y127.765 S400
+G1 X78.532 Y129.271 S400
+G1 X78.007 Y130.751 S400
+G1 X77.406 Y132.202 S400
+G1 X76.730 Y133.620 S400
+G1 X75.981 Y135.000 S400
+G1 X75.160 Y136.339 S400
+G1 X74.271 Y137.634 S400
+G1 X73.314 Y138.880 S400
+G1 X72.294 Y140.074 S400
+G1 X71.213 Y141.213 S400
+G1 X70.074 Y142.294 S400
+G1 X68.880 Y143.314 S400
+G1 X67.634 Y144.271 S400
+G1 X66.339 Y145.160 S400
+G1 X65.000 Y145.981 S400
+G1 X63.620 Y146.730 S400
+G1 X62.202 Y147.406 S400
+G1 X60.751 Y148.007 S400
+G1 X59.271 Y148.532 S400
+G1 X57.765 Y148.978 S400
+G1 X56.237 Y149.344 S400
+G1 X54.693 Y149.631 S400
+G1 X53.136 Y149.836 S400
+G1 X51.570 Y149.959 S400
+G1 X50.000 Y150.000 S400
+G1 X48.430 Y149.959 S400
+G1 X46.864 Y149.836 S400
+G1 X45.307 Y149.631 S400
+G1 X43.763 Y149.344 S400
+G1 X42.235 Y148.978 S400
+G1 X40.729 Y148.532 S400
+G1 X39.249 Y148.007 S400
+G1 X37.798 Y147.406 S400
+G1 X36.380 Y146.730 S400
+G1 X35.000 Y145.981 S400
+G1 X33.661 Y145.160 S400
+G1 X32.366 Y144.271 S400
+G1 X31.120 Y143.314 S400
+G1 X29.926 Y142.294 S400
+G1 X28.787 Y141.213 S400
+G1 X27.706 Y140.074 S400
+G1 X26.686 Y138.880 S400
+G1 X25.729 Y137.634 S400
+G1 X24.840 Y136.339 S400
+G1 X24.019 Y135.000 S400
+G1 X23.270 Y133.620 S400
+G1 X22.594 Y132.202 S400
+G1 X21.993 Y130.751 S400
+G1 X21.468 Y129.271 S400
+G1 X21.022 Y127.765 S400
+G1 X20.656 Y126.237 S400
+G1 X20.369 Y124.693 S400
+G1 X20.164 Y123.136 S400
+G1 X20.041 Y121.570 S400
+G1 X20.000 Y120.000 S400
+G1 X20.041 Y118.430 S400
+G1 X20.164 Y116.864 S400
+G1 X20.369 Y115.307 S400
+G1 X20.656 Y113.763 S400
+G1 X21.022 Y112.235 S400
+G1 X21.468 Y110.729 S400
+G1 X21.993 Y109.249 S400
+G1 X22.594 Y107.798 S400
+G1 X23.270 Y106.380 S400
+G1 X24.019 Y105.000 S400
+G1 X24.840 Y103.661 S400
+G1 X25.729 Y102.366 S400
+G1 X26.686 Y101.120 S400
+G1 X27.706 Y99.926 S400
+G1 X28.787 Y98.787 S400
+G1 X29.926 Y97.706 S400
+G1 X31.120 Y96.686 S400
+G1 X32.366 Y95.729 S400
+G1 X33.661 Y94.840 S400
+G1 X35.000 Y94.019 S400
+G1 X36.380 Y93.270 S400
+G1 X37.798 Y92.594 S400
+G1 X39.249 Y91.993 S400
+G1 X40.729 Y91.468 S400
+G1 X42.235 Y91.022 S400
+G1 X43.763 Y90.656 S400
+G1 X45.307 Y90.369 S400
+G1 X46.864 Y90.164 S400
+G1 X48.430 Y90.041 S400
+G1 X50.000 Y90.000 S400
+G1 X51.570 Y90.041 S400
+G1 X53.136 Y90.164 S400
+G1 X54.693 Y90.369 S400
+G1 X56.237 Y90.656 S400
+G1 X57.765 Y91.022 S400
+G1 X59.271 Y91.468 S400
+G1 X60.751 Y91.993 S400
+G1 X62.202 Y92.594 S400
+G1 X63.620 Y93.270 S400
+G1 X65.000 Y94.019 S400
+G1 X66.339 Y94.840 S400
+G1 X67.634 Y95.729 S400
+G1 X68.880 Y96.686 S400
+G1 X70.074 Y97.706 S400
+G1 X71.213 Y98.787 S400
+G1 X72.294 Y99.926 S400
+G1 X73.314 Y101.120 S400
+G1 X74.271 Y102.366 S400
+G1 X75.160 Y103.661 S400
+G1 X75.981 Y105.000 S400
+G1 X76.730 Y106.380 S400
+G1 X77.406 Y107.798 S400
+G1 X78.007 Y109.249 S400
+G1 X78.532 Y110.729 S400
+G1 X78.978 Y112.235 S400
+G1 X79.344 Y113.763 S400
+G1 X79.631 Y115.307 S400
+G1 X79.836 Y116.864 S400
+G1 X79.959 Y118.430 S400
+G1 X80.000 Y120.000 S400
+G0 X135.000 Y120.000
+G1 X134.918 Y121.568 S400
+G1 X134.672 Y123.119 S400
+G1 X134.266 Y124.635 S400
+G1 X133.703 Y126.101 S400
+G1 X132.990 Y127.500 S400
+G1 X132.135 Y128.817 S400
+G1 X131.147 Y130.037 S400
+G1 X130.037 Y131.147 S400
+G1 X128.817 Y132.135 S400
+G1 X127.500 Y132.990 S400
+G1 X126.101 Y133.703 S400
+G1 X124.635 Y134.266 S400
+G1 X123.119 Y134.672 S400
+G1 X121.568 Y134.918 S400
+G1 X120.000 Y135.000 S400
+G1 X118.432 Y134.918 S400
+G1 X116.881 Y134.672 S400
+G1 X115.365 Y134.266 S400
+G1 X113.899 Y133.703 S400
+G1 X112.500 Y132.990 S400
+G1 X111.183 Y132.135 S400
+G1 X109.963 Y131.147 S400
+G1 X108.853 Y130.037 S400
+G1 X107.865 Y128.817 S400
+G1 X107.010 Y127.500 S400
+G1 X106.297 Y126.101 S400
+G1 X105.734 Y124.635 S400
+G1 X105.328 Y123.119 S400
+G1 X105.082 Y121.568 S400
+G1 X105.000 Y120.000 S400
+G1 X105.082 Y118.432 S400
+G1 X105.328 Y116.881 S400
+G1 X105.734 Y115.365 S400
+G1 X106.297 Y113.899 S400
+G1 X107.010 Y112.500 S400
+G1 X107.865 Y111.183 S400
+G1 X108.853 Y109.963 S400
+G1 X109.963 Y108.853 S400
+G1 X111.183 Y107.865 S400
+G1 X112.500 Y107.010 S400
+G1 X113.899 Y106.297 S400
+G1 X115.365 Y105.734 S400
+G1 X116.881 Y105.328 S400
+G1 X118.432 Y105.082 S400
+G1 X120.000 Y105.000 S400
+G1 X121.568 Y105.082 S400
+G1 X123.119 Y105.328 S400
+G1 X124.635 Y105.734 S400
+G1 X126.101 Y106.297 S400
+G1 X127.500 Y107.010 S400
+G1 X128.817 Y107.865 S400
+G1 X130.037 Y108.853 S400
+G1 X131.147 Y109.963 S400
+G1 X132.135 Y111.183 S400
+G1 X132.990 Y112.500 S400
+G1 X133.703 Y113.899 S400
+G1 X134.266 Y115.365 S400
+G1 X134.672 Y116.881 S400
+G1 X134.918 Y118.432 S400
+G1 X135.000 Y120.000 S400
+G0 X205.000 Y50.000
+G2 X205.000 Y50.000 I-5.000 J0
+G0 X220.000 Y120.000
+G2 X220.000 Y120.000 I-20.000 J0
+M5
+G0 X0 Y0
@@ -0,0 +1,6 @@
+G21 G90
+G0 X10 Y-10
+G0 X300.013 Y-200.007
+G1 X310 Y-205 F1000 S100 M3
+G0 X1.3 Y-1.7
+M5
@@ -0,0 +1,56 @@
+G21 G90
+G0 X60 Y15 Z0
+G0 X40 Y5
+G0 X10 Y10
+M3 S500
+G1 X30 Y10 F3000
+G1 X30 Y30 F3000
+G1 X10 Y30 F3000
+G1 X10 Y10 F3000
+M5
+G0 X160 Y45 Z-0.5
+G0 X140 Y35
+G0 X110 Y40
+M3 S500
+G1 X130 Y40 F3000
+G1 X130 Y60 F3000
+G1 X110 Y60 F3000
+G1 X110 Y40 F3000
+M5
+G0 X60 Y75 Z0.5
+G0 X40 Y65
+G0 X10 Y70
+M3 S500
+G1 X30 Y70 F3000
+G1 X30 Y90 F3000
+G1 X10 Y90 F3000
+G1 X10 Y70 F3000
+M5
+G0 X160 Y105 Z-0.5
+G0 X140 Y95
+G0 X110 Y100
+M3 S500
+G1 X130 Y100 F3000
+G1 X130 Y120 F3000
+G1 X110 Y120 F3000
+G1 X110 Y100 F3000
+M5
+G0 X60 Y135 Z0.5
+G0 X40 Y125
+G0 X10 Y130
+M3 S500
+G1 X30 Y130 F3000
+G1 X30 Y150 F3000
+G1 X10 Y150 F3000
+G1 X10 Y130 F3000
+M5
+G0 X160 Y165 Z0
+G0 X140 Y155
+G0 X110 Y160
+M3 S500
+G1 X130 Y160 F3000
+G1 X130 Y180 F3000
+G1 X110 Y180 F3000
+G1 X110 Y160 F3000
+M5
+G0 X0 Y0 Z0